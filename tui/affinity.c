@@ -0,0 +1,659 @@
+/**
+ * @file affinity.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sched.h>
+#include <limits.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "affinity.h"
+
+/* How many NUMA nodes we keep counts for when picking the iSCSI node */
+#define AFFINITY_MAX_NODES      64
+
+/* An SCST device, and where its back-end is */
+typedef struct affinity_dev AFFINITYDEV;
+struct affinity_dev {
+    char name[NAME_MAX + 1];
+    char disk[NAME_MAX + 1];
+    int numa_node;
+};
+
+
+/*
+ * The NUMA node of a device ('sys_path' is its real /sys/devices path),
+ * from the bus device it hangs off; 'bus_path' (PATH_MAX bytes, or NULL)
+ * gets where it was found. Returns -1 if there is none.
+ */
+int findBusNUMANode(const char sys_path[], char bus_path[]) {
+    char path[PATH_MAX] = {0}, attr_path[PATH_MAX] = {0},
+            value[MAX_SYSFS_ATTR_SIZE] = {0};
+    char *slash = NULL, *end = NULL;
+    long numa_node = 0;
+
+    snprintf(path, PATH_MAX, "%s", sys_path);
+    while (strlen(path) > strlen(SYSFS_DEVICES)) {
+        snprintf(attr_path, PATH_MAX, "%s/numa_node", path);
+        if (readAttributeAt(AT_FDCWD, attr_path, value) == 0) {
+            numa_node = strtol(value, &end, 10);
+            if (end == value)
+                return -1;
+            if (bus_path != NULL)
+                snprintf(bus_path, PATH_MAX, "%s", path);
+            return (int) numa_node;
+        }
+        if ((slash = strrchr(path, '/')) == NULL)
+            break;
+        *slash = '\0';
+    }
+    return -1;
+}
+
+
+/*
+ * Parse a CPU list (eg, "0-7,16-23") into a CPU set; returns how many
+ * CPUs are in it.
+ */
+static int parseCPUList(const char cpu_list[], cpu_set_t *cpu_set) {
+    const char *cursor = cpu_list;
+    char *end = NULL;
+    long first = 0, last = 0, cpu = 0;
+
+    CPU_ZERO(cpu_set);
+    while (*cursor != '\0') {
+        first = last = strtol(cursor, &end, 10);
+        if (end == cursor)
+            break;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            if (cpu >= 0)
+                CPU_SET(cpu, cpu_set);
+        if (*end != ',')
+            break;
+        cursor = end + 1;
+    }
+    return CPU_COUNT(cpu_set);
+}
+
+
+/*
+ * How many CPUs are in a CPU list.
+ */
+int cpuListCount(const char cpu_list[]) {
+    cpu_set_t cpu_set;
+
+    return parseCPUList(cpu_list, &cpu_set);
+}
+
+
+/*
+ * Format a CPU set as a CPU list ("0-7,16-23"); cut short if it doesn't
+ * fit in AFFINITY_LIST_LEN.
+ */
+static void formatCPUList(const cpu_set_t *cpu_set, char cpu_list[]) {
+    size_t length = 0;
+    int cpu = 0, last = 0;
+
+    cpu_list[0] = '\0';
+    for (cpu = 0; cpu < CPU_SETSIZE && length < AFFINITY_LIST_LEN; cpu++) {
+        if (!CPU_ISSET(cpu, cpu_set))
+            continue;
+        for (last = cpu; last + 1 < CPU_SETSIZE &&
+                CPU_ISSET(last + 1, cpu_set); last++)
+            ;
+        if (last == cpu)
+            snprintf(cpu_list + length, AFFINITY_LIST_LEN - length, "%s%d",
+                    (length ? "," : ""), cpu);
+        else
+            snprintf(cpu_list + length, AFFINITY_LIST_LEN - length,
+                    "%s%d-%d", (length ? "," : ""), cpu, last);
+        length += strlen(cpu_list + length);
+        cpu = last;
+    }
+    return;
+}
+
+
+/*
+ * Parse a kernel CPU mask (hex, in comma separated 32-bit words, eg
+ * "ff,00000000") into a CPU set.
+ */
+static void parseCPUMask(const char cpu_mask[], cpu_set_t *cpu_set) {
+    int i = 0, bit = 0, nibble = 0, j = 0;
+
+    CPU_ZERO(cpu_set);
+    for (i = (int) strlen(cpu_mask) - 1; i >= 0 && bit < CPU_SETSIZE; i--) {
+        if (!isxdigit((unsigned char) cpu_mask[i]))
+            continue;
+        nibble = isdigit((unsigned char) cpu_mask[i]) ? (cpu_mask[i] - '0') :
+                (tolower((unsigned char) cpu_mask[i]) - 'a' + 10);
+        for (j = 0; j < 4; j++, bit++)
+            if (nibble & (1 << j))
+                CPU_SET(bit, cpu_set);
+    }
+    return;
+}
+
+
+/*
+ * Format a CPU set as a kernel CPU mask.
+ */
+static void formatCPUMask(const cpu_set_t *cpu_set, char cpu_mask[],
+        size_t size) {
+    size_t length = 0;
+    unsigned int word = 0;
+    int top = 0, i = 0, j = 0;
+
+    for (i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, cpu_set))
+            top = i;
+    cpu_mask[0] = '\0';
+    for (i = top / 32; i >= 0 && length < size; i--) {
+        word = 0;
+        for (j = 0; j < 32; j++)
+            if (CPU_ISSET((i * 32) + j, cpu_set))
+                word |= (1U << j);
+        snprintf(cpu_mask + length, size - length,
+                (length ? ",%08x" : "%x"), word);
+        length += strlen(cpu_mask + length);
+    }
+    return;
+}
+
+
+/*
+ * Just the hex digits of a WWN/GUID, in lower case ("0x" dropped), so FC
+ * port names and IB GUIDs can be matched with SCST target names.
+ */
+static void hexDigits(const char id[], char digits[], size_t size) {
+    size_t length = 0;
+
+    if (strncmp(id, "0x", 2) == 0)
+        id += 2;
+    for (; *id != '\0' && *id != '\n' && length + 1 < size; id++)
+        if (isxdigit((unsigned char) *id))
+            digits[length++] = tolower((unsigned char) *id);
+    digits[length] = '\0';
+    return;
+}
+
+
+/*
+ * Read where an item is running now, as a CPU list. Returns 0 (zero) or
+ * the errno value.
+ */
+static int readPlacement(const AFFINITYITEM *item, char cpu_list[]) {
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
+    cpu_set_t cpu_set;
+    int ret_val = 0;
+
+    cpu_list[0] = '\0';
+    switch (item->kind) {
+        case AFFINITY_IRQ:
+            snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
+                    "%s/%d/smp_affinity_list", PROC_IRQ, item->id);
+            if ((ret_val = readAttributeAt(AT_FDCWD, attr_path,
+                    attr_value)) != 0)
+                return ret_val;
+            parseCPUList(attr_value, &cpu_set);
+            break;
+        case AFFINITY_TARGET:
+            snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
+                    "%s/targets/%s/%s/cpu_mask", SYSFS_SCST_TGT,
+                    item->driver, item->name);
+            if ((ret_val = readAttributeAt(AT_FDCWD, attr_path,
+                    attr_value)) != 0)
+                return ret_val;
+            parseCPUMask(attr_value, &cpu_set);
+            break;
+        default:
+            if (sched_getaffinity(item->id, sizeof (cpu_set), &cpu_set) == -1)
+                return errno;
+            break;
+    }
+    formatCPUList(&cpu_set, cpu_list);
+    return 0;
+}
+
+
+/*
+ * Add an item to the plan (growing it as needed), and note where it runs
+ * now. Returns 0 (zero) or ENOMEM.
+ */
+static int addAffinityItem(AFFINITYITEM **items, int *item_cnt,
+        int *item_max, int kind, int id, const char name[],
+        const char driver[], const char owner[], int numa_node) {
+    AFFINITYITEM *item = NULL, *new_items = NULL;
+
+    if (*item_cnt == *item_max) {
+        *item_max = (*item_max == 0) ? 32 : (*item_max * 2);
+        if ((new_items = realloc(*items,
+                *item_max * sizeof (AFFINITYITEM))) == NULL)
+            return ENOMEM;
+        *items = new_items;
+    }
+    item = &(*items)[(*item_cnt)++];
+    memset(item, 0, sizeof (AFFINITYITEM));
+    item->kind = kind;
+    item->id = id;
+    if (kind == AFFINITY_IRQ)
+        snprintf(item->name, NAME_MAX + 1, "IRQ %d", id);
+    else
+        snprintf(item->name, NAME_MAX + 1, "%s", name);
+    snprintf(item->driver, AFFINITY_OWNER_LEN, "%s", driver);
+    snprintf(item->owner, AFFINITY_OWNER_LEN, "%s", owner);
+    item->numa_node = numa_node;
+    item->error = readPlacement(item, item->before);
+    return 0;
+}
+
+
+/*
+ * Add the IRQs of a PCI function (MSI/MSI-X vectors, or the legacy one).
+ */
+static int planIRQs(const char bus_path[], const char owner[],
+        int numa_node, AFFINITYITEM **items, int *item_cnt, int *item_max) {
+    char attr_path[PATH_MAX] = {0}, attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
+    DIR *irq_dir = NULL;
+    struct dirent *irq = NULL;
+    int ret_val = 0, irq_num = 0;
+
+    snprintf(attr_path, PATH_MAX, "%s/msi_irqs", bus_path);
+    if ((irq_dir = opendir(attr_path)) != NULL) {
+        while ((irq = readdir(irq_dir)) != NULL && ret_val == 0) {
+            if (!isdigit((unsigned char) irq->d_name[0]))
+                continue;
+            ret_val = addAffinityItem(items, item_cnt, item_max,
+                    AFFINITY_IRQ, atoi(irq->d_name), NULL, "", owner,
+                    numa_node);
+        }
+        closedir(irq_dir);
+        return ret_val;
+    }
+    snprintf(attr_path, PATH_MAX, "%s/irq", bus_path);
+    if (readAttributeAt(AT_FDCWD, attr_path, attr_value) == 0 &&
+            (irq_num = atoi(attr_value)) > 0)
+        ret_val = addAffinityItem(items, item_cnt, item_max, AFFINITY_IRQ,
+                irq_num, NULL, "", owner, numa_node);
+    return ret_val;
+}
+
+
+/*
+ * Add the SCST targets of a driver; with an 'id' (WWN/GUID digits) only
+ * the targets named after it, otherwise all of them.
+ */
+static int planTargets(const char driver[], const char id[],
+        const char owner[], int numa_node, AFFINITYITEM **items,
+        int *item_cnt, int *item_max) {
+    char dir_name[MAX_SYSFS_PATH_SIZE] = {0}, tgt_id[NAME_MAX + 1] = {0};
+    DIR *tgt_dir = NULL;
+    struct dirent *tgt = NULL;
+    int ret_val = 0;
+
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/targets/%s", SYSFS_SCST_TGT,
+            driver);
+    if ((tgt_dir = opendir(dir_name)) == NULL)
+        return 0;
+    while ((tgt = readdir(tgt_dir)) != NULL && ret_val == 0) {
+        if (tgt->d_type != DT_DIR || tgt->d_name[0] == '.')
+            continue;
+        if (id != NULL) {
+            hexDigits(tgt->d_name, tgt_id, NAME_MAX + 1);
+            if (id[0] == '\0' || strstr(tgt_id, id) == NULL)
+                continue;
+        }
+        ret_val = addAffinityItem(items, item_cnt, item_max, AFFINITY_TARGET,
+                -1, tgt->d_name, driver, owner, numa_node);
+    }
+    closedir(tgt_dir);
+    return ret_val;
+}
+
+
+/*
+ * Add the IRQs and SCST targets of each fabric adapter in a sysfs class
+ * (FC hosts or IB HCAs); 'id_attr' names the adapter attribute the SCST
+ * target names are made from.
+ */
+static int planAdapters(const char class_dir[], const char id_attr[],
+        const char driver[], AFFINITYITEM **items, int *item_cnt,
+        int *item_max) {
+    char dev_path[PATH_MAX] = {0}, sys_path[PATH_MAX] = {0},
+            bus_path[PATH_MAX] = {0}, attr_value[MAX_SYSFS_ATTR_SIZE] = {0},
+            id[NAME_MAX + 1] = {0};
+    DIR *class_stream = NULL;
+    struct dirent *adapter = NULL;
+    int numa_node = 0, ret_val = 0;
+
+    if ((class_stream = opendir(class_dir)) == NULL)
+        return 0;
+    while ((adapter = readdir(class_stream)) != NULL && ret_val == 0) {
+        if (adapter->d_name[0] == '.')
+            continue;
+        snprintf(dev_path, PATH_MAX, "%s/%s/device", class_dir,
+                adapter->d_name);
+        if (realpath(dev_path, sys_path) == NULL ||
+                (numa_node = findBusNUMANode(sys_path, bus_path)) < 0)
+            continue;
+        if ((ret_val = planIRQs(bus_path, adapter->d_name, numa_node, items,
+                item_cnt, item_max)) != 0)
+            break;
+        snprintf(dev_path, PATH_MAX, "%s/%s/%s", class_dir, adapter->d_name,
+                id_attr);
+        if (readAttributeAt(AT_FDCWD, dev_path, attr_value) != 0)
+            continue;
+        hexDigits(attr_value, id, NAME_MAX + 1);
+        ret_val = planTargets(driver, id, adapter->d_name, numa_node, items,
+                item_cnt, item_max);
+    }
+    closedir(class_stream);
+    return ret_val;
+}
+
+
+/*
+ * The NUMA node most of the (physical) network interfaces are on, for
+ * iSCSI; 'owner' gets the first interface there. Returns -1 if none.
+ */
+static int findNetNUMANode(char owner[]) {
+    char dev_path[PATH_MAX] = {0}, sys_path[PATH_MAX] = {0};
+    char first[AFFINITY_MAX_NODES][AFFINITY_OWNER_LEN];
+    int node_cnts[AFFINITY_MAX_NODES] = {0};
+    DIR *net_dir = NULL;
+    struct dirent *iface = NULL;
+    int numa_node = -1, best = -1;
+
+    if ((net_dir = opendir(SYSFS_NET)) == NULL)
+        return -1;
+    while ((iface = readdir(net_dir)) != NULL) {
+        if (iface->d_name[0] == '.')
+            continue;
+        snprintf(dev_path, PATH_MAX, "%s/%s/device", SYSFS_NET,
+                iface->d_name);
+        if (realpath(dev_path, sys_path) == NULL ||
+                (numa_node = findBusNUMANode(sys_path, NULL)) < 0 ||
+                numa_node >= AFFINITY_MAX_NODES)
+            continue;
+        if (node_cnts[numa_node]++ == 0)
+            snprintf(first[numa_node], AFFINITY_OWNER_LEN, "%s",
+                    iface->d_name);
+        if (best == -1 || node_cnts[numa_node] > node_cnts[best])
+            best = numa_node;
+    }
+    closedir(net_dir);
+    if (best != -1)
+        snprintf(owner, AFFINITY_OWNER_LEN, "%s", first[best]);
+    return best;
+}
+
+
+/*
+ * The SCST devices with a back-end on a NUMA node. Returns 0 (zero) or
+ * the errno value; '*devs' is allocated (the caller frees it).
+ */
+static int findDevNUMANodes(AFFINITYDEV **devs, int *dev_cnt) {
+    char dir_name[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            filename[MAX_SYSFS_ATTR_SIZE] = {0};
+    DIR *dev_dir = NULL;
+    struct dirent *dev_entry = NULL;
+    AFFINITYDEV *new_devs = NULL;
+    TUNINGQUEUE queue;
+    int dev_max = 0;
+
+    *devs = NULL;
+    *dev_cnt = 0;
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/devices", SYSFS_SCST_TGT);
+    if ((dev_dir = opendir(dir_name)) == NULL)
+        return 0;
+    while ((dev_entry = readdir(dev_dir)) != NULL) {
+        if (dev_entry->d_name[0] == '.')
+            continue;
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/filename", dir_name,
+                dev_entry->d_name);
+        if (readAttributeAt(AT_FDCWD, attr_path, filename) != 0)
+            continue;
+        if (inspectBackingQueue(filename, &queue) != 0 ||
+                queue.numa_node < 0)
+            continue;
+        if (*dev_cnt == dev_max) {
+            dev_max = (dev_max == 0) ? 16 : (dev_max * 2);
+            if ((new_devs = realloc(*devs,
+                    dev_max * sizeof (AFFINITYDEV))) == NULL) {
+                closedir(dev_dir);
+                return ENOMEM;
+            }
+            *devs = new_devs;
+        }
+        snprintf((*devs)[*dev_cnt].name, NAME_MAX + 1, "%s",
+                dev_entry->d_name);
+        snprintf((*devs)[*dev_cnt].disk, NAME_MAX + 1, "%s", queue.disk);
+        (*devs)[(*dev_cnt)++].numa_node = queue.numa_node;
+    }
+    closedir(dev_dir);
+    return 0;
+}
+
+
+/*
+ * Which SCST device a kernel thread works for, going by its name (see
+ * AFFINITY_DEV_THREAD_LEN); the longest matching device name wins.
+ * Returns the index, or -1.
+ */
+static int matchDevThread(const char comm[], const AFFINITYDEV devs[],
+        int dev_cnt) {
+    const int cut_lens[] = {AFFINITY_DEV_THREAD_LEN, AFFINITY_TGT_THREAD_LEN};
+    size_t length = 0, best_length = 0;
+    int best = -1, i = 0, j = 0;
+
+    for (i = 0; i < dev_cnt; i++) {
+        for (j = 0; j < (int) (sizeof (cut_lens) / sizeof (*cut_lens));
+                j++) {
+            length = strlen(devs[i].name);
+            if (length > (size_t) cut_lens[j])
+                length = cut_lens[j];
+            if (strncmp(comm, devs[i].name, length) != 0 ||
+                    comm[length] == '\0' ||
+                    strspn(comm + length, "0123456789_") !=
+                    strlen(comm + length))
+                continue;
+            if (length > best_length) {
+                best_length = length;
+                best = i;
+            }
+        }
+    }
+    return best;
+}
+
+
+/*
+ * Add the SCST device threads (local to their back-end), and the iSCSI
+ * daemon and threads (local to the network interfaces).
+ */
+static int planThreads(AFFINITYITEM **items, int *item_cnt,
+        int *item_max) {
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            comm[MAX_SYSFS_ATTR_SIZE] = {0},
+            cmdline[MAX_SYSFS_ATTR_SIZE] = {0},
+            iscsi_owner[AFFINITY_OWNER_LEN] = {0};
+    DIR *proc_dir = NULL, *task_dir = NULL;
+    struct dirent *proc_entry = NULL, *task = NULL;
+    AFFINITYDEV *devs = NULL;
+    int dev_cnt = 0, iscsi_node = -1, dev = 0, ret_val = 0;
+
+    if ((ret_val = findDevNUMANodes(&devs, &dev_cnt)) != 0) {
+        FREE_NULL(devs);
+        return ret_val;
+    }
+    iscsi_node = findNetNUMANode(iscsi_owner);
+    if ((proc_dir = opendir(PROC_DIR)) == NULL) {
+        FREE_NULL(devs);
+        return errno;
+    }
+    while ((proc_entry = readdir(proc_dir)) != NULL && ret_val == 0) {
+        if (!isdigit((unsigned char) proc_entry->d_name[0]))
+            continue;
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/comm", PROC_DIR,
+                proc_entry->d_name);
+        if (readAttributeAt(AT_FDCWD, attr_path, comm) != 0)
+            continue;
+
+        /* The iSCSI daemon; all of its tasks */
+        if (strcmp(comm, AFFINITY_ISCSI_DAEMON) == 0) {
+            if (iscsi_node < 0)
+                continue;
+            snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/task",
+                    PROC_DIR, proc_entry->d_name);
+            if ((task_dir = opendir(attr_path)) == NULL)
+                continue;
+            while ((task = readdir(task_dir)) != NULL && ret_val == 0) {
+                if (!isdigit((unsigned char) task->d_name[0]))
+                    continue;
+                ret_val = addAffinityItem(items, item_cnt, item_max,
+                        AFFINITY_THREAD, atoi(task->d_name), comm, "",
+                        iscsi_owner, iscsi_node);
+            }
+            closedir(task_dir);
+            continue;
+        }
+
+        /* Otherwise, only kernel threads (no command line) */
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/cmdline", PROC_DIR,
+                proc_entry->d_name);
+        if (readAttributeAt(AT_FDCWD, attr_path, cmdline) != 0 ||
+                cmdline[0] != '\0')
+            continue;
+        if (strncmp(comm, AFFINITY_ISCSI_READ,
+                strlen(AFFINITY_ISCSI_READ)) == 0 ||
+                strncmp(comm, AFFINITY_ISCSI_WRITE,
+                strlen(AFFINITY_ISCSI_WRITE)) == 0) {
+            if (iscsi_node >= 0)
+                ret_val = addAffinityItem(items, item_cnt, item_max,
+                        AFFINITY_THREAD, atoi(proc_entry->d_name), comm, "",
+                        iscsi_owner, iscsi_node);
+        } else if ((dev = matchDevThread(comm, devs, dev_cnt)) != -1) {
+            ret_val = addAffinityItem(items, item_cnt, item_max,
+                    AFFINITY_THREAD, atoi(proc_entry->d_name), comm, "",
+                    devs[dev].disk, devs[dev].numa_node);
+        }
+    }
+    closedir(proc_dir);
+
+    /* The iSCSI targets go with the daemon */
+    if (ret_val == 0 && iscsi_node >= 0)
+        ret_val = planTargets("iscsi", NULL, iscsi_owner, iscsi_node, items,
+                item_cnt, item_max);
+    FREE_NULL(devs);
+    return ret_val;
+}
+
+
+/*
+ * Work out what should be pinned where: FC HBA and IB HCA IRQs and their
+ * SCST targets go to the adapter's node, SCST device threads to their
+ * back-end's node, and iSCSI to the network interfaces' node. Things with
+ * no NUMA node are left out (so a single node system gets nothing).
+ * '*items' is allocated (the caller frees it). Returns 0 (zero) or the
+ * errno value.
+ */
+int planAffinity(AFFINITYITEM **items, int *item_cnt) {
+    int item_max = 0, ret_val = 0;
+
+    *items = NULL;
+    *item_cnt = 0;
+    if ((ret_val = planAdapters(SYSFS_FC_HOST, "port_name", "qla2x00t",
+            items, item_cnt, &item_max)) == 0 &&
+            (ret_val = planAdapters(SYSFS_INFINIBAND, "node_guid", "ib_srpt",
+            items, item_cnt, &item_max)) == 0)
+        ret_val = planThreads(items, item_cnt, &item_max);
+    if (ret_val != 0) {
+        FREE_NULL(*items);
+        *item_cnt = 0;
+    }
+    return ret_val;
+}
+
+
+/*
+ * Pin each item to the CPUs of its NUMA node ('after' gets where it ends
+ * up); items already there are left alone. Returns 0 (zero) or the errno
+ * value of the first failure (each item has its own).
+ */
+int applyAffinity(AFFINITYITEM items[], int item_cnt) {
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            node_list[MAX_SYSFS_ATTR_SIZE] = {0},
+            cpu_mask[MAX_SYSFS_ATTR_SIZE] = {0};
+    cpu_set_t node_set, item_set;
+    AFFINITYITEM *item = NULL;
+    int ret_val = 0, i = 0;
+
+    for (i = 0; i < item_cnt; i++) {
+        item = &items[i];
+        if (item->error != 0 || item->numa_node < 0)
+            continue;
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/node%d/cpulist",
+                SYSFS_NODE, item->numa_node);
+        if ((item->error = readAttributeAt(AT_FDCWD, attr_path,
+                node_list)) != 0) {
+            if (ret_val == 0)
+                ret_val = item->error;
+            continue;
+        }
+        if (parseCPUList(node_list, &node_set) == 0)
+            continue;
+        parseCPUList(item->before, &item_set);
+        if (CPU_EQUAL(&node_set, &item_set)) {
+            snprintf(item->after, AFFINITY_LIST_LEN, "%s", item->before);
+            continue;
+        }
+
+        switch (item->kind) {
+            case AFFINITY_IRQ:
+                snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
+                        "%s/%d/smp_affinity_list", PROC_IRQ, item->id);
+                item->error = writeAttribute(attr_path, node_list);
+                break;
+            case AFFINITY_TARGET:
+                snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
+                        "%s/targets/%s/%s/cpu_mask", SYSFS_SCST_TGT,
+                        item->driver, item->name);
+                formatCPUMask(&node_set, cpu_mask, MAX_SYSFS_ATTR_SIZE);
+                item->error = writeAttribute(attr_path, cpu_mask);
+                break;
+            default:
+                if (sched_setaffinity(item->id, sizeof (node_set),
+                        &node_set) == -1)
+                    item->error = errno;
+                break;
+        }
+        if (item->error != 0) {
+            DEBUG_LOG("Couldn't pin %s to node %d: %s", item->name,
+                    item->numa_node, strerror(item->error));
+            if (ret_val == 0)
+                ret_val = item->error;
+            continue;
+        }
+        readPlacement(item, item->after);
+    }
+    return ret_val;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file affinity.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _AFFINITY_H
+#define	_AFFINITY_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <limits.h>
+#include <cdk.h>
+
+/* CPU affinity settings */
+#define AFFINITY_LIST_LEN       64
+#define AFFINITY_OWNER_LEN      32
+/* SCST names a device's threads after the device, cut to this many
+ * characters, with the thread (and initiator) numbers after it */
+#define AFFINITY_DEV_THREAD_LEN 13
+#define AFFINITY_TGT_THREAD_LEN 10
+/* The iSCSI target daemon, and its kernel thread name prefixes */
+#define AFFINITY_ISCSI_DAEMON   "iscsi-scstd"
+#define AFFINITY_ISCSI_READ     "iscsird"
+#define AFFINITY_ISCSI_WRITE    "iscsiwr"
+
+/* What an item is pinned through */
+#define AFFINITY_IRQ            0
+#define AFFINITY_TARGET         1
+#define AFFINITY_THREAD         2
+
+/* Something that gets pinned to its local NUMA node */
+typedef struct affinity_item AFFINITYITEM;
+struct affinity_item {
+    /* One of AFFINITY_IRQ (/proc/irq/N/smp_affinity_list), AFFINITY_TARGET
+     * (the SCST target's cpu_mask), or AFFINITY_THREAD (a kernel thread or
+     * daemon task) */
+    int kind;
+    /* The IRQ number or thread ID; unused for targets */
+    int id;
+    /* The thread/target name ("IRQ N" for IRQs), its SCST target driver,
+     * and what it is local to (an FC host, HCA, disk, or NIC) */
+    char name[NAME_MAX + 1];
+    char driver[AFFINITY_OWNER_LEN];
+    char owner[AFFINITY_OWNER_LEN];
+    int numa_node;
+    /* Its CPU list before and after being pinned */
+    char before[AFFINITY_LIST_LEN];
+    char after[AFFINITY_LIST_LEN];
+    /* The errno value if it couldn't be pinned, or 0 */
+    int error;
+};
+
+/* Function prototypes */
+int findBusNUMANode(const char sys_path[], char bus_path[]);
+int cpuListCount(const char cpu_list[]);
+int planAffinity(AFFINITYITEM **items, int *item_cnt);
+int applyAffinity(AFFINITYITEM items[], int item_cnt);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _AFFINITY_H */
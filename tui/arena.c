@@ -0,0 +1,104 @@
+/**
+ * @file arena.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "arena.h"
+
+/*
+ * Allocate memory from the arena (aligned to ARENA_ALIGN bytes). Blocks
+ * left over from before the last reset are re-used first, and a new block
+ * is added to the chain if none have room. The memory is not zeroed. On
+ * error, NULL is returned and errno is set.
+ */
+void *arenaAlloc(ARENA *arena, size_t size) {
+    ARENABLOCK *block = NULL;
+    size_t block_size = 0;
+    void *memory = NULL;
+
+    size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+    block = arena->current;
+    while (block != NULL && (block->size - block->used) < size) {
+        /* Move on to the next block (if any); it is empty after a reset */
+        block = block->next;
+        if (block != NULL) {
+            block->used = 0;
+            arena->current = block;
+        }
+    }
+
+    if (block == NULL) {
+        /* Nothing left in the chain that fits, add a block to the end */
+        block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+        if ((block = malloc(sizeof (ARENABLOCK) + block_size)) == NULL)
+            return NULL;
+        block->next = NULL;
+        block->size = block_size;
+        block->used = 0;
+        if (arena->first == NULL) {
+            arena->first = block;
+        } else {
+            /* The current block is always the last one with data */
+            block->next = arena->current->next;
+            arena->current->next = block;
+        }
+        arena->current = block;
+    }
+
+    memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+
+/*
+ * Copy a string into the arena. On error, NULL is returned.
+ */
+char *arenaStrDup(ARENA *arena, const char *string) {
+    size_t length = strlen(string) + 1;
+    char *copy = NULL;
+
+    if ((copy = arenaAlloc(arena, length)) != NULL)
+        memcpy(copy, string, length);
+    return copy;
+}
+
+
+/*
+ * Release everything allocated from the arena in one step; the blocks are
+ * kept (and marked empty as they are reached again), so this doesn't
+ * depend on how much was allocated.
+ */
+void arenaReset(ARENA *arena) {
+    if (arena->first != NULL)
+        arena->first->used = 0;
+    arena->current = arena->first;
+    return;
+}
+
+
+/*
+ * Return all of the arena memory to the system.
+ */
+void arenaFree(ARENA *arena) {
+    ARENABLOCK *block = arena->first, *next_block = NULL;
+
+    while (block != NULL) {
+        next_block = block->next;
+        free(block);
+        block = next_block;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+    return;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file arena.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _ARENA_H
+#define	_ARENA_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* Arena block sizing/alignment */
+#define ARENA_BLOCK_SIZE        65536
+#define ARENA_ALIGN             16
+
+/* A block of arena memory; blocks are chained and kept for re-use */
+typedef struct arena_block ARENABLOCK;
+struct arena_block {
+    ARENABLOCK *next;
+    /* Usable bytes in 'data' and how many have been handed out */
+    size_t size;
+    size_t used;
+    char data[] __attribute__ ((aligned (ARENA_ALIGN)));
+};
+
+/* A simple bump allocator for data that is thrown away all at once (eg,
+ * everything read during one refresh); a zeroed structure is an empty
+ * arena */
+typedef struct arena ARENA;
+struct arena {
+    ARENABLOCK *first;
+    /* Block that allocations are currently coming from */
+    ARENABLOCK *current;
+};
+
+/* Function prototypes */
+void *arenaAlloc(ARENA *arena, size_t size);
+char *arenaStrDup(ARENA *arena, const char *string);
+void arenaReset(ARENA *arena);
+void arenaFree(ARENA *arena);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _ARENA_H */
@@ -0,0 +1,325 @@
+/**
+ * @file megaraid_bench.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "megaraid.h"
+
+/* Benchmark settings; each query is parsed until this much time has gone
+ * by, and the corpus is read from here unless a directory is given */
+#define BENCH_MIN_NSECS         1000000000LL
+#define BENCH_CORPUS_DIR        "bench/megacli"
+#define BENCH_MAX_PATH          4096
+
+/* Saved output of each bulk query and what it must parse to */
+static int checkAdapter(MRCACHE *cache);
+static int checkDisks(MRCACHE *cache);
+static int checkLDrives(MRCACHE *cache);
+static int checkEnclosures(MRCACHE *cache);
+static const struct {
+    const char *file;
+    int section;
+    int (*check)(MRCACHE *cache);
+} bench_corpus[] = {
+    {"adpallinfo.txt", MR_CACHE_ADAPTER, checkAdapter},
+    {"pdlist.txt", MR_CACHE_DISKS, checkDisks},
+    {"ldinfo.txt", MR_CACHE_LDRIVES, checkLDrives},
+    {"encinfo.txt", MR_CACHE_ENCLS, checkEnclosures}
+};
+#define BENCH_CORPUS_CNT \
+        (int) (sizeof (bench_corpus) / sizeof (*bench_corpus))
+
+
+/*
+ * Nanoseconds on the monotonic clock.
+ */
+static long long benchNow(void) {
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+
+/*
+ * Compare a parsed string/integer value with what we expect; returns the
+ * number of failures (0 or 1).
+ */
+static int expectStr(const char *what, const char *value,
+        const char *expected) {
+    if (strcmp(value, expected) == 0)
+        return 0;
+    fprintf(stderr, "FAIL: %s is '%s', expected '%s'\n", what, value,
+            expected);
+    return 1;
+}
+
+static int expectInt(const char *what, int value, int expected) {
+    if (value == expected)
+        return 0;
+    fprintf(stderr, "FAIL: %s is %d, expected %d\n", what, value, expected);
+    return 1;
+}
+
+
+/*
+ * The adapter keys are spread over many sub-sections; "BBU" appears again
+ * under the supported operations, and the first one must win.
+ */
+static int checkAdapter(MRCACHE *cache) {
+    MRADAPTER *adapter = &cache->adapter;
+    int fails = 0;
+
+    fails += expectStr("prod_name", adapter->prod_name,
+            "LSI MegaRAID SAS 9271-8i");
+    fails += expectStr("serial", adapter->serial, "SV31215427");
+    fails += expectStr("firmware", adapter->firmware, "23.22.0-0012");
+    fails += expectStr("bbu", adapter->bbu, "Present");
+    fails += expectStr("memory", adapter->memory, "1024MB");
+    fails += expectStr("interface", adapter->interface, "PCIE");
+    fails += expectInt("logical_drv_cnt", adapter->logical_drv_cnt, 3);
+    fails += expectInt("disk_cnt", adapter->disk_cnt, 8);
+    fails += expectStr("cluster", adapter->cluster, "No");
+    fails += expectStr("cluster_on", adapter->cluster_on, "No");
+    return fails;
+}
+
+
+/*
+ * Disks in a logical drive have a "Drive's position" line (whose value
+ * has colons of its own); the unconfigured one in slot 7 doesn't.
+ */
+static int checkDisks(MRCACHE *cache) {
+    int fails = 0;
+
+    fails += expectInt("disk_cnt", cache->disk_cnt, 8);
+    if (cache->disk_cnt != 8)
+        return fails;
+    fails += expectInt("disks[0].enclosure_id",
+            cache->disks[0].enclosure_id, 252);
+    fails += expectInt("disks[0].slot_num", cache->disks[0].slot_num, 0);
+    fails += expectStr("disks[0].pd_type", cache->disks[0].pd_type, "SAS");
+    fails += expectStr("disks[0].raw_size", cache->disks[0].raw_size,
+            "558.911 GB [0x45dd2fb0 Sectors]");
+    fails += expectStr("disks[0].inquiry", cache->disks[0].inquiry,
+            "SEAGATE ST600MM0006     0004S0M1AB00");
+    fails += expectInt("disks[0].part_of_ld", cache->disks[0].part_of_ld,
+            TRUE);
+    fails += expectStr("disks[4].state", cache->disks[4].state, "Rebuild");
+    fails += expectStr("disks[6].speed", cache->disks[6].speed, "3.0Gb/s");
+    fails += expectInt("disks[7].slot_num", cache->disks[7].slot_num, 7);
+    fails += expectStr("disks[7].state", cache->disks[7].state,
+            "Unconfigured(good), Spun Up");
+    fails += expectInt("disks[7].part_of_ld", cache->disks[7].part_of_ld,
+            FALSE);
+    fails += expectInt("disks[7].present", cache->disks[7].present, TRUE);
+    return fails;
+}
+
+
+/*
+ * "Size" must not match "Sector Size"/"Parity Size", and the cache policy
+ * string is turned into the '-LDSetProp' options.
+ */
+static int checkLDrives(MRCACHE *cache) {
+    MRLDENTRY *entry = cache->ldrives;
+    int fails = 0;
+
+    fails += expectInt("ldrive_cnt", cache->ldrive_cnt, 3);
+    if (cache->ldrive_cnt != 3)
+        return fails;
+    fails += expectInt("ldrives[1].ldrive_id", entry[1].ldrive.ldrive_id, 1);
+    fails += expectInt("ldrives[1].props.ldrive_id",
+            entry[1].props.ldrive_id, 1);
+    fails += expectStr("ldrives[1].name", entry[1].props.name, "vm_store");
+    fails += expectStr("ldrives[1].raid_lvl", entry[1].ldrive.raid_lvl,
+            "Primary-5, Secondary-0, RAID Level Qualifier-3");
+    fails += expectStr("ldrives[1].size", entry[1].ldrive.size, "1.634 TB");
+    fails += expectStr("ldrives[1].strip_size", entry[1].ldrive.strip_size,
+            "256 KB");
+    fails += expectInt("ldrives[1].drive_cnt", entry[1].ldrive.drive_cnt, 4);
+    fails += expectStr("ldrives[1].write_policy",
+            entry[1].props.write_policy, "WT");
+    fails += expectStr("ldrives[1].read_policy",
+            entry[1].props.read_policy, "RA");
+    fails += expectStr("ldrives[1].cache_policy",
+            entry[1].props.cache_policy, "Cached");
+    fails += expectStr("ldrives[1].bbu_cache_policy",
+            entry[1].props.bbu_cache_policy, "CachedBadBBU");
+    fails += expectStr("ldrives[0].read_policy",
+            entry[0].props.read_policy, "ADRA");
+    fails += expectStr("ldrives[0].bbu_cache_policy",
+            entry[0].props.bbu_cache_policy, "NoCachedBadBBU");
+    fails += expectStr("ldrives[2].name", entry[2].props.name, "");
+    fails += expectStr("ldrives[2].state", entry[2].ldrive.state,
+            "Partially Degraded");
+    fails += expectStr("ldrives[2].read_policy",
+            entry[2].props.read_policy, "NORA");
+    return fails;
+}
+
+
+/*
+ * The second enclosure has PSU/fan "Status" lines after its own; the
+ * enclosure status must be the first one.
+ */
+static int checkEnclosures(MRCACHE *cache) {
+    MRENCL *encl = cache->enclosures;
+    int fails = 0;
+
+    fails += expectInt("encl_cnt", cache->encl_cnt, 2);
+    if (cache->encl_cnt != 2)
+        return fails;
+    fails += expectInt("enclosures[0].device_id", encl[0].device_id, 252);
+    fails += expectStr("enclosures[0].product", encl[0].product, "SGPIO");
+    fails += expectInt("enclosures[1].device_id", encl[1].device_id, 8);
+    fails += expectInt("enclosures[1].slots", encl[1].slots, 24);
+    fails += expectInt("enclosures[1].power_supps", encl[1].power_supps, 2);
+    fails += expectInt("enclosures[1].fans", encl[1].fans, 3);
+    fails += expectStr("enclosures[1].status", encl[1].status, "Normal");
+    fails += expectStr("enclosures[1].vendor", encl[1].vendor, "LSI");
+    fails += expectStr("enclosures[1].product", encl[1].product, "SAS2X36");
+    return fails;
+}
+
+
+/*
+ * Read a whole corpus file; returns NULL (with errno set) on failure.
+ */
+static char *readCorpus(const char *path, size_t *length) {
+    FILE *file = NULL;
+    char *buffer = NULL, *new_buffer = NULL;
+    size_t size = 0, count = 0;
+
+    if ((file = fopen(path, "r")) == NULL)
+        return NULL;
+    *length = 0;
+    do {
+        if (*length == size) {
+            size = (size == 0) ? 65536 : (size * 2);
+            if ((new_buffer = realloc(buffer, size)) == NULL) {
+                free(buffer);
+                fclose(file);
+                errno = ENOMEM;
+                return NULL;
+            }
+            buffer = new_buffer;
+        }
+        count = fread(buffer + *length, 1, size - *length, file);
+        *length += count;
+    } while (count > 0);
+    fclose(file);
+    return buffer;
+}
+
+
+/*
+ * Parse a buffer of MegaCLI output (as the refresher does with the pipe
+ * from MegaCLI); FALSE if it couldn't be opened as a stream.
+ */
+static boolean parseBuffer(char *buffer, size_t length, int section,
+        MRCACHE *cache) {
+    FILE *output = NULL;
+
+    if ((output = fmemopen(buffer, length, "r")) == NULL)
+        return FALSE;
+    parseMROutput(output, section, cache);
+    fclose(output);
+    return TRUE;
+}
+
+
+/*
+ * Run the MegaCLI output parser over the saved output of each bulk query
+ * and check the records it fills in, then (unless '-c' is given) time it.
+ * The corpus directory can be given as the last argument.
+ */
+int main(int argc, char *argv[]) {
+    MRCACHE *cache = NULL;
+    char path[BENCH_MAX_PATH] = {0};
+    char *buffer = NULL, *dir = BENCH_CORPUS_DIR;
+    size_t length = 0, i = 0;
+    long long start = 0, elapsed = 0, passes = 0;
+    int opt = 0, item = 0, fails = 0, lines = 0, exit_status = EXIT_FAILURE;
+    boolean check_only = FALSE;
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        if (opt != 'c') {
+            fprintf(stderr, "usage: %s [-c] [corpus directory]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        check_only = TRUE;
+    }
+    if (optind < argc)
+        dir = argv[optind];
+    if ((cache = calloc(1, sizeof (MRCACHE))) == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    if (!check_only)
+        printf("%-16s %6s %10s %12s %10s\n", "Output", "Lines", "MB/s",
+                "Lines/s", "us/Parse");
+    for (item = 0; item < BENCH_CORPUS_CNT; item++) {
+        snprintf(path, sizeof (path), "%s/%s", dir, bench_corpus[item].file);
+        if ((buffer = readCorpus(path, &length)) == NULL) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            goto out;
+        }
+        for (i = 0, lines = 0; i < length; i++) {
+            if (buffer[i] == '\n')
+                lines++;
+        }
+
+        /* Check the parsed records */
+        memset(cache, 0, sizeof (MRCACHE));
+        if (!parseBuffer(buffer, length, bench_corpus[item].section,
+                cache)) {
+            perror("fmemopen");
+            goto out;
+        }
+        if ((fails = bench_corpus[item].check(cache)) != 0) {
+            fprintf(stderr, "%s: %d check(s) failed\n", path, fails);
+            goto out;
+        }
+        if (check_only) {
+            printf("%s: OK\n", path);
+            free(buffer);
+            buffer = NULL;
+            continue;
+        }
+
+        /* Time it */
+        start = benchNow();
+        passes = 0;
+        do {
+            parseBuffer(buffer, length, bench_corpus[item].section, cache);
+            passes++;
+            elapsed = benchNow() - start;
+        } while (elapsed < BENCH_MIN_NSECS);
+        printf("%-16s %6d %10.1f %12.0f %10.2f\n", bench_corpus[item].file,
+                lines, ((double) length * passes * 1000.0) / elapsed,
+                ((double) lines * passes * 1000000000.0) / elapsed,
+                ((double) elapsed / passes) / 1000.0);
+        free(buffer);
+        buffer = NULL;
+    }
+    exit_status = EXIT_SUCCESS;
+
+    out:
+    free(buffer);
+    free(cache);
+    return exit_status;
+}
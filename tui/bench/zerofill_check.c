@@ -0,0 +1,128 @@
+/**
+ * @file zerofill_check.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "zerofill.h"
+
+/* Check settings; a fill that isn't done in CHECK_TIMEOUT_SECS is hung */
+#define CHECK_FILE_MIB          64
+#define CHECK_TIMEOUT_SECS      30
+#define CHECK_BLOCK_SIZE        65536
+
+
+/*
+ * The fill didn't finish in time.
+ */
+static void checkTimeout(int signal_num) {
+    static const char msg[] = "FAIL: the fill hung\n";
+
+    if (write(STDERR_FILENO, msg, sizeof (msg) - 1) == -1)
+        _exit(2);
+    _exit(1);
+}
+
+
+/*
+ * Fill a file of data in the given directory, the way runZeroFillJob()
+ * does, with the limits pinned at 'max_depth' writes in flight (what the
+ * governor does to a fill on a busy device) the whole time, and check
+ * that it finishes and leaves only zeros. Returns the number of failures.
+ */
+static int checkFill(const char *dir, int max_depth) {
+    ZEROFILL fill = {0};
+    char path[PATH_MAX] = {0}, *block = NULL;
+    off_t size = (off_t) CHECK_FILE_MIB << 20, offset = 0;
+    ssize_t bytes_read = 0;
+    int fd = -1, ret_val = 0, fails = 0;
+
+    snprintf(path, sizeof (path), "%s/zerofill_check.XXXXXX", dir);
+    if ((fd = mkstemp(path)) == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+    if ((block = malloc(CHECK_BLOCK_SIZE)) == NULL) {
+        close(fd);
+        return 1;
+    }
+    memset(block, 0xa5, CHECK_BLOCK_SIZE);
+    for (offset = 0; offset < size; offset += CHECK_BLOCK_SIZE) {
+        if (pwrite(fd, block, CHECK_BLOCK_SIZE, offset) !=
+                CHECK_BLOCK_SIZE) {
+            perror("pwrite");
+            fails++;
+            goto out;
+        }
+    }
+
+    alarm(CHECK_TIMEOUT_SECS);
+    if ((ret_val = startZeroFill(&fill, fd, 0, size, FILL_MIN_BUFF_SIZE,
+            FILL_DEF_QUEUE_DEPTH)) != 0) {
+        fprintf(stderr, "startZeroFill(): %s\n", strerror(ret_val));
+        fails++;
+        goto out;
+    }
+    while (!zeroFillDone(&fill)) {
+        setZeroFillLimits(&fill, 0, max_depth);
+        usleep(FILL_GOV_IDLE_USECS);
+    }
+    if ((ret_val = finishZeroFill(&fill)) != 0) {
+        fprintf(stderr, "finishZeroFill(): %s\n", strerror(ret_val));
+        fails++;
+        goto out;
+    }
+    alarm(0);
+
+    for (offset = 0; offset < size; offset += bytes_read) {
+        if ((bytes_read = pread(fd, block, CHECK_BLOCK_SIZE, offset)) <= 0)
+            break;
+        if (memchr(block, 0xa5, bytes_read) != NULL) {
+            fprintf(stderr, "FAIL: data left at %lld (depth %d)\n",
+                    (long long) offset, max_depth);
+            fails++;
+            break;
+        }
+    }
+    if (offset != size && fails == 0) {
+        fprintf(stderr, "FAIL: the file is short (depth %d)\n", max_depth);
+        fails++;
+    }
+
+    out:
+    free(block);
+    close(fd);
+    return fails;
+}
+
+
+/*
+ * Run the zero-fill engine over a scratch file with each depth limit from
+ * 1 to the queue depth. The directory for the file can be given as the
+ * only argument.
+ */
+int main(int argc, char *argv[]) {
+    const char *dir = (argc > 1) ? argv[1] : ".";
+    int depth = 0;
+
+    signal(SIGALRM, checkTimeout);
+    for (depth = 1; depth <= FILL_DEF_QUEUE_DEPTH; depth++) {
+        if (checkFill(dir, depth) != 0)
+            return EXIT_FAILURE;
+        printf("Depth limit %d: OK\n", depth);
+    }
+    return EXIT_SUCCESS;
+}
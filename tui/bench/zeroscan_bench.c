@@ -0,0 +1,105 @@
+/**
+ * @file zeroscan_bench.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "zeroscan.h"
+
+/* Benchmark settings; each test is repeated until it has run this long */
+#define BENCH_DEFAULT_MIB       256
+#define BENCH_MIN_NSECS         1000000000LL
+#define BENCH_BLOCK_SIZE        4096
+
+
+/*
+ * Nanoseconds on the monotonic clock.
+ */
+static long long benchNow(void) {
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+
+/*
+ * Scan the (zeroed) buffer with the current kernel, either in one call or
+ * a block at a time (the way reclaim does it), until enough time has gone
+ * by; returns the rate in GB/s.
+ */
+static double benchScan(const char *buffer, size_t length, int blocks) {
+    long long start = benchNow(), elapsed = 0, passes = 0;
+
+    do {
+        if (blocks) {
+            if (zeroRunLength(buffer, length, BENCH_BLOCK_SIZE) != length)
+                return -1.0;
+        } else {
+            if (!isZeroBuffer(buffer, length))
+                return -1.0;
+        }
+        passes++;
+        elapsed = benchNow() - start;
+    } while (elapsed < BENCH_MIN_NSECS);
+    return ((double) length * passes) / elapsed;
+}
+
+
+/*
+ * Run each zero scan kernel this CPU has over a zeroed buffer (in the
+ * calling thread, so the rates are per core). The buffer size (MiB) can
+ * be given as the only argument.
+ */
+int main(int argc, char *argv[]) {
+    char *buffer = NULL;
+    size_t length = 0;
+    int best = 0, i = 0;
+    double whole = 0, blocks = 0;
+
+    length = (size_t) ((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MIB) << 20;
+    if (length == 0) {
+        fprintf(stderr, "usage: %s [buffer MiB]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if ((errno = posix_memalign((void **) &buffer, BENCH_BLOCK_SIZE,
+            length)) != 0) {
+        perror("posix_memalign");
+        return EXIT_FAILURE;
+    }
+    /* Touch every page so we time the scan, not page faults */
+    memset(buffer, 0, length);
+
+    best = getZeroScanKernel();
+    printf("Buffer: %zu MiB, default kernel: %s\n", length >> 20,
+            zeroScanKernelName(best));
+    printf("%-8s %12s %16s\n", "Kernel", "Whole GB/s", "4 KiB Block GB/s");
+    for (i = 0; i < ZEROSCAN_KERNELS; i++) {
+        if (!setZeroScanKernel(i)) {
+            printf("%-8s %12s %16s\n", zeroScanKernelName(i), "-", "-");
+            continue;
+        }
+        whole = benchScan(buffer, length, 0);
+        blocks = benchScan(buffer, length, 1);
+        if (whole < 0 || blocks < 0) {
+            fprintf(stderr, "%s: found data in a zeroed buffer!\n",
+                    zeroScanKernelName(i));
+            free(buffer);
+            return EXIT_FAILURE;
+        }
+        printf("%-8s %12.2f %16.2f\n", zeroScanKernelName(i), whole, blocks);
+    }
+
+    free(buffer);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,283 @@
+/**
+ * @file clone.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "zeroscan.h"
+#include "vdisk.h"
+#include "clone.h"
+
+/*
+ * Write a buffer to the destination at the given offset. Returns 0 (zero)
+ * or the errno value.
+ */
+static int cloneWrite(FILECLONE *clone, const char *buffer, size_t length,
+        off_t offset) {
+    ssize_t bytes_written = 0;
+    size_t done = 0;
+
+    while (done < length) {
+        bytes_written = pwrite(clone->dst_fd, buffer + done, length - done,
+                offset + done);
+        if (bytes_written == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        done += bytes_written;
+    }
+    return 0;
+}
+
+
+/*
+ * copy_file_range() (linux 4.5); glibc only has a wrapper from 2.27, so we
+ * make the system call ourselves. Without the system call number (older
+ * kernel headers) it fails with ENOSYS, like on an older kernel, and the
+ * clone is done with read()/write().
+ */
+static ssize_t cloneCopyRange(int fd_in, loff_t *off_in, int fd_out,
+        loff_t *off_out, size_t length, unsigned int flags) {
+#ifdef __NR_copy_file_range
+    return syscall(__NR_copy_file_range, fd_in, off_in, fd_out, off_out,
+            length, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+/*
+ * Copy one data extent from the source to the destination (same offsets)
+ * with copy_file_range(), which lets the file system (or NFS/SMB server)
+ * do the copy without it passing through us; if that can't be used, we
+ * switch the clone over to read()/write() with the given buffer (allocated
+ * on first use), which leaves zeroed blocks out. Returns 0 (zero) or the
+ * errno value.
+ */
+static int cloneExtent(FILECLONE *clone, off_t offset, off_t length,
+        char **buffer) {
+    loff_t in_offset = offset, out_offset = offset;
+    ssize_t bytes_copied = 0, done = 0;
+    off_t end = offset + length;
+    size_t run = 0;
+    int ret_val = 0;
+
+    while (__atomic_load_n(&clone->method, __ATOMIC_SEQ_CST) ==
+            CLONE_COPY_RANGE && in_offset < end) {
+        bytes_copied = cloneCopyRange(clone->src_fd, &in_offset,
+                clone->dst_fd, &out_offset, end - in_offset, 0);
+        if (bytes_copied == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+                    errno != EOPNOTSUPP)
+                return errno;
+            __atomic_store_n(&clone->method, CLONE_READ_WRITE,
+                    __ATOMIC_SEQ_CST);
+        } else if (bytes_copied == 0) {
+            /* The source got shorter; nothing more to copy */
+            return 0;
+        }
+    }
+
+    /* The slow way (from wherever copy_file_range() got to) */
+    if (in_offset < end && *buffer == NULL &&
+            (*buffer = malloc(CLONE_BUFF_SIZE)) == NULL)
+        return ENOMEM;
+    while (in_offset < end) {
+        bytes_copied = pread(clone->src_fd, *buffer,
+                MIN(end - in_offset, CLONE_BUFF_SIZE), in_offset);
+        if (bytes_copied == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        } else if (bytes_copied == 0) {
+            return 0;
+        }
+        /* Zeroed blocks are left as holes (the destination is new) */
+        for (done = 0; done < bytes_copied; done += run) {
+            if ((run = zeroRunLength(*buffer + done, bytes_copied - done,
+                    CLONE_ZERO_BLOCK)) > 0)
+                continue;
+            run = dataRunLength(*buffer + done, bytes_copied - done,
+                    CLONE_ZERO_BLOCK);
+            if ((ret_val = cloneWrite(clone, *buffer + done, run,
+                    in_offset + done)) != 0)
+                return ret_val;
+        }
+        in_offset += bytes_copied;
+    }
+    return 0;
+}
+
+
+/*
+ * Copy the data in one region of the source, skipping holes (found with
+ * SEEK_DATA/SEEK_HOLE; if the file system can't tell us, it's all data).
+ * The destination was sized up front, so skipped holes stay holes.
+ * Returns 0 (zero) or the errno value.
+ */
+static int cloneRegion(FILECLONE *clone, off_t start, off_t end,
+        char **buffer) {
+    off_t data = 0, hole = 0, position = start;
+    int ret_val = 0;
+
+    while (position < end) {
+        if ((data = lseek(clone->src_fd, position, SEEK_DATA)) == -1) {
+            if (errno == ENXIO)
+                return 0;
+            if (errno != EINVAL && errno != EOPNOTSUPP)
+                return errno;
+            data = position;
+            hole = end;
+        } else if ((hole = lseek(clone->src_fd, data, SEEK_HOLE)) == -1) {
+            hole = end;
+        }
+        if (data >= end)
+            return 0;
+        hole = MIN(hole, end);
+        if ((ret_val = cloneExtent(clone, data, hole - data, buffer)) != 0)
+            return ret_val;
+        position = hole;
+    }
+    return 0;
+}
+
+
+/*
+ * A clone worker; claims the next region of the file, copies it, and
+ * repeats until the file is done or an error occurs.
+ */
+static void *cloneWorker(void *arg) {
+    FILECLONE *clone = arg;
+    char *buffer = NULL;
+    off_t start = 0, end = 0;
+    int ret_val = 0, no_error = 0;
+
+    while (__atomic_load_n(&clone->error, __ATOMIC_SEQ_CST) == 0) {
+        start = __atomic_fetch_add(&clone->next_offset,
+                (off_t) CLONE_REGION_SIZE, __ATOMIC_SEQ_CST);
+        if (start >= clone->size)
+            break;
+        end = MIN(start + CLONE_REGION_SIZE, clone->size);
+        if ((ret_val = cloneRegion(clone, start, end, &buffer)) != 0) {
+            /* Keep the first error; everyone else stops */
+            no_error = 0;
+            __atomic_compare_exchange_n(&clone->error, &no_error, ret_val,
+                    FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            break;
+        }
+        __atomic_add_fetch(&clone->done_bytes, end - start,
+                __ATOMIC_SEQ_CST);
+    }
+
+    FREE_NULL(buffer);
+    __atomic_sub_fetch(&clone->active, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+
+/*
+ * Clone the source file into the (new, empty) destination file. A reflink
+ * (FICLONE; btrfs, XFS with reflink=1) shares the extents and is done
+ * before we return. Otherwise the data is copied in the background by
+ * worker threads with copy_file_range() or, failing that, read()/write();
+ * watch it with fileCloneProgress() and fileCloneDone(). Always call
+ * finishFileClone() afterwards. Returns 0 (zero) or the errno value.
+ */
+int startFileClone(FILECLONE *clone, int src_fd, int dst_fd) {
+    struct stat src_stat = {0};
+    int ret_val = 0, i = 0;
+
+    memset(clone, 0, sizeof (FILECLONE));
+    clone->src_fd = src_fd;
+    clone->dst_fd = dst_fd;
+    if (fstat(src_fd, &src_stat) == -1)
+        return errno;
+    clone->size = src_stat.st_size;
+
+    /* Instant, if the file system can do it */
+    if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+        clone->method = CLONE_REFLINK;
+        clone->done_bytes = clone->size;
+        return 0;
+    } else if (errno != EOPNOTSUPP && errno != ENOTTY && errno != EXDEV &&
+            errno != EINVAL && errno != ENOSYS) {
+        return errno;
+    }
+
+    /* Set the size first; the holes we skip are left as holes */
+    clone->method = CLONE_COPY_RANGE;
+    if (ftruncate(dst_fd, clone->size) == -1)
+        return errno;
+
+    /* Start the workers */
+    clone->active = CLONE_THREADS;
+    for (i = 0; i < CLONE_THREADS; i++) {
+        if ((ret_val = pthread_create(&clone->threads[i], NULL,
+                cloneWorker, clone)) != 0) {
+            DEBUG_LOG("pthread_create(): %s", strerror(ret_val));
+            __atomic_sub_fetch(&clone->active, CLONE_THREADS - i,
+                    __ATOMIC_SEQ_CST);
+            break;
+        }
+        clone->thread_cnt++;
+    }
+    if (clone->thread_cnt == 0)
+        return ret_val;
+    return 0;
+}
+
+
+/*
+ * Bytes cloned so far.
+ */
+off_t fileCloneProgress(FILECLONE *clone) {
+    return __atomic_load_n(&clone->done_bytes, __ATOMIC_SEQ_CST);
+}
+
+
+/*
+ * Have all of the workers finished (done or failed)?
+ */
+boolean fileCloneDone(FILECLONE *clone) {
+    return (__atomic_load_n(&clone->active, __ATOMIC_SEQ_CST) == 0) ?
+            TRUE : FALSE;
+}
+
+
+/*
+ * Wait for the workers. The caller still owns the descriptors (and any
+ * fsync()). Returns 0 (zero) or the errno value of the first failure.
+ */
+int finishFileClone(FILECLONE *clone) {
+    int i = 0;
+
+    for (i = 0; i < clone->thread_cnt; i++)
+        pthread_join(clone->threads[i], NULL);
+    clone->thread_cnt = 0;
+    return clone->error;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file clone.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _CLONE_H
+#define	_CLONE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <linux/ioctl.h>
+#include <cdk.h>
+
+/* File clone settings; each worker thread claims a region at a time, and
+ * only the data (not the holes) in it is copied */
+#define CLONE_REGION_SIZE       67108864
+#define CLONE_BUFF_SIZE         4194304
+/* Zeroed blocks this size are skipped by the read()/write() copy */
+#define CLONE_ZERO_BLOCK        4096
+#define CLONE_THREADS           4
+#define CLONE_POLL_USECS        100000
+
+/* How a clone is being done, best first */
+#define CLONE_REFLINK           0
+#define CLONE_COPY_RANGE        1
+#define CLONE_READ_WRITE        2
+
+/* Reflinks are from linux 4.5; the ESOS toolchain's headers (linux 3.14)
+ * predate them */
+#ifndef FICLONE
+#define FICLONE                 _IOW(0x94, 9, int)
+#endif
+
+/* A clone of one file to another; the progress/error fields are shared
+ * with the worker threads and must only be read with fileCloneProgress()
+ * and friends */
+typedef struct file_clone FILECLONE;
+struct file_clone {
+    /* Source and destination files (opened/closed by the caller) */
+    int src_fd;
+    int dst_fd;
+    off_t size;
+    /* One of the CLONE_* methods; the workers drop down to read()/write()
+     * if copy_file_range() isn't supported */
+    int method;
+    /* Next region to be claimed by a worker */
+    off_t next_offset;
+    /* Bytes done so far (holes count, they're just skipped) */
+    off_t done_bytes;
+    /* First error (errno value) seen by a worker, or 0 */
+    int error;
+    /* Workers still running */
+    int active;
+    int thread_cnt;
+    pthread_t threads[CLONE_THREADS];
+};
+
+/* Function prototypes */
+int startFileClone(FILECLONE *clone, int src_fd, int dst_fd);
+off_t fileCloneProgress(FILECLONE *clone);
+boolean fileCloneDone(FILECLONE *clone);
+int finishFileClone(FILECLONE *clone);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _CLONE_H */
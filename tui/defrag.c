@@ -0,0 +1,371 @@
+/**
+ * @file defrag.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/magic.h>
+#include <linux/btrfs.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "vdisk.h"
+#include "defrag.h"
+
+/*
+ * Move one range of an ext4 file into new space: preallocate the same
+ * range in the donor file, and if that came out in fewer extents than the
+ * file has there, have the kernel move the data over and swap the blocks
+ * (holes are skipped, and I/O to the file just waits on each page). The
+ * donor ends up with the old blocks, which are freed when we truncate it.
+ * The kernel won't move pages that are cached (EBUSY), so the range is
+ * written back and dropped from the page cache first.
+ */
+static int defragExt4Range(FILEDEFRAG *defrag, off_t start, off_t length,
+        long extents, off_t *moved) {
+    struct move_extent move_ext = {0};
+    off_t blocks = (length + defrag->block_size - 1) / defrag->block_size;
+    long donor_extents = 0;
+    int ret_val = 0;
+
+    if (sync_file_range(defrag->fd, start, length,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+            SYNC_FILE_RANGE_WAIT_AFTER) == -1)
+        return errno;
+    posix_fadvise(defrag->fd, start, length, POSIX_FADV_DONTNEED);
+    if (fallocate(defrag->donor_fd, 0, start,
+            blocks * defrag->block_size) == -1)
+        return errno;
+    donor_extents = countVDiskExtents(defrag->donor_fd, start, length);
+    if (extents < 0 || donor_extents < 0 || donor_extents < extents) {
+        move_ext.donor_fd = defrag->donor_fd;
+        move_ext.orig_start = start / defrag->block_size;
+        move_ext.donor_start = move_ext.orig_start;
+        move_ext.len = blocks;
+        /* No data past the start of the range is ENODATA */
+        if (ioctl(defrag->fd, EXT4_IOC_MOVE_EXT, &move_ext) == -1 &&
+                errno != ENODATA)
+            ret_val = errno;
+        *moved += move_ext.moved_len * defrag->block_size;
+        /* The moved data is written back through the page cache; wait for
+         * it, so our I/O is done before we're paced */
+        if (move_ext.moved_len > 0 && sync_file_range(defrag->fd, start,
+                length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                SYNC_FILE_RANGE_WAIT_AFTER) == -1 && ret_val == 0)
+            ret_val = errno;
+    }
+    if (ftruncate(defrag->donor_fd, 0) == -1 && ret_val == 0)
+        ret_val = errno;
+    return ret_val;
+}
+
+
+/*
+ * Let btrfs rewrite one range of the file; it takes care of any I/O to
+ * the file going on at the same time. The write back it starts is waited
+ * on, like for ext4.
+ */
+static int defragBtrfsRange(FILEDEFRAG *defrag, off_t start, off_t length,
+        off_t *moved) {
+    struct btrfs_ioctl_defrag_range_args range = {0};
+
+    range.start = start;
+    range.len = length;
+    range.flags = BTRFS_DEFRAG_RANGE_START_IO;
+    /* Anything smaller than a range is fair game */
+    range.extent_thresh = DEFRAG_RANGE_SIZE;
+    if (ioctl(defrag->fd, BTRFS_IOC_DEFRAG_RANGE, &range) == -1)
+        return errno;
+    if (sync_file_range(defrag->fd, start, length,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+            SYNC_FILE_RANGE_WAIT_AFTER) == -1)
+        return errno;
+    *moved = length;
+    return 0;
+}
+
+
+/*
+ * XFS can only swap whole files, so we let xfs_fsr (which does just that,
+ * and gives up if the file is changed underneath it) do the file. It's
+ * run directly (no shell), with its output in a pipe, at the lowest CPU
+ * and I/O priorities; see runXFSDefrag(). Returns 0 (zero) or the errno
+ * value.
+ */
+static int startXFSDefrag(FILEDEFRAG *defrag) {
+    char *fsr_argv[] = {XFS_FSR_BIN, defrag->path, NULL};
+    int pipe_fds[2] = {-1, -1};
+    pid_t child_pid = 0;
+    int ret_val = 0;
+
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+        return errno;
+    if ((child_pid = fork()) == -1) {
+        ret_val = errno;
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return ret_val;
+    } else if (child_pid == 0) {
+        /* The child */
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        dup2(pipe_fds[1], STDERR_FILENO);
+        errno = 0;
+        if (nice(DEFRAG_XFS_NICE) == -1 && errno != 0)
+            DEBUG_LOG("nice(): %s", strerror(errno));
+        if (syscall(SYS_ioprio_set, DEFRAG_XFS_IOPRIO_WHO, 0,
+                DEFRAG_XFS_IOPRIO) == -1)
+            DEBUG_LOG("ioprio_set(): %s", strerror(errno));
+        execv(XFS_FSR_BIN, fsr_argv);
+        DEBUG_LOG("execv(): %s", strerror(errno));
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    defrag->fsr_pid = child_pid;
+    defrag->fsr_fd = pipe_fds[0];
+    defrag->fsr_output[0] = '\0';
+    defrag->fsr_read_bytes = 0;
+    return 0;
+}
+
+
+/*
+ * The bytes read from storage by a process so far (from /proc/PID/io);
+ * 0 if we can't tell.
+ */
+static unsigned long long processReadBytes(pid_t pid) {
+    FILE *io_file = NULL;
+    char io_path[MAX_SYSFS_PATH_SIZE] = {0}, line[MAX_SYSFS_ATTR_SIZE] = {0};
+    unsigned long long read_bytes = 0;
+
+    snprintf(io_path, MAX_SYSFS_PATH_SIZE, "/proc/%d/io", (int) pid);
+    if ((io_file = fopen(io_path, "r")) == NULL)
+        return 0;
+    while (fgets(line, sizeof (line), io_file) != NULL) {
+        if (sscanf(line, "read_bytes: %llu", &read_bytes) == 1)
+            break;
+    }
+    fclose(io_file);
+    return read_bytes;
+}
+
+
+/*
+ * Let xfs_fsr run for a slice (DEFRAG_XFS_SLICE_MSECS), then stop it until
+ * the next call, so the job can be paced and cancelled in between;
+ * '*moved' is set to what it read in the slice. Returns EINPROGRESS while
+ * it's still going, then 0 (zero) or the errno value: EBUSY if it gave up
+ * because the file was modified (it's in use), or EIO if it failed in
+ * some other way (its output is logged).
+ */
+static int runXFSDefrag(FILEDEFRAG *defrag, off_t *moved) {
+    struct pollfd output = {0};
+    struct timespec start = {0}, now = {0};
+    unsigned long long read_bytes = 0;
+    long long msecs = 0;
+    ssize_t bytes_read = 0;
+    int status = 0, ret_val = 0;
+
+    kill(defrag->fsr_pid, SIGCONT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    output.fd = defrag->fsr_fd;
+    output.events = POLLIN;
+    while (msecs < DEFRAG_XFS_SLICE_MSECS) {
+        if (poll(&output, 1, DEFRAG_XFS_SLICE_MSECS - msecs) > 0) {
+            bytes_read = read(defrag->fsr_fd, defrag->fsr_output,
+                    DEFRAG_XFS_OUTPUT_LEN - 1);
+            if (bytes_read == 0)
+                break;
+            if (bytes_read > 0)
+                defrag->fsr_output[bytes_read] = '\0';
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        msecs = ((now.tv_sec - start.tv_sec) * 1000LL) +
+                ((now.tv_nsec - start.tv_nsec) / 1000000LL);
+    }
+    if ((read_bytes = processReadBytes(defrag->fsr_pid)) >
+            defrag->fsr_read_bytes) {
+        *moved = read_bytes - defrag->fsr_read_bytes;
+        defrag->fsr_read_bytes = read_bytes;
+    }
+    if (msecs >= DEFRAG_XFS_SLICE_MSECS) {
+        kill(defrag->fsr_pid, SIGSTOP);
+        return EINPROGRESS;
+    }
+
+    /* It closed its output, so it's done */
+    while (waitpid(defrag->fsr_pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    defrag->fsr_pid = 0;
+    close(defrag->fsr_fd);
+    defrag->fsr_fd = -1;
+    if (strstr(defrag->fsr_output, "file modified") != NULL)
+        ret_val = EBUSY;
+    else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        ret_val = EIO;
+    if (ret_val != 0)
+        DEBUG_LOG("xfs_fsr of '%s' failed (status %d): %s", defrag->path,
+                status, strStrip(defrag->fsr_output));
+    return ret_val;
+}
+
+
+/*
+ * Get ready to defragment the given file; how depends on the file system
+ * it's on (ext4, btrfs, or XFS). Always call closeFileDefrag() afterwards.
+ * Returns 0 (zero) or the errno value (EOPNOTSUPP for any other file
+ * system).
+ */
+int openFileDefrag(FILEDEFRAG *defrag, const char path[]) {
+    char donor_path[PATH_MAX] = {0};
+    char *last_slash = NULL;
+    struct stat file_stat = {0};
+    struct statfs fs_stat = {0};
+
+    memset(defrag, 0, sizeof (FILEDEFRAG));
+    defrag->fd = -1;
+    defrag->donor_fd = -1;
+    defrag->fsr_fd = -1;
+    if (strlen(path) >= PATH_MAX)
+        return ENAMETOOLONG;
+    snprintf(defrag->path, PATH_MAX, "%s", path);
+    if ((defrag->fd = open(path, O_RDWR | O_CLOEXEC)) == -1)
+        return errno;
+    if (fstat(defrag->fd, &file_stat) == -1 ||
+            fstatfs(defrag->fd, &fs_stat) == -1)
+        return errno;
+    if (!S_ISREG(file_stat.st_mode))
+        return EINVAL;
+    defrag->size = file_stat.st_size;
+    defrag->block_size = fs_stat.f_bsize;
+    defrag->range_size = DEFRAG_RANGE_SIZE;
+
+    switch (fs_stat.f_type) {
+        case EXT4_SUPER_MAGIC:
+            /* The donor goes in the same directory (same file system) */
+            defrag->method = DEFRAG_EXT4;
+            snprintf(donor_path, PATH_MAX, "%s", path);
+            if ((last_slash = strrchr(donor_path, '/')) != NULL)
+                *(last_slash + 1) = '\0';
+            else
+                donor_path[0] = '\0';
+            if (strlen(donor_path) + strlen(DEFRAG_DONOR_NAME) >= PATH_MAX)
+                return ENAMETOOLONG;
+            strcat(donor_path, DEFRAG_DONOR_NAME);
+            if ((defrag->donor_fd = mkostemp(donor_path, O_CLOEXEC)) == -1)
+                return errno;
+            unlink(donor_path);
+            return 0;
+        case BTRFS_SUPER_MAGIC:
+            defrag->method = DEFRAG_BTRFS;
+            return 0;
+        case XFS_SUPER_MAGIC:
+            /* The whole file is one range */
+            defrag->method = DEFRAG_XFS;
+            defrag->range_size = defrag->size;
+            if (access(XFS_FSR_BIN, X_OK) == -1)
+                return errno;
+            return 0;
+        default:
+            return EOPNOTSUPP;
+    }
+}
+
+
+/*
+ * Defragment the range of the file at 'start' (range_size bytes, or to the
+ * end of the file) if it's fragmented; '*moved' is set to the bytes that
+ * were rewritten, for the caller to pace (0 if the range was left alone).
+ * Returns 0 (zero) or the errno value; for XFS, EINPROGRESS means xfs_fsr
+ * is still going, and the same range should be given again (after pacing).
+ */
+int defragRange(FILEDEFRAG *defrag, off_t start, off_t *moved) {
+    off_t length = MIN(defrag->range_size, defrag->size - start);
+    long extents = 0;
+    int ret_val = 0, i = 0;
+
+    *moved = 0;
+    if (defrag->fsr_pid > 0)
+        return runXFSDefrag(defrag, moved);
+    if (length <= 0)
+        return 0;
+    extents = countVDiskExtents(defrag->fd, start, length);
+    if (extents >= 0 && extents <= DEFRAG_RANGE_EXTENTS)
+        return 0;
+
+    switch (defrag->method) {
+        case DEFRAG_EXT4:
+            /* A range with pages in use is busy; try again (from a fresh
+             * look, since some of it may have moved) and if it's still
+             * busy, leave it for another time */
+            for (i = 0; i < DEFRAG_BUSY_RETRIES; i++) {
+                if ((ret_val = defragExt4Range(defrag, start, length,
+                        extents, moved)) != EBUSY)
+                    return ret_val;
+                usleep(DEFRAG_BUSY_USECS);
+                extents = countVDiskExtents(defrag->fd, start, length);
+                if (extents >= 0 && extents <= DEFRAG_RANGE_EXTENTS)
+                    return 0;
+            }
+            DEBUG_LOG("Skipping a busy range of '%s' at %lld", defrag->path,
+                    (long long) start);
+            return 0;
+        case DEFRAG_BTRFS:
+            return defragBtrfsRange(defrag, start, length, moved);
+        case DEFRAG_XFS:
+            if ((ret_val = startXFSDefrag(defrag)) != 0)
+                return ret_val;
+            return runXFSDefrag(defrag, moved);
+        default:
+            return EOPNOTSUPP;
+    }
+}
+
+
+/*
+ * Done with a defragmentation.
+ */
+void closeFileDefrag(FILEDEFRAG *defrag) {
+    /* A cancelled xfs_fsr leaves the file as it was (it only swaps the
+     * extents in once the copy is done) */
+    if (defrag->fsr_pid > 0) {
+        kill(defrag->fsr_pid, SIGTERM);
+        kill(defrag->fsr_pid, SIGCONT);
+        while (waitpid(defrag->fsr_pid, NULL, 0) == -1 && errno == EINTR)
+            ;
+        defrag->fsr_pid = 0;
+    }
+    if (defrag->fsr_fd != -1) {
+        close(defrag->fsr_fd);
+        defrag->fsr_fd = -1;
+    }
+    if (defrag->donor_fd != -1) {
+        close(defrag->donor_fd);
+        defrag->donor_fd = -1;
+    }
+    if (defrag->fd != -1) {
+        close(defrag->fd);
+        defrag->fd = -1;
+    }
+    return;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file defrag.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _DEFRAG_H
+#define	_DEFRAG_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <limits.h>
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#include <cdk.h>
+
+/* Defragmentation settings; a file is done a range at a time, and a range
+ * with no more than DEFRAG_RANGE_EXTENTS extents is left alone */
+#define DEFRAG_RANGE_SIZE       67108864
+#define DEFRAG_RANGE_EXTENTS    2
+/* Ceiling for the rate (bytes per second) data is moved at; the job backs
+ * off from it with the fill governor's latency threshold */
+#define DEFRAG_MAX_BPS          67108864LL
+#define DEFRAG_DONOR_NAME       ".defrag.XXXXXX"
+/* ext4 gives up on a range with pages in use (EBUSY); how many times we
+ * try a range, and how long we wait in between */
+#define DEFRAG_BUSY_RETRIES     3
+#define DEFRAG_BUSY_USECS       100000
+
+/* XFS files are done whole by xfs_fsr, in a child process at the lowest
+ * CPU and (idle class, see ioprio_set(2)) I/O priorities; it runs for a
+ * slice at a time, and is stopped while the job is paced */
+#define DEFRAG_XFS_SLICE_MSECS  250
+#define DEFRAG_XFS_NICE         19
+#define DEFRAG_XFS_IOPRIO       (3 << 13)
+#define DEFRAG_XFS_IOPRIO_WHO   1
+#define DEFRAG_XFS_OUTPUT_LEN   256
+
+/* How a file is being defragmented (depends on the file system) */
+#define DEFRAG_EXT4             0
+#define DEFRAG_BTRFS            1
+#define DEFRAG_XFS              2
+
+/* ext4 online defrag (from e2fsprogs; not exported by the kernel) */
+#ifndef EXT4_IOC_MOVE_EXT
+struct move_extent {
+    __u32 reserved;
+    __u32 donor_fd;
+    __u64 orig_start;
+    __u64 donor_start;
+    __u64 len;
+    __u64 moved_len;
+};
+#define EXT4_IOC_MOVE_EXT       _IOWR('f', 15, struct move_extent)
+#endif
+
+/* A defragmentation of one file; the file is rewritten by the file system
+ * itself, so it can stay in use (eg, by SCST) the whole time */
+typedef struct file_defrag FILEDEFRAG;
+struct file_defrag {
+    /* File being defragmented */
+    char path[PATH_MAX];
+    int fd;
+    /* ext4: an unlinked file in the same directory the new (contiguous)
+     * space is preallocated in */
+    int donor_fd;
+    /* One of the DEFRAG_* methods */
+    int method;
+    /* File system block size, file size, and the size of each range */
+    unsigned long block_size;
+    off_t size;
+    off_t range_size;
+    /* XFS: the running xfs_fsr (0 if there isn't one), a pipe with its
+     * output and the last of that output, and the bytes it had read at
+     * the end of the last slice */
+    pid_t fsr_pid;
+    int fsr_fd;
+    char fsr_output[DEFRAG_XFS_OUTPUT_LEN];
+    unsigned long long fsr_read_bytes;
+};
+
+/* Function prototypes */
+int openFileDefrag(FILEDEFRAG *defrag, const char path[]);
+int defragRange(FILEDEFRAG *defrag, off_t start, off_t *moved);
+void closeFileDefrag(FILEDEFRAG *defrag);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _DEFRAG_H */
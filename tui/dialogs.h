@@ -43,9 +43,13 @@ extern "C" {
 #define SCST_INFO_ROWS                  10
 #define SCST_INFO_COLS                  60
 #define MAX_SCST_INFO_LINES             128
+#define AFFINITY_INFO_ROWS              16
+#define AFFINITY_INFO_COLS              72
+#define MAX_AFFINITY_INFO_LINES         512
 #define DEV_INFO_ROWS                   16
 #define DEV_INFO_COLS                   73
 #define MAX_DEV_INFO_LINES              64
+#define MAX_DEV_INFO_ATTRS              10
 #define MAKE_FS_INFO_ROWS               8
 #define MAKE_FS_INFO_COLS               58
 #define MAX_MAKE_FS_INFO_LINES          64
@@ -57,13 +61,25 @@ extern "C" {
 #define MAX_LIP_INFO_LINES              32
 #define LUN_LAYOUT_ROWS                 12
 #define LUN_LAYOUT_COLS                 62
-#define MAX_LUN_LAYOUT_LINES            128
 #define CRM_INFO_ROWS                   12
 #define CRM_INFO_COLS                   68
 #define MAX_CRM_INFO_LINES              512
 #define VDLIST_INFO_ROWS                10
-#define VDLIST_INFO_COLS                70
-#define MAX_VDLIST_INFO_LINES           512
+#define VDLIST_INFO_COLS                76
+#define VDLIST_SORT_KEY                 'o'
+#define BULK_ADD_INFO_ROWS              8
+#define BULK_ADD_INFO_COLS              66
+#define MAX_BULK_ADD_INFO_LINES         8
+#define TUNE_INFO_ROWS                  12
+#define TUNE_INFO_COLS                  66
+#define MAX_TUNE_INFO_LINES             (TUNING_ATTRS + 6)
+#define REBAL_INFO_ROWS                 14
+#define REBAL_INFO_COLS                 66
+#define MAX_REBAL_INFO_LINES            256
+#define DEV_PATHS_ROWS                  14
+#define DEV_PATHS_COLS                  72
+#define MAX_DEV_PATH_SESSIONS           16
+#define DEV_PATHS_UNMAP_KEY             'u'
 #define ALUA_LAYOUT_ROWS                12
 #define ALUA_LAYOUT_COLS                72
 #define MAX_ALUA_LAYOUT_LINES           128
@@ -85,7 +101,7 @@ extern "C" {
 #define ADD_TGT_INFO_LINES              4
 #define MAX_NET_INFO_LINES              10
 #define NET_SHORT_INFO_LINES            1
-#define HELP_MSG_SIZE                   17
+#define HELP_MSG_SIZE                   18
 #define SUPPORT_PKG_MSG_SIZE            7
 #define ABOUT_MSG_SIZE                  12
 
@@ -145,6 +161,13 @@ typedef enum {
     NO_BONDING, MASTER, SLAVE
 } bonding_t;
 
+/* Main screen sessions label sort order */
+typedef enum {
+    SORT_TOTAL_BW, SORT_READ_BW, SORT_WRITE_BW, SORT_TOTAL_IOPS,
+    SORT_READ_IOPS, SORT_WRITE_IOPS, SORT_ACTIVE_CMDS, SORT_INIT_NAME,
+    SESS_SORT_KEYS
+} sess_sort_t;
+
 /* This would normally be set via the ESOS build */
 #ifndef BUILD_OPTS
 #define BUILD_OPTS "N/A"
@@ -0,0 +1,287 @@
+/**
+ * @file events.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <cdk.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "snapshot.h"
+
+/* Poll set slots */
+#define EVENT_INPUT     0
+#define EVENT_TIMER     1
+#define EVENT_CONFIG    2
+#define EVENT_UEVENT    3
+#define EVENT_SNAPSHOT  4
+#define EVENT_SOURCES   5
+
+/* Configuration files (in EVENT_CONF_DIR) that trigger a refresh */
+static const char *conf_files[] = {
+    ESOS_CONF, SCST_CONF, NETWORK_CONF, FSTAB
+};
+
+/* Kernel (uevent) subsystems that trigger a refresh on add/remove */
+static const char *uevent_subsystems[] = {
+    "fc_host", "fc_remote_ports", "scsi", "scsi_host", "infiniband"
+};
+
+static int event_fds[EVENT_SOURCES] = {-1, -1, -1, -1, -1};
+static boolean events_open = FALSE;
+
+
+/*
+ * Set up the main screen wake-up sources: the SCST collector thread's
+ * "snapshot published" descriptor (or, without a collector, a timer for
+ * sampling the counters every REFRESH_DELAY tenths of a second), inotify
+ * on our configuration files, and a netlink socket for kernel uevents.
+ * Anything that can't be set up is logged and skipped; without the timer
+ * we fall back to a poll() timeout.
+ */
+static void openMainEvents() {
+    struct itimerspec interval = {{0}, {0}};
+    struct sockaddr_nl address = {0};
+
+    event_fds[EVENT_INPUT] = STDIN_FILENO;
+
+    /* New snapshots from the collector; owned by snapshot.c */
+    event_fds[EVENT_SNAPSHOT] = scstSnapshotEventFd();
+
+    /* Counter sampling timer (the collector has its own) */
+    if (event_fds[EVENT_SNAPSHOT] != -1) {
+        event_fds[EVENT_TIMER] = -1;
+    } else if ((event_fds[EVENT_TIMER] = timerfd_create(CLOCK_MONOTONIC,
+            TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        DEBUG_LOG("timerfd_create(): %s", strerror(errno));
+    } else {
+        interval.it_interval.tv_sec = REFRESH_DELAY / 10;
+        interval.it_interval.tv_nsec = (REFRESH_DELAY % 10) * 100000000L;
+        interval.it_value = interval.it_interval;
+        if (timerfd_settime(event_fds[EVENT_TIMER], 0,
+                &interval, NULL) == -1) {
+            DEBUG_LOG("timerfd_settime(): %s", strerror(errno));
+            close(event_fds[EVENT_TIMER]);
+            event_fds[EVENT_TIMER] = -1;
+        }
+    }
+
+    /* Configuration files; we watch the directory since the files are
+     * often replaced (renamed over) rather than written in place */
+    if ((event_fds[EVENT_CONFIG] = inotify_init1(IN_NONBLOCK |
+            IN_CLOEXEC)) == -1) {
+        DEBUG_LOG("inotify_init1(): %s", strerror(errno));
+    } else if (inotify_add_watch(event_fds[EVENT_CONFIG], EVENT_CONF_DIR,
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) == -1) {
+        DEBUG_LOG("inotify_add_watch(): %s", strerror(errno));
+        close(event_fds[EVENT_CONFIG]);
+        event_fds[EVENT_CONFIG] = -1;
+    }
+
+    /* Kernel uevents (hot-plug) */
+    if ((event_fds[EVENT_UEVENT] = socket(AF_NETLINK,
+            SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            NETLINK_KOBJECT_UEVENT)) == -1) {
+        DEBUG_LOG("socket(): %s", strerror(errno));
+    } else {
+        address.nl_family = AF_NETLINK;
+        address.nl_pid = 0;
+        address.nl_groups = 1;
+        if (bind(event_fds[EVENT_UEVENT], (struct sockaddr *) &address,
+                sizeof (address)) == -1) {
+            DEBUG_LOG("bind(): %s", strerror(errno));
+            close(event_fds[EVENT_UEVENT]);
+            event_fds[EVENT_UEVENT] = -1;
+        }
+    }
+
+    events_open = TRUE;
+    return;
+}
+
+
+/*
+ * Drain the inotify descriptor; returns TRUE if one of our configuration
+ * files changed.
+ */
+static boolean readConfigEvents(int inotify_fd) {
+    char buffer[MAX_UEVENT_SIZE]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event = NULL;
+    const char *file_name = NULL;
+    ssize_t length = 0;
+    char *position = NULL;
+    boolean relevant = FALSE;
+    int i = 0;
+
+    while ((length = read(inotify_fd, buffer, sizeof (buffer))) > 0) {
+        for (position = buffer; position < buffer + length;
+                position += sizeof (struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) position;
+            if (event->len == 0)
+                continue;
+            for (i = 0; i < (int) (sizeof (conf_files) /
+                    sizeof (*conf_files)); i++) {
+                file_name = strrchr(conf_files[i], '/') + 1;
+                if (strcmp(event->name, file_name) == 0)
+                    relevant = TRUE;
+            }
+        }
+    }
+    return relevant;
+}
+
+
+/*
+ * Drain the uevent socket; returns TRUE if a device was added or removed
+ * (or changed) in one of the subsystems we care about. A uevent is a
+ * header ("ACTION@DEVPATH") followed by NUL separated KEY=VALUE pairs.
+ */
+static boolean readUEvents(int uevent_fd) {
+    char buffer[MAX_UEVENT_SIZE] = {0};
+    const char *subsystem = NULL, *action = NULL;
+    ssize_t length = 0;
+    char *position = NULL;
+    boolean relevant = FALSE;
+    int i = 0;
+
+    while ((length = recv(uevent_fd, buffer, sizeof (buffer) - 1, 0)) > 0) {
+        buffer[length] = '\0';
+        subsystem = NULL;
+        action = NULL;
+        for (position = buffer; position < buffer + length;
+                position += strlen(position) + 1) {
+            if (strncmp(position, "ACTION=", 7) == 0)
+                action = position + 7;
+            else if (strncmp(position, "SUBSYSTEM=", 10) == 0)
+                subsystem = position + 10;
+        }
+        if (subsystem == NULL || action == NULL ||
+                (strcmp(action, "add") != 0 &&
+                strcmp(action, "remove") != 0 &&
+                strcmp(action, "change") != 0))
+            continue;
+        for (i = 0; i < (int) (sizeof (uevent_subsystems) /
+                sizeof (*uevent_subsystems)); i++) {
+            if (strcmp(subsystem, uevent_subsystems[i]) == 0)
+                relevant = TRUE;
+        }
+    }
+    return relevant;
+}
+
+
+/*
+ * Wait for something to happen on the main screen. If a key was pressed
+ * it is returned; ERR is returned when the information labels should be
+ * refreshed (a new snapshot was published, the sampling timer fired, or
+ * without a collector, a configuration file changed or an adapter/device
+ * was added or removed). With a collector, those last two just ask it for
+ * a new snapshot, which wakes us up when it's ready. Events we don't care
+ * about are consumed here, so an idle console only wakes up for the timer.
+ */
+int waitMainEvent(WINDOW *window) {
+    struct pollfd poll_fds[EVENT_SOURCES];
+    uint64_t expirations = 0;
+    eventfd_t count = 0;
+    boolean refresh = FALSE;
+    int key_pressed = 0, timeout = -1, i = 0;
+
+    if (!events_open)
+        openMainEvents();
+    if (event_fds[EVENT_TIMER] == -1 && event_fds[EVENT_SNAPSHOT] == -1)
+        timeout = REFRESH_DELAY * 100;
+
+    for (;;) {
+        /* Check for input first, curses may already have some buffered */
+        nodelay(window, TRUE);
+        key_pressed = wgetch(window);
+        nodelay(window, FALSE);
+        if (key_pressed != ERR)
+            return key_pressed;
+
+        for (i = 0; i < EVENT_SOURCES; i++) {
+            poll_fds[i].fd = event_fds[i];
+            poll_fds[i].events = POLLIN;
+            poll_fds[i].revents = 0;
+        }
+        switch (poll(poll_fds, EVENT_SOURCES, timeout)) {
+            case -1:
+                /* A signal (eg, SIGWINCH) gets us a KEY_RESIZE from curses */
+                if (errno == EINTR)
+                    continue;
+                DEBUG_LOG("poll(): %s", strerror(errno));
+                return ERR;
+            case 0:
+                /* No timer descriptor, so the timeout is our timer */
+                return ERR;
+            default:
+                break;
+        }
+
+        if (poll_fds[EVENT_INPUT].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            /* Lost the terminal; let the caller deal with it */
+            return ERR;
+        }
+        if (poll_fds[EVENT_SNAPSHOT].revents & POLLIN) {
+            if (eventfd_read(event_fds[EVENT_SNAPSHOT], &count) == -1 &&
+                    errno != EAGAIN)
+                DEBUG_LOG("eventfd_read(): %s", strerror(errno));
+            return ERR;
+        }
+        if (poll_fds[EVENT_TIMER].revents & POLLIN) {
+            if (read(event_fds[EVENT_TIMER], &expirations,
+                    sizeof (expirations)) == -1 && errno != EAGAIN)
+                DEBUG_LOG("read(): %s", strerror(errno));
+            return ERR;
+        }
+        refresh = FALSE;
+        if ((poll_fds[EVENT_CONFIG].revents & POLLIN) &&
+                readConfigEvents(event_fds[EVENT_CONFIG]))
+            refresh = TRUE;
+        if ((poll_fds[EVENT_UEVENT].revents & POLLIN) &&
+                readUEvents(event_fds[EVENT_UEVENT]))
+            refresh = TRUE;
+        if (refresh) {
+            if (event_fds[EVENT_SNAPSHOT] == -1)
+                return ERR;
+            kickSCSTCollector();
+        }
+        /* Anything else (input) loops back to curses */
+    }
+}
+
+
+/*
+ * Close the main screen wake-up sources.
+ */
+void closeMainEvents() {
+    int i = 0;
+
+    for (i = EVENT_TIMER; i < EVENT_SNAPSHOT; i++) {
+        if (event_fds[i] != -1) {
+            close(event_fds[i]);
+            event_fds[i] = -1;
+        }
+    }
+    event_fds[EVENT_SNAPSHOT] = -1;
+    events_open = FALSE;
+    return;
+}
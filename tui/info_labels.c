@@ -19,6 +19,7 @@
 #include "system.h"
 #include "dialogs.h"
 #include "strings.h"
+#include "snapshot.h"
 
 /*
  * This function is responsible for moving, resizing, and updating the message
@@ -36,15 +37,20 @@ boolean updateInfoLabels(CDKSCREEN *cdk_screen,
             sess_lbl_rows = 0, tgt_lbl_height = 0, sess_lbl_height = 0,
             tgt_y_start = 0, sess_y_start = 0,
             smallest_val = 0, largest_val = 0;
-    boolean success = TRUE;
-
-    /* Fill the label messages and get sizes */
-    tgt_want_rows = readTargetData(tgt_info_msg);
-    sess_want_rows = readSessionData(sess_info_msg);
+    boolean success = TRUE, tgt_changed = FALSE, sess_changed = FALSE;
+    SCSTSNAPSHOT *snapshot = NULL;
 
     /* Figure out how much real estate we have */
     getmaxyx(cdk_screen->window, window_y, window_x);
     usable_height = window_y - 1;
+
+    /* Fill the label messages and get sizes; both labels use the latest
+     * snapshot from the collector (one pass over sysfs) */
+    snapshot = acquireSCSTSnapshot();
+    tgt_want_rows = readTargetData(snapshot, tgt_info_msg, &tgt_changed);
+    sess_want_rows = readSessionData(snapshot, sess_info_msg,
+            usable_height, &sess_changed);
+    releaseSCSTSnapshot();
     /* Its okay if its odd, integer division will truncate (1 spare row) */
     half_height = usable_height / 2;
 
@@ -121,6 +127,7 @@ boolean updateInfoLabels(CDKSCREEN *cdk_screen,
             }
             setCDKLabelBoxAttribute(*tgt_info, COLOR_MAIN_BOX);
             setCDKLabelBackgroundAttrib(*tgt_info, COLOR_MAIN_TEXT);
+            tgt_changed = TRUE;
         }
         if (*sess_info == NULL) {
             *sess_info = newCDKLabel(cdk_screen, 1, sess_y_start,
@@ -132,14 +139,18 @@ boolean updateInfoLabels(CDKSCREEN *cdk_screen,
             }
             setCDKLabelBoxAttribute(*sess_info, COLOR_MAIN_BOX);
             setCDKLabelBackgroundAttrib(*sess_info, COLOR_MAIN_TEXT);
+            sess_changed = TRUE;
         }
         break;
     }
 
-    /* Refresh information label messages */
+    /* Refresh information label messages; CDK re-draws the whole label
+     * so we only do it when a row has actually changed */
     if (success) {
-        setCDKLabelMessage(*tgt_info, tgt_info_msg, tgt_lbl_rows);
-        setCDKLabelMessage(*sess_info, sess_info_msg, sess_lbl_rows);
+        if (tgt_changed)
+            setCDKLabelMessage(*tgt_info, tgt_info_msg, tgt_lbl_rows);
+        if (sess_changed)
+            setCDKLabelMessage(*sess_info, sess_info_msg, sess_lbl_rows);
     }
 
     /* Done */
@@ -147,39 +158,60 @@ boolean updateInfoLabels(CDKSCREEN *cdk_screen,
 }
 
 
+/*
+ * Set a single label row; the existing string is kept if it matches. We
+ * return TRUE if the row was actually changed.
+ */
+static boolean setLabelRow(char *label_msg[], int row, const char *text) {
+    if (label_msg[row] != NULL && strcmp(label_msg[row], text) == 0)
+        return FALSE;
+    FREE_NULL(label_msg[row]);
+    SAFE_ASPRINTF(&label_msg[row], "%s", text);
+    return TRUE;
+}
+
+
+/*
+ * Free any label rows past the new row count (from the last row count).
+ * Returns TRUE if any rows were removed.
+ */
+static boolean trimLabelRows(char *label_msg[], int row_cnt,
+        int last_row_cnt) {
+    boolean changed = FALSE;
+    int i = 0;
+    for (i = row_cnt; i < last_row_cnt; i++) {
+        if (label_msg[i] != NULL) {
+            FREE_NULL(label_msg[i]);
+            changed = TRUE;
+        }
+    }
+    return changed;
+}
+
+
 /*
  * This function will fill an array of char pointers for the "targets"
- * information label (main screen). The return value is the number of rows
- * that should be displayed in the label. If an error occurs, we simply
- * print the error message in the label row data and return.
+ * information label (main screen) using the given SCST snapshot. The return
+ * value is the number of rows that should be displayed in the label, and
+ * 'changed' is set if any row differs from the last call. If an error
+ * occurred taking the snapshot, we print the error message in the label
+ * row data.
  */
-int readTargetData(char *label_msg[]) {
-    DIR *dir_stream = NULL;
-    struct dirent *dir_entry = NULL;
-    int row_cnt = 0, i = 0, j = 0, driver_cnt = 0, temp_int = 0,
-            fc_adp_cnt = 0, ib_adp_cnt = 0, port_name_size = 0, tgt_cnt = 0;
-    char line_buffer[TARGETS_LABEL_COLS],
-            dir_name[MAX_SYSFS_PATH_SIZE] = {0},
-            attr_path[MAX_SYSFS_PATH_SIZE] = {0},
-            attr_val[MAX_SYSFS_ATTR_SIZE] = {0};
-    char tgt_drivers[MAX_SCST_DRIVERS][MISC_STRING_LEN] = {{0}, {0}},
-            driver_name[MAX_SCST_SESSNS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            tgt_name[MAX_SCST_SESSNS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            tgt_state[MAX_SCST_SESSNS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            fc_port_name[MAX_FC_ADAPTERS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            fc_speed[MAX_FC_ADAPTERS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            ib_node_guid[MAX_IB_ADAPTERS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            ib_port_speed[MAX_IB_ADAPTERS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}},
-            tgt_speed_str[MAX_SCST_SESSNS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}};
-    char *temp_pstr = NULL;
-
-    /* Clear the label message */
-    for (i = 0; i < MAX_INFO_LABEL_ROWS; i++)
-        FREE_NULL(label_msg[i]);
+int readTargetData(SCSTSNAPSHOT *snapshot, char *label_msg[],
+        boolean *changed) {
+    static int last_row_cnt = 0;
+    int row_cnt = 0, i = 0;
+    char line_buffer[TARGETS_LABEL_COLS] = {0};
+    SNAPTARGET *target = NULL;
+
+    /* Nothing to do if the targets haven't changed */
+    *changed = FALSE;
+    if (last_row_cnt != 0 && label_msg[0] != NULL && !snapshot->tgt_changed)
+        return last_row_cnt;
 
     /* Set the initial label messages; the number of characters
      * controls the label width (using white space as padding for width) */
-    SAFE_ASPRINTF(&label_msg[0],
+    *changed |= setLabelRow(label_msg, 0,
             "</21/B/U>Target<!21><!B><!U>                            "
             "</21/B/U>Driver<!21><!B><!U>     "
             "</21/B/U>State<!21><!B><!U>      "
@@ -188,166 +220,31 @@ int readTargetData(char *label_msg[]) {
     /* We start our row 1 down (skip title) */
     row_cnt = 1;
 
-    /* Print a nice message if SCST isn't loaded and return */
-    if (!isSCSTLoaded()) {
+    if (!snapshot->scst_loaded) {
+        /* Print a nice message if SCST isn't loaded */
         snprintf(line_buffer, TARGETS_LABEL_COLS, NO_SCST_MSG);
-        SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-        row_cnt++;
-        return row_cnt;
-    }
-
-    /* Fill the array with current SCST target drivers */
-    if (!listSCSTTgtDrivers(tgt_drivers, &driver_cnt)) {
-        snprintf(line_buffer, TARGETS_LABEL_COLS, TGT_DRIVERS_ERR);
-        SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
+        *changed |= setLabelRow(label_msg, row_cnt, line_buffer);
         row_cnt++;
-        return row_cnt;
-    }
 
-    for (i = 0; i < driver_cnt; i++) {
-        /* Open the directory for targets */
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-                "%s/targets/%s", SYSFS_SCST_TGT, tgt_drivers[i]);
-        if ((dir_stream = opendir(dir_name)) == NULL) {
-            if (row_cnt < MAX_INFO_LABEL_ROWS) {
-                snprintf(line_buffer, SESSIONS_LABEL_COLS, "opendir(): %s",
-                        strerror(errno));
-                SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-                row_cnt++;
-            }
-            return row_cnt;
-        }
-        while ((dir_entry = readdir(dir_stream)) != NULL) {
-            /* The target names are directories */
-            if ((dir_entry->d_type == DT_DIR) &&
-                    (strcmp(dir_entry->d_name, ".") != 0) &&
-                    (strcmp(dir_entry->d_name, "..") != 0)) {
-                /* Store the driver name for this target */
-                snprintf(driver_name[j], MAX_SYSFS_ATTR_SIZE, tgt_drivers[i]);
-                /* Store the target name */
-                snprintf(tgt_name[j], MAX_SYSFS_ATTR_SIZE, dir_entry->d_name);
-                /* Get the target enabled/disabled attribute */
-                snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
-                        "%s/targets/%s/%s/enabled", SYSFS_SCST_TGT,
-                        tgt_drivers[i], dir_entry->d_name);
-                readAttribute(attr_path, attr_val);
-                temp_int = atoi(attr_val);
-                if (temp_int == 1)
-                    snprintf(tgt_state[j], MAX_SYSFS_ATTR_SIZE, "Enabled");
-                else
-                    snprintf(tgt_state[j], MAX_SYSFS_ATTR_SIZE, "Disabled");
-                j++;
-            }
-        }
-        /* Close the target directory stream */
-        closedir(dir_stream);
-    }
-
-    /* Fibre Channel / FCoE adapter information */
-    if ((dir_stream = opendir(SYSFS_FC_HOST)) == NULL) {
-        if (row_cnt < MAX_INFO_LABEL_ROWS) {
-            snprintf(line_buffer, TARGETS_LABEL_COLS, "opendir(): %s",
-                    strerror(errno));
-            SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-        }
-        return row_cnt;
-    }
-    while ((dir_entry = readdir(dir_stream)) != NULL) {
-        /* The hostX directory names are links */
-        if (dir_entry->d_type == DT_LNK) {
-            /* Get the port name */
-            snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/port_name",
-                    SYSFS_FC_HOST, dir_entry->d_name);
-            readAttribute(attr_path, attr_val);
-            /* Make the port name match a SCST target name */
-            temp_pstr = strchr(attr_val, 'x');
-            if (temp_pstr != NULL) {
-                temp_pstr++;
-                while ((temp_int = strlen(temp_pstr)) != 0) {
-                    if (!((temp_int - 2) < 0)) {
-                        if (port_name_size >= MAX_SYSFS_ATTR_SIZE) {
-                            break;
-                        } else {
-                            strncat(fc_port_name[fc_adp_cnt], temp_pstr, 2);
-                            port_name_size = port_name_size + 2;
-                            if ((temp_int - 2) != 0) {
-                                strncat(fc_port_name[fc_adp_cnt], ":", 1);
-                                port_name_size++;
-                            }
-                            temp_pstr = temp_pstr + 2;
-                        }
-                    } else {
-                        break;
-                    }
-                }
-            }
-            /* Get speed string */
-            snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/speed",
-                    SYSFS_FC_HOST, dir_entry->d_name);
-            readAttribute(attr_path, attr_val);
-            snprintf(fc_speed[fc_adp_cnt], MAX_SYSFS_ATTR_SIZE, "%s", attr_val);
-        }
-        fc_adp_cnt++;
-    }
-    closedir(dir_stream);
-
-    /* InfiniBand HCA information */
-    if ((dir_stream = opendir(SYSFS_INFINIBAND)) == NULL) {
-        if (row_cnt < MAX_INFO_LABEL_ROWS) {
-            snprintf(line_buffer, TARGETS_LABEL_COLS, "opendir(): %s",
-                    strerror(errno));
-            SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-        }
-        return row_cnt;
-    }
-    while ((dir_entry = readdir(dir_stream)) != NULL) {
-        /* The IB directory names are links */
-        if (dir_entry->d_type == DT_LNK) {
-            /* Get the HCA node GUID (this matches what SCST has) */
-            snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/node_guid",
-                    SYSFS_INFINIBAND, dir_entry->d_name);
-            readAttribute(attr_path, attr_val);
-            snprintf(ib_node_guid[ib_adp_cnt], MAX_SYSFS_ATTR_SIZE, attr_val);
-
-            /* Get the port rate/speed */
-            // TODO: It may be incorrect to assume there is only 1 port!
-            snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/ports/1/rate",
-                    SYSFS_INFINIBAND, dir_entry->d_name);
-            readAttribute(attr_path, attr_val);
-            snprintf(ib_port_speed[ib_adp_cnt], MAX_SYSFS_ATTR_SIZE, attr_val);
-        }
-        ib_adp_cnt++;
-    }
-    closedir(dir_stream);
-
-    /* Fill the label lines */
-    tgt_cnt = j;
-    for (i = 0; i < tgt_cnt; i++) {
-        for (j = 0; j < fc_adp_cnt; j++) {
-            if (strcmp(tgt_name[i], fc_port_name[j]) == 0) {
-                /* Add speed/rate if its a matching FC adapter */
-                snprintf(tgt_speed_str[i], MAX_SYSFS_ATTR_SIZE,
-                        "%s", fc_speed[j]);
-                break;
-            }
-        }
-        for (j = 0; j < ib_adp_cnt; j++) {
-            if (strcmp(tgt_name[i], ib_node_guid[j]) == 0) {
-                /* Add speed/rate if its a matching IB adapter */
-                snprintf(tgt_speed_str[i], MAX_SYSFS_ATTR_SIZE,
-                        "%s", ib_port_speed[j]);
+    } else {
+        /* Fill the label lines */
+        for (i = 0; i < snapshot->tgt_cnt; i++) {
+            if (row_cnt >= (MAX_INFO_LABEL_ROWS - 1))
                 break;
-            }
-        }
-        if (tgt_speed_str[i][0] == '\0')
-            snprintf(tgt_speed_str[i], MAX_SYSFS_ATTR_SIZE, "N/A");
-        /* Put it all together */
-        if (row_cnt < MAX_INFO_LABEL_ROWS) {
+            target = snapshot->targets[i];
             snprintf(line_buffer, TARGETS_LABEL_COLS,
                     "%-33.33s %-10.10s %-10.10s %-20.20s",
-                    tgt_name[i], driver_name[i],
-                    tgt_state[i], tgt_speed_str[i]);
-            SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
+                    target->name, target->driver,
+                    (target->enabled ? "Enabled" : "Disabled"),
+                    target->speed);
+            *changed |= setLabelRow(label_msg, row_cnt, line_buffer);
+            row_cnt++;
+        }
+
+        /* Show the error (if any) after the data we did get */
+        if (snapshot->error[0] != '\0') {
+            snprintf(line_buffer, TARGETS_LABEL_COLS, "%s", snapshot->error);
+            *changed |= setLabelRow(label_msg, row_cnt, line_buffer);
             row_cnt++;
         }
     }
@@ -355,225 +252,228 @@ int readTargetData(char *label_msg[]) {
     /* Done */
     if (row_cnt == 1) {
         /* Add a blank line if there are no rows of data */
-        SAFE_ASPRINTF(&label_msg[row_cnt], " ");
+        *changed |= setLabelRow(label_msg, row_cnt, " ");
         row_cnt++;
     }
+    *changed |= trimLabelRows(label_msg, row_cnt, last_row_cnt);
+    last_row_cnt = row_cnt;
     return row_cnt;
 }
 
 
+/* Current sort order for the sessions label (changed with a hot key) */
+static sess_sort_t sess_sort_key = SORT_TOTAL_BW;
+
+
+/*
+ * Switch the sessions label to the next sort order; the label is re-sorted
+ * on the next refresh.
+ */
+void nextSessionSortKey() {
+    sess_sort_key = (sess_sort_key + 1) % SESS_SORT_KEYS;
+    return;
+}
+
+
+/*
+ * Return the value of a session for the current sort order (the names are
+ * handled in the comparator).
+ */
+static unsigned long sessionSortValue(const SNAPSESSION *session) {
+    switch (sess_sort_key) {
+        case SORT_READ_BW:
+            return session->read_kbps;
+        case SORT_WRITE_BW:
+            return session->write_kbps;
+        case SORT_TOTAL_IOPS:
+            return session->read_iops + session->write_iops;
+        case SORT_READ_IOPS:
+            return session->read_iops;
+        case SORT_WRITE_IOPS:
+            return session->write_iops;
+        case SORT_ACTIVE_CMDS:
+            return session->active_cmds;
+        default:
+            return session->read_kbps + session->write_kbps;
+    }
+}
+
+
+/*
+ * Sort comparator for the sessions label; busiest session (by the current
+ * sort order) first, or by initiator name, then by session ID so the order
+ * is stable between refreshes.
+ */
+static int compareSessions(const void *a, const void *b) {
+    const SNAPSESSION *sess_a = *(SNAPSESSION * const *) a,
+            *sess_b = *(SNAPSESSION * const *) b;
+    unsigned long value_a = 0, value_b = 0;
+    int ret_val = 0;
+
+    if (sess_sort_key == SORT_INIT_NAME) {
+        if ((ret_val = strcmp(sess_a->init_name, sess_b->init_name)) != 0)
+            return ret_val;
+    } else {
+        value_a = sessionSortValue(sess_a);
+        value_b = sessionSortValue(sess_b);
+        if (value_a != value_b)
+            return (value_a < value_b) ? 1 : -1;
+    }
+    if (sess_a->sess_id != sess_b->sess_id)
+        return (sess_a->sess_id < sess_b->sess_id) ? -1 : 1;
+    return 0;
+}
+
+
+/*
+ * Build the sessions label title row; the column(s) the label is sorted
+ * by are shown in reverse video.
+ */
+static void sessionLabelTitle(char title[], int size) {
+    /* Title and width of each column; a negative width is left-justified */
+    static const char *col_names[] = {"Session", "LUNs", "Cmds",
+            "Rd MB/s", "Wr MB/s", "Rd IOPS", "Wr IOPS"};
+    static const int col_widths[] = {-24, 5, 6, 10, 10, 10, 10};
+    /* Columns (bit per column) highlighted for each sort order */
+    static const int sort_cols[SESS_SORT_KEYS] = {0x18, 0x08, 0x10, 0x60,
+            0x20, 0x40, 0x04, 0x01};
+    int i = 0, length = 0, padding = 0;
+    boolean sorted = FALSE;
+
+    title[0] = '\0';
+    for (i = 0; i < (int) (sizeof (col_names) / sizeof (*col_names)); i++) {
+        sorted = (sort_cols[sess_sort_key] & (1 << i)) ? TRUE : FALSE;
+        padding = abs(col_widths[i]) - strlen(col_names[i]);
+        length += snprintf(title + length, size - length,
+                "%*s</21/B/U%s>%s<!21><!B><!U>%s%*s",
+                (col_widths[i] > 0 ? padding : 0), "",
+                (sorted ? "/R" : ""), col_names[i], (sorted ? "<!R>" : ""),
+                (col_widths[i] < 0 ? padding : 0), "");
+        if (length >= size)
+            return;
+    }
+    snprintf(title + length, size - length, " ");
+    return;
+}
+
+
 /*
  * This function will fill an array of char pointers for the "sessions"
- * information label (main screen). The return value is the number of rows
- * that should be displayed in the label. If an error occurs, we simply
- * print the error message in the label row data and return.
+ * information label (main screen) using the given SCST snapshot. The return
+ * value is the number of rows that should be displayed in the label, but
+ * only the first 'max_rows' (what can fit on the screen) are filled in;
+ * 'changed' is set if any of those rows differ from the last call. Each row
+ * remembers which session it shows, so only sessions that are new, moved,
+ * or have new counter values get re-formatted. Throughput is shown as MB/s
+ * and IOPS over the last sample interval, sorted by the current sort order
+ * (see nextSessionSortKey()). If an error occurred taking the snapshot, we
+ * print the error message in the label row data.
  */
-int readSessionData(char *label_msg[]) {
-    DIR *tgt_dir_stream = NULL, *sess_dir_stream = NULL;
-    struct dirent *tgt_dir_entry = NULL, *sess_dir_entry = NULL;
-    int i = 0, j = 0, row_cnt = 0, driver_cnt = 0, num_sessions = 0,
-            max_index = 0, tmp_act_cmds = 0, tmp_lun_cnt = 0;
-    int active_cmds[MAX_SCST_SESSNS] = {0}, lun_count[MAX_SCST_SESSNS] = {0};
-    unsigned long long read_io_kb[MAX_SCST_SESSNS] = {0},
-            write_io_kb[MAX_SCST_SESSNS] = {0};
-    unsigned long long tmp_read_io = 0, tmp_write_io = 0;
-    char line_buffer[SESSIONS_LABEL_COLS],
-            tgt_dir_name[MAX_SYSFS_PATH_SIZE] = {0},
-            sess_dir_name[MAX_SYSFS_PATH_SIZE] = {0},
-            attr_path[MAX_SYSFS_PATH_SIZE] = {0},
-            attr_val[MAX_SYSFS_ATTR_SIZE] = {0},
-            tmp_init_name[MAX_SYSFS_ATTR_SIZE] = {0};
-    char tgt_drivers[MAX_SCST_DRIVERS][MISC_STRING_LEN] = {{0}, {0}},
-            init_names[MAX_SCST_SESSNS][MAX_SYSFS_ATTR_SIZE] = {{0}, {0}};
-
-    /* Clear the label message */
-    for (i = 0; i < MAX_INFO_LABEL_ROWS; i++)
-        FREE_NULL(label_msg[i]);
+int readSessionData(SCSTSNAPSHOT *snapshot, char *label_msg[], int max_rows,
+        boolean *changed) {
+    static int last_row_cnt = 0, last_fill_cnt = 0;
+    static unsigned long row_sess_ids[MAX_INFO_LABEL_ROWS] = {0};
+    static SNAPSESSION **order = NULL;
+    static int order_size = 0;
+    static sess_sort_t last_sort_key = SORT_TOTAL_BW;
+    SNAPSESSION **new_order = NULL;
+    int i = 0, row_cnt = 0, fill_cnt = 0;
+    char line_buffer[SESSIONS_LABEL_COLS] = {0},
+            title[MISC_STRING_LEN * 4] = {0};
+    SNAPSESSION *session = NULL;
+
+    /* Nothing to do if the sessions (or screen, or sort) haven't changed */
+    *changed = FALSE;
+    fill_cnt = MIN(max_rows, MAX_INFO_LABEL_ROWS);
+    if (last_row_cnt != 0 && label_msg[0] != NULL &&
+            !snapshot->sess_changed && fill_cnt == last_fill_cnt &&
+            sess_sort_key == last_sort_key)
+        return last_row_cnt;
+    last_sort_key = sess_sort_key;
 
     /* Set the initial label messages; the number of characters
      * controls the label width (using white space as padding for width) */
-    SAFE_ASPRINTF(&label_msg[0],
-            "</21/B/U>Session<!21><!B><!U>                  "
-            "  </21/B/U>LUNs<!21><!B><!U>"
-            "  </21/B/U>Cmds<!21><!B><!U>"
-            "       </21/B/U>Read IO (KB)<!21><!B><!U>"
-            "      </21/B/U>Write IO (KB)<!21><!B><!U> ");
+    sessionLabelTitle(title, MISC_STRING_LEN * 4);
+    *changed |= setLabelRow(label_msg, 0, title);
 
     /* We start our row 1 down (skip title) */
     row_cnt = 1;
 
-    /* Print a nice message if SCST isn't loaded and return */
-    if (!isSCSTLoaded()) {
+    if (!snapshot->scst_loaded) {
+        /* Print a nice message if SCST isn't loaded */
         snprintf(line_buffer, SESSIONS_LABEL_COLS, NO_SCST_MSG);
-        SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-        row_cnt++;
-        return row_cnt;
-    }
-
-    /* Fill the array with current SCST target drivers */
-    if (!listSCSTTgtDrivers(tgt_drivers, &driver_cnt)) {
-        snprintf(line_buffer, SESSIONS_LABEL_COLS, TGT_DRIVERS_ERR);
-        SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
+        *changed |= setLabelRow(label_msg, row_cnt, line_buffer);
+        row_sess_ids[row_cnt] = 0;
         row_cnt++;
-        return row_cnt;
-    }
 
-    for (i = 0; i < driver_cnt; i++) {
-        /* Open the directory for targets */
-        snprintf(tgt_dir_name, MAX_SYSFS_PATH_SIZE,
-                "%s/targets/%s", SYSFS_SCST_TGT, tgt_drivers[i]);
-        if ((tgt_dir_stream = opendir(tgt_dir_name)) == NULL) {
-            if (row_cnt < MAX_INFO_LABEL_ROWS) {
-                snprintf(line_buffer, SESSIONS_LABEL_COLS, "opendir(): %s",
-                        strerror(errno));
-                SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-                row_cnt++;
-            }
-            return row_cnt;
-        }
-        while ((tgt_dir_entry = readdir(tgt_dir_stream)) != NULL) {
-            /* The target names are directories */
-            if ((tgt_dir_entry->d_type == DT_DIR) &&
-                    (strcmp(tgt_dir_entry->d_name, ".") != 0) &&
-                    (strcmp(tgt_dir_entry->d_name, "..") != 0)) {
-                /* Open the directory for sessions */
-                snprintf(sess_dir_name, MAX_SYSFS_PATH_SIZE,
-                        "%s/targets/%s/%s/sessions",
-                        SYSFS_SCST_TGT, tgt_drivers[i],
-                        tgt_dir_entry->d_name);
-                if ((sess_dir_stream = opendir(sess_dir_name)) == NULL) {
-                    closedir(tgt_dir_stream);
-                    if (row_cnt < MAX_INFO_LABEL_ROWS) {
-                        snprintf(line_buffer, SESSIONS_LABEL_COLS,
-                                "opendir(): %s", strerror(errno));
-                        SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
-                        row_cnt++;
-                    }
-                    return row_cnt;
-                }
-                while ((sess_dir_entry = readdir(sess_dir_stream)) != NULL) {
-                    /* The session names are directories */
-                    if ((sess_dir_entry->d_type == DT_DIR) &&
-                            (strcmp(sess_dir_entry->d_name, ".") != 0) &&
-                            (strcmp(sess_dir_entry->d_name, "..") != 0)) {
-                        /* Get the initiator name attribute */
-                        snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
-                                "%s/targets/%s/%s/sessions/%s/initiator_name",
-                                SYSFS_SCST_TGT, tgt_drivers[i],
-                                tgt_dir_entry->d_name,
-                                sess_dir_entry->d_name);
-                        readAttribute(attr_path, attr_val);
-                        snprintf(init_names[j], MAX_SYSFS_ATTR_SIZE,
-                                "%s", attr_val);
-                        /* Get the number of LUNs for this session */
-                        lun_count[j] = countSCSTSessLUNs(tgt_dir_entry->d_name,
-                                tgt_drivers[i], sess_dir_entry->d_name);
-                        /* Get the active commands attribute */
-                        snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
-                                "%s/targets/%s/%s/sessions/%s/active_commands",
-                                SYSFS_SCST_TGT, tgt_drivers[i],
-                                tgt_dir_entry->d_name,
-                                sess_dir_entry->d_name);
-                        readAttribute(attr_path, attr_val);
-                        active_cmds[j] = atoi(attr_val);
-                        /* Get the read IO (in KB) attribute */
-                        snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
-                                "%s/targets/%s/%s/sessions/%s/read_io_count_kb",
-                                SYSFS_SCST_TGT, tgt_drivers[i],
-                                tgt_dir_entry->d_name,
-                                sess_dir_entry->d_name);
-                        readAttribute(attr_path, attr_val);
-                        errno = 0;
-                        read_io_kb[j] = strtoull(attr_val, NULL, 10);
-                        if (errno != 0) {
-                            closedir(sess_dir_stream);
-                            closedir(tgt_dir_stream);
-                            if (row_cnt < MAX_INFO_LABEL_ROWS) {
-                                snprintf(line_buffer, SESSIONS_LABEL_COLS,
-                                        "strtoull(): %s", strerror(errno));
-                                SAFE_ASPRINTF(&label_msg[row_cnt], "%s",
-                                        line_buffer);
-                                row_cnt++;
-                            }
-                            return row_cnt;
-                        }
-                        /* Get the write IO (in KB) attribute */
-                        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/targets/"
-                                "%s/%s/sessions/%s/write_io_count_kb",
-                                SYSFS_SCST_TGT, tgt_drivers[i],
-                                tgt_dir_entry->d_name,
-                                sess_dir_entry->d_name);
-                        readAttribute(attr_path, attr_val);
-                        errno = 0;
-                        write_io_kb[j] = strtoull(attr_val, NULL, 10);
-                        if (errno != 0) {
-                            closedir(sess_dir_stream);
-                            closedir(tgt_dir_stream);
-                            if (row_cnt < MAX_INFO_LABEL_ROWS) {
-                                snprintf(line_buffer, SESSIONS_LABEL_COLS,
-                                        "strtoull(): %s", strerror(errno));
-                                SAFE_ASPRINTF(&label_msg[row_cnt], "%s",
-                                        line_buffer);
-                                row_cnt++;
-                            }
-                            return row_cnt;
-                        }
-                        j++;
-                    }
-                }
-                /* Close the session directory stream */
-                closedir(sess_dir_stream);
-            }
+    } else {
+        /* Show the error (if any) first so its not scrolled away */
+        if (snapshot->error[0] != '\0' && row_cnt < fill_cnt) {
+            snprintf(line_buffer, SESSIONS_LABEL_COLS, "%s",
+                    snapshot->error);
+            *changed |= setLabelRow(label_msg, row_cnt, line_buffer);
+            row_sess_ids[row_cnt] = 0;
+            row_cnt++;
         }
-        /* Close the target directory stream */
-        closedir(tgt_dir_stream);
-    }
 
-    /* Sort the data so the busiest session (most read IO in KB) is higher */
-    num_sessions = j;
-    for (i = 0; i < num_sessions; i++) {
-        max_index = i;
-        for (j = i; j < num_sessions; j++) {
-            if (read_io_kb[max_index] < read_io_kb[j])
-                max_index = j;
+        /* Sort the data so the busiest session is higher (or by name); this
+         * is an index (pointer) sort, the snapshot records don't move */
+        if (snapshot->sess_cnt > order_size &&
+                (new_order = realloc(order,
+                snapshot->sess_cnt * sizeof (SNAPSESSION *))) != NULL) {
+            order = new_order;
+            order_size = snapshot->sess_cnt;
         }
-        /* Set temporary variable */
-        strncpy(tmp_init_name, init_names[i], MAX_SYSFS_ATTR_SIZE);
-        tmp_lun_cnt = lun_count[i];
-        tmp_act_cmds = active_cmds[i];
-        tmp_read_io = read_io_kb[i];
-        tmp_write_io = write_io_kb[i];
-        /* Set current position variable with new maximum */
-        strncpy(init_names[i], init_names[max_index], MAX_SYSFS_ATTR_SIZE);
-        lun_count[i] = lun_count[max_index];
-        active_cmds[i] = active_cmds[max_index];
-        read_io_kb[i] = read_io_kb[max_index];
-        write_io_kb[i] = write_io_kb[max_index];
-        /* Move variable to old location */
-        strncpy(init_names[max_index], tmp_init_name, MAX_SYSFS_ATTR_SIZE);
-        lun_count[max_index] = tmp_lun_cnt;
-        active_cmds[max_index] = tmp_act_cmds;
-        read_io_kb[max_index] = tmp_read_io;
-        write_io_kb[max_index] = tmp_write_io;
-    }
-
-    /* Finally, fill the label array with our sorted data */
-    for (i = 0; i < num_sessions; i++) {
-        if (row_cnt < MAX_INFO_LABEL_ROWS) {
+        if (snapshot->sess_cnt > order_size) {
+            /* We couldn't grow the sort array */
             snprintf(line_buffer, SESSIONS_LABEL_COLS,
-                    "%-25.25s %5d %5d %18llu %18llu",
-                    init_names[i], lun_count[i], active_cmds[i],
-                    read_io_kb[i], write_io_kb[i]);
-            SAFE_ASPRINTF(&label_msg[row_cnt], "%s", line_buffer);
+                    "realloc(): %s", strerror(errno));
+            *changed |= setLabelRow(label_msg, row_cnt, line_buffer);
+            row_sess_ids[row_cnt] = 0;
             row_cnt++;
+
+        } else {
+            memcpy(order, snapshot->sessions,
+                    snapshot->sess_cnt * sizeof (SNAPSESSION *));
+            qsort(order, snapshot->sess_cnt, sizeof (SNAPSESSION *),
+                    compareSessions);
+
+            /* Fill the label array with our sorted data; rows that still
+             * show the same (unchanged) session are left alone, and rows
+             * that won't fit on the screen are only counted */
+            for (i = 0; i < snapshot->sess_cnt; i++) {
+                session = order[i];
+                if (row_cnt < fill_cnt && (label_msg[row_cnt] == NULL ||
+                        session->changed ||
+                        row_sess_ids[row_cnt] != session->sess_id)) {
+                    snprintf(line_buffer, SESSIONS_LABEL_COLS,
+                            "%-24.24s %4d %5d %9.1f %9.1f %9lu %9lu",
+                            session->init_name, session->lun_count,
+                            session->active_cmds,
+                            session->read_kbps / 1024.0,
+                            session->write_kbps / 1024.0,
+                            session->read_iops, session->write_iops);
+                    *changed |= setLabelRow(label_msg, row_cnt,
+                            line_buffer);
+                    row_sess_ids[row_cnt] = session->sess_id;
+                }
+                row_cnt++;
+            }
         }
     }
 
     /* Done */
     if (row_cnt == 1) {
         /* Add a blank line if there are no rows of data */
-        SAFE_ASPRINTF(&label_msg[row_cnt], " ");
+        *changed |= setLabelRow(label_msg, row_cnt, " ");
+        row_sess_ids[row_cnt] = 0;
         row_cnt++;
     }
+    fill_cnt = MIN(row_cnt, fill_cnt);
+    *changed |= trimLabelRows(label_msg, fill_cnt, last_fill_cnt);
+    for (i = fill_cnt; i < last_fill_cnt; i++)
+        row_sess_ids[i] = 0;
+    last_row_cnt = row_cnt;
+    last_fill_cnt = fill_cnt;
     return row_cnt;
 }
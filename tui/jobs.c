@@ -0,0 +1,757 @@
+/**
+ * @file jobs.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/param.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "strings.h"
+#include "jobs.h"
+#include "zerofill.h"
+#include "vdisk.h"
+#include "defrag.h"
+#include "reclaim.h"
+
+/* Signals the UI (curses) may have handlers for; the job process wants
+ * the defaults */
+static const int job_signals[] = {
+    SIGINT, SIGQUIT, SIGTERM, SIGTSTP, SIGWINCH
+};
+
+/* Paces the I/O of a defrag or reclaim job (see paceJob()) */
+typedef struct job_pacer JOBPACER;
+struct job_pacer {
+    /* Current and highest byte rates (per second) allowed */
+    long long max_bps;
+    long long ceiling_bps;
+    /* Watches the backing device latency */
+    FILLGOVERNOR governor;
+    /* When the job was last checkpointed, and where it was */
+    struct timespec last_time;
+    off_t last_offset;
+};
+
+
+/*
+ * Open the job table (creating it if needed) and flock() it with the given
+ * lock type. With an exclusive lock, a table that isn't the size we expect
+ * (new, or from another version) is cleared. Close the descriptor to
+ * unlock. Returns 0 (zero) or the errno value.
+ */
+static int lockJobTable(int lock_type, int *table_fd) {
+    struct stat table_stat = {0};
+    int ret_val = 0;
+
+    if (mkdir(VDISK_JOBS_DIR, 0755) == -1 && errno != EEXIST)
+        return errno;
+    if ((*table_fd = open(VDISK_JOBS_FILE, O_RDWR | O_CREAT | O_CLOEXEC,
+            0600)) == -1)
+        return errno;
+    while (flock(*table_fd, lock_type) == -1) {
+        if (errno != EINTR) {
+            ret_val = errno;
+            close(*table_fd);
+            return ret_val;
+        }
+    }
+    if (lock_type == LOCK_EX) {
+        if (fstat(*table_fd, &table_stat) == -1 ||
+                (table_stat.st_size != (MAX_VDISK_JOBS * sizeof (VDISKJOB)) &&
+                (ftruncate(*table_fd, 0) == -1 ||
+                ftruncate(*table_fd, MAX_VDISK_JOBS * sizeof (VDISKJOB)) ==
+                -1))) {
+            ret_val = errno;
+            close(*table_fd);
+            return ret_val;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Read a job table record; a short (or missing) table reads as free
+ * records. Returns 0 (zero) or the errno value.
+ */
+static int readJob(int table_fd, int slot, VDISKJOB *job) {
+    ssize_t bytes_read = 0;
+
+    memset(job, 0, sizeof (VDISKJOB));
+    if ((bytes_read = pread(table_fd, job, sizeof (VDISKJOB),
+            slot * sizeof (VDISKJOB))) == -1)
+        return errno;
+    if (bytes_read != sizeof (VDISKJOB))
+        memset(job, 0, sizeof (VDISKJOB));
+    return 0;
+}
+
+
+/*
+ * Write a job table record. Returns 0 (zero) or the errno value.
+ */
+static int writeJob(int table_fd, int slot, const VDISKJOB *job) {
+    ssize_t bytes_written = 0;
+
+    if ((bytes_written = pwrite(table_fd, job, sizeof (VDISKJOB),
+            slot * sizeof (VDISKJOB))) == -1)
+        return errno;
+    if (bytes_written != sizeof (VDISKJOB))
+        return EIO;
+    return 0;
+}
+
+
+/*
+ * Does a job process hold this record? The job process keeps a write lock
+ * (fcntl) on its record for as long as it runs, and the kernel drops it
+ * when the process exits, however that happens.
+ */
+static boolean jobOwned(int table_fd, int slot) {
+    struct flock record_lock = {0};
+
+    record_lock.l_type = F_WRLCK;
+    record_lock.l_whence = SEEK_SET;
+    record_lock.l_start = slot * sizeof (VDISKJOB);
+    record_lock.l_len = sizeof (VDISKJOB);
+    if (fcntl(table_fd, F_GETLK, &record_lock) == -1)
+        return FALSE;
+    return (record_lock.l_type != F_UNLCK) ? TRUE : FALSE;
+}
+
+
+/*
+ * Update our job record (the job process side); the state, offset, rate,
+ * governor, extent, reclaim, and error fields are copied from 'status'.
+ * Returns TRUE if the UI asked us to stop.
+ */
+static boolean updateJob(int table_fd, int slot, const VDISKJOB *status) {
+    VDISKJOB job = {0};
+    int ret_val = 0;
+
+    /* Only this descriptor may be used for the table (closing any other
+     * would drop our record lock) */
+    while (flock(table_fd, LOCK_EX) == -1 && errno == EINTR)
+        ;
+    if ((ret_val = readJob(table_fd, slot, &job)) == 0) {
+        job.state = status->state;
+        job.size = status->size;
+        job.offset = status->offset;
+        job.rate = status->rate;
+        job.rate_limit = status->rate_limit;
+        job.latency_ms = status->latency_ms;
+        job.extents_before = status->extents_before;
+        job.extents_after = status->extents_after;
+        job.reclaimed = status->reclaimed;
+        job.error = status->error;
+        job.updated = time(NULL);
+        if (job.state != VDISK_JOB_RUNNING)
+            job.cancel = FALSE;
+        ret_val = writeJob(table_fd, slot, &job);
+    }
+    if (ret_val != 0)
+        DEBUG_LOG("Updating virtual disk job %d failed: %s", slot,
+                strerror(ret_val));
+    flock(table_fd, LOCK_UN);
+    return job.cancel;
+}
+
+
+/*
+ * Tell the UI how getting started went (0 or an errno value).
+ */
+static void jobReady(int ready_fd, int ret_val) {
+    if (write(ready_fd, &ret_val, sizeof (ret_val)) == -1)
+        DEBUG_LOG("write(): %s", strerror(errno));
+    close(ready_fd);
+    return;
+}
+
+
+/*
+ * Take our record (the job process side); it's locked for as long as we
+ * run, and stamped with our PID. Returns 0 (zero) or the errno value;
+ * '*table_fd' is left at -1 if we didn't get the record.
+ */
+static int takeJob(int slot, int *table_fd, VDISKJOB *job) {
+    struct flock record_lock = {0};
+    int ret_val = 0;
+
+    if ((*table_fd = open(VDISK_JOBS_FILE, O_RDWR | O_CLOEXEC)) == -1)
+        return errno;
+    record_lock.l_type = F_WRLCK;
+    record_lock.l_whence = SEEK_SET;
+    record_lock.l_start = slot * sizeof (VDISKJOB);
+    record_lock.l_len = sizeof (VDISKJOB);
+    if (fcntl(*table_fd, F_SETLK, &record_lock) == -1) {
+        ret_val = (errno == EAGAIN || errno == EACCES) ? EBUSY : errno;
+        close(*table_fd);
+        *table_fd = -1;
+        return ret_val;
+    }
+    while (flock(*table_fd, LOCK_EX) == -1 && errno == EINTR)
+        ;
+    if ((ret_val = readJob(*table_fd, slot, job)) == 0) {
+        job->pid = getpid();
+        job->started = time(NULL);
+        job->rate = 0;
+        job->rate_limit = 0;
+        ret_val = writeJob(*table_fd, slot, job);
+    }
+    flock(*table_fd, LOCK_UN);
+    return ret_val;
+}
+
+
+/*
+ * Zero the file from the recorded offset with the zero-fill engine (with a
+ * governor, so front-end I/O on the same device comes first), and
+ * checkpoint the progress every VDISK_JOB_UPDATE_SECS. Returns 0 (zero),
+ * ECANCELED, or the errno value.
+ */
+static int runZeroFillJob(int table_fd, int slot, VDISKJOB *job,
+        int ready_fd) {
+    ZEROFILL fill = {0};
+    FILLGOVERNOR governor = {0};
+    struct timespec last_time = {0}, now = {0};
+    off_t last_offset = 0;
+    int vdisk_fd = -1, ret_val = 0;
+
+    /* Start zeroing where we left off */
+    if ((vdisk_fd = open(job->path, O_WRONLY | O_CLOEXEC)) == -1)
+        ret_val = errno;
+    else if ((ret_val = startZeroFill(&fill, vdisk_fd, job->offset,
+            job->size, FILL_DEF_BUFF_SIZE, FILL_DEF_QUEUE_DEPTH)) != 0)
+        close(vdisk_fd);
+    jobReady(ready_fd, ret_val);
+    if (ret_val != 0)
+        return ret_val;
+    if ((ret_val = openFillGovernor(&governor, vdisk_fd,
+            FILL_GOV_OWN_WRITES)) != 0)
+        DEBUG_LOG("The fill of '%s' can't be governed: %s", job->path,
+                strerror(ret_val));
+
+    /* Checkpoint until the fill is done (or we're asked to stop) */
+    clock_gettime(CLOCK_MONOTONIC, &last_time);
+    last_offset = job->offset;
+    while (!zeroFillDone(&fill)) {
+        sleep(VDISK_JOB_UPDATE_SECS);
+        runFillGovernor(&governor, &fill);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        job->offset = zeroFillCheckpoint(&fill);
+        if (now.tv_sec > last_time.tv_sec) {
+            job->rate = (job->offset - last_offset) /
+                    (now.tv_sec - last_time.tv_sec);
+            last_time = now;
+            last_offset = job->offset;
+        }
+        job->rate_limit = fill.max_bps;
+        job->latency_ms = governor.latency_ms;
+        if (updateJob(table_fd, slot, job))
+            cancelZeroFill(&fill);
+    }
+    closeFillGovernor(&governor);
+
+    /* The workers are gone, so this is where a resume would start */
+    job->offset = zeroFillCheckpoint(&fill);
+    if ((ret_val = finishZeroFill(&fill)) == 0 && fsync(vdisk_fd) == -1)
+        ret_val = errno;
+
+    /* Only now is the file really eager zeroed (it was tagged thin) */
+    if (ret_val == 0 && fsetxattr(vdisk_fd, VDISK_PROV_XATTR,
+            g_vdisk_prov_names[VDISK_PROV_EAGER_ZERO],
+            strlen(g_vdisk_prov_names[VDISK_PROV_EAGER_ZERO]), 0) == -1)
+        DEBUG_LOG("fsetxattr(): %s", strerror(errno));
+    close(vdisk_fd);
+    return ret_val;
+}
+
+
+/*
+ * Get a job ready to be paced with paceJob(), up to 'max_bps' bytes per
+ * second; 'fd' is the file the job does its I/O on.
+ */
+static void startJobPacer(JOBPACER *pacer, VDISKJOB *job, int fd,
+        long long max_bps) {
+    int ret_val = 0;
+
+    memset(pacer, 0, sizeof (JOBPACER));
+    if ((ret_val = openFillGovernor(&pacer->governor, fd,
+            FILL_GOV_OWN_ANY)) != 0)
+        DEBUG_LOG("The job for '%s' can't be governed: %s", job->path,
+                strerror(ret_val));
+    pacer->max_bps = max_bps;
+    pacer->ceiling_bps = max_bps;
+    clock_gettime(CLOCK_MONOTONIC, &pacer->last_time);
+    pacer->last_offset = job->offset;
+    return;
+}
+
+
+/*
+ * Pace a job that just did 'bytes' of I/O (which must have completed), and
+ * checkpoint it every VDISK_JOB_UPDATE_SECS. The rate limit is halved when
+ * the backing device latency goes past the fill governor's threshold, and
+ * steps back up to the ceiling when it's under it; the latency is only
+ * taken while we sleep here, so none of it is from the job itself.
+ * Returns TRUE if the UI asked us to stop.
+ */
+static boolean paceJob(int table_fd, int slot, VDISKJOB *job,
+        JOBPACER *pacer, off_t bytes) {
+    struct timespec now = {0};
+    long long idle_usecs = (bytes * 1000000LL) / pacer->max_bps,
+            sleep_usecs = 0;
+
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - pacer->last_time.tv_sec >= VDISK_JOB_UPDATE_SECS) {
+            if (sampleFillGovernor(&pacer->governor, job->offset) != -1) {
+                if (pacer->governor.latency_ms > FILL_GOV_LAT_MSECS)
+                    pacer->max_bps = MAX(pacer->max_bps / 2,
+                            FILL_GOV_MIN_BPS);
+                else
+                    pacer->max_bps = MIN(pacer->max_bps +
+                            FILL_GOV_STEP_BPS, pacer->ceiling_bps);
+            }
+            job->rate = (job->offset - pacer->last_offset) /
+                    (now.tv_sec - pacer->last_time.tv_sec);
+            pacer->last_time = now;
+            pacer->last_offset = job->offset;
+            job->rate_limit = (pacer->max_bps < pacer->ceiling_bps) ?
+                    pacer->max_bps : 0;
+            job->latency_ms = pacer->governor.latency_ms;
+            if (updateJob(table_fd, slot, job))
+                return TRUE;
+        }
+        if (idle_usecs <= 0)
+            return FALSE;
+        sleep_usecs = MIN(idle_usecs, 1000000LL);
+        idleFillGovernor(&pacer->governor, TRUE);
+        usleep(sleep_usecs);
+        idleFillGovernor(&pacer->governor, FALSE);
+        idle_usecs -= sleep_usecs;
+    }
+}
+
+
+/*
+ * Defragment the file from the recorded offset, a range at a time, pacing
+ * the data moved (up to DEFRAG_MAX_BPS). Returns 0 (zero), ECANCELED, or
+ * the errno value.
+ */
+static int runDefragJob(int table_fd, int slot, VDISKJOB *job,
+        int ready_fd) {
+    FILEDEFRAG defrag = {0};
+    JOBPACER pacer = {0};
+    off_t moved = 0;
+    int ret_val = 0;
+
+    ret_val = openFileDefrag(&defrag, job->path);
+    jobReady(ready_fd, ret_val);
+    if (ret_val != 0) {
+        closeFileDefrag(&defrag);
+        return ret_val;
+    }
+    /* A resumed job keeps the count from before it first started */
+    if (job->offset == 0) {
+        job->size = defrag.size;
+        job->extents_before = countVDiskExtents(defrag.fd, 0, 0);
+    }
+
+    startJobPacer(&pacer, job, defrag.fd, DEFRAG_MAX_BPS);
+    while (job->offset < MIN(job->size, defrag.size)) {
+        /* xfs_fsr does the (one) range a slice at a time */
+        if ((ret_val = defragRange(&defrag, job->offset, &moved)) ==
+                EINPROGRESS)
+            ret_val = 0;
+        else if (ret_val != 0)
+            break;
+        else
+            job->offset = MIN(job->offset + defrag.range_size, job->size);
+        if (paceJob(table_fd, slot, job, &pacer, moved)) {
+            ret_val = ECANCELED;
+            break;
+        }
+    }
+    closeFillGovernor(&pacer.governor);
+
+    job->extents_after = countVDiskExtents(defrag.fd, 0, 0);
+    if (ret_val == 0 && fsync(defrag.fd) == -1)
+        ret_val = errno;
+    closeFileDefrag(&defrag);
+    return ret_val;
+}
+
+
+/*
+ * Punch the zeroed space out of the file from the recorded offset, pacing
+ * what's read (up to RECLAIM_MAX_BPS). A file that had anything punched
+ * out is thin now, so its provisioning mode is changed to say so. Returns
+ * 0 (zero), ECANCELED, or the errno value.
+ */
+static int runReclaimJob(int table_fd, int slot, VDISKJOB *job,
+        int ready_fd) {
+    FILERECLAIM reclaim = {0};
+    JOBPACER pacer = {0};
+    off_t read_bytes = 0, punched = 0;
+    int ret_val = 0;
+
+    ret_val = openFileReclaim(&reclaim, job->path);
+    jobReady(ready_fd, ret_val);
+    if (ret_val != 0) {
+        closeFileReclaim(&reclaim);
+        return ret_val;
+    }
+    if (job->offset == 0) {
+        job->size = reclaim.size;
+        job->reclaimed = 0;
+    }
+
+    startJobPacer(&pacer, job, reclaim.fd, RECLAIM_MAX_BPS);
+    while (job->offset < MIN(job->size, reclaim.size)) {
+        ret_val = reclaimRange(&reclaim, job->offset, &read_bytes,
+                &punched);
+        job->reclaimed += punched;
+        if (ret_val != 0)
+            break;
+        job->offset = MIN(job->offset + RECLAIM_BUFF_SIZE, job->size);
+        if (paceJob(table_fd, slot, job, &pacer, read_bytes)) {
+            ret_val = ECANCELED;
+            break;
+        }
+    }
+    closeFillGovernor(&pacer.governor);
+
+    if (job->reclaimed > 0 && fsetxattr(reclaim.fd, VDISK_PROV_XATTR,
+            g_vdisk_prov_names[VDISK_PROV_THIN],
+            strlen(g_vdisk_prov_names[VDISK_PROV_THIN]), 0) == -1)
+        DEBUG_LOG("fsetxattr(): %s", strerror(errno));
+    if (ret_val == 0 && fsync(reclaim.fd) == -1)
+        ret_val = errno;
+    closeFileReclaim(&reclaim);
+    return ret_val;
+}
+
+
+/*
+ * The job process; takes its record, runs the job, and records how it
+ * ended. The result (0 or an errno value) of getting started is sent on
+ * 'ready_fd'. Never returns.
+ */
+static void runVDiskJob(int slot, int ready_fd) {
+    VDISKJOB job = {0};
+    DIR *fd_dir = NULL;
+    struct dirent *fd_entry = NULL;
+    int table_fd = -1, null_fd = -1, fd = 0, ret_val = 0, i = 0;
+
+    /* Let go of the terminal and anything else the UI had open */
+    if ((null_fd = open("/dev/null", O_RDWR)) != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO)
+            close(null_fd);
+    }
+    if ((fd_dir = opendir("/proc/self/fd")) != NULL) {
+        while ((fd_entry = readdir(fd_dir)) != NULL) {
+            fd = atoi(fd_entry->d_name);
+            if (fd > STDERR_FILENO && fd != ready_fd && fd != dirfd(fd_dir))
+                close(fd);
+        }
+        closedir(fd_dir);
+    }
+    for (i = 0; i < (int) (sizeof (job_signals) / sizeof (*job_signals));
+            i++)
+        signal(job_signals[i], SIG_DFL);
+
+    /* Stay out of the way of everything else */
+    errno = 0;
+    if (nice(VDISK_JOB_NICE) == -1 && errno != 0)
+        DEBUG_LOG("nice(): %s", strerror(errno));
+    if (syscall(SYS_ioprio_set, VDISK_JOB_IOPRIO_WHO, 0,
+            VDISK_JOB_IOPRIO) == -1)
+        DEBUG_LOG("ioprio_set(): %s", strerror(errno));
+
+    /* Run it; the runner tells the UI once it's started */
+    if ((ret_val = takeJob(slot, &table_fd, &job)) != 0)
+        jobReady(ready_fd, ret_val);
+    else if (job.type == VDISK_JOB_DEFRAG)
+        ret_val = runDefragJob(table_fd, slot, &job, ready_fd);
+    else if (job.type == VDISK_JOB_RECLAIM)
+        ret_val = runReclaimJob(table_fd, slot, &job, ready_fd);
+    else
+        ret_val = runZeroFillJob(table_fd, slot, &job, ready_fd);
+    if (table_fd == -1)
+        _exit(1);
+
+    if (ret_val == 0) {
+        job.state = VDISK_JOB_DONE;
+        job.offset = job.size;
+    } else if (ret_val == ECANCELED) {
+        job.state = VDISK_JOB_CANCELLED;
+    } else {
+        job.state = VDISK_JOB_FAILED;
+        job.error = ret_val;
+    }
+    job.rate = 0;
+    job.rate_limit = 0;
+    updateJob(table_fd, slot, &job);
+    close(table_fd);
+    _exit(0);
+}
+
+
+/*
+ * Start the process for a job (the record must already say it's running);
+ * we fork twice, with a new session in between, so the job isn't our child
+ * and isn't killed when the terminal goes away. Returns 0 (zero) or the
+ * errno value.
+ */
+static int spawnJobProcess(int slot) {
+    pid_t child_pid = 0;
+    int ready_pipe[2] = {-1, -1};
+    int ret_val = 0, child_status = 0;
+    ssize_t bytes_read = 0;
+
+    if (pipe2(ready_pipe, O_CLOEXEC) == -1)
+        return errno;
+    if ((child_pid = fork()) == -1) {
+        ret_val = errno;
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
+        return ret_val;
+    } else if (child_pid == 0) {
+        /* Child; detach and start the job process */
+        close(ready_pipe[0]);
+        setsid();
+        if ((child_pid = fork()) == 0)
+            runVDiskJob(slot, ready_pipe[1]);
+        _exit((child_pid == -1) ? 1 : 0);
+    }
+
+    /* Parent; reap the child, then wait for the job process to check in
+     * (end of file means it never got that far) */
+    close(ready_pipe[1]);
+    while (waitpid(child_pid, &child_status, 0) == -1 && errno == EINTR)
+        ;
+    while ((bytes_read = read(ready_pipe[0], &ret_val,
+            sizeof (ret_val))) == -1 && errno == EINTR)
+        ;
+    close(ready_pipe[0]);
+    if (bytes_read != sizeof (ret_val))
+        ret_val = ECHILD;
+    return ret_val;
+}
+
+
+/*
+ * Mark a job as failed from the UI side (when its process couldn't be
+ * started).
+ */
+static void failVDiskJob(int slot, int error) {
+    VDISKJOB job = {0};
+    int table_fd = -1;
+
+    if (lockJobTable(LOCK_EX, &table_fd) != 0)
+        return;
+    if (!jobOwned(table_fd, slot) && readJob(table_fd, slot, &job) == 0 &&
+            job.state == VDISK_JOB_RUNNING) {
+        job.state = VDISK_JOB_FAILED;
+        job.error = error;
+        job.updated = time(NULL);
+        writeJob(table_fd, slot, &job);
+    }
+    close(table_fd);
+    return;
+}
+
+
+/*
+ * Add a job of the given type for the (existing) virtual disk file, and
+ * start it in the background; a zero-fill job zeros the file up to 'size'
+ * bytes. A finished job's record is re-used if the table is full. Returns
+ * 0 (zero) or the errno value (ENOSPC if the job table is full).
+ */
+int startVDiskJob(int type, const char path[], off_t size) {
+    VDISKJOB job = {0};
+    int table_fd = -1, slot = 0, free_slot = -1, done_slot = -1, ret_val = 0;
+
+    if (strlen(path) >= VDISK_JOB_PATH_LEN)
+        return ENAMETOOLONG;
+    if ((ret_val = lockJobTable(LOCK_EX, &table_fd)) != 0)
+        return ret_val;
+
+    /* Find a record for the job */
+    for (slot = 0; slot < MAX_VDISK_JOBS; slot++) {
+        if ((ret_val = readJob(table_fd, slot, &job)) != 0)
+            break;
+        if (job.state == VDISK_JOB_FREE && free_slot == -1)
+            free_slot = slot;
+        else if (job.state == VDISK_JOB_DONE && done_slot == -1)
+            done_slot = slot;
+    }
+    slot = (free_slot != -1) ? free_slot : done_slot;
+    if (ret_val == 0 && slot == -1)
+        ret_val = ENOSPC;
+    if (ret_val == 0) {
+        memset(&job, 0, sizeof (VDISKJOB));
+        job.state = VDISK_JOB_RUNNING;
+        job.type = type;
+        snprintf(job.path, VDISK_JOB_PATH_LEN, "%s", path);
+        job.size = size;
+        job.started = time(NULL);
+        job.updated = job.started;
+        ret_val = writeJob(table_fd, slot, &job);
+    }
+    close(table_fd);
+    if (ret_val != 0)
+        return ret_val;
+
+    if ((ret_val = spawnJobProcess(slot)) != 0)
+        failVDiskJob(slot, ret_val);
+    return ret_val;
+}
+
+
+/*
+ * Fill 'jobs' (MAX_VDISK_JOBS records) from the job table; running jobs
+ * without a job process are returned as interrupted. Returns 0 (zero) or
+ * the errno value.
+ */
+int readVDiskJobs(VDISKJOB jobs[]) {
+    int table_fd = -1, slot = 0, ret_val = 0;
+
+    if ((ret_val = lockJobTable(LOCK_SH, &table_fd)) != 0)
+        return ret_val;
+    for (slot = 0; slot < MAX_VDISK_JOBS; slot++) {
+        if ((ret_val = readJob(table_fd, slot, &jobs[slot])) != 0)
+            break;
+        if (jobs[slot].state == VDISK_JOB_RUNNING &&
+                !jobOwned(table_fd, slot))
+            jobs[slot].state = VDISK_JOB_INTERRUPTED;
+    }
+    close(table_fd);
+    return ret_val;
+}
+
+
+/*
+ * Ask a running job to stop; it records its offset so it can be resumed.
+ * Returns 0 (zero) or the errno value.
+ */
+int cancelVDiskJob(int slot) {
+    VDISKJOB job = {0};
+    int table_fd = -1, ret_val = 0;
+
+    if ((ret_val = lockJobTable(LOCK_EX, &table_fd)) != 0)
+        return ret_val;
+    if ((ret_val = readJob(table_fd, slot, &job)) == 0) {
+        if (job.state != VDISK_JOB_RUNNING || !jobOwned(table_fd, slot)) {
+            ret_val = EINVAL;
+        } else {
+            job.cancel = TRUE;
+            ret_val = writeJob(table_fd, slot, &job);
+        }
+    }
+    close(table_fd);
+    return ret_val;
+}
+
+
+/*
+ * Restart a cancelled, failed, or interrupted job from its last recorded
+ * offset. Returns 0 (zero) or the errno value.
+ */
+int resumeVDiskJob(int slot) {
+    VDISKJOB job = {0};
+    int table_fd = -1, ret_val = 0;
+
+    if ((ret_val = lockJobTable(LOCK_EX, &table_fd)) != 0)
+        return ret_val;
+    if ((ret_val = readJob(table_fd, slot, &job)) == 0) {
+        if (jobOwned(table_fd, slot)) {
+            ret_val = EBUSY;
+        } else if (job.state == VDISK_JOB_FREE ||
+                job.state == VDISK_JOB_DONE) {
+            ret_val = EINVAL;
+        } else {
+            job.state = VDISK_JOB_RUNNING;
+            job.cancel = FALSE;
+            job.error = 0;
+            job.rate = 0;
+            job.rate_limit = 0;
+            ret_val = writeJob(table_fd, slot, &job);
+        }
+    }
+    close(table_fd);
+    if (ret_val != 0)
+        return ret_val;
+
+    if ((ret_val = spawnJobProcess(slot)) != 0)
+        failVDiskJob(slot, ret_val);
+    return ret_val;
+}
+
+
+/*
+ * Remove a job (that isn't running) from the job table. Returns 0 (zero)
+ * or the errno value.
+ */
+int removeVDiskJob(int slot) {
+    VDISKJOB job = {0};
+    int table_fd = -1, ret_val = 0;
+
+    if ((ret_val = lockJobTable(LOCK_EX, &table_fd)) != 0)
+        return ret_val;
+    if (jobOwned(table_fd, slot)) {
+        ret_val = EBUSY;
+    } else {
+        memset(&job, 0, sizeof (VDISKJOB));
+        ret_val = writeJob(table_fd, slot, &job);
+    }
+    close(table_fd);
+    return ret_val;
+}
+
+
+/*
+ * Resume any jobs that were interrupted (eg, by a crash or reboot); run
+ * once at start-up. Failures are logged.
+ */
+void resumeVDiskJobs() {
+    VDISKJOB jobs[MAX_VDISK_JOBS];
+    int slot = 0, ret_val = 0;
+
+    if (access(VDISK_JOBS_FILE, F_OK) == -1)
+        return;
+    if ((ret_val = readVDiskJobs(jobs)) != 0) {
+        DEBUG_LOG("readVDiskJobs(): %s", strerror(ret_val));
+        return;
+    }
+    for (slot = 0; slot < MAX_VDISK_JOBS; slot++) {
+        if (jobs[slot].state == VDISK_JOB_INTERRUPTED &&
+                (ret_val = resumeVDiskJob(slot)) != 0)
+            DEBUG_LOG("resumeVDiskJob(): %s", strerror(ret_val));
+    }
+    return;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file jobs.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _JOBS_H
+#define	_JOBS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <time.h>
+#include <cdk.h>
+
+/* Background virtual disk job settings; the job table is a fixed array of
+ * records in VDISK_JOBS_FILE */
+#define VDISK_JOBS_DIR          "/var/lib/esos"
+#define VDISK_JOBS_FILE         "/var/lib/esos/vdisk_jobs"
+#define MAX_VDISK_JOBS          16
+#define VDISK_JOB_PATH_LEN      256
+#define VDISK_JOB_UPDATE_SECS   1
+#define VDISK_JOB_NICE          10
+/* Best-effort I/O class, lowest priority, for this process (see
+ * ioprio_set(2)) */
+#define VDISK_JOB_IOPRIO        ((2 << 13) | 7)
+#define VDISK_JOB_IOPRIO_WHO    1
+
+/* Job states; a job that is "running" without a live job process (it
+ * holds a lock on its record) was interrupted */
+#define VDISK_JOB_FREE          0
+#define VDISK_JOB_RUNNING       1
+#define VDISK_JOB_DONE          2
+#define VDISK_JOB_FAILED        3
+#define VDISK_JOB_CANCELLED     4
+#define VDISK_JOB_INTERRUPTED   5
+
+/* Job types */
+#define VDISK_JOB_ZERO_FILL     0
+#define VDISK_JOB_DEFRAG        1
+#define VDISK_JOB_RECLAIM       2
+
+/* One record in the job table; this is the on-disk format */
+typedef struct vdisk_job VDISKJOB;
+struct vdisk_job {
+    /* One of the VDISK_JOB_* states and types */
+    int state;
+    int type;
+    /* Set by the UI to ask the job process to stop */
+    boolean cancel;
+    /* Process running the job (informational) */
+    pid_t pid;
+    /* Virtual disk file the job is for */
+    char path[VDISK_JOB_PATH_LEN];
+    /* File size; everything before 'offset' has been done */
+    off_t size;
+    off_t offset;
+    /* Bytes per second over the last update */
+    long long rate;
+    /* Fill governor: the current byte rate limit (0 if not throttled) and
+     * the front-end latency on the backing device (milliseconds) */
+    long long rate_limit;
+    unsigned long latency_ms;
+    /* Defrag: the file's extent count before we started and when we
+     * stopped (-1 if the file system can't tell us) */
+    long extents_before;
+    long extents_after;
+    /* Reclaim: bytes punched out so far */
+    off_t reclaimed;
+    /* Wall clock times the job was (re)started and last updated */
+    time_t started;
+    time_t updated;
+    /* The errno value for a failed job */
+    int error;
+};
+
+/* Function prototypes */
+int startVDiskJob(int type, const char path[], off_t size);
+int readVDiskJobs(VDISKJOB jobs[]);
+int cancelVDiskJob(int slot);
+int resumeVDiskJob(int slot);
+int removeVDiskJob(int slot);
+void resumeVDiskJobs();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _JOBS_H */
@@ -23,6 +23,7 @@
 #include "system.h"
 #include "dialogs.h"
 #include "strings.h"
+#include "jobs.h"
 
 int main(int argc, char** argv) {
     CDKSCREEN *cdk_screen = 0;
@@ -55,6 +56,9 @@ int main(int argc, char** argv) {
     /* Check if there is Internet access */
     inet_works = checkInetAccess();
 
+    /* Pick up any virtual disk jobs that were interrupted */
+    resumeVDiskJobs();
+
     /* Initialize screen and check size */
 start:
     main_window = initscr();
@@ -97,6 +101,8 @@ start:
             "</B>CRM Status        <!B>";
     menu_list[SYSTEM_MENU][SYSTEM_DATE_TIME] = \
             "</B>Date/Time Settings<!B>";
+    menu_list[SYSTEM_MENU][SYSTEM_CPU_AFFINITY] = \
+            "</B>CPU Affinity      <!B>";
 
     menu_list[BACK_STORAGE_MENU][0] = "</29/B/U>B<!29><!U>ack-End "
             "Storage  <!B>";
@@ -124,8 +130,16 @@ start:
             "</B>Add Virt Disk File  <!B>";
     menu_list[BACK_STORAGE_MENU][BACK_STORAGE_DEL_VDISK_FILE] = \
             "</B>Delete Virt Dsk File<!B>";
+    menu_list[BACK_STORAGE_MENU][BACK_STORAGE_CLONE_VDISK_FILE] = \
+            "</B>Clone Virt Disk File<!B>";
+    menu_list[BACK_STORAGE_MENU][BACK_STORAGE_DEFRAG_VDISK_FILE] = \
+            "</B>Defrag Virt Disk    <!B>";
+    menu_list[BACK_STORAGE_MENU][BACK_STORAGE_RECLAIM_VDISK_FILE] = \
+            "</B>Reclaim Virt Disk   <!B>";
     menu_list[BACK_STORAGE_MENU][BACK_STORAGE_VDISK_FILE_LIST] = \
             "</B>Virt Disk File List <!B>";
+    menu_list[BACK_STORAGE_MENU][BACK_STORAGE_VDISK_JOBS] = \
+            "</B>Virt Disk Jobs      <!B>";
 
     menu_list[HOSTS_MENU][0] = "</29/B/U>H<!29><!U>osts  <!B>";
     menu_list[HOSTS_MENU][HOSTS_ADD_GROUP] = \
@@ -142,8 +156,16 @@ start:
             "</B>LUN/Group Layout   <!B>";
     menu_list[DEVICES_MENU][DEVICES_DEV_INFO] = \
             "</B>Device Information <!B>";
+    menu_list[DEVICES_MENU][DEVICES_DEV_PATHS] = \
+            "</B>Device Paths       <!B>";
     menu_list[DEVICES_MENU][DEVICES_ADD_DEV] = \
             "</B>Add Device         <!B>";
+    menu_list[DEVICES_MENU][DEVICES_BULK_ADD_DEV] = \
+            "</B>Bulk Add Devices   <!B>";
+    menu_list[DEVICES_MENU][DEVICES_TUNE_DEV] = \
+            "</B>Tune Device        <!B>";
+    menu_list[DEVICES_MENU][DEVICES_REBALANCE_DEVS] = \
+            "</B>Rebalance Threads  <!B>";
     menu_list[DEVICES_MENU][DEVICES_REM_DEV] = \
             "</B>Remove Device      <!B>";
     menu_list[DEVICES_MENU][DEVICES_MAP_TO] = \
@@ -198,13 +220,13 @@ start:
             "</B>About        <!B>";
 
     /* Set menu sizes and locations */
-    submenu_size[SYSTEM_MENU]       = 12;
+    submenu_size[SYSTEM_MENU]       = 13;
     menu_loc[SYSTEM_MENU]           = LEFT;
-    submenu_size[BACK_STORAGE_MENU] = 14;
+    submenu_size[BACK_STORAGE_MENU] = 18;
     menu_loc[BACK_STORAGE_MENU]     = LEFT;
     submenu_size[HOSTS_MENU]        = 5;
     menu_loc[HOSTS_MENU]            = LEFT;
-    submenu_size[DEVICES_MENU]      = 7;
+    submenu_size[DEVICES_MENU]      = 11;
     menu_loc[DEVICES_MENU]          = LEFT;
     submenu_size[TARGETS_MENU]      = 7;
     menu_loc[TARGETS_MENU]          = LEFT;
@@ -247,8 +269,16 @@ start:
                 "functions will not work. Check the '/var/log/boot' file.");
     }
 
-    /* Loop, refreshing the labels and waiting for input */
-    halfdelay(REFRESH_DELAY);
+    /* Start collecting SCST data in the background (if that fails, the
+     * labels still work, the data is just collected in this thread) */
+    startSCSTCollector();
+
+    /* MegaCLI queries run in the background too (once the MegaRAID
+     * dialogs are used); the dialogs read the cached data */
+    startMRRefresher();
+
+    /* Loop, refreshing the labels and waiting for input (or events) */
+    cbreak();
     for (;;) {
         /* Update the information labels */
         if (!updateInfoLabels(cdk_screen, &targets_label, &sessions_label,
@@ -257,10 +287,10 @@ start:
                 &last_tgt_lbl_rows, &last_sess_lbl_rows))
             goto quit;
 
-        /* Get user input */
+        /* Get user input; ERR means the labels need a refresh */
         wrefresh(sub_window);
         keypad(sub_window, TRUE);
-        key_pressed = wgetch(sub_window);
+        key_pressed = waitMainEvent(sub_window);
 
         /* Check and see what we got */
         if (key_pressed == 's' || key_pressed == 'S') {
@@ -305,6 +335,11 @@ start:
             setCDKMenu(menu, INTERFACE_MENU, 0, A_NORMAL, COLOR_MENU_TEXT);
             selection = activateCDKMenu(menu, 0);
 
+        } else if (key_pressed == 'o' || key_pressed == 'O') {
+            /* Change the sessions label sort order */
+            nextSessionSortKey();
+            continue;
+
         } else if (key_pressed == KEY_RESIZE) {
             /* Screen re-size */
             screenResize(cdk_screen, main_window, sub_window,
@@ -312,7 +347,7 @@ start:
             continue;
 
         } else if (key_pressed == ERR) {
-            /* Looks like the user didn't press anything (half-delay mode) */
+            /* Timer, configuration, or device event (no key pressed) */
             continue;
 
         } else {
@@ -457,6 +492,11 @@ start:
                 /* Date & Time Settings dialog */
                 dateTimeDialog(cdk_screen);
 
+            } else if (menu_choice == SYSTEM_MENU &&
+                    submenu_choice == SYSTEM_CPU_AFFINITY - 1) {
+                /* CPU Affinity dialog */
+                affinityDialog(cdk_screen);
+
             } else if (menu_choice == BACK_STORAGE_MENU &&
                     submenu_choice == BACK_STORAGE_ADP_PROP - 1) {
                 /* Adapter Properties dialog */
@@ -517,11 +557,31 @@ start:
                 /* Delete Virtual Disk File dialog */
                 delVDiskFileDialog(cdk_screen);
 
+            } else if (menu_choice == BACK_STORAGE_MENU &&
+                    submenu_choice == BACK_STORAGE_CLONE_VDISK_FILE - 1) {
+                /* Clone Virtual Disk File dialog */
+                cloneVDiskFileDialog(cdk_screen);
+
+            } else if (menu_choice == BACK_STORAGE_MENU &&
+                    submenu_choice == BACK_STORAGE_DEFRAG_VDISK_FILE - 1) {
+                /* Defragment Virtual Disk File dialog */
+                defragVDiskFileDialog(cdk_screen);
+
+            } else if (menu_choice == BACK_STORAGE_MENU &&
+                    submenu_choice == BACK_STORAGE_RECLAIM_VDISK_FILE - 1) {
+                /* Reclaim Virtual Disk File dialog */
+                reclaimVDiskFileDialog(cdk_screen);
+
             } else if (menu_choice == BACK_STORAGE_MENU &&
                     submenu_choice == BACK_STORAGE_VDISK_FILE_LIST - 1) {
                 /* Virtual Disk File List dialog */
                 vdiskFileListDialog(cdk_screen);
 
+            } else if (menu_choice == BACK_STORAGE_MENU &&
+                    submenu_choice == BACK_STORAGE_VDISK_JOBS - 1) {
+                /* Virtual Disk Jobs dialog */
+                vdiskJobsDialog(cdk_screen);
+
             } else if (menu_choice == ALUA_MENU &&
                     submenu_choice == ALUA_DEV_GRP_LAYOUT - 1) {
                 /* Device/Target Group Layout dialog */
@@ -597,11 +657,31 @@ start:
                 /* Device Information dialog */
                 devInfoDialog(cdk_screen);
 
+            } else if (menu_choice == DEVICES_MENU &&
+                    submenu_choice == DEVICES_DEV_PATHS - 1) {
+                /* Device Paths dialog */
+                devPathsDialog(cdk_screen);
+
             } else if (menu_choice == DEVICES_MENU &&
                     submenu_choice == DEVICES_ADD_DEV - 1) {
                 /* Add Device dialog */
                 addDeviceDialog(cdk_screen);
 
+            } else if (menu_choice == DEVICES_MENU &&
+                    submenu_choice == DEVICES_BULK_ADD_DEV - 1) {
+                /* Bulk Add Devices dialog */
+                bulkAddDeviceDialog(cdk_screen);
+
+            } else if (menu_choice == DEVICES_MENU &&
+                    submenu_choice == DEVICES_TUNE_DEV - 1) {
+                /* Tune Device dialog */
+                tuneDeviceDialog(cdk_screen);
+
+            } else if (menu_choice == DEVICES_MENU &&
+                    submenu_choice == DEVICES_REBALANCE_DEVS - 1) {
+                /* Rebalance Threads dialog */
+                rebalanceDevicesDialog(cdk_screen);
+
             } else if (menu_choice == DEVICES_MENU &&
                     submenu_choice == DEVICES_REM_DEV - 1) {
                 /* Delete Device dialog */
@@ -656,9 +736,6 @@ start:
             refreshCDKScreen(cdk_screen);
             curs_set(0);
         }
-
-        /* Done with the menu, go back to half-delay mode */
-        halfdelay(REFRESH_DELAY);
     }
 
     /* All done -- clean up */
@@ -672,6 +749,10 @@ quit:
     }
     delwin(sub_window);
     delwin(main_window);
+    closeMainEvents();
+    closeSCSTSnapshot();
+    closeMRRefresher();
+    closeTopology();
     for (i = 0; i < MAX_INFO_LABEL_ROWS; i++) {
         FREE_NULL(tgt_label_msg[i]);
         FREE_NULL(sess_label_msg[i]);
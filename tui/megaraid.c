@@ -13,13 +13,555 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <syslog.h>
 #include <assert.h>
+#include <time.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #include "prototypes.h"
 #include "system.h"
 #include "dialogs.h"
 #include "megaraid.h"
 
+/* Set up new MegaCLI records */
+static void mrInitAdapter(void *record, int adapter_id);
+static void mrInitDisk(void *record, int adapter_id);
+static void mrInitLDrive(void *record, int adapter_id);
+static void mrInitEnclosure(void *record, int adapter_id);
+
+/* The bulk MegaCLI queries, indexed by MR_CACHE_* section */
+static const MRSECTION mr_sections[MR_CACHE_SECTIONS] = {
+    {"-AdpAllInfo", NULL, offsetof(MRCACHE, adapter), 0,
+            sizeof (MRADAPTER), 1, mrInitAdapter},
+    {"-PDList", "Enclosure Device ID", offsetof(MRCACHE, disks),
+            offsetof(MRCACHE, disk_cnt), sizeof (MRDISK), MAX_MR_DISKS,
+            mrInitDisk},
+    {"-LDInfo -Lall", "Virtual Drive", offsetof(MRCACHE, ldrives),
+            offsetof(MRCACHE, ldrive_cnt), sizeof (MRLDENTRY), MAX_MR_LDS,
+            mrInitLDrive},
+    {"-EncInfo", "Device ID", offsetof(MRCACHE, enclosures),
+            offsetof(MRCACHE, encl_cnt), sizeof (MRENCL), MAX_MR_ENCLS,
+            mrInitEnclosure}
+};
+
+/* The keys we keep from the bulk queries; a key only sets its field the
+ * first time it is seen in a record (MegaCLI re-uses some key names in
+ * later sub-sections, eg, fan/PSU "Status" lines in -EncInfo) */
+static const MRFIELD mr_fields[] = {
+    {MR_CACHE_ADAPTER, "Product Name",
+            offsetof(MRADAPTER, prod_name), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "Serial No",
+            offsetof(MRADAPTER, serial), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "FW Package Build",
+            offsetof(MRADAPTER, firmware), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "BBU",
+            offsetof(MRADAPTER, bbu), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "Memory Size",
+            offsetof(MRADAPTER, memory), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "Host Interface",
+            offsetof(MRADAPTER, interface), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "Virtual Drives",
+            offsetof(MRADAPTER, logical_drv_cnt), MR_FIELD_INT},
+    {MR_CACHE_ADAPTER, "Disks",
+            offsetof(MRADAPTER, disk_cnt), MR_FIELD_INT},
+    {MR_CACHE_ADAPTER, "Cluster Permitted",
+            offsetof(MRADAPTER, cluster), MR_FIELD_STRING},
+    {MR_CACHE_ADAPTER, "Cluster Active",
+            offsetof(MRADAPTER, cluster_on), MR_FIELD_STRING},
+    {MR_CACHE_DISKS, "Enclosure Device ID",
+            offsetof(MRDISK, enclosure_id), MR_FIELD_INT},
+    {MR_CACHE_DISKS, "Slot Number",
+            offsetof(MRDISK, slot_num), MR_FIELD_INT},
+    {MR_CACHE_DISKS, "PD Type",
+            offsetof(MRDISK, pd_type), MR_FIELD_STRING},
+    {MR_CACHE_DISKS, "Raw Size",
+            offsetof(MRDISK, raw_size), MR_FIELD_STRING},
+    {MR_CACHE_DISKS, "Firmware state",
+            offsetof(MRDISK, state), MR_FIELD_STRING},
+    {MR_CACHE_DISKS, "Inquiry Data",
+            offsetof(MRDISK, inquiry), MR_FIELD_STRING},
+    {MR_CACHE_DISKS, "Link Speed",
+            offsetof(MRDISK, speed), MR_FIELD_STRING},
+    /* If the PD entry has this key, then its part of a logical drive */
+    {MR_CACHE_DISKS, "Drive's position",
+            offsetof(MRDISK, part_of_ld), MR_FIELD_FLAG},
+    {MR_CACHE_LDRIVES, "Virtual Drive",
+            offsetof(MRLDENTRY, ldrive.ldrive_id), MR_FIELD_INT},
+    {MR_CACHE_LDRIVES, "Name",
+            offsetof(MRLDENTRY, props.name), MR_FIELD_STRING},
+    {MR_CACHE_LDRIVES, "RAID Level",
+            offsetof(MRLDENTRY, ldrive.raid_lvl), MR_FIELD_STRING},
+    {MR_CACHE_LDRIVES, "Size",
+            offsetof(MRLDENTRY, ldrive.size), MR_FIELD_STRING},
+    {MR_CACHE_LDRIVES, "State",
+            offsetof(MRLDENTRY, ldrive.state), MR_FIELD_STRING},
+    {MR_CACHE_LDRIVES, "Strip Size",
+            offsetof(MRLDENTRY, ldrive.strip_size), MR_FIELD_STRING},
+    {MR_CACHE_LDRIVES, "Number Of Drives",
+            offsetof(MRLDENTRY, ldrive.drive_cnt), MR_FIELD_INT},
+    {MR_CACHE_LDRIVES, "Current Cache Policy",
+            offsetof(MRLDENTRY, props), MR_FIELD_POLICY},
+    {MR_CACHE_ENCLS, "Device ID",
+            offsetof(MRENCL, device_id), MR_FIELD_INT},
+    {MR_CACHE_ENCLS, "Number of Slots",
+            offsetof(MRENCL, slots), MR_FIELD_INT},
+    {MR_CACHE_ENCLS, "Number of Power Supplies",
+            offsetof(MRENCL, power_supps), MR_FIELD_INT},
+    {MR_CACHE_ENCLS, "Number of Fans",
+            offsetof(MRENCL, fans), MR_FIELD_INT},
+    {MR_CACHE_ENCLS, "Status",
+            offsetof(MRENCL, status), MR_FIELD_STRING},
+    {MR_CACHE_ENCLS, "Vendor Identification",
+            offsetof(MRENCL, vendor), MR_FIELD_STRING},
+    {MR_CACHE_ENCLS, "Product Identification",
+            offsetof(MRENCL, product), MR_FIELD_STRING}
+};
+#define MR_FIELD_CNT (int) (sizeof (mr_fields) / sizeof (*mr_fields))
+
+/* Perfect hash of (section, key) to mr_fields[] index + 1; built once */
+static pthread_once_t mr_key_once = PTHREAD_ONCE_INIT;
+static unsigned char mr_key_index[MR_KEY_HASH_SIZE] = {0};
+static unsigned int mr_key_seed = 0;
+
+/* Per-adapter MegaCLI output cache (allocated on first use) and the
+ * adapter count; all of it is protected by mr_lock */
+static pthread_mutex_t mr_lock = PTHREAD_MUTEX_INITIALIZER;
+static MRCACHE *mr_cache[MAX_ADAPTERS] = {NULL};
+static boolean mr_adp_count_valid = FALSE;
+static int mr_adp_count = 0;
+static time_t mr_adp_count_time = 0, mr_adp_count_used = 0;
+
+/* The refresher thread; it waits on mr_wake_cond (for work, or the poll
+ * timer), and signals mr_loaded_cond after each query */
+static pthread_t mr_thread;
+static pthread_cond_t mr_wake_cond, mr_loaded_cond;
+static boolean mr_refresher_running = FALSE, mr_refresher_stop = FALSE;
+/* Where a query is parsed (outside of the lock); only one query runs at
+ * a time, in the refresher or (without one) the UI thread */
+static MRCACHE *mr_scratch = NULL;
+
+
+/*
+ * Seconds on the monotonic clock, for aging the MegaCLI cache.
+ */
+static time_t mrNow() {
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+
+/*
+ * Copy the value following the first 'separator' in a line of MegaCLI
+ * output (whitespace stripped); an empty string if there isn't one.
+ */
+static void mrLineValue(char line[], char separator, char value[]) {
+    char *position = strchr(line, separator);
+
+    snprintf(value, MAX_MR_ATTR_SIZE, "%s",
+            (position == NULL) ? "" : strStrip(position + 1));
+    return;
+}
+
+
+/*
+ * Fill in the LD cache/write/read/BBU policies (in the form the
+ * '-LDSetProp' option takes) from a MegaCLI cache policy string.
+ */
+static void mrParseCachePolicy(char policy[], MRLDPROPS *ld_props) {
+    /* Write policy */
+    if (strstr(policy, "WriteThrough"))
+        strncpy(ld_props->write_policy, "WT", MAX_MR_ATTR_SIZE);
+    else if (strstr(policy, "WriteBack"))
+        strncpy(ld_props->write_policy, "WB", MAX_MR_ATTR_SIZE);
+    else
+        strncpy(ld_props->write_policy, "UNKNOWN", MAX_MR_ATTR_SIZE);
+
+    /* Read policy */
+    if (strstr(policy, "ReadAheadNone"))
+        strncpy(ld_props->read_policy, "NORA", MAX_MR_ATTR_SIZE);
+    else if (strstr(policy, "ReadAdaptive"))
+        strncpy(ld_props->read_policy, "ADRA", MAX_MR_ATTR_SIZE);
+    else if (strstr(policy, "ReadAhead"))
+        strncpy(ld_props->read_policy, "RA", MAX_MR_ATTR_SIZE);
+    else
+        strncpy(ld_props->read_policy, "UNKNOWN", MAX_MR_ATTR_SIZE);
+
+    /* Cache policy */
+    if (strstr(policy, "Direct"))
+        strncpy(ld_props->cache_policy, "Direct", MAX_MR_ATTR_SIZE);
+    else if (strstr(policy, "Cached"))
+        strncpy(ld_props->cache_policy, "Cached", MAX_MR_ATTR_SIZE);
+    else
+        strncpy(ld_props->cache_policy, "UNKNOWN", MAX_MR_ATTR_SIZE);
+
+    /* BBU cache policy (the case of "bad" varies between commands) */
+    if (strcasestr(policy, "No Write Cache if bad BBU"))
+        strncpy(ld_props->bbu_cache_policy, "NoCachedBadBBU",
+                MAX_MR_ATTR_SIZE);
+    else if (strcasestr(policy, "Write Cache OK if bad BBU"))
+        strncpy(ld_props->bbu_cache_policy, "CachedBadBBU",
+                MAX_MR_ATTR_SIZE);
+    else
+        strncpy(ld_props->bbu_cache_policy, "UNKNOWN", MAX_MR_ATTR_SIZE);
+    return;
+}
+
+
+/*
+ * Hash a MegaCLI key (which isn't NUL terminated) for the given section;
+ * FNV-1a, with a seed chosen so our keys don't collide.
+ */
+static unsigned int mrKeyHash(unsigned int seed, int section,
+        const char *key, size_t length) {
+    unsigned int hash = 2166136261U ^ seed;
+    size_t i = 0;
+
+    hash = (hash ^ (unsigned char) section) * 16777619U;
+    for (i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char) key[i]) * 16777619U;
+    return hash % MR_KEY_HASH_SIZE;
+}
+
+
+/*
+ * Build the key index: find a hash seed that puts every (section, key) in
+ * mr_fields[] in its own slot. This runs once (pthread_once()); after that
+ * the index is read-only, so the parser is safe to use from any thread.
+ */
+static void mrBuildKeyIndex() {
+    unsigned int seed = 0, slot = 0;
+    int i = 0;
+
+    assert(MR_FIELD_CNT < 255);
+    for (seed = 0; seed < MR_MAX_HASH_SEEDS; seed++) {
+        memset(mr_key_index, 0, sizeof (mr_key_index));
+        for (i = 0; i < MR_FIELD_CNT; i++) {
+            slot = mrKeyHash(seed, mr_fields[i].section, mr_fields[i].key,
+                    strlen(mr_fields[i].key));
+            if (mr_key_index[slot] != 0)
+                break;
+            mr_key_index[slot] = (unsigned char) (i + 1);
+        }
+        if (i == MR_FIELD_CNT) {
+            mr_key_seed = seed;
+            return;
+        }
+    }
+    /* Can't happen with a sane MR_KEY_HASH_SIZE */
+    assert(seed < MR_MAX_HASH_SEEDS);
+    return;
+}
+
+
+/*
+ * Find the field for a key in the given section; NULL if we don't want it.
+ */
+static const MRFIELD *mrFindField(int section, const char *key,
+        size_t length) {
+    const MRFIELD *field = NULL;
+    unsigned int slot = 0;
+
+    slot = mrKeyHash(mr_key_seed, section, key, length);
+    if (mr_key_index[slot] == 0)
+        return NULL;
+    field = &mr_fields[mr_key_index[slot] - 1];
+    if (field->section != section || strncmp(field->key, key, length) != 0 ||
+            field->key[length] != '\0')
+        return NULL;
+    return field;
+}
+
+
+/*
+ * Store a MegaCLI value in a record.
+ */
+static void mrStoreField(const MRFIELD *field, char *record, char value[]) {
+    switch (field->type) {
+        case MR_FIELD_STRING:
+            snprintf(record + field->offset, MAX_MR_ATTR_SIZE, "%s", value);
+            break;
+        case MR_FIELD_INT:
+            *((int *) (record + field->offset)) =
+                    (int) strtol(value, NULL, 10);
+            break;
+        case MR_FIELD_FLAG:
+            *((boolean *) (record + field->offset)) = TRUE;
+            break;
+        case MR_FIELD_POLICY:
+            mrParseCachePolicy(value, (MRLDPROPS *) (record + field->offset));
+            break;
+    }
+    return;
+}
+
+
+/*
+ * Parse the output of a bulk MegaCLI query into the cache records for the
+ * section. Each line is split once, at the first colon, into a key and a
+ * value (whitespace trimmed); the key is looked up in the field table and
+ * the value stored in the current record. A section's record key starts a
+ * new record. No state is kept outside of this call and the cache, so
+ * this is reentrant (bench/megaraid_bench.c runs it over saved output).
+ */
+void parseMROutput(FILE *megacli, int section, MRCACHE *cache) {
+    const MRSECTION *sect = &mr_sections[section];
+    const MRFIELD *field = NULL;
+    char line[MAX_MC_LINE] = {0};
+    char *key = NULL, *key_end = NULL, *value = NULL, *record = NULL,
+            *records = (char *) cache + sect->records;
+    int *count = NULL, field_idx = 0;
+    uint64_t fields_set = 0;
+
+    pthread_once(&mr_key_once, mrBuildKeyIndex);
+
+    /* Sections with a record key start empty, otherwise there's just
+     * the one record */
+    if (sect->record_key != NULL) {
+        count = (int *) ((char *) cache + sect->count);
+        *count = 0;
+    } else {
+        record = records;
+        memset(record, 0, sect->record_size);
+        sect->init_record(record, cache->adapter_id);
+    }
+
+    while (fgets(line, sizeof (line), megacli) != NULL) {
+        /* Split the line */
+        if ((value = strchr(line, ':')) == NULL)
+            continue;
+        for (key = line; isspace((unsigned char) *key); key++)
+            ;
+        for (key_end = value; key_end > key &&
+                isspace((unsigned char) *(key_end - 1)); key_end--)
+            ;
+        if (key_end == key)
+            continue;
+        *value = '\0';
+        value = strStrip(value + 1);
+        if ((field = mrFindField(section, key, key_end - key)) == NULL)
+            continue;
+
+        /* New record? */
+        if (sect->record_key != NULL &&
+                strcmp(field->key, sect->record_key) == 0) {
+            if (*count >= sect->max_records) {
+                record = NULL;
+                continue;
+            }
+            record = records + (*count * sect->record_size);
+            (*count)++;
+            memset(record, 0, sect->record_size);
+            sect->init_record(record, cache->adapter_id);
+            fields_set = 0;
+        }
+        if (record == NULL)
+            continue;
+
+        /* The first occurrence of a key in a record wins */
+        field_idx = field - mr_fields;
+        if (fields_set & ((uint64_t) 1 << field_idx))
+            continue;
+        fields_set |= (uint64_t) 1 << field_idx;
+        mrStoreField(field, record, value);
+    }
+
+    /* The logical drive properties need the LD ID */
+    if (section == MR_CACHE_LDRIVES) {
+        for (field_idx = 0; field_idx < *count; field_idx++)
+            cache->ldrives[field_idx].props.ldrive_id =
+                    cache->ldrives[field_idx].ldrive.ldrive_id;
+    }
+    return;
+}
+
+
+/*
+ * Set up a new adapter record.
+ */
+static void mrInitAdapter(void *record, int adapter_id) {
+    ((MRADAPTER *) record)->adapter_id = adapter_id;
+    return;
+}
+
+
+/*
+ * Set up a new disk record; any disk MegaCLI lists is present.
+ */
+static void mrInitDisk(void *record, int adapter_id) {
+    MRDISK *disk = record;
+
+    disk->adapter_id = adapter_id;
+    disk->present = TRUE;
+    disk->part_of_ld = FALSE;
+    return;
+}
+
+
+/*
+ * Set up a new logical drive record.
+ */
+static void mrInitLDrive(void *record, int adapter_id) {
+    MRLDENTRY *entry = record;
+
+    entry->ldrive.adapter_id = adapter_id;
+    entry->props.adapter_id = adapter_id;
+    return;
+}
+
+
+/*
+ * Set up a new enclosure record.
+ */
+static void mrInitEnclosure(void *record, int adapter_id) {
+    ((MRENCL *) record)->adapter_id = adapter_id;
+    return;
+}
+
+
+/*
+ * Copy one section's records (and record count) between caches.
+ */
+static void mrCopySection(MRCACHE *dst, MRCACHE *src, int section) {
+    const MRSECTION *sect = &mr_sections[section];
+
+    memcpy((char *) dst + sect->records, (char *) src + sect->records,
+            sect->max_records * sect->record_size);
+    if (sect->record_key != NULL)
+        *((int *) ((char *) dst + sect->count)) =
+                *((int *) ((char *) src + sect->count));
+    return;
+}
+
+
+/*
+ * Run the bulk MegaCLI query for a section and store the result in the
+ * cache. Called with mr_lock held; the lock is dropped while MegaCLI runs
+ * (the output is parsed into the scratch cache). If the cache was
+ * invalidated in the mean time, the result is thrown away and the section
+ * is left unloaded.
+ */
+static void mrLoadSection(MRCACHE *cache, int section) {
+    FILE *megacli = NULL;
+    char *command = NULL;
+    unsigned long generation = cache->generation;
+    int status = 0;
+
+    if (mr_scratch == NULL &&
+            (mr_scratch = calloc(1, sizeof (MRCACHE))) == NULL) {
+        status = -1;
+    } else {
+        mr_scratch->adapter_id = cache->adapter_id;
+        pthread_mutex_unlock(&mr_lock);
+
+        /* MegaCLI command */
+        SAFE_ASPRINTF(&command, "%s %s -a%d -NoLog 2>&1", MEGACLI_BIN,
+                mr_sections[section].query, cache->adapter_id);
+        if ((megacli = popen(command, "r")) == NULL) {
+            status = -1;
+        } else {
+            parseMROutput(megacli, section, mr_scratch);
+            status = pclose(megacli);
+        }
+        FREE_NULL(command);
+        pthread_mutex_lock(&mr_lock);
+    }
+
+    if (cache->generation == generation) {
+        if (status != -1)
+            mrCopySection(cache, mr_scratch, section);
+        cache->status[section] = status;
+        cache->loaded[section] = TRUE;
+        cache->load_time[section] = mrNow();
+    }
+    pthread_cond_broadcast(&mr_loaded_cond);
+    return;
+}
+
+
+/*
+ * Wake the refresher thread up (mr_lock held).
+ */
+static void mrKickRefresher() {
+    pthread_cond_signal(&mr_wake_cond);
+    return;
+}
+
+
+/*
+ * Get the cache for an adapter with the given section loaded; on success,
+ * mr_lock is held and the caller must mrPutCache() once it has copied
+ * what it needs. With the refresher running we never run MegaCLI here: the
+ * cached data is used as is (the refresher keeps data in use fresh), and
+ * we only wait for the refresher if the section hasn't been loaded yet (or
+ * was invalidated). Without it, the query is run here when the data is
+ * missing or older than MR_CACHE_TTL seconds. The query exit status is
+ * kept in the cache (it's up to the caller what a failure means). Returns
+ * NULL if the adapter ID is out of range or we're out of memory.
+ */
+static MRCACHE *mrGetCache(int adapter_id, int section) {
+    MRCACHE *cache = NULL;
+    time_t now = mrNow();
+
+    if (adapter_id < 0 || adapter_id >= MAX_ADAPTERS)
+        return NULL;
+    pthread_mutex_lock(&mr_lock);
+    if (mr_cache[adapter_id] == NULL) {
+        if ((mr_cache[adapter_id] = calloc(1, sizeof (MRCACHE))) == NULL) {
+            pthread_mutex_unlock(&mr_lock);
+            return NULL;
+        }
+        mr_cache[adapter_id]->adapter_id = adapter_id;
+    }
+    cache = mr_cache[adapter_id];
+    cache->used_time = now;
+
+    if (mr_refresher_running) {
+        while (!cache->loaded[section]) {
+            mrKickRefresher();
+            pthread_cond_wait(&mr_loaded_cond, &mr_lock);
+        }
+    } else if (!cache->loaded[section] ||
+            (now - cache->load_time[section]) >= MR_CACHE_TTL) {
+        mrLoadSection(cache, section);
+    }
+    return cache;
+}
+
+
+/*
+ * Done with the cache from mrGetCache().
+ */
+static void mrPutCache() {
+    pthread_mutex_unlock(&mr_lock);
+    return;
+}
+
+
+/*
+ * Throw away the cached MegaCLI data for an adapter; we do this after
+ * changing anything on it. The refresher re-loads it right away.
+ */
+static void mrInvalidateCache(int adapter_id) {
+    int i = 0;
+
+    if (adapter_id < 0 || adapter_id >= MAX_ADAPTERS)
+        return;
+    pthread_mutex_lock(&mr_lock);
+    if (mr_cache[adapter_id] != NULL) {
+        mr_cache[adapter_id]->generation++;
+        for (i = 0; i < MR_CACHE_SECTIONS; i++)
+            mr_cache[adapter_id]->loaded[i] = FALSE;
+        if (mr_refresher_running)
+            mrKickRefresher();
+    }
+    pthread_mutex_unlock(&mr_lock);
+    return;
+}
+
+
 /*
  * Get MegaCLI version -- just the actual number for now.
  */
@@ -53,9 +595,10 @@ char *getMegaCLIVersion() {
 
 
 /*
- * Get number of adapters (RAID controllers).
+ * Ask MegaCLI for the number of adapters (RAID controllers); -1 if it
+ * isn't working.
  */
-int getMRAdapterCount() {
+static int mrQueryAdapterCount() {
     FILE *megacli = NULL;
     char *command = NULL, *mc_version = NULL;
     int count = 0;
@@ -88,91 +631,180 @@ int getMRAdapterCount() {
 
 
 /*
- * Get adapter attributes from MegaCLI.
+ * Re-load the adapter count; called with mr_lock held (it is dropped
+ * while MegaCLI runs).
  */
-MRADAPTER *getMRAdapter(int adapter_id) {
-    MRADAPTER *adapter = 0;
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    char line[MAX_MC_LINE] = {0};
-    int status = 0;
+static void mrLoadAdapterCount() {
+    int count = 0;
 
-    adapter = (MRADAPTER *) calloc(1, sizeof(MRADAPTER));
-    if (adapter != NULL) {
-        adapter->adapter_id = adapter_id;
+    pthread_mutex_unlock(&mr_lock);
+    count = mrQueryAdapterCount();
+    pthread_mutex_lock(&mr_lock);
+    mr_adp_count = count;
+    mr_adp_count_time = mrNow();
+    mr_adp_count_valid = TRUE;
+    pthread_cond_broadcast(&mr_loaded_cond);
+    return;
+}
 
-        /* MegaCLI command */
-        SAFE_ASPRINTF(&command, "%s -AdpAllInfo -a%d -NoLog 2>&1",
-                MEGACLI_BIN, adapter_id);
-        megacli = popen(command, "r");
 
-        /* Loop over command output */
-        while (fgets(line, sizeof(line), megacli) != NULL) {
-            if (strstr(line, "Product Name    :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->prod_name, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Serial No       :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->serial, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "FW Package Build:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->firmware, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "BBU              :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->bbu, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Memory Size      :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->memory, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Host Interface  :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->interface, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Virtual Drives    :")) {
-                sscanf(line, "%*s %*s %*s %d", &adapter->logical_drv_cnt);
-
-            } else if (strstr(line, "  Disks           :")) {
-                sscanf(line, "%*s %*s %d", &adapter->disk_cnt);
-
-            } else if (strstr(line, "Cluster Permitted     :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->cluster, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Cluster Active        :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(adapter->cluster_on, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
+/*
+ * Find the next thing for the refresher to load: the adapter count, or a
+ * cache section, that the UI has used lately and is missing or getting
+ * old. All of an adapter's sections are kept loaded once the UI uses one
+ * of them (the dialogs use most of them together). Called (and returns)
+ * with mr_lock held. Returns FALSE if there was nothing to do.
+ */
+static boolean mrRefreshNext() {
+    MRCACHE *cache = NULL;
+    time_t now = mrNow();
+    int i = 0, j = 0;
+
+    if (mr_adp_count_used != 0 &&
+            (now - mr_adp_count_used) < MR_CACHE_IDLE_SECS &&
+            (!mr_adp_count_valid ||
+            (now - mr_adp_count_time) >= MR_REFRESH_SECS)) {
+        mrLoadAdapterCount();
+        return TRUE;
+    }
+    for (i = 0; i < MAX_ADAPTERS; i++) {
+        cache = mr_cache[i];
+        if (cache == NULL || (now - cache->used_time) >= MR_CACHE_IDLE_SECS)
+            continue;
+        for (j = 0; j < MR_CACHE_SECTIONS; j++) {
+            if (!cache->loaded[j] ||
+                    (now - cache->load_time[j]) >= MR_REFRESH_SECS) {
+                mrLoadSection(cache, j);
+                return TRUE;
             }
         }
+    }
+    return FALSE;
+}
 
-        /* Done with MegaCLI */
-        status = pclose(megacli);
-        FREE_NULL(command);
-        if (status != 0) {
-            FREE_NULL(adapter);
-            return NULL;
+
+/*
+ * The refresher thread: run the MegaCLI queries whenever there is
+ * something to load, otherwise wait to be kicked (or for the poll timer).
+ */
+static void *mrRefresher(void *arg) {
+    struct timespec deadline = {0};
+
+    pthread_mutex_lock(&mr_lock);
+    while (!mr_refresher_stop) {
+        if (mrRefreshNext())
+            continue;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += MR_REFRESH_POLL_SECS;
+        pthread_cond_timedwait(&mr_wake_cond, &mr_lock, &deadline);
+    }
+    pthread_mutex_unlock(&mr_lock);
+    return arg;
+}
+
+
+/*
+ * Start the MegaCLI refresher thread. Nothing is queried until the UI
+ * first asks for MegaRAID data. If the thread can't be started, the
+ * queries are run by the UI thread as needed. Returns TRUE if it is
+ * running.
+ */
+boolean startMRRefresher() {
+    pthread_condattr_t cond_attr;
+    int ret_val = 0;
+
+    if (mr_refresher_running)
+        return TRUE;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mr_wake_cond, &cond_attr);
+    pthread_cond_init(&mr_loaded_cond, NULL);
+    pthread_condattr_destroy(&cond_attr);
+
+    pthread_mutex_lock(&mr_lock);
+    mr_refresher_stop = FALSE;
+    if ((ret_val = pthread_create(&mr_thread, NULL, mrRefresher,
+            NULL)) == 0)
+        mr_refresher_running = TRUE;
+    else
+        DEBUG_LOG("pthread_create(): %s", strerror(ret_val));
+    pthread_mutex_unlock(&mr_lock);
+    return mr_refresher_running;
+}
+
+
+/*
+ * Stop the refresher thread (waiting for a running query to finish) and
+ * free the cache.
+ */
+void closeMRRefresher() {
+    int i = 0;
+
+    pthread_mutex_lock(&mr_lock);
+    if (mr_refresher_running) {
+        mr_refresher_stop = TRUE;
+        mrKickRefresher();
+        pthread_mutex_unlock(&mr_lock);
+        pthread_join(mr_thread, NULL);
+        pthread_mutex_lock(&mr_lock);
+        mr_refresher_running = FALSE;
+        pthread_cond_destroy(&mr_wake_cond);
+        pthread_cond_destroy(&mr_loaded_cond);
+    }
+    for (i = 0; i < MAX_ADAPTERS; i++)
+        FREE_NULL(mr_cache[i]);
+    FREE_NULL(mr_scratch);
+    mr_adp_count_valid = FALSE;
+    mr_adp_count_used = 0;
+    pthread_mutex_unlock(&mr_lock);
+    return;
+}
+
+
+/*
+ * Get number of adapters (RAID controllers); cached like the rest of the
+ * MegaCLI data (see mrGetCache()).
+ */
+int getMRAdapterCount() {
+    int count = 0;
+    time_t now = mrNow();
+
+    pthread_mutex_lock(&mr_lock);
+    mr_adp_count_used = now;
+    if (mr_refresher_running) {
+        while (!mr_adp_count_valid) {
+            mrKickRefresher();
+            pthread_cond_wait(&mr_loaded_cond, &mr_lock);
         }
+    } else if (!mr_adp_count_valid ||
+            (now - mr_adp_count_time) >= MR_CACHE_TTL) {
+        mrLoadAdapterCount();
+    }
+    count = mr_adp_count;
+    pthread_mutex_unlock(&mr_lock);
+    return count;
+}
+
+
+/*
+ * Get adapter attributes from MegaCLI (cached).
+ */
+MRADAPTER *getMRAdapter(int adapter_id) {
+    MRADAPTER *adapter = 0;
+    MRCACHE *cache = NULL;
+
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_ADAPTER)) == NULL)
+        return NULL;
+    if (cache->status[MR_CACHE_ADAPTER] != 0) {
+        mrPutCache();
+        return NULL;
     }
 
+    adapter = (MRADAPTER *) calloc(1, sizeof(MRADAPTER));
+    if (adapter != NULL)
+        memcpy(adapter, &cache->adapter, sizeof (MRADAPTER));
+    mrPutCache();
+
     /* Done */
     return adapter;
 }
@@ -184,8 +816,8 @@ MRADAPTER *getMRAdapter(int adapter_id) {
 MRADPPROPS *getMRAdapterProps(int adapter_id) {
     MRADPPROPS *adp_props = 0;
     FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    char line[MAX_MC_LINE] = {0};
+    char *command = NULL, *position = NULL;
+    char line[MAX_MC_LINE] = {0}, value[MAX_MR_ATTR_SIZE] = {0};
     int status = 0;
 
     adp_props = (MRADPPROPS *) calloc(1, sizeof(MRADPPROPS));
@@ -198,9 +830,8 @@ MRADPPROPS *getMRAdapterProps(int adapter_id) {
         megacli = popen(command, "r");
         while (fgets(line, sizeof(line), megacli) != NULL) {
             if (strstr(line, "Cache Flush Interval")) {
-                strtok_result = strtok(line, "=");
-                strtok_result = strtok(NULL, "=");
-                sscanf(strStrip(strtok_result), "%d", &adp_props->cache_flush);
+                mrLineValue(line, '=', value);
+                sscanf(value, "%d", &adp_props->cache_flush);
             }
         }
         status = pclose(megacli);
@@ -215,9 +846,8 @@ MRADPPROPS *getMRAdapterProps(int adapter_id) {
         megacli = popen(command, "r");
         while (fgets(line, sizeof(line), megacli) != NULL) {
             if (strstr(line, "Rebuild Rate")) {
-                strtok_result = strtok(line, "=");
-                strtok_result = strtok(NULL, "=");
-                sscanf(strStrip(strtok_result), "%d", &adp_props->rebuild_rate);
+                mrLineValue(line, '=', value);
+                sscanf(value, "%d", &adp_props->rebuild_rate);
             }
         }
         status = pclose(megacli);
@@ -232,12 +862,11 @@ MRADPPROPS *getMRAdapterProps(int adapter_id) {
         megacli = popen(command, "r");
         while (fgets(line, sizeof(line), megacli) != NULL) {
             if (strstr(line, "Cluster :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strtok_result = strtok(NULL, ":");
-                if (strcmp(strStrip(strtok_result), "Enabled") == 0) {
+                /* The value is after the last colon */
+                position = strStrip(strrchr(line, ':') + 1);
+                if (strcmp(position, "Enabled") == 0) {
                     adp_props->cluster = TRUE;
-                } else if (strcmp(strStrip(strtok_result), "Disabled") == 0) {
+                } else if (strcmp(position, "Disabled") == 0) {
                     adp_props->cluster = FALSE;
                 }
             }
@@ -254,13 +883,10 @@ MRADPPROPS *getMRAdapterProps(int adapter_id) {
         megacli = popen(command, "r");
         while (fgets(line, sizeof(line), megacli) != NULL) {
             if (strstr(line, "NCQ Status is")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (strcmp(strStrip(strtok_result),
-                        "NCQ Status is Enabled") == 0) {
+                mrLineValue(line, ':', value);
+                if (strcmp(value, "NCQ Status is Enabled") == 0) {
                     adp_props->ncq = TRUE;
-                } else if (strcmp(strStrip(strtok_result),
-                        "NCQ Status is Disabled") == 0) {
+                } else if (strcmp(value, "NCQ Status is Disabled") == 0) {
                     adp_props->ncq = FALSE;
                 }
             }
@@ -279,9 +905,9 @@ MRADPPROPS *getMRAdapterProps(int adapter_id) {
 
 
 /*
- * Set adapter properties via MegaCLI.
+ * Set adapter properties via MegaCLI (the caller takes care of the cache).
  */
-int setMRAdapterProps(MRADPPROPS *adp_props) {
+static int mrSetAdapterProps(MRADPPROPS *adp_props) {
     char *command = NULL;
     int status = 0;
 
@@ -364,84 +990,50 @@ int setMRAdapterProps(MRADPPROPS *adp_props) {
 
 
 /*
- * Get MegaRAID disk information.
+ * Set adapter properties via MegaCLI. The cached data is thrown away
+ * before and after, so a refresh that overlaps the change isn't kept.
+ */
+int setMRAdapterProps(MRADPPROPS *adp_props) {
+    int ret_val = 0;
+
+    mrInvalidateCache(adp_props->adapter_id);
+    ret_val = mrSetAdapterProps(adp_props);
+    mrInvalidateCache(adp_props->adapter_id);
+    return ret_val;
+}
+
+
+/*
+ * Get MegaRAID disk information (cached); all of the disks on the adapter
+ * come from one MegaCLI query, so walking the slots is cheap.
  */
 MRDISK *getMRDisk(int adapter_id, int encl_id, int slot) {
     MRDISK *disk = 0;
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    char line[MAX_MC_LINE] = {0};
-    int status = 0;
+    MRCACHE *cache = NULL;
+    int i = 0;
+
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_DISKS)) == NULL)
+        return NULL;
+    if (cache->status[MR_CACHE_DISKS] != 0) {
+        mrPutCache();
+        return NULL;
+    }
 
     disk = (MRDISK *) calloc(1, sizeof(MRDISK));
     if (disk != NULL) {
         disk->adapter_id = adapter_id;
-        disk->present = TRUE;
+        /* A disk isn't present in the specified slot unless we find it */
+        disk->present = FALSE;
         disk->part_of_ld = FALSE;
-
-        /* MegaCLI command */
-        SAFE_ASPRINTF(&command, "%s -pdInfo -PhysDrv[%d:%d] -a%d -NoLog 2>&1",
-                MEGACLI_BIN, encl_id, slot, adapter_id);
-        megacli = popen(command, "r");
-
-        /* Loop over command output */
-        while (fgets(line, sizeof(line), megacli) != NULL) {
-            if (strstr(line, "is not found.")) {
-                /* A disk isn't present in the specified slot */
-                disk->present = FALSE;
-                continue;
-
-            } else if (strstr(line, "Enclosure Device ID:")) {
-                sscanf(line, "%*s %*s %*s %d", &disk->enclosure_id);
-
-            } else if (strstr(line, "Slot Number:")) {
-                sscanf(line, "%*s %*s %d", &disk->slot_num);
-
-            } else if (strstr(line, "PD Type:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(disk->pd_type, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Raw Size:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(disk->raw_size, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Firmware state:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(disk->state, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Inquiry Data:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(disk->inquiry, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Link Speed:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(disk->speed, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Drive's position:")) {
-                /* If the PD entry contains the string above, then its
-                 * part of a logical drive (LD). */
-                disk->part_of_ld = TRUE;
+        for (i = 0; i < cache->disk_cnt; i++) {
+            if (cache->disks[i].enclosure_id == encl_id &&
+                    cache->disks[i].slot_num == slot) {
+                memcpy(disk, &cache->disks[i], sizeof (MRDISK));
+                break;
             }
         }
-
-        /* Done with MegaCLI */
-        status = pclose(megacli);
-        FREE_NULL(command);
-        if (status != 0) {
-            FREE_NULL(disk);
-            return NULL;
-        }
     }
+    mrPutCache();
 
     /* Done */
     return disk;
@@ -449,91 +1041,27 @@ MRDISK *getMRDisk(int adapter_id, int encl_id, int slot) {
 
 
 /*
- * Get MegaRAID enclosure information; not happy about how this is
- * implemented -- if LSI could have just made all of the MegaCLI commands
- * uniform (eg, be able to specify an enclosure like you specify an adapter)!
+ * Get MegaRAID enclosure information (cached); the enclosures are numbered
+ * in the order MegaCLI lists them, not by their device ID.
  */
 MRENCL *getMREnclosure(int adapter_id, int encl_id) {
     MRENCL *enclosure = 0;
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    char line[MAX_MC_LINE] = {0};
-    int status = 0;
-    int counters[] = {0, 0, 0, 0, 0, 0, 0};
+    MRCACHE *cache = NULL;
+
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_ENCLS)) == NULL)
+        return NULL;
+    if (cache->status[MR_CACHE_ENCLS] != 0) {
+        mrPutCache();
+        return NULL;
+    }
 
     enclosure = (MRENCL *) calloc(1, sizeof(MRENCL));
     if (enclosure != NULL) {
         enclosure->adapter_id = adapter_id;
-
-        /* MegaCLI command */
-        SAFE_ASPRINTF(&command, "%s -EncInfo -a%d -NoLog 2>&1",
-                MEGACLI_BIN, adapter_id);
-        megacli = popen(command, "r");
-
-        /* Loop over command output */
-        while (fgets(line, sizeof(line), megacli) != NULL) {
-            if (strstr(line, "    Device ID                     :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[0] == encl_id)
-                    sscanf(strtok_result, " %d", &enclosure->device_id);
-                counters[0]++;
-
-            } else if (strstr(line, "    Number of Slots               :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[1] == encl_id)
-                    sscanf(strtok_result, " %d", &enclosure->slots);
-                counters[1]++;
-
-            } else if (strstr(line, "    Number of Power Supplies      :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[2] == encl_id)
-                    sscanf(strtok_result, " %d", &enclosure->power_supps);
-                counters[2]++;
-
-            } else if (strstr(line, "    Number of Fans                :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[3] == encl_id)
-                    sscanf(strtok_result, " %d", &enclosure->fans);
-                counters[3]++;
-
-            } else if (strstr(line, "    Status                        :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[4] == encl_id)
-                    strncpy(enclosure->status, strStrip(strtok_result),
-                            MAX_MR_ATTR_SIZE);
-                counters[4]++;
-
-            } else if (strstr(line, "        Vendor Identification     :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[5] == encl_id)
-                    strncpy(enclosure->vendor, strStrip(strtok_result),
-                            MAX_MR_ATTR_SIZE);
-                counters[5]++;
-
-            } else if (strstr(line, "        Product Identification    :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                if (counters[6] == encl_id)
-                    strncpy(enclosure->product, strStrip(strtok_result),
-                            MAX_MR_ATTR_SIZE);
-                counters[6]++;
-            }
-        }
-
-        /* Done with MegaCLI */
-        status = pclose(megacli);
-        FREE_NULL(command);
-        if (status != 0) {
-            FREE_NULL(enclosure);
-            return NULL;
-        }
+        if (encl_id >= 0 && encl_id < cache->encl_cnt)
+            memcpy(enclosure, &cache->enclosures[encl_id], sizeof (MRENCL));
     }
+    mrPutCache();
 
     /* Done */
     return enclosure;
@@ -541,138 +1069,71 @@ MRENCL *getMREnclosure(int adapter_id, int encl_id) {
 
 
 /*
- * Get a count of the enclosures for the specified adapter.
+ * Get a count of the enclosures for the specified adapter (cached).
  */
 int getMREnclCount(int adapter_id) {
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    int status = 0, count = 0;
-    char line[MAX_MC_LINE] = {0};
-
-    /* MegaCLI command */
-    SAFE_ASPRINTF(&command, "%s -EncInfo -a%d -NoLog 2>&1", MEGACLI_BIN, adapter_id);
-    megacli = popen(command, "r");
+    MRCACHE *cache = NULL;
+    int encl_cnt = 0;
 
-    /* Loop over command output */
-    while (fgets(line, sizeof(line), megacli) != NULL) {
-        if (strstr(line, "    Number of enclosures on adapter")) {
-            strtok_result = strtok(line, "--");
-            strtok_result = strtok(NULL, "--");
-            sscanf(strtok_result, " %d", &count);
-        }
-    }
-
-    /* Done with MegaCLI */
-    status = pclose(megacli);
-    FREE_NULL(command);
-    if (status != 0) {
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_ENCLS)) == NULL)
         return -1;
-    }
+    encl_cnt = (cache->status[MR_CACHE_ENCLS] != 0) ? -1 : cache->encl_cnt;
+    mrPutCache();
 
     /* Done */
-    return count;
+    return encl_cnt;
 }
 
 
 /*
- * Get count of MegaRAID logical (virtual) drives for given adapter.
+ * Get count of MegaRAID logical (virtual) drives for given adapter
+ * (cached). We only fail if MegaCLI couldn't be run at all; it exits
+ * with an error when there are no LDs on the adapter.
  */
 int getMRLDCount(int adapter_id) {
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL, *mc_version = NULL;
-    int count = 0;
-    char line[MAX_MC_LINE] = {0};
+    MRCACHE *cache = NULL;
+    int ldrive_cnt = 0;
 
-    /* A cheezy check to see if MegaCLI is "working" -- see comments below */
-    mc_version = getMegaCLIVersion();
-    if (!mc_version) {
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_LDRIVES)) == NULL)
         return -1;
-    }
-
-    /* MegaCLI command */
-    SAFE_ASPRINTF(&command, "%s -LDGetNum -a%d -NoLog 2>&1",
-            MEGACLI_BIN, adapter_id);
-    megacli = popen(command, "r");
-
-    /* Loop over command output */
-    while (fgets(line, sizeof(line), megacli) != NULL) {
-        if (strstr(line, "Number of Virtual Drives Configured on Adapter")) {
-            strtok_result = strtok(line, ":");
-            strtok_result = strtok(NULL, ":");
-            sscanf(strtok_result, " %d", &count);
-        }
-    }
-
-    /* For this one we ignore the exit code -- when using the 'LDGetNum' option
-     * with MegaCLI, it also returns the LD count as the exit code */
-    pclose(megacli);
+    ldrive_cnt = (cache->status[MR_CACHE_LDRIVES] == -1) ? -1 :
+            cache->ldrive_cnt;
+    mrPutCache();
 
     /* Done */
-    FREE_NULL(command);
-    return count;
+    return ldrive_cnt;
 }
 
 
 /*
- * Get MegaRAID logical drive information.
+ * Get MegaRAID logical drive information (cached).
  */
 MRLDRIVE *getMRLogicalDrive(int adapter_id, int ldrive_id) {
     MRLDRIVE *logical_drive = 0;
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    char line[MAX_MC_LINE] = {0};
-    int status = 0;
-
-    logical_drive = (MRLDRIVE *) calloc(1, sizeof(MRLDRIVE));
-    if (logical_drive != NULL) {
-        logical_drive->adapter_id = adapter_id;
-        logical_drive->ldrive_id = ldrive_id;
+    MRCACHE *cache = NULL;
+    int i = 0;
 
-        /* MegaCLI command */
-        SAFE_ASPRINTF(&command, "%s -LDInfo -L%d -a%d -NoLog 2>&1",
-                MEGACLI_BIN, ldrive_id, adapter_id);
-        megacli = popen(command, "r");
-
-        /* Loop over command output */
-        while (fgets(line, sizeof(line), megacli) != NULL) {
-            if (strstr(line, "RAID Level          :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(logical_drive->raid_lvl, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Size                :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(logical_drive->size, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "State               :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(logical_drive->state, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Strip Size          :")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(logical_drive->strip_size, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-
-            } else if (strstr(line, "Number Of Drives    :")) {
-                sscanf(line, "%*s %*s %*s %*s %d", &logical_drive->drive_cnt);
-            }
-        }
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_LDRIVES)) == NULL)
+        return NULL;
+    if (cache->status[MR_CACHE_LDRIVES] != 0) {
+        mrPutCache();
+        return NULL;
+    }
 
-        /* Done with MegaCLI */
-        status = pclose(megacli);
-        FREE_NULL(command);
-        if (status != 0) {
-            FREE_NULL(logical_drive);
-            return NULL;
-        }
+    for (i = 0; i < cache->ldrive_cnt; i++) {
+        if (cache->ldrives[i].ldrive.ldrive_id == ldrive_id)
+            break;
+    }
+    if (i == cache->ldrive_cnt) {
+        mrPutCache();
+        return NULL;
     }
 
+    logical_drive = (MRLDRIVE *) calloc(1, sizeof(MRLDRIVE));
+    if (logical_drive != NULL)
+        memcpy(logical_drive, &cache->ldrives[i].ldrive, sizeof (MRLDRIVE));
+    mrPutCache();
+
     /* Done */
     return logical_drive;
 }
@@ -682,7 +1143,7 @@ MRLDRIVE *getMRLogicalDrive(int adapter_id, int ldrive_id) {
  */
 int getMRLDDisks(int adapter_id, int ldrive_id, int encl_ids[], int slots[]) {
     FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL, *vdrive_line = NULL;
+    char *command = NULL, *vdrive_line = NULL;
     char line[MAX_MC_LINE] = {0};
     boolean ld_start = FALSE;
     int status = 0, ld_drv_cnt = 0, encl_count = 0, slot_count = 0;
@@ -702,22 +1163,16 @@ int getMRLDDisks(int adapter_id, int ldrive_id, int encl_ids[], int slots[]) {
 
         } else if (ld_start && strstr(line, "Number Of Drives    :") &&
                 ld_drv_cnt == 0) {
-            strtok_result = strtok(line, ":");
-            strtok_result = strtok(NULL, ":");
-            sscanf(strtok_result, " %d", &ld_drv_cnt);
+            sscanf(strchr(line, ':') + 1, " %d", &ld_drv_cnt);
 
         } else if (ld_start && strstr(line, "Enclosure Device ID:") &&
                 encl_count < ld_drv_cnt) {
-            strtok_result = strtok(line, ":");
-            strtok_result = strtok(NULL, ":");
-            sscanf(strtok_result, " %d", &encl_ids[encl_count]);
+            sscanf(strchr(line, ':') + 1, " %d", &encl_ids[encl_count]);
             encl_count++;
 
         } else if (ld_start && strstr(line, "Slot Number:") &&
                 slot_count < ld_drv_cnt) {
-            strtok_result = strtok(line, ":");
-            strtok_result = strtok(NULL, ":");
-            sscanf(strtok_result, " %d", &slots[slot_count]);
+            sscanf(strchr(line, ':') + 1, " %d", &slots[slot_count]);
             slot_count++;
         }
     }
@@ -735,109 +1190,34 @@ int getMRLDDisks(int adapter_id, int ldrive_id, int encl_ids[], int slots[]) {
 
 
 /*
- * Get MegaRAID logical (virtual) drive properties.
+ * Get MegaRAID logical (virtual) drive properties (cached; these come
+ * from the same query as the logical drive information).
  */
 MRLDPROPS *getMRLDProps(int adapter_id, int ldrive_id) {
     MRLDPROPS *ld_props = 0;
-    FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
-    char line[MAX_MC_LINE] = {0}, temp_str[MAX_MC_LINE] = {0};
-    int status = 0;
-
-    ld_props = (MRLDPROPS *) calloc(1, sizeof(MRLDPROPS));
-    if (ld_props != NULL) {
-        ld_props->adapter_id = adapter_id;
-        ld_props->ldrive_id = ldrive_id;
+    MRCACHE *cache = NULL;
+    int i = 0;
 
-        /* Get cache policies */
-        SAFE_ASPRINTF(&command, "%s -LDGetProp -Cache -L%d -a%d -NoLog 2>&1",
-                MEGACLI_BIN, ldrive_id, adapter_id);
-        megacli = popen(command, "r");
-        while (fgets(line, sizeof(line), megacli) != NULL) {
-            if (strstr(line, "Cache Policy:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strtok_result = strtok(NULL, ":");
-                strtok_result = strtok(NULL, ":");
-                strcpy(temp_str, strtok_result);
-
-                /* Write policy */
-                strtok_result = strtok(temp_str, ",");
-                if (strstr(strStrip(strtok_result), "WriteThrough")) {
-                    strncpy(ld_props->write_policy, "WT", MAX_MR_ATTR_SIZE);
-                } else if (strstr(strStrip(strtok_result), "WriteBack")) {
-                    strncpy(ld_props->write_policy, "WB", MAX_MR_ATTR_SIZE);
-                } else {
-                    strncpy(ld_props->write_policy, "UNKNOWN",
-                            MAX_MR_ATTR_SIZE);
-                }
-
-                /* Read policy */
-                strtok_result = strtok(NULL, ",");
-                if (strstr(strStrip(strtok_result), "ReadAheadNone")) {
-                    strncpy(ld_props->read_policy, "NORA", MAX_MR_ATTR_SIZE);
-                } else if (strstr(strStrip(strtok_result), "ReadAhead")) {
-                    strncpy(ld_props->read_policy, "RA", MAX_MR_ATTR_SIZE);
-                } else if (strstr(strStrip(strtok_result), "ReadAdaptive")) {
-                    strncpy(ld_props->read_policy, "ADRA", MAX_MR_ATTR_SIZE);
-                } else {
-                    strncpy(ld_props->read_policy, "UNKNOWN",
-                            MAX_MR_ATTR_SIZE);
-                }
-
-                /* Cache policy */
-                strtok_result = strtok(NULL, ",");
-                if (strstr(strStrip(strtok_result), "Direct")) {
-                    strncpy(ld_props->cache_policy, "Direct", MAX_MR_ATTR_SIZE);
-                } else if (strstr(strStrip(strtok_result), "Cached")) {
-                    strncpy(ld_props->cache_policy, "Cached", MAX_MR_ATTR_SIZE);
-                } else {
-                    strncpy(ld_props->cache_policy, "UNKNOWN",
-                            MAX_MR_ATTR_SIZE);
-                }
-
-                /* BBU cache policy */
-                strtok_result = strtok(NULL, ",");
-                if (strstr(strStrip(strtok_result),
-                        "No Write Cache if bad BBU")) {
-                    strncpy(ld_props->bbu_cache_policy, "NoCachedBadBBU",
-                            MAX_MR_ATTR_SIZE);
-                } else if (strstr(strStrip(strtok_result),
-                        "Write Cache OK if bad BBU")) {
-                    strncpy(ld_props->bbu_cache_policy, "CachedBadBBU",
-                            MAX_MR_ATTR_SIZE);
-                } else {
-                    strncpy(ld_props->bbu_cache_policy, "UNKNOWN",
-                            MAX_MR_ATTR_SIZE);
-                }
-            }
-        }
-        status = pclose(megacli);
-        FREE_NULL(command);
-        if (status != 0) {
-            return NULL;
-        }
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_LDRIVES)) == NULL)
+        return NULL;
+    if (cache->status[MR_CACHE_LDRIVES] != 0) {
+        mrPutCache();
+        return NULL;
+    }
 
-        /* Get Name */
-        SAFE_ASPRINTF(&command, "%s -LDGetProp -Name -L%d -a%d -NoLog 2>&1",
-                MEGACLI_BIN, ldrive_id, adapter_id);
-        megacli = popen(command, "r");
-        while (fgets(line, sizeof(line), megacli) != NULL) {
-            if (strstr(line, "Name:")) {
-                strtok_result = strtok(line, ":");
-                strtok_result = strtok(NULL, ":");
-                strtok_result = strtok(NULL, ":");
-                strtok_result = strtok(NULL, ":");
-                strncpy(ld_props->name, strStrip(strtok_result),
-                        MAX_MR_ATTR_SIZE);
-            }
-        }
-        status = pclose(megacli);
-        FREE_NULL(command);
-        if (status != 0) {
-            return NULL;
-        }
+    for (i = 0; i < cache->ldrive_cnt; i++) {
+        if (cache->ldrives[i].props.ldrive_id == ldrive_id)
+            break;
     }
+    if (i == cache->ldrive_cnt) {
+        mrPutCache();
+        return NULL;
+    }
+
+    ld_props = (MRLDPROPS *) calloc(1, sizeof(MRLDPROPS));
+    if (ld_props != NULL)
+        memcpy(ld_props, &cache->ldrives[i].props, sizeof (MRLDPROPS));
+    mrPutCache();
 
     /* Done */
     return ld_props;
@@ -845,9 +1225,9 @@ MRLDPROPS *getMRLDProps(int adapter_id, int ldrive_id) {
 
 
 /*
- * Set logical drive properties.
+ * Set logical drive properties (the caller takes care of the cache).
  */
-int setMRLDProps(MRLDPROPS *ld_props) {
+static int mrSetLDProps(MRLDPROPS *ld_props) {
     char *command = NULL;
     int status = 0;
 
@@ -944,6 +1324,20 @@ int setMRLDProps(MRLDPROPS *ld_props) {
 }
 
 
+/*
+ * Set logical drive properties. The cached data is thrown away before and
+ * after, so a refresh that overlaps the change isn't kept.
+ */
+int setMRLDProps(MRLDPROPS *ld_props) {
+    int ret_val = 0;
+
+    mrInvalidateCache(ld_props->adapter_id);
+    ret_val = mrSetLDProps(ld_props);
+    mrInvalidateCache(ld_props->adapter_id);
+    return ret_val;
+}
+
+
 /*
  * Check if the given logical drive is set as bootable on the adapter. This
  * will probably need to be re-worked in the future, but should provide some
@@ -951,7 +1345,7 @@ int setMRLDProps(MRLDPROPS *ld_props) {
  */
 boolean isLDBootDrive(int adapter_id, int ldrive_id) {
     FILE *megacli = NULL;
-    char *command = NULL, *strtok_result = NULL;
+    char *command = NULL, *position = NULL;
     int status = 0, boot_ld = 0;
     char line[MAX_MC_LINE] = {0};
 
@@ -963,9 +1357,8 @@ boolean isLDBootDrive(int adapter_id, int ldrive_id) {
     /* Loop over command output */
     while (fgets(line, sizeof(line), megacli) != NULL) {
         if (strstr(line, "Boot Virtual Drive -")) {
-            strtok_result = strtok(line, "#");
-            strtok_result = strtok(NULL, "#");
-            sscanf(strtok_result, "%d", &boot_ld);
+            if ((position = strchr(line, '#')) != NULL)
+                sscanf(position + 1, "%d", &boot_ld);
         }
     }
 
@@ -989,6 +1382,9 @@ int delMRLogicalDrive(int adapter_id, int ldrive_id) {
     char *command = NULL;
     int status = 0, ret_val = 0;
 
+    /* Whatever happens below, our cached data may be stale */
+    mrInvalidateCache(adapter_id);
+
     /* The delete-logical-drive command */
     SAFE_ASPRINTF(&command, "%s -CfgLdDel -L%d -a%d -Silent -NoLog > /dev/null 2>&1",
             MEGACLI_BIN, ldrive_id, adapter_id);
@@ -1005,7 +1401,8 @@ int delMRLogicalDrive(int adapter_id, int ldrive_id) {
         }
     }
 
-    /* Done */
+    /* Done (a refresh that overlapped the change is thrown away) */
+    mrInvalidateCache(adapter_id);
     FREE_NULL(command);
     return ret_val;
 }
@@ -1020,6 +1417,9 @@ int addMRLogicalDrive(MRLDPROPS *ld_props, int num_disks, MRDISK *disks[],
     int status = 0, i = 0, ret_val = 0, pd_val_size = 0, pd_line_size = 0;
     char pd_list_line_buffer[MAX_MR_PD_LIST_BUFF] = {0};
 
+    /* Whatever happens below, our cached data may be stale */
+    mrInvalidateCache(ld_props->adapter_id);
+
     /* Build the new LD command */
     for (i = 0; i < num_disks; i++) {
         if (i == (num_disks - 1))
@@ -1064,37 +1464,29 @@ int addMRLogicalDrive(MRLDPROPS *ld_props, int num_disks, MRDISK *disks[],
         }
     }
 
-    /* Done */
+    /* Done (a refresh that overlapped the change is thrown away) */
+    mrInvalidateCache(ld_props->adapter_id);
     FREE_NULL(command);
     return ret_val;
 }
 
 
 /*
- * Get MegaRAID logical drive IDs.
+ * Get MegaRAID logical drive IDs (cached).
  */
 int getMRLDIDNums(int adapter_id, int ld_count, int ld_ids[]) {
-    FILE *megacli = NULL;
-    char *command = NULL;
-    char line[MAX_MC_LINE] = {0};
-    int status = 0, ld_line_cnt = 0, ret_val = 0;
+    MRCACHE *cache = NULL;
+    int status = 0, ret_val = 0, ldrive_cnt = 0, i = 0;
 
-    /* MegaCLI command */
-    SAFE_ASPRINTF(&command, "%s -LDInfo -Lall -a%d -NoLog 2>&1",
-            MEGACLI_BIN, adapter_id);
-    megacli = popen(command, "r");
-
-    /* Loop over command output */
-    ld_line_cnt = 0;
-    while (fgets(line, sizeof (line), megacli) != NULL) {
-        if (strstr(line, "Virtual Drive:")) {
-            sscanf(line, "%*s %*s %d", &ld_ids[ld_line_cnt]);
-            ld_line_cnt++;
-        }
-    }
+    if ((cache = mrGetCache(adapter_id, MR_CACHE_LDRIVES)) == NULL)
+        return -1;
+    for (i = 0; i < cache->ldrive_cnt && i < ld_count; i++)
+        ld_ids[i] = cache->ldrives[i].ldrive.ldrive_id;
+    ldrive_cnt = cache->ldrive_cnt;
 
-    /* Done with MegaCLI */
-    status = pclose(megacli);
+    /* Check how MegaCLI exited */
+    status = cache->status[MR_CACHE_LDRIVES];
+    mrPutCache();
     if (status == -1) {
         ret_val = -1;
     } else {
@@ -1106,10 +1498,9 @@ int getMRLDIDNums(int adapter_id, int ld_count, int ld_ids[]) {
     }
 
     /* Make sure we got the same number of IDs */
-    if (ld_count != ld_line_cnt)
+    if (ld_count != ldrive_cnt)
         ret_val = -1;
 
     /* Done */
-    FREE_NULL(command);
     return ret_val;
 }
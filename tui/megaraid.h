@@ -11,6 +11,8 @@
 extern "C" {
 #endif
 
+#include <stdio.h>
+#include <time.h>
 #include <cdk.h>
 
 /* MegaRAID specific limits */
@@ -25,6 +27,24 @@ extern "C" {
 #define MAX_LD_NAME             15
 #define MAX_MR_PD_LIST_BUFF     512
 
+/* MegaCLI output cache; each section is one bulk query per adapter */
+#define MR_CACHE_ADAPTER        0
+#define MR_CACHE_DISKS          1
+#define MR_CACHE_LDRIVES        2
+#define MR_CACHE_ENCLS          3
+#define MR_CACHE_SECTIONS       4
+#define MR_CACHE_TTL            30
+/* The refresher re-loads data the UI has used in the last
+ * MR_CACHE_IDLE_SECS seconds once it is MR_REFRESH_SECS old (before the
+ * TTL runs out), checking every MR_REFRESH_POLL_SECS */
+#define MR_REFRESH_SECS         20
+#define MR_CACHE_IDLE_SECS      300
+#define MR_REFRESH_POLL_SECS    1
+
+/* MegaCLI output parser */
+#define MR_KEY_HASH_SIZE        256
+#define MR_MAX_HASH_SEEDS       10000
+
 /* We re-use boolean from cdk.h */
 /*typedef int boolean;*/
 
@@ -154,7 +174,79 @@ struct megaraid_ld_props {
     char name[MAX_MR_ATTR_SIZE];
 };
 
+/* A logical drive and its properties (both come from -LDInfo) */
+typedef struct megaraid_ld_entry MRLDENTRY;
+struct megaraid_ld_entry {
+    MRLDRIVE ldrive;
+    MRLDPROPS props;
+};
+
+/* Parsed MegaCLI output for one adapter; a section is re-loaded when it is
+ * older than MR_CACHE_TTL seconds, or after we change the adapter
+ * configuration (set/add/delete) ourselves. With the refresher thread
+ * running, the queries are run there and the UI only reads the cache. */
+typedef struct megaraid_cache MRCACHE;
+struct megaraid_cache {
+    int adapter_id;
+    /* When (CLOCK_MONOTONIC seconds) the UI last read from the cache */
+    time_t used_time;
+    /* Bumped when the cache is invalidated; a query that was already
+     * running when it changes is thrown away */
+    unsigned long generation;
+    /* Whether/when (CLOCK_MONOTONIC seconds) each section was loaded */
+    boolean loaded[MR_CACHE_SECTIONS];
+    time_t load_time[MR_CACHE_SECTIONS];
+    /* MegaCLI exit status (from pclose()) for each section's query */
+    int status[MR_CACHE_SECTIONS];
+    /* From -AdpAllInfo */
+    MRADAPTER adapter;
+    /* From -PDList */
+    int disk_cnt;
+    MRDISK disks[MAX_MR_DISKS];
+    /* From -LDInfo -Lall */
+    int ldrive_cnt;
+    MRLDENTRY ldrives[MAX_MR_LDS];
+    /* From -EncInfo */
+    int encl_cnt;
+    MRENCL enclosures[MAX_MR_ENCLS];
+};
+
+/* How a MegaCLI value is stored in a record */
+typedef enum {
+    MR_FIELD_STRING, MR_FIELD_INT, MR_FIELD_FLAG, MR_FIELD_POLICY
+} mr_field_t;
+
+/* One MegaCLI output key ("Key Name : value") and where its value goes;
+ * the offset is into the section's record structure */
+typedef struct megaraid_field MRFIELD;
+struct megaraid_field {
+    /* MR_CACHE_* section (query) the key appears in */
+    int section;
+    const char *key;
+    size_t offset;
+    mr_field_t type;
+};
+
+/* One bulk MegaCLI query and the records its output is parsed into */
+typedef struct megaraid_section MRSECTION;
+struct megaraid_section {
+    /* MegaCLI arguments (the adapter is added) */
+    const char *query;
+    /* Key that starts a new record (NULL if there is just one) */
+    const char *record_key;
+    /* Record array and count (offsets into MRCACHE) */
+    size_t records;
+    size_t count;
+    size_t record_size;
+    int max_records;
+    /* Set up a new (zeroed) record */
+    void (*init_record)(void *record, int adapter_id);
+};
+
 /* Function prototypes */
+void parseMROutput(FILE *megacli, int section, MRCACHE *cache);
+boolean startMRRefresher();
+void closeMRRefresher();
 char *getMegaCLIVersion();
 int getMRAdapterCount();
 MRADAPTER *getMRAdapter(int adapter_id);
@@ -14,6 +14,8 @@
 #include <parted/parted.h>
 #include <mntent.h>
 #include <sys/statvfs.h>
+#include <sys/xattr.h>
+#include <syslog.h>
 #include <fcntl.h>
 #include <sys/param.h>
 #include <limits.h>
@@ -25,6 +27,9 @@
 #include "dialogs.h"
 #include "strings.h"
 #include "megaraid.h"
+#include "jobs.h"
+#include "clone.h"
+#include "vdisk.h"
 
 /*
  * Run the Adapter Properties dialog
@@ -2027,25 +2032,24 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
     CDKBUTTON *ok_button = 0, *cancel_button = 0;
     CDKENTRY *vdisk_name = 0, *vdisk_size = 0;
     CDKHISTOGRAM *vdisk_progress = 0;
+    CDKRADIO *vdisk_prov = 0;
     tButtonCallback ok_cb = &okButtonCB, cancel_cb = &cancelButtonCB;
     char fs_name[MAX_FS_ATTR_LEN] = {0}, fs_path[MAX_FS_ATTR_LEN] = {0},
             fs_type[MAX_FS_ATTR_LEN] = {0}, mount_cmd[MAX_SHELL_CMD_LEN] = {0},
             vdisk_name_buff[MAX_VDISK_NAME] = {0},
             gib_free_str[MISC_STRING_LEN] = {0},
             gib_total_str[MISC_STRING_LEN] = {0},
-            zero_buff[VDISK_WRITE_SIZE] = {0},
             new_vdisk_file[MAX_VDISK_PATH_LEN] = {0};
     char *error_msg = NULL;
     char *vdisk_dialog_msg[ADD_VDISK_INFO_LINES] = {NULL};
-    boolean mounted = FALSE, question = FALSE, finished = FALSE;
+    boolean mounted = FALSE, question = FALSE;
     struct statvfs *fs_info = NULL;
     int window_y = 0, window_x = 0, traverse_ret = 0, i = 0, exit_stat = 0,
             ret_val = 0, vdisk_size_int = 0, new_vdisk_fd = 0,
-            vdisk_window_lines = 0, vdisk_window_cols = 0;
+            vdisk_window_lines = 0, vdisk_window_cols = 0, prov_mode = 0,
+            prov_tag = 0;
     long long bytes_free = 0ll, bytes_total = 0ll, new_vdisk_bytes = 0ll,
             new_vdisk_mib = 0ll;
-    off_t position = 0;
-    ssize_t bytes_written = 0, write_length = 0;
 
     /* Have the user select a file system to remove */
     getFSChoice(main_cdk_screen, fs_name, fs_path, fs_type, &mounted);
@@ -2073,7 +2077,7 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
 
     while (1) {
         /* Setup a new small CDK screen for virtual disk information */
-        vdisk_window_lines = 12;
+        vdisk_window_lines = 14;
         vdisk_window_cols = 70;
         window_y = ((LINES / 2) - (vdisk_window_lines / 2));
         window_x = ((COLS / 2) - (vdisk_window_cols / 2));
@@ -2153,8 +2157,27 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
         }
         setCDKEntryBoxAttribute(vdisk_size, COLOR_DIALOG_INPUT);
 
+        /* Provisioning mode; thick (fallocate) for file systems that
+         * support it, and the zero-fill engine for others */
+        if ((strcmp(fs_type, "xfs") == 0) ||
+                (strcmp(fs_type, "ext4") == 0) ||
+                (strcmp(fs_type, "btrfs") == 0))
+            prov_mode = VDISK_PROV_THICK;
+        else
+            prov_mode = VDISK_PROV_EAGER_ZERO;
+        vdisk_prov = newCDKRadio(vdisk_screen, (window_x + 46),
+                (window_y + 6), NONE, (VDISK_PROV_MODES + 1), 22,
+                "</B>Provisioning", g_vdisk_prov_opts, VDISK_PROV_MODES,
+                '#' | COLOR_DIALOG_SELECT, prov_mode,
+                COLOR_DIALOG_SELECT, FALSE, FALSE);
+        if (!vdisk_prov) {
+            errorDialog(main_cdk_screen, RADIO_ERR_MSG, NULL);
+            break;
+        }
+        setCDKRadioBackgroundAttrib(vdisk_prov, COLOR_DIALOG_TEXT);
+
         /* Buttons */
-        ok_button = newCDKButton(vdisk_screen, (window_x + 26), (window_y + 10),
+        ok_button = newCDKButton(vdisk_screen, (window_x + 26), (window_y + 12),
                 g_ok_cancel_msg[0], ok_cb, FALSE, FALSE);
         if (!ok_button) {
             errorDialog(main_cdk_screen, BUTTON_ERR_MSG, NULL);
@@ -2162,7 +2185,7 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
         }
         setCDKButtonBackgroundAttrib(ok_button, COLOR_DIALOG_INPUT);
         cancel_button = newCDKButton(vdisk_screen, (window_x + 36),
-                (window_y + 10), g_ok_cancel_msg[1], cancel_cb, FALSE, FALSE);
+                (window_y + 12), g_ok_cancel_msg[1], cancel_cb, FALSE, FALSE);
         if (!cancel_button) {
             errorDialog(main_cdk_screen, BUTTON_ERR_MSG, NULL);
             break;
@@ -2192,7 +2215,9 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             new_vdisk_bytes = vdisk_size_int * GIBIBYTE_SIZE;
-            if (new_vdisk_bytes > bytes_free) {
+            prov_mode = getCDKRadioSelectedItem(vdisk_prov);
+            /* A thin file only takes space as it's written */
+            if (prov_mode != VDISK_PROV_THIN && new_vdisk_bytes > bytes_free) {
                 errorDialog(main_cdk_screen,
                         "The given size is greater than the available space!",
                         NULL);
@@ -2249,61 +2274,70 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
 
-            /* Zero-out the new virtual disk file to the
-             * length specified (size) */
-            memset(zero_buff, 0, VDISK_WRITE_SIZE);
-            for (position = 0; position < new_vdisk_bytes;
-                    position += write_length) {
-                write_length = MIN((new_vdisk_bytes - position),
-                        VDISK_WRITE_SIZE);
-                /* Use fallocate() for modern file systems, and
-                 * write() for others */
-                if ((strcmp(fs_type, "xfs") == 0) ||
-                        (strcmp(fs_type, "ext4") == 0) ||
-                        (strcmp(fs_type, "btrfs") == 0)) {
-                    if (fallocate(new_vdisk_fd, 0, position,
-                            write_length) == -1) {
-                        SAFE_ASPRINTF(&error_msg, "fallocate(): %s",
-                                strerror(errno));
-                        errorDialog(main_cdk_screen, error_msg, NULL);
-                        FREE_NULL(error_msg);
-                        close(new_vdisk_fd);
-                        finished = TRUE;
-                        break;
-                    }
-                } else {
-                    bytes_written = write(new_vdisk_fd, zero_buff,
-                            write_length);
-                    if (bytes_written == -1) {
-                        SAFE_ASPRINTF(&error_msg, "write(): %s", strerror(errno));
-                        errorDialog(main_cdk_screen, error_msg, NULL);
-                        FREE_NULL(error_msg);
-                        close(new_vdisk_fd);
-                        finished = TRUE;
-                        break;
-                    } else if (bytes_written != write_length) {
-                        errorDialog(main_cdk_screen,
-                                "The number of bytes written is different",
-                                "than the requested write length!");
-                        close(new_vdisk_fd);
-                        finished = TRUE;
-                        break;
-                    }
+            /* Create the new virtual disk file at the length specified
+             * (size) using the chosen provisioning mode; everything but
+             * eager zero is a single call */
+            if (prov_mode == VDISK_PROV_THICK) {
+                if (fallocate(new_vdisk_fd, 0, 0, new_vdisk_bytes) == -1) {
+                    SAFE_ASPRINTF(&error_msg, "fallocate(): %s",
+                            strerror(errno));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                    close(new_vdisk_fd);
+                    break;
                 }
-                /* This controls how often the progress bar is updated; it can
-                 * adversely affect performance of the write operation if its
-                 * updated too frequently */
-                if ((position % (VDISK_WRITE_SIZE * 1000)) == 0) {
-                    /* Since our maximum size was checked above against an int
-                     * type, we'll assume we're safe if we made it this far */
-                    setCDKHistogram(vdisk_progress, vPERCENT, CENTER,
-                            COLOR_DIALOG_TEXT, 0, new_vdisk_mib,
-                            (position / MEBIBYTE_SIZE), ' ' | A_REVERSE, TRUE);
-                    drawCDKHistogram(vdisk_progress, TRUE);
+            } else if (prov_mode == VDISK_PROV_ZERO_RANGE) {
+                /* Kernels before 3.15 (and some file systems) don't do
+                 * zero range; unwritten extents read back as zeros too, so
+                 * fall back to a plain (thick) fallocate() */
+                ret_val = fallocate(new_vdisk_fd, FALLOC_FL_ZERO_RANGE, 0,
+                        new_vdisk_bytes);
+                if (ret_val == -1 && errno == EOPNOTSUPP) {
+                    DEBUG_LOG("FALLOC_FL_ZERO_RANGE not supported, "
+                            "using a thick fallocate()");
+                    prov_mode = VDISK_PROV_THICK;
+                    ret_val = fallocate(new_vdisk_fd, 0, 0, new_vdisk_bytes);
+                }
+                if (ret_val == -1) {
+                    SAFE_ASPRINTF(&error_msg, "fallocate(): %s",
+                            strerror(errno));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                    close(new_vdisk_fd);
+                    break;
+                }
+            } else if (prov_mode == VDISK_PROV_THIN) {
+                if (ftruncate(new_vdisk_fd, new_vdisk_bytes) == -1) {
+                    SAFE_ASPRINTF(&error_msg, "ftruncate(): %s",
+                            strerror(errno));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                    close(new_vdisk_fd);
+                    break;
+                }
+            } else {
+                /* Eager zero can take a long time, so the zeros are written
+                 * by a background job (started below); the file gets its
+                 * full size now */
+                if (ftruncate(new_vdisk_fd, new_vdisk_bytes) == -1) {
+                    SAFE_ASPRINTF(&error_msg, "ftruncate(): %s",
+                            strerror(errno));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                    close(new_vdisk_fd);
+                    break;
                 }
             }
-            if (finished)
-                break;
+
+            /* Remember how the file was provisioned; not all file systems
+             * support user extended attributes, so this isn't fatal (an
+             * eager zero file is thin until the zero fill job finishes) */
+            prov_tag = (prov_mode == VDISK_PROV_EAGER_ZERO) ?
+                    VDISK_PROV_THIN : prov_mode;
+            if (fsetxattr(new_vdisk_fd, VDISK_PROV_XATTR,
+                    g_vdisk_prov_names[prov_tag],
+                    strlen(g_vdisk_prov_names[prov_tag]), 0) == -1)
+                DEBUG_LOG("fsetxattr(): %s", strerror(errno));
 
             /* We've completed writing the new file; update the progress bar */
             setCDKHistogram(vdisk_progress, vPERCENT, CENTER, COLOR_DIALOG_TEXT,
@@ -2327,6 +2361,25 @@ void addVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
             }
             destroyCDKHistogram(vdisk_progress);
             vdisk_progress = NULL;
+
+            /* Start the eager zero job */
+            if (prov_mode == VDISK_PROV_EAGER_ZERO) {
+                if ((ret_val = startVDiskJob(VDISK_JOB_ZERO_FILL,
+                        new_vdisk_file, new_vdisk_bytes)) == ENOSPC) {
+                    errorDialog(main_cdk_screen,
+                            "The virtual disk job table is full; the file",
+                            "was created, but it has not been zeroed.");
+                } else if (ret_val != 0) {
+                    SAFE_ASPRINTF(&error_msg, "startVDiskJob(): %s",
+                            strerror(ret_val));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                } else if (questionDialog(main_cdk_screen,
+                        "The file is being zeroed in the background.",
+                        "Would you like to view the virtual disk jobs?")) {
+                    vdiskJobsDialog(main_cdk_screen);
+                }
+            }
         }
         break;
     }
@@ -2424,103 +2477,728 @@ void delVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
 }
 
 
+/*
+ * Run the Clone Virtual Disk File dialog; the clone goes next to the
+ * source file. Reflinks are instant, anything else shows the progress.
+ */
+void cloneVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
+    CDKFSELECT *file_select = 0;
+    CDKENTRY *clone_name_entry = 0;
+    CDKHISTOGRAM *clone_progress = 0;
+    FILECLONE file_clone = {0};
+    char fs_name[MAX_FS_ATTR_LEN] = {0}, fs_path[MAX_FS_ATTR_LEN] = {0},
+            fs_type[MAX_FS_ATTR_LEN] = {0}, mount_cmd[MAX_SHELL_CMD_LEN] = {0},
+            src_file[MAX_VDISK_PATH_LEN] = {0},
+            clone_name[MAX_VDISK_NAME] = {0},
+            clone_file[MAX_VDISK_PATH_LEN] = {0};
+    char *error_msg = NULL, *selected_file = NULL, *entry_value = NULL,
+            *last_slash = NULL;
+    boolean mounted = FALSE, question = FALSE;
+    int exit_stat = 0, ret_val = 0, src_fd = -1, clone_fd = -1;
+    long long clone_mib = 0ll;
+
+    /* Have the user select a file system */
+    getFSChoice(main_cdk_screen, fs_name, fs_path, fs_type, &mounted);
+    if (fs_name[0] == '\0')
+        return;
+
+    if (!mounted) {
+        question = questionDialog(main_cdk_screen,
+                NOT_MOUNTED_1, NOT_MOUNTED_2);
+        if (question) {
+            /* Run mount */
+            snprintf(mount_cmd, MAX_SHELL_CMD_LEN, "%s %s > /dev/null 2>&1",
+                    MOUNT_BIN, fs_path);
+            ret_val = system(mount_cmd);
+            if ((exit_stat = WEXITSTATUS(ret_val)) != 0) {
+                SAFE_ASPRINTF(&error_msg, CMD_FAILED_ERR, MOUNT_BIN,
+                        exit_stat);
+                errorDialog(main_cdk_screen, error_msg, NULL);
+                FREE_NULL(error_msg);
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+
+    while (1) {
+        /* Create the file selector widget */
+        file_select = newCDKFselect(main_cdk_screen, CENTER, CENTER, 20, 40,
+                "<C></31/B>Choose a virtual disk file to clone:\n",
+                "VDisk File: ", COLOR_DIALOG_INPUT, '_' | COLOR_DIALOG_INPUT,
+                A_REVERSE, "</N>", "</B>", "</N>", "</N>", TRUE, FALSE);
+        if (!file_select) {
+            errorDialog(main_cdk_screen, FSELECT_ERR_MSG, NULL);
+            break;
+        }
+        setCDKFselectBoxAttribute(file_select, COLOR_DIALOG_BOX);
+        setCDKFselectBackgroundAttrib(file_select, COLOR_DIALOG_TEXT);
+        setCDKFselectDirectory(file_select, fs_path);
+
+        /* Activate the widget and let the user choose a file */
+        selected_file = activateCDKFselect(file_select, 0);
+        if (file_select->exitType != vNORMAL)
+            break;
+        snprintf(src_file, MAX_VDISK_PATH_LEN, "%s", selected_file);
+        destroyCDKFselect(file_select);
+        file_select = NULL;
+
+        /* Get the name for the clone (entry widget) */
+        clone_name_entry = newCDKEntry(main_cdk_screen, CENTER, CENTER,
+                "<C></31/B>Clone Virtual Disk File\n",
+                "</B>Clone File Name: ", COLOR_DIALOG_SELECT,
+                '_' | COLOR_DIALOG_INPUT, vLMIXED, 20, 0, MAX_VDISK_NAME,
+                TRUE, FALSE);
+        if (!clone_name_entry) {
+            errorDialog(main_cdk_screen, ENTRY_ERR_MSG, NULL);
+            break;
+        }
+        setCDKEntryBoxAttribute(clone_name_entry, COLOR_DIALOG_BOX);
+        setCDKEntryBackgroundAttrib(clone_name_entry, COLOR_DIALOG_TEXT);
+        curs_set(1);
+        entry_value = activateCDKEntry(clone_name_entry, 0);
+        curs_set(0);
+        if (clone_name_entry->exitType != vNORMAL)
+            break;
+        strncpy(clone_name, entry_value, MAX_VDISK_NAME - 1);
+        destroyCDKEntry(clone_name_entry);
+        clone_name_entry = NULL;
+        refreshCDKScreen(main_cdk_screen);
+        if (!checkInputStr(main_cdk_screen, NAME_CHARS, clone_name))
+            break;
+
+        /* The clone goes in the same directory as the source (a reflink
+         * only works within a file system) */
+        snprintf(clone_file, MAX_VDISK_PATH_LEN, "%s", src_file);
+        if ((last_slash = strrchr(clone_file, '/')) != NULL)
+            *(last_slash + 1) = '\0';
+        else
+            clone_file[0] = '\0';
+        if (strlen(clone_file) + strlen(clone_name) >= MAX_VDISK_PATH_LEN) {
+            errorDialog(main_cdk_screen, "The clone file path is too long!",
+                    NULL);
+            break;
+        }
+        strcat(clone_file, clone_name);
+
+        /* Open the source and create the clone (it must not exist) */
+        if ((src_fd = open(src_file, O_RDONLY | O_CLOEXEC)) == -1) {
+            SAFE_ASPRINTF(&error_msg, "open(): %s", strerror(errno));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        if ((clone_fd = open(clone_file, O_WRONLY | O_CREAT | O_EXCL |
+                O_CLOEXEC, 0666)) == -1) {
+            if (errno == EEXIST) {
+                SAFE_ASPRINTF(&error_msg, "It appears the '%s'", clone_file);
+                errorDialog(main_cdk_screen, error_msg,
+                        "file already exists!");
+            } else {
+                SAFE_ASPRINTF(&error_msg, "open(): %s", strerror(errno));
+                errorDialog(main_cdk_screen, error_msg, NULL);
+            }
+            FREE_NULL(error_msg);
+            break;
+        }
+
+        /* Start the clone; if it isn't a reflink, show the progress */
+        if ((ret_val = startFileClone(&file_clone, src_fd, clone_fd)) == 0 &&
+                file_clone.method != CLONE_REFLINK) {
+            clone_progress = newCDKHistogram(main_cdk_screen, CENTER, CENTER,
+                    1, 50, HORIZONTAL,
+                    "<C></31/B>Cloning virtual disk file (units = MiB):\n",
+                    TRUE, FALSE);
+            if (clone_progress) {
+                setCDKScrollBoxAttribute(clone_progress, COLOR_DIALOG_BOX);
+                setCDKScrollBackgroundAttrib(clone_progress,
+                        COLOR_DIALOG_TEXT);
+            }
+            clone_mib = MIN(file_clone.size / MEBIBYTE_SIZE, INT_MAX);
+            while (!fileCloneDone(&file_clone)) {
+                if (clone_progress) {
+                    setCDKHistogram(clone_progress, vPERCENT, CENTER,
+                            COLOR_DIALOG_TEXT, 0, clone_mib,
+                            MIN(fileCloneProgress(&file_clone) /
+                            MEBIBYTE_SIZE, clone_mib),
+                            ' ' | A_REVERSE, TRUE);
+                    drawCDKHistogram(clone_progress, TRUE);
+                }
+                usleep(CLONE_POLL_USECS);
+            }
+        }
+        if (ret_val == 0)
+            ret_val = finishFileClone(&file_clone);
+        if (ret_val == 0 && fsync(clone_fd) == -1)
+            ret_val = errno;
+        if (ret_val != 0) {
+            /* A partial clone is no use to anyone */
+            unlink(clone_file);
+            SAFE_ASPRINTF(&error_msg, "Cloning the file failed: %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+        }
+        break;
+    }
+
+    /* Done */
+    if (src_fd != -1)
+        close(src_fd);
+    if (clone_fd != -1)
+        close(clone_fd);
+    if (clone_progress != NULL)
+        destroyCDKHistogram(clone_progress);
+    if (clone_name_entry != NULL)
+        destroyCDKEntry(clone_name_entry);
+    if (file_select != NULL)
+        destroyCDKFselect(file_select);
+    refreshCDKScreen(main_cdk_screen);
+    /* Using the file selector widget changes the CWD -- fix it */
+    if ((chdir(getenv("HOME"))) == -1) {
+        SAFE_ASPRINTF(&error_msg, "chdir(): %s", strerror(errno));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+    }
+    return;
+}
+
+
+/*
+ * Run the Defragment Virtual Disk File dialog
+ */
+void defragVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
+    CDKFSELECT *file_select = 0;
+    char fs_name[MAX_FS_ATTR_LEN] = {0}, fs_path[MAX_FS_ATTR_LEN] = {0},
+            fs_type[MAX_FS_ATTR_LEN] = {0}, mount_cmd[MAX_SHELL_CMD_LEN] = {0},
+            vdisk_file[MAX_VDISK_PATH_LEN] = {0},
+            extents_msg[MAX_TUI_STR_LEN] = {0};
+    char *error_msg = NULL, *selected_file = NULL;
+    boolean mounted = FALSE, question = FALSE;
+    int exit_stat = 0, ret_val = 0, vdisk_fd = -1;
+    long extents = 0;
+    struct stat vdisk_stat = {0};
+
+    /* Have the user select a file system */
+    getFSChoice(main_cdk_screen, fs_name, fs_path, fs_type, &mounted);
+    if (fs_name[0] == '\0')
+        return;
+
+    if (!mounted) {
+        question = questionDialog(main_cdk_screen,
+                NOT_MOUNTED_1, NOT_MOUNTED_2);
+        if (question) {
+            /* Run mount */
+            snprintf(mount_cmd, MAX_SHELL_CMD_LEN, "%s %s > /dev/null 2>&1",
+                    MOUNT_BIN, fs_path);
+            ret_val = system(mount_cmd);
+            if ((exit_stat = WEXITSTATUS(ret_val)) != 0) {
+                SAFE_ASPRINTF(&error_msg, CMD_FAILED_ERR, MOUNT_BIN,
+                        exit_stat);
+                errorDialog(main_cdk_screen, error_msg, NULL);
+                FREE_NULL(error_msg);
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+
+    while (1) {
+        /* Create the file selector widget */
+        file_select = newCDKFselect(main_cdk_screen, CENTER, CENTER, 20, 40,
+                "<C></31/B>Choose a virtual disk file to defragment:\n",
+                "VDisk File: ", COLOR_DIALOG_INPUT, '_' | COLOR_DIALOG_INPUT,
+                A_REVERSE, "</N>", "</B>", "</N>", "</N>", TRUE, FALSE);
+        if (!file_select) {
+            errorDialog(main_cdk_screen, FSELECT_ERR_MSG, NULL);
+            break;
+        }
+        setCDKFselectBoxAttribute(file_select, COLOR_DIALOG_BOX);
+        setCDKFselectBackgroundAttrib(file_select, COLOR_DIALOG_TEXT);
+        setCDKFselectDirectory(file_select, fs_path);
+
+        /* Activate the widget and let the user choose a file */
+        selected_file = activateCDKFselect(file_select, 0);
+        if (file_select->exitType != vNORMAL)
+            break;
+        snprintf(vdisk_file, MAX_VDISK_PATH_LEN, "%s", selected_file);
+        destroyCDKFselect(file_select);
+        file_select = NULL;
+        refreshCDKScreen(main_cdk_screen);
+
+        /* Show how fragmented it is now */
+        if ((vdisk_fd = open(vdisk_file, O_RDONLY | O_CLOEXEC)) == -1) {
+            SAFE_ASPRINTF(&error_msg, "open(): %s", strerror(errno));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        if (fstat(vdisk_fd, &vdisk_stat) == -1) {
+            SAFE_ASPRINTF(&error_msg, "fstat(): %s", strerror(errno));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        extents = countVDiskExtents(vdisk_fd, 0, 0);
+        close(vdisk_fd);
+        vdisk_fd = -1;
+        if (extents < 0)
+            snprintf(extents_msg, MAX_TUI_STR_LEN,
+                    "The file's extent count is unknown; defragment it?");
+        else
+            snprintf(extents_msg, MAX_TUI_STR_LEN,
+                    "The file has %ld extent(s); defragment it?", extents);
+        if (!questionDialog(main_cdk_screen, extents_msg,
+                "(It is done in the background, and the file stays in use.)"))
+            break;
+
+        /* Start the job */
+        if ((ret_val = startVDiskJob(VDISK_JOB_DEFRAG, vdisk_file,
+                vdisk_stat.st_size)) == ENOSPC) {
+            errorDialog(main_cdk_screen,
+                    "The virtual disk job table is full!", NULL);
+        } else if (ret_val == EOPNOTSUPP) {
+            errorDialog(main_cdk_screen, "Only files on ext4, btrfs, and XFS",
+                    "file systems can be defragmented.");
+        } else if (ret_val != 0) {
+            SAFE_ASPRINTF(&error_msg, "startVDiskJob(): %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+        } else if (questionDialog(main_cdk_screen,
+                "The file is being defragmented in the background.",
+                "Would you like to view the virtual disk jobs?")) {
+            vdiskJobsDialog(main_cdk_screen);
+        }
+        break;
+    }
+
+    /* Done */
+    if (vdisk_fd != -1)
+        close(vdisk_fd);
+    if (file_select != NULL)
+        destroyCDKFselect(file_select);
+    refreshCDKScreen(main_cdk_screen);
+    /* Using the file selector widget changes the CWD -- fix it */
+    if ((chdir(getenv("HOME"))) == -1) {
+        SAFE_ASPRINTF(&error_msg, "chdir(): %s", strerror(errno));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+    }
+    return;
+}
+
+
+/*
+ * Run the Reclaim Virtual Disk File dialog
+ */
+void reclaimVDiskFileDialog(CDKSCREEN *main_cdk_screen) {
+    CDKFSELECT *file_select = 0;
+    char fs_name[MAX_FS_ATTR_LEN] = {0}, fs_path[MAX_FS_ATTR_LEN] = {0},
+            fs_type[MAX_FS_ATTR_LEN] = {0}, mount_cmd[MAX_SHELL_CMD_LEN] = {0},
+            vdisk_file[MAX_VDISK_PATH_LEN] = {0},
+            dev_name[MAX_SYSFS_ATTR_SIZE] = {0},
+            prov_mode[MISC_STRING_LEN] = {0}, prov_msg[MAX_TUI_STR_LEN] = {0};
+    char *error_msg = NULL, *selected_file = NULL;
+    boolean mounted = FALSE, question = FALSE;
+    int exit_stat = 0, ret_val = 0;
+    ssize_t prov_len = 0;
+    struct stat vdisk_stat = {0};
+
+    /* Have the user select a file system */
+    getFSChoice(main_cdk_screen, fs_name, fs_path, fs_type, &mounted);
+    if (fs_name[0] == '\0')
+        return;
+
+    if (!mounted) {
+        question = questionDialog(main_cdk_screen,
+                NOT_MOUNTED_1, NOT_MOUNTED_2);
+        if (question) {
+            /* Run mount */
+            snprintf(mount_cmd, MAX_SHELL_CMD_LEN, "%s %s > /dev/null 2>&1",
+                    MOUNT_BIN, fs_path);
+            ret_val = system(mount_cmd);
+            if ((exit_stat = WEXITSTATUS(ret_val)) != 0) {
+                SAFE_ASPRINTF(&error_msg, CMD_FAILED_ERR, MOUNT_BIN,
+                        exit_stat);
+                errorDialog(main_cdk_screen, error_msg, NULL);
+                FREE_NULL(error_msg);
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+
+    while (1) {
+        /* Create the file selector widget */
+        file_select = newCDKFselect(main_cdk_screen, CENTER, CENTER, 20, 40,
+                "<C></31/B>Choose a virtual disk file to reclaim:\n",
+                "VDisk File: ", COLOR_DIALOG_INPUT, '_' | COLOR_DIALOG_INPUT,
+                A_REVERSE, "</N>", "</B>", "</N>", "</N>", TRUE, FALSE);
+        if (!file_select) {
+            errorDialog(main_cdk_screen, FSELECT_ERR_MSG, NULL);
+            break;
+        }
+        setCDKFselectBoxAttribute(file_select, COLOR_DIALOG_BOX);
+        setCDKFselectBackgroundAttrib(file_select, COLOR_DIALOG_TEXT);
+        setCDKFselectDirectory(file_select, fs_path);
+
+        /* Activate the widget and let the user choose a file */
+        selected_file = activateCDKFselect(file_select, 0);
+        if (file_select->exitType != vNORMAL)
+            break;
+        snprintf(vdisk_file, MAX_VDISK_PATH_LEN, "%s", selected_file);
+        destroyCDKFselect(file_select);
+        file_select = NULL;
+        refreshCDKScreen(main_cdk_screen);
+
+        /* Holes can only be punched in a file no one is writing to */
+        if ((ret_val = findVDiskSCSTDev(vdisk_file, dev_name)) == 0) {
+            SAFE_ASPRINTF(&error_msg, "The file is in use by SCST device "
+                    "'%s'; remove", dev_name);
+            errorDialog(main_cdk_screen, error_msg,
+                    "the device (or reclaim a snapshot/copy) first.");
+            FREE_NULL(error_msg);
+            break;
+        } else if (ret_val != ENOENT) {
+            SAFE_ASPRINTF(&error_msg, "findVDiskSCSTDev(): %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        if (stat(vdisk_file, &vdisk_stat) == -1) {
+            SAFE_ASPRINTF(&error_msg, "stat(): %s", strerror(errno));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+
+        /* Preallocated files don't stay that way */
+        if ((prov_len = getxattr(vdisk_file, VDISK_PROV_XATTR, prov_mode,
+                MISC_STRING_LEN - 1)) == -1)
+            prov_len = 0;
+        prov_mode[prov_len] = '\0';
+        if (prov_len > 0 &&
+                strcmp(prov_mode, g_vdisk_prov_names[VDISK_PROV_THIN]) != 0)
+            snprintf(prov_msg, MAX_TUI_STR_LEN,
+                    "(This '%s' file will be left thin.)", prov_mode);
+        else
+            snprintf(prov_msg, MAX_TUI_STR_LEN,
+                    "(It is done in the background.)");
+        if (!questionDialog(main_cdk_screen,
+                "Punch the zeroed space out of the file?", prov_msg))
+            break;
+
+        /* Start the job */
+        if ((ret_val = startVDiskJob(VDISK_JOB_RECLAIM, vdisk_file,
+                vdisk_stat.st_size)) == ENOSPC) {
+            errorDialog(main_cdk_screen,
+                    "The virtual disk job table is full!", NULL);
+        } else if (ret_val != 0) {
+            SAFE_ASPRINTF(&error_msg, "startVDiskJob(): %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+        } else if (questionDialog(main_cdk_screen,
+                "The file is being reclaimed in the background.",
+                "Would you like to view the virtual disk jobs?")) {
+            vdiskJobsDialog(main_cdk_screen);
+        }
+        break;
+    }
+
+    /* Done */
+    if (file_select != NULL)
+        destroyCDKFselect(file_select);
+    refreshCDKScreen(main_cdk_screen);
+    /* Using the file selector widget changes the CWD -- fix it */
+    if ((chdir(getenv("HOME"))) == -1) {
+        SAFE_ASPRINTF(&error_msg, "chdir(): %s", strerror(errno));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+    }
+    return;
+}
+
+
 /*
  * Run the Virtual Disk File List dialog
  */
 void vdiskFileListDialog(CDKSCREEN *main_cdk_screen) {
     CDKSWINDOW *vdisk_files = 0;
-    char *swindow_info[MAX_VDLIST_INFO_LINES] = {NULL};
-    char *error_msg = NULL, *pretty_size = NULL;
-    int i = 0, line_pos = 0;
+    char **swindow_info = NULL;
+    char *error_msg = NULL, *pretty_size = NULL, *pretty_alloc = NULL;
+    int i = 0, line_pos = 0, line_cnt = 0, file_cnt = 0, key = 0,
+            ret_val = 0;
     char fs_name[MAX_FS_ATTR_LEN] = {0}, fs_path[MAX_FS_ATTR_LEN] = {0},
             fs_type[MAX_FS_ATTR_LEN] = {0},
             vd_list_title[VDLIST_INFO_COLS] = {0},
-            file_path[MAX_SYSFS_PATH_SIZE] = {0};
-    boolean mounted = FALSE;
-    DIR *dir_stream = NULL;
-    struct dirent *dir_entry = NULL;
-    struct stat file_stat = {0};
+            hole_ratio[MISC_STRING_LEN] = {0},
+            extents[MISC_STRING_LEN] = {0};
+    boolean mounted = FALSE, function_key = FALSE;
+    VDISKINFO *files = NULL, *info = NULL;
+    vdisk_sort_t sort_key = VDISK_SORT_NAME;
 
     /* Have the user select a file system */
     getFSChoice(main_cdk_screen, fs_name, fs_path, fs_type, &mounted);
     if (fs_name[0] == '\0')
         return;
 
-    /* Open the directory */
-    if ((dir_stream = opendir(fs_path)) == NULL) {
-        SAFE_ASPRINTF(&error_msg, "opendir(): %s", strerror(errno));
+    /* Look at all of the files up front; sorting doesn't need a rescan */
+    if ((ret_val = scanVDiskDir(fs_path, &files, &file_cnt)) != 0) {
+        SAFE_ASPRINTF(&error_msg, "scanVDiskDir(): %s", strerror(ret_val));
         errorDialog(main_cdk_screen, error_msg, NULL);
         FREE_NULL(error_msg);
         return;
     }
-
-    /* Setup scrolling window widget */
-    snprintf(vd_list_title, VDLIST_INFO_COLS,
-            "<C></31/B>Virtual Disk File List (%.25s)\n", fs_path);
-    vdisk_files = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
-            (VDLIST_INFO_ROWS + 2), (VDLIST_INFO_COLS + 2),
-            vd_list_title, MAX_VDLIST_INFO_LINES, TRUE, FALSE);
-    if (!vdisk_files) {
-        errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+    /* A title row, the files, and the messages at the bottom */
+    line_cnt = file_cnt + 4;
+    if ((swindow_info = calloc(line_cnt, sizeof (char *))) == NULL) {
+        errorDialog(main_cdk_screen, "calloc(): Failed to allocate memory!",
+                NULL);
+        FREE_NULL(files);
         return;
     }
-    setCDKSwindowBackgroundAttrib(vdisk_files, COLOR_DIALOG_TEXT);
-    setCDKSwindowBoxAttribute(vdisk_files, COLOR_DIALOG_BOX);
 
-    /* Loop over each entry in the directory */
-    if (line_pos < MAX_VDLIST_INFO_LINES) {
-        SAFE_ASPRINTF(&swindow_info[line_pos], "<C></B>%-20.20s %15.15s",
-                "File Name", "File Size");
+    while (1) {
+        /* Setup scrolling window widget */
+        snprintf(vd_list_title, VDLIST_INFO_COLS,
+                "<C></31/B>Virtual Disk File List (%.25s)\n", fs_path);
+        vdisk_files = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
+                (VDLIST_INFO_ROWS + 2), (VDLIST_INFO_COLS + 2),
+                vd_list_title, line_cnt, TRUE, FALSE);
+        if (!vdisk_files) {
+            errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+            break;
+        }
+        setCDKSwindowBackgroundAttrib(vdisk_files, COLOR_DIALOG_TEXT);
+        setCDKSwindowBoxAttribute(vdisk_files, COLOR_DIALOG_BOX);
+
+        /* The column we're sorted by is shown in reverse video */
+        sortVDiskInfo(files, file_cnt, sort_key);
+        line_pos = 0;
+        SAFE_ASPRINTF(&swindow_info[line_pos],
+                "<C></B>%s%-22s%s %s%10s%s %s%10s%s %s%6s%s "
+                "%s%8s%s %-12s",
+                (sort_key == VDISK_SORT_NAME ? "</R>" : ""), "File Name",
+                (sort_key == VDISK_SORT_NAME ? "<!R>" : ""),
+                (sort_key == VDISK_SORT_SIZE ? "</R>" : ""), "Size",
+                (sort_key == VDISK_SORT_SIZE ? "<!R>" : ""),
+                (sort_key == VDISK_SORT_ALLOCATED ? "</R>" : ""), "Allocated",
+                (sort_key == VDISK_SORT_ALLOCATED ? "<!R>" : ""),
+                (sort_key == VDISK_SORT_HOLES ? "</R>" : ""), "Holes",
+                (sort_key == VDISK_SORT_HOLES ? "<!R>" : ""),
+                (sort_key == VDISK_SORT_EXTENTS ? "</R>" : ""), "Extents",
+                (sort_key == VDISK_SORT_EXTENTS ? "<!R>" : ""),
+                "Provisioning");
         line_pos++;
-    }
-    while ((dir_entry = readdir(dir_stream)) != NULL) {
-        /* We only want the files */
-        if (dir_entry->d_type != DT_DIR) {
-            /* Add the contents to the scrolling window widget */
-            if (line_pos < MAX_VDLIST_INFO_LINES) {
-                snprintf(file_path, MAX_SYSFS_PATH_SIZE, "%s/%s",
-                        fs_path, dir_entry->d_name);
-                if (stat(file_path, &file_stat) == -1) {
-                    SAFE_ASPRINTF(&error_msg, "stat(): %s", strerror(errno));
-                    SAFE_ASPRINTF(&swindow_info[line_pos], "<C>%-20.20s %15.15s",
-                            dir_entry->d_name, error_msg);
-                    FREE_NULL(error_msg);
-                } else {
-                    pretty_size = prettyFormatBytes(file_stat.st_size);
-                    SAFE_ASPRINTF(&swindow_info[line_pos], "<C>%-20.20s %15.15s",
-                            dir_entry->d_name, pretty_size);
-                    FREE_NULL(pretty_size);
-                }
+        for (i = 0; i < file_cnt; i++) {
+            info = &files[i];
+            if (info->error != 0) {
+                SAFE_ASPRINTF(&swindow_info[line_pos], "<C>%-22.22s %-50.50s",
+                        info->name, strerror(info->error));
                 line_pos++;
+                continue;
             }
+            if (info->hole_bytes < 0)
+                snprintf(hole_ratio, MISC_STRING_LEN, "-");
+            else
+                snprintf(hole_ratio, MISC_STRING_LEN, "%.1f%%",
+                        (info->size ? (double) info->hole_bytes * 100.0 /
+                        info->size : 0.0));
+            if (info->extents < 0)
+                snprintf(extents, MISC_STRING_LEN, "-");
+            else
+                snprintf(extents, MISC_STRING_LEN, "%ld", info->extents);
+            pretty_size = prettyFormatBytes(info->size);
+            pretty_alloc = prettyFormatBytes(info->allocated);
+            SAFE_ASPRINTF(&swindow_info[line_pos],
+                    "<C>%-22.22s %10.10s %10.10s %6.6s %8.8s %-12.12s",
+                    info->name, pretty_size, pretty_alloc, hole_ratio,
+                    extents, (info->prov_mode[0] ? info->prov_mode : "-"));
+            FREE_NULL(pretty_size);
+            FREE_NULL(pretty_alloc);
+            line_pos++;
         }
-    }
 
-    /* Close the directory stream */
-    closedir(dir_stream);
-
-    /* Add a message to the bottom explaining how to close the dialog */
-    if (line_pos < MAX_VDLIST_INFO_LINES) {
+        /* Add a message to the bottom explaining how to use the dialog */
         SAFE_ASPRINTF(&swindow_info[line_pos], " ");
         line_pos++;
-    }
-    if (line_pos < MAX_VDLIST_INFO_LINES) {
+        SAFE_ASPRINTF(&swindow_info[line_pos],
+                "<C>(Press '%c' to change the sort order.)", VDLIST_SORT_KEY);
+        line_pos++;
         SAFE_ASPRINTF(&swindow_info[line_pos], CONTINUE_MSG);
         line_pos++;
+
+        /* Set the scrolling window content */
+        setCDKSwindowContents(vdisk_files, swindow_info, line_pos);
+        for (i = 0; i < line_cnt; i++)
+            FREE_NULL(swindow_info[i]);
+
+        /* Drive the widget ourselves so the sort key can be caught; the
+         * 'g' makes the swindow widget scroll to the top */
+        drawCDKSwindow(vdisk_files, TRUE);
+        injectCDKSwindow(vdisk_files, 'g');
+        while (1) {
+            key = getchCDKObject(ObjOf(vdisk_files), &function_key);
+            if (key == VDLIST_SORT_KEY)
+                break;
+            injectCDKSwindow(vdisk_files, key);
+            if (vdisk_files->exitType != vEARLY_EXIT)
+                break;
+        }
+        destroyCDKSwindow(vdisk_files);
+        refreshCDKScreen(main_cdk_screen);
+        if (key != VDLIST_SORT_KEY)
+            break;
+        sort_key = (sort_key + 1) % VDISK_SORT_KEYS;
     }
 
-    /* Set the scrolling window content */
-    setCDKSwindowContents(vdisk_files, swindow_info, line_pos);
+    /* Done */
+    FREE_NULL(swindow_info);
+    FREE_NULL(files);
+    return;
+}
 
-    /* The 'g' makes the swindow widget scroll to the top, then activate */
-    injectCDKSwindow(vdisk_files, 'g');
-    activateCDKSwindow(vdisk_files, 0);
 
-    /* We fell through -- the user exited the widget, but we don't care how */
-    destroyCDKSwindow(vdisk_files);
+/*
+ * Run the Virtual Disk Jobs dialog; lists the background jobs (eager zero
+ * fills) with their progress, and lets the user cancel, resume, or remove
+ * one. The list is re-read each time we come back around.
+ */
+void vdiskJobsDialog(CDKSCREEN *main_cdk_screen) {
+    CDKSCROLL *jobs_scroll = 0;
+    VDISKJOB jobs[MAX_VDISK_JOBS];
+    char *scroll_list[MAX_VDISK_JOBS] = {NULL};
+    char *error_msg = NULL, *pretty_rate = NULL;
+    const char *file_name = NULL;
+    char job_msg[MAX_TUI_STR_LEN] = {0}, error_str[MAX_TUI_STR_LEN] = {0},
+            job_detail[MAX_TUI_STR_LEN] = {0};
+    int job_slots[MAX_VDISK_JOBS] = {0};
+    int i = 0, job_cnt = 0, user_choice = 0, slot = 0, ret_val = 0;
+
+    while (1) {
+        /* Get the current jobs */
+        if ((ret_val = readVDiskJobs(jobs)) != 0) {
+            SAFE_ASPRINTF(&error_msg, "readVDiskJobs(): %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        job_cnt = 0;
+        for (i = 0; i < MAX_VDISK_JOBS; i++) {
+            if (jobs[i].state == VDISK_JOB_FREE)
+                continue;
+            file_name = strrchr(jobs[i].path, '/');
+            file_name = (file_name != NULL) ? file_name + 1 : jobs[i].path;
+            /* Running jobs show their rate; a finished (or cancelled)
+             * defrag shows the extent count before and after, and a
+             * reclaim the space it freed */
+            if (jobs[i].state == VDISK_JOB_RUNNING) {
+                pretty_rate = prettyFormatBytes(jobs[i].rate);
+                snprintf(job_detail, MAX_TUI_STR_LEN, "%s/s", pretty_rate);
+                FREE_NULL(pretty_rate);
+            } else if (jobs[i].type == VDISK_JOB_RECLAIM &&
+                    jobs[i].state != VDISK_JOB_INTERRUPTED) {
+                pretty_rate = prettyFormatBytes(jobs[i].reclaimed);
+                snprintf(job_detail, MAX_TUI_STR_LEN, "%s freed",
+                        pretty_rate);
+                FREE_NULL(pretty_rate);
+            } else if (jobs[i].type == VDISK_JOB_DEFRAG &&
+                    (jobs[i].state == VDISK_JOB_DONE ||
+                    jobs[i].state == VDISK_JOB_CANCELLED) &&
+                    jobs[i].extents_before >= 0 &&
+                    jobs[i].extents_after >= 0) {
+                snprintf(job_detail, MAX_TUI_STR_LEN, "%ld > %ld ext",
+                        jobs[i].extents_before, jobs[i].extents_after);
+            } else {
+                snprintf(job_detail, MAX_TUI_STR_LEN, "-");
+            }
+            /* A running job held back by its governor shows as throttled */
+            SAFE_ASPRINTF(&scroll_list[job_cnt],
+                    "<C>%-18.18s %-9.9s %-11.11s %5.1f%% %14.14s", file_name,
+                    g_vdisk_job_types[jobs[i].type],
+                    (jobs[i].state == VDISK_JOB_RUNNING &&
+                    jobs[i].rate_limit > 0) ? "Throttled" :
+                    g_vdisk_job_states[jobs[i].state],
+                    (jobs[i].size > 0) ?
+                    (jobs[i].offset * 100.0 / jobs[i].size) : 100.0,
+                    job_detail);
+            job_slots[job_cnt] = i;
+            job_cnt++;
+        }
+        if (job_cnt == 0) {
+            errorDialog(main_cdk_screen, "There are no virtual disk jobs.",
+                    NULL);
+            break;
+        }
+
+        /* Get the job choice */
+        jobs_scroll = newCDKScroll(main_cdk_screen, CENTER, CENTER, NONE,
+                15, 70, "<C></31/B>Virtual Disk Jobs (Select for Options)\n",
+                scroll_list, job_cnt, FALSE, COLOR_DIALOG_SELECT, TRUE, FALSE);
+        if (!jobs_scroll) {
+            errorDialog(main_cdk_screen, SCROLL_ERR_MSG, NULL);
+            break;
+        }
+        setCDKScrollBoxAttribute(jobs_scroll, COLOR_DIALOG_BOX);
+        setCDKScrollBackgroundAttrib(jobs_scroll, COLOR_DIALOG_TEXT);
+        user_choice = activateCDKScroll(jobs_scroll, 0);
+        if (jobs_scroll->exitType != vNORMAL)
+            break;
+        destroyCDKScroll(jobs_scroll);
+        jobs_scroll = NULL;
+        refreshCDKScreen(main_cdk_screen);
+        for (i = 0; i < job_cnt; i++)
+            FREE_NULL(scroll_list[i]);
+
+        /* What can be done depends on the state */
+        slot = job_slots[user_choice];
+        snprintf(job_msg, MAX_TUI_STR_LEN, "'%.50s'?", jobs[slot].path);
+        ret_val = 0;
+        if (jobs[slot].state == VDISK_JOB_RUNNING) {
+            if (questionDialog(main_cdk_screen, "Cancel the job for", job_msg))
+                ret_val = cancelVDiskJob(slot);
+        } else if (jobs[slot].state == VDISK_JOB_DONE) {
+            if (questionDialog(main_cdk_screen,
+                    "Remove the finished job for", job_msg))
+                ret_val = removeVDiskJob(slot);
+        } else {
+            if (jobs[slot].state == VDISK_JOB_FAILED &&
+                    jobs[slot].type == VDISK_JOB_DEFRAG &&
+                    jobs[slot].error == EBUSY) {
+                errorDialog(main_cdk_screen, XFS_FSR_MODIFIED_1,
+                        XFS_FSR_MODIFIED_2);
+            } else if (jobs[slot].state == VDISK_JOB_FAILED) {
+                snprintf(error_str, MAX_TUI_STR_LEN, "The job failed: %s",
+                        strerror(jobs[slot].error));
+                errorDialog(main_cdk_screen, error_str, NULL);
+            }
+            if (questionDialog(main_cdk_screen, "Resume the job for",
+                    job_msg))
+                ret_val = resumeVDiskJob(slot);
+            else if (questionDialog(main_cdk_screen, "Remove the job for",
+                    job_msg))
+                ret_val = removeVDiskJob(slot);
+        }
+        if (ret_val != 0) {
+            SAFE_ASPRINTF(&error_msg, "Changing the job failed: %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+        }
+    }
 
     /* Done */
-    for (i = 0; i < MAX_VDLIST_INFO_LINES; i++)
-        FREE_NULL(swindow_info[i]);
+    if (jobs_scroll != NULL)
+        destroyCDKScroll(jobs_scroll);
+    refreshCDKScreen(main_cdk_screen);
+    for (i = 0; i < MAX_VDISK_JOBS; i++)
+        FREE_NULL(scroll_list[i]);
     return;
 }
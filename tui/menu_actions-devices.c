@@ -13,29 +13,101 @@
 #include <cdk.h>
 #include <syslog.h>
 #include <assert.h>
+#include <unistd.h>
+#include <limits.h>
 
 #include "prototypes.h"
 #include "system.h"
 #include "dialogs.h"
 #include "strings.h"
+#include "provision.h"
 
 /*
  * Run the Device Information dialog
  */
 void devInfoDialog(CDKSCREEN *main_cdk_screen) {
     CDKSWINDOW *dev_info = 0;
+    /* Attributes to show (label, then the attribute name); the common ones
+     * come first, then those for certain device handlers */
+    static const char *common_attrs[][2] = {
+        {"</B>Number of Threads:<!B>\t", "threads_num"},
+        {"</B>Threads Pool Type:<!B>\t", "threads_pool_type"},
+        {"</B>SCSI Type:<!B>\t\t", "type"}
+    };
+    static const char *vcdrom_attrs[][2] = {
+        {"</B>Filename:<!B>\t", "filename"}
+    };
+    static const char *vdisk_attrs[][2] = {
+        {"</B>Filename:<!B>\t", "filename"},
+        {"</B>Block Size:<!B>\t", "blocksize"},
+        {"</B>NV Cache:<!B>\t", "nv_cache"},
+        {"</B>Read Only:<!B>\t", "read_only"},
+        {"</B>Removable:<!B>\t", "removable"},
+        {"</B>Rotational:<!B>\t", "rotational"},
+        {"</B>Write Through:<!B>\t", "write_through"}
+    };
+    static const char *nullio_attrs[][2] = {
+        {"</B>Block Size:<!B>\t", "blocksize"},
+        {"</B>Read Only:<!B>\t", "read_only"},
+        {"</B>Removable:<!B>\t", "removable"},
+        {"</B>Rotational:<!B>\t", "rotational"}
+    };
+    const char *(*extra_attrs)[2] = NULL;
+    const char *attr_labels[MAX_DEV_INFO_ATTRS] = {NULL};
+    ATTRREAD attrs[MAX_DEV_INFO_ATTRS];
     char scst_dev[MAX_SYSFS_ATTR_SIZE] = {0},
             scst_hndlr[MAX_SYSFS_ATTR_SIZE] = {0},
             dir_name[MAX_SYSFS_PATH_SIZE] = {0},
-            tmp_buff[MAX_SYSFS_ATTR_SIZE] = {0};
+            attr_values[MAX_DEV_INFO_ATTRS][MAX_SYSFS_ATTR_SIZE];
     char *swindow_info[MAX_DEV_INFO_LINES] = {NULL};
-    int i = 0, line_cnt = 0;
+    char *error_msg = NULL;
+    int i = 0, line_cnt = 0, attr_cnt = 0, extra_cnt = 0, dev_dir_fd = -1,
+            temp_int = 0;
 
     /* Have the user choose a SCST device */
     getSCSTDevChoice(main_cdk_screen, scst_dev, scst_hndlr);
     if (scst_dev[0] == '\0' || scst_hndlr[0] == '\0')
         return;
 
+    /* Read all of the device attributes in one go */
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s",
+            SYSFS_SCST_TGT, scst_hndlr, scst_dev);
+    if ((temp_int = openAttrDir(dir_name, &dev_dir_fd)) != 0) {
+        SAFE_ASPRINTF(&error_msg, "Couldn't open SCST device: %s",
+                strerror(temp_int));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+        return;
+    }
+    if (strcmp(scst_hndlr, "vcdrom") == 0) {
+        extra_attrs = vcdrom_attrs;
+        extra_cnt = sizeof (vcdrom_attrs) / sizeof (*vcdrom_attrs);
+    } else if (strcmp(scst_hndlr, "vdisk_blockio") == 0 ||
+            strcmp(scst_hndlr, "vdisk_fileio") == 0) {
+        extra_attrs = vdisk_attrs;
+        extra_cnt = sizeof (vdisk_attrs) / sizeof (*vdisk_attrs);
+    } else if (strcmp(scst_hndlr, "vdisk_nullio") == 0) {
+        extra_attrs = nullio_attrs;
+        extra_cnt = sizeof (nullio_attrs) / sizeof (*nullio_attrs);
+    }
+    for (i = 0; i < (int) (sizeof (common_attrs) / sizeof (*common_attrs));
+            i++) {
+        attr_labels[attr_cnt] = common_attrs[i][0];
+        attrs[attr_cnt].name = common_attrs[i][1];
+        attr_cnt++;
+    }
+    for (i = 0; i < extra_cnt && attr_cnt < MAX_DEV_INFO_ATTRS; i++) {
+        attr_labels[attr_cnt] = extra_attrs[i][0];
+        attrs[attr_cnt].name = extra_attrs[i][1];
+        attr_cnt++;
+    }
+    for (i = 0; i < attr_cnt; i++) {
+        attrs[i].dir_fd = dev_dir_fd;
+        attrs[i].value = attr_values[i];
+    }
+    readAttributes(attrs, attr_cnt);
+    close(dev_dir_fd);
+
     /* Setup scrolling window widget */
     dev_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
             (DEV_INFO_ROWS + 2), (DEV_INFO_COLS + 2),
@@ -48,115 +120,23 @@ void devInfoDialog(CDKSCREEN *main_cdk_screen) {
     setCDKSwindowBackgroundAttrib(dev_info, COLOR_DIALOG_TEXT);
     setCDKSwindowBoxAttribute(dev_info, COLOR_DIALOG_BOX);
 
-    /* Add device information (common attributes) */
+    /* Add device information; a blank line separates the common
+     * attributes from the handler specific ones */
     SAFE_ASPRINTF(&swindow_info[0], "</B>Device Name:<!B>\t\t%s", scst_dev);
     SAFE_ASPRINTF(&swindow_info[1], "</B>Device Handler:<!B>\t\t%s", scst_hndlr);
-    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/threads_num",
-            SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-    readAttribute(dir_name, tmp_buff);
-    SAFE_ASPRINTF(&swindow_info[2], "</B>Number of Threads:<!B>\t%s", tmp_buff);
-    snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-            "%s/handlers/%s/%s/threads_pool_type",
-            SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-    readAttribute(dir_name, tmp_buff);
-    SAFE_ASPRINTF(&swindow_info[3], "</B>Threads Pool Type:<!B>\t%s", tmp_buff);
-    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/type",
-            SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-    readAttribute(dir_name, tmp_buff);
-    SAFE_ASPRINTF(&swindow_info[4], "</B>SCSI Type:<!B>\t\t%s", tmp_buff);
-    SAFE_ASPRINTF(&swindow_info[5], " ");
-    line_cnt = 6;
-
-    /* Some extra attributes for certain device handlers */
-    if (strcmp(scst_hndlr, "vcdrom") == 0) {
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/filename",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[6], "</B>Filename:<!B>\t%s", tmp_buff);
-        line_cnt = 7;
-
-    } else if (strcmp(scst_hndlr, "vdisk_blockio") == 0) {
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/filename",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[6], "</B>Filename:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/blocksize",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[7], "</B>Block Size:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/nv_cache",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[8], "</B>NV Cache:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/read_only",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[9], "</B>Read Only:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/removable",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[10], "</B>Removable:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/rotational",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[11], "</B>Rotational:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-                "%s/handlers/%s/%s/write_through",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[12], "</B>Write Through:<!B>\t%s", tmp_buff);
-        line_cnt = 13;
-
-    } else if (strcmp(scst_hndlr, "vdisk_fileio") == 0) {
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/filename",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[6], "</B>Filename:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/blocksize",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[7], "</B>Block Size:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/nv_cache",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[8], "</B>NV Cache:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/read_only",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[9], "</B>Read Only:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/removable",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[10], "</B>Removable:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/rotational",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[11], "</B>Rotational:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-                "%s/handlers/%s/%s/write_through",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[12], "</B>Write Through:<!B>\t%s", tmp_buff);
-        line_cnt = 13;
-
-    } else if (strcmp(scst_hndlr, "vdisk_nullio") == 0) {
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/blocksize",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[6], "</B>Block Size:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/read_only",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[7], "</B>Read Only:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/removable",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[8], "</B>Removable:<!B>\t%s", tmp_buff);
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/%s/rotational",
-                SYSFS_SCST_TGT, scst_hndlr, scst_dev);
-        readAttribute(dir_name, tmp_buff);
-        SAFE_ASPRINTF(&swindow_info[9], "</B>Rotational:<!B>\t%s", tmp_buff);
-        line_cnt = 10;
+    line_cnt = 2;
+    for (i = 0; i < attr_cnt && line_cnt < MAX_DEV_INFO_LINES; i++) {
+        if (attrs[i].error != 0)
+            SAFE_ASPRINTF(&swindow_info[line_cnt], "%s(%s)", attr_labels[i],
+                    strerror(attrs[i].error));
+        else
+            SAFE_ASPRINTF(&swindow_info[line_cnt], "%s%s", attr_labels[i],
+                    attrs[i].value);
+        line_cnt++;
+        if (i == 2 && line_cnt < MAX_DEV_INFO_LINES) {
+            SAFE_ASPRINTF(&swindow_info[line_cnt], " ");
+            line_cnt++;
+        }
     }
 
     /* Add a message to the bottom explaining how to close the dialog */
@@ -213,8 +193,11 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
     char *dev_info_msg[ADD_DEV_INFO_LINES] = {NULL};
     int dev_window_lines = 0, dev_window_cols = 0, window_y = 0, window_x = 0,
             dev_choice = 0, temp_int = 0, i = 0, traverse_ret = 0,
-            fio_type_choice = 0;
+            fio_type_choice = 0, profile_choice = 0, result_cnt = 0;
     boolean mounted = FALSE;
+    TUNINGPROFILE profiles[TUNING_MAX_PROFILES];
+    TUNINGPROFILE *profile = NULL;
+    TUNINGRESULT results[TUNING_ATTRS];
 
     /* Prompt for new device type */
     dev_list = newCDKScroll(main_cdk_screen, CENTER, CENTER, NONE, 15, 30,
@@ -338,6 +321,12 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
             if ((block_dev = getBlockDevChoice(main_cdk_screen)) == NULL)
                 break;
 
+            /* Start from a tuning profile (or not) */
+            if ((profile_choice = getTuningProfileChoice(main_cdk_screen,
+                    profiles, TRUE)) == -2)
+                break;
+            profile = (profile_choice >= 0) ? &profiles[profile_choice] : NULL;
+
             /* New CDK screen */
             dev_window_lines = 18;
             dev_window_cols = 60;
@@ -386,7 +375,9 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
             /* Block size widget (item list) */
             block_size = newCDKItemlist(dev_screen,
                     (window_x + 1), (window_y + 7),
-                    "</B>Block Size", NULL, g_scst_bs_list, 5, 0, FALSE, FALSE);
+                    "</B>Block Size", NULL, g_scst_bs_list, 5,
+                    tuningValueIndex(profile, TUNING_BLOCKSIZE,
+                    g_scst_bs_list, 5, 0), FALSE, FALSE);
             if (!block_size) {
                 errorDialog(main_cdk_screen, ITEM_LIST_ERR_MSG, NULL);
                 break;
@@ -403,7 +394,9 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(write_through, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(write_through, 0);
+            setCDKRadioCurrentItem(write_through,
+                    tuningValueIndex(profile, TUNING_WRITE_THROUGH, NULL, 2,
+                    0));
 
             /* NV cache widget (radio) */
             nv_cache = newCDKRadio(dev_screen, (window_x + 18), (window_y + 7),
@@ -415,7 +408,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(nv_cache, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(nv_cache, 0);
+            setCDKRadioCurrentItem(nv_cache,
+                    tuningValueIndex(profile, TUNING_NV_CACHE, NULL, 2, 0));
 
             /* Read only widget (radio) */
             read_only = newCDKRadio(dev_screen, (window_x + 18),
@@ -451,7 +445,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(rotational, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(rotational, 1);
+            setCDKRadioCurrentItem(rotational,
+                    tuningValueIndex(profile, TUNING_ROTATIONAL, NULL, 2, 1));
 
             /* Buttons */
             ok_button = newCDKButton(dev_screen, (window_x + 21),
@@ -498,11 +493,28 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                         getCDKRadioSelectedItem(read_only),
                         getCDKRadioSelectedItem(removable),
                         getCDKRadioSelectedItem(rotational));
+                tuningCreateParams(profile, "vdisk_blockio", attr_value,
+                        MAX_SYSFS_ATTR_SIZE);
                 if ((temp_int = writeAttribute(attr_path, attr_value)) != 0) {
                     SAFE_ASPRINTF(&error_msg, "Couldn't add SCST device: %s",
                             strerror(temp_int));
                     errorDialog(main_cdk_screen, error_msg, NULL);
                     FREE_NULL(error_msg);
+                } else if (profile != NULL && (temp_int =
+                        applyTuningProfile(profile,
+                        getCDKEntryValue(dev_name_field), "vdisk_blockio",
+                        results, &result_cnt)) != 0) {
+                    SAFE_ASPRINTF(&error_msg,
+                            "Couldn't apply the tuning profile: %s",
+                            strerror(temp_int));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                } else if (profile == NULL ||
+                        profile->values[TUNING_THREADS_NUM][0] == '\0') {
+                    /* No threads from the profile; size them */
+                    autoTuneDevice(main_cdk_screen,
+                            getCDKEntryValue(dev_name_field), "vdisk_blockio",
+                            block_dev);
                 }
             }
             break;
@@ -580,6 +592,14 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                         strncpy(fileio_file, block_dev, MAX_SYSFS_PATH_SIZE);
                 }
             }
+            if (fileio_file[0] == '\0')
+                break;
+
+            /* Start from a tuning profile (or not) */
+            if ((profile_choice = getTuningProfileChoice(main_cdk_screen,
+                    profiles, TRUE)) == -2)
+                break;
+            profile = (profile_choice >= 0) ? &profiles[profile_choice] : NULL;
 
             /* New CDK screen */
             dev_window_lines = 18;
@@ -629,7 +649,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
             /* Block size widget (item list) */
             block_size = newCDKItemlist(dev_screen, (window_x + 1),
                     (window_y + 7), "</B>Block Size", NULL,
-                    g_scst_bs_list, 5, 0, FALSE, FALSE);
+                    g_scst_bs_list, 5, tuningValueIndex(profile,
+                    TUNING_BLOCKSIZE, g_scst_bs_list, 5, 0), FALSE, FALSE);
             if (!block_size) {
                 errorDialog(main_cdk_screen, ITEM_LIST_ERR_MSG, NULL);
                 break;
@@ -646,7 +667,9 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(write_through, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(write_through, 0);
+            setCDKRadioCurrentItem(write_through,
+                    tuningValueIndex(profile, TUNING_WRITE_THROUGH, NULL, 2,
+                    0));
 
             /* NV cache widget (radio) */
             nv_cache = newCDKRadio(dev_screen, (window_x + 18), (window_y + 7),
@@ -658,7 +681,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(nv_cache, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(nv_cache, 0);
+            setCDKRadioCurrentItem(nv_cache,
+                    tuningValueIndex(profile, TUNING_NV_CACHE, NULL, 2, 0));
 
             /* Read only widget (radio) */
             read_only = newCDKRadio(dev_screen, (window_x + 18),
@@ -694,7 +718,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(rotational, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(rotational, 1);
+            setCDKRadioCurrentItem(rotational,
+                    tuningValueIndex(profile, TUNING_ROTATIONAL, NULL, 2, 1));
 
             /* Buttons */
             ok_button = newCDKButton(dev_screen, (window_x + 21),
@@ -741,17 +766,40 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                         getCDKRadioSelectedItem(read_only),
                         getCDKRadioSelectedItem(removable),
                         getCDKRadioSelectedItem(rotational));
+                tuningCreateParams(profile, "vdisk_fileio", attr_value,
+                        MAX_SYSFS_ATTR_SIZE);
                 if ((temp_int = writeAttribute(attr_path, attr_value)) != 0) {
                     SAFE_ASPRINTF(&error_msg, "Couldn't add SCST device: %s",
                             strerror(temp_int));
                     errorDialog(main_cdk_screen, error_msg, NULL);
                     FREE_NULL(error_msg);
+                } else if (profile != NULL && (temp_int =
+                        applyTuningProfile(profile,
+                        getCDKEntryValue(dev_name_field), "vdisk_fileio",
+                        results, &result_cnt)) != 0) {
+                    SAFE_ASPRINTF(&error_msg,
+                            "Couldn't apply the tuning profile: %s",
+                            strerror(temp_int));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
+                } else if (profile == NULL ||
+                        profile->values[TUNING_THREADS_NUM][0] == '\0') {
+                    /* No threads from the profile; size them */
+                    autoTuneDevice(main_cdk_screen,
+                            getCDKEntryValue(dev_name_field), "vdisk_fileio",
+                            fileio_file);
                 }
             }
             break;
 
         /* vdisk_nullio */
         case 5:
+            /* Start from a tuning profile (or not) */
+            if ((profile_choice = getTuningProfileChoice(main_cdk_screen,
+                    profiles, TRUE)) == -2)
+                break;
+            profile = (profile_choice >= 0) ? &profiles[profile_choice] : NULL;
+
             /* New CDK screen */
             dev_window_lines = 18;
             dev_window_cols = 50;
@@ -798,7 +846,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
             /* Block size widget (item list) */
             block_size = newCDKItemlist(dev_screen, (window_x + 1),
                     (window_y + 5), "</B>Block Size", NULL,
-                    g_scst_bs_list, 5, 0, FALSE, FALSE);
+                    g_scst_bs_list, 5, tuningValueIndex(profile,
+                    TUNING_BLOCKSIZE, g_scst_bs_list, 5, 0), FALSE, FALSE);
             if (!block_size) {
                 errorDialog(main_cdk_screen, ITEM_LIST_ERR_MSG, NULL);
                 break;
@@ -839,7 +888,8 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                 break;
             }
             setCDKRadioBackgroundAttrib(rotational, COLOR_DIALOG_TEXT);
-            setCDKRadioCurrentItem(rotational, 1);
+            setCDKRadioCurrentItem(rotational,
+                    tuningValueIndex(profile, TUNING_ROTATIONAL, NULL, 2, 1));
 
             /* Buttons */
             ok_button = newCDKButton(dev_screen, (window_x + 16),
@@ -883,11 +933,22 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
                         getCDKRadioSelectedItem(read_only),
                         getCDKRadioSelectedItem(removable),
                         getCDKRadioSelectedItem(rotational));
+                tuningCreateParams(profile, "vdisk_nullio", attr_value,
+                        MAX_SYSFS_ATTR_SIZE);
                 if ((temp_int = writeAttribute(attr_path, attr_value)) != 0) {
                     SAFE_ASPRINTF(&error_msg, "Couldn't add SCST device: %s",
                             strerror(temp_int));
                     errorDialog(main_cdk_screen, error_msg, NULL);
                     FREE_NULL(error_msg);
+                } else if (profile != NULL && (temp_int =
+                        applyTuningProfile(profile,
+                        getCDKEntryValue(dev_name_field), "vdisk_nullio",
+                        results, &result_cnt)) != 0) {
+                    SAFE_ASPRINTF(&error_msg,
+                            "Couldn't apply the tuning profile: %s",
+                            strerror(temp_int));
+                    errorDialog(main_cdk_screen, error_msg, NULL);
+                    FREE_NULL(error_msg);
                 }
             }
             break;
@@ -972,28 +1033,415 @@ void addDeviceDialog(CDKSCREEN *main_cdk_screen) {
 }
 
 
+/*
+ * Run the Bulk Add Devices dialog; every device in a manifest (see
+ * provision.h) is checked first, then they're all added, or none are
+ */
+void bulkAddDeviceDialog(CDKSCREEN *main_cdk_screen) {
+    CDKFSELECT *file_select = 0;
+    CDKSWINDOW *bulk_info = 0;
+    PROVDEV *devs = NULL;
+    PROVSUMMARY summary = {0};
+    char manifest_file[PATH_MAX] = {0}, manifest_err[PROVISION_ERR_LEN] = {0};
+    char *error_msg = NULL, *confirm_msg = NULL, *selected_file = NULL;
+    char *swindow_info[MAX_BULK_ADD_INFO_LINES] = {NULL};
+    int dev_cnt = 0, bad_cnt = 0, ret_val = 0, line_cnt = 0, i = 0;
+    boolean confirm = FALSE;
+
+    while (1) {
+        /* Have the user choose the manifest */
+        file_select = newCDKFselect(main_cdk_screen, CENTER, CENTER, 20, 40,
+                "<C></31/B>Choose a Device Manifest (CSV)\n", "File: ",
+                COLOR_DIALOG_INPUT, '_' | COLOR_DIALOG_INPUT,
+                A_REVERSE, "</N>", "</B>", "</N>", "</N>", TRUE, FALSE);
+        if (!file_select) {
+            errorDialog(main_cdk_screen, FSELECT_ERR_MSG, NULL);
+            break;
+        }
+        setCDKFselectBoxAttribute(file_select, COLOR_DIALOG_BOX);
+        setCDKFselectBackgroundAttrib(file_select, COLOR_DIALOG_TEXT);
+        setCDKFselectDirectory(file_select, "/");
+        selected_file = activateCDKFselect(file_select, 0);
+        if (file_select->exitType != vNORMAL)
+            break;
+        snprintf(manifest_file, PATH_MAX, "%s", selected_file);
+        destroyCDKFselect(file_select);
+        file_select = NULL;
+        refreshCDKScreen(main_cdk_screen);
+
+        /* Read it, and check every entry */
+        if ((ret_val = loadProvisionManifest(manifest_file, &devs, &dev_cnt,
+                &bad_cnt, manifest_err)) == EINVAL) {
+            SAFE_ASPRINTF(&error_msg, "(%d bad entries; nothing was added.)",
+                    bad_cnt);
+            errorDialog(main_cdk_screen, manifest_err, error_msg);
+            FREE_NULL(error_msg);
+            break;
+        } else if (ret_val == E2BIG) {
+            errorDialog(main_cdk_screen, manifest_err, NULL);
+            break;
+        } else if (ret_val == ENODATA) {
+            errorDialog(main_cdk_screen, "The manifest has no devices!",
+                    NULL);
+            break;
+        } else if (ret_val != 0) {
+            SAFE_ASPRINTF(&error_msg, "loadProvisionManifest(): %s",
+                    strerror(ret_val));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+
+        /* Get a final confirmation from user before we add them */
+        SAFE_ASPRINTF(&confirm_msg, "add %d SCST devices from the manifest?",
+                dev_cnt);
+        confirm = confirmDialog(main_cdk_screen, "Are you sure you want to",
+                confirm_msg);
+        FREE_NULL(confirm_msg);
+        if (!confirm)
+            break;
+
+        /* Setup scrolling window widget */
+        bulk_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
+                (BULK_ADD_INFO_ROWS + 2), (BULK_ADD_INFO_COLS + 2),
+                "<C></31/B>Bulk Adding SCST Devices\n",
+                MAX_BULK_ADD_INFO_LINES, TRUE, FALSE);
+        if (!bulk_info) {
+            errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+            break;
+        }
+        setCDKSwindowBackgroundAttrib(bulk_info, COLOR_DIALOG_TEXT);
+        setCDKSwindowBoxAttribute(bulk_info, COLOR_DIALOG_BOX);
+        SAFE_ASPRINTF(&swindow_info[0], "Adding %d devices (%d at a time)...",
+                dev_cnt, PROVISION_THREADS);
+        line_cnt = 1;
+        setCDKSwindowContents(bulk_info, swindow_info, line_cnt);
+        drawCDKSwindow(bulk_info, TRUE);
+        refreshCDKScreen(main_cdk_screen);
+
+        /* Add them (all or nothing) and show how it went */
+        ret_val = runProvision(devs, dev_cnt, &summary);
+        if (ret_val == 0) {
+            SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                    "</B>Added %d devices in %.2f seconds.<!B>",
+                    summary.added, summary.total_usecs / 1000000.0);
+        } else {
+            SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                    "</B>Line %d (%s) failed:<!B> %s",
+                    devs[summary.failed].line, devs[summary.failed].name,
+                    strerror(ret_val));
+            SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                    "Removed the %d devices already added (%d left over).",
+                    summary.rolled_back, summary.added - summary.rolled_back);
+            SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                    "Took %.2f seconds in all.",
+                    summary.total_usecs / 1000000.0);
+        }
+        if (summary.added > 0)
+            SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                    "Per device: %.1f ms average, %.1f ms slowest.",
+                    summary.avg_usecs / 1000.0, summary.max_usecs / 1000.0);
+        SAFE_ASPRINTF(&swindow_info[line_cnt++], " ");
+        SAFE_ASPRINTF(&swindow_info[line_cnt++], CONTINUE_MSG);
+        setCDKSwindowContents(bulk_info, swindow_info, line_cnt);
+        activateCDKSwindow(bulk_info, 0);
+        break;
+    }
+
+    /* Done */
+    if (file_select != NULL)
+        destroyCDKFselect(file_select);
+    if (bulk_info != NULL)
+        destroyCDKSwindow(bulk_info);
+    for (i = 0; i < MAX_BULK_ADD_INFO_LINES; i++)
+        FREE_NULL(swindow_info[i]);
+    freeProvisionManifest(devs, dev_cnt);
+    refreshCDKScreen(main_cdk_screen);
+    /* Using the file selector widget changes the CWD -- fix it */
+    if ((chdir(getenv("HOME"))) == -1) {
+        SAFE_ASPRINTF(&error_msg, "chdir(): %s", strerror(errno));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+    }
+    return;
+}
+
+
+/*
+ * Run the Tune Device dialog; the run-time attributes in a tuning profile
+ * are applied to an existing device, and the creation-time ones checked
+ */
+void tuneDeviceDialog(CDKSCREEN *main_cdk_screen) {
+    CDKSWINDOW *tune_info = 0;
+    TUNINGPROFILE profiles[TUNING_MAX_PROFILES];
+    TUNINGRESULT results[TUNING_ATTRS];
+    TUNINGPROFILE *profile = NULL;
+    char scst_dev[MAX_SYSFS_ATTR_SIZE] = {0},
+            scst_hndlr[MAX_SYSFS_ATTR_SIZE] = {0};
+    char *swindow_info[MAX_TUNE_INFO_LINES] = {NULL};
+    int profile_choice = 0, result_cnt = 0, line_cnt = 0, i = 0;
+
+    /* Have the user choose a SCST device, then a profile */
+    getSCSTDevChoice(main_cdk_screen, scst_dev, scst_hndlr);
+    if (scst_dev[0] == '\0' || scst_hndlr[0] == '\0')
+        return;
+    if ((profile_choice = getTuningProfileChoice(main_cdk_screen, profiles,
+            FALSE)) < 0)
+        return;
+    profile = &profiles[profile_choice];
+
+    /* Setup scrolling window widget */
+    tune_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
+            (TUNE_INFO_ROWS + 2), (TUNE_INFO_COLS + 2),
+            "<C></31/B>Tuning SCST Device\n", MAX_TUNE_INFO_LINES,
+            TRUE, FALSE);
+    if (!tune_info) {
+        errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+        return;
+    }
+    setCDKSwindowBackgroundAttrib(tune_info, COLOR_DIALOG_TEXT);
+    setCDKSwindowBoxAttribute(tune_info, COLOR_DIALOG_BOX);
+
+    /* Apply it, and show what happened to each attribute */
+    applyTuningProfile(profile, scst_dev, scst_hndlr, results, &result_cnt);
+    SAFE_ASPRINTF(&swindow_info[line_cnt++], "</B>Device:<!B>\t%s (%s)",
+            scst_dev, scst_hndlr);
+    SAFE_ASPRINTF(&swindow_info[line_cnt++], "</B>Profile:<!B>\t%s (%s)",
+            profile->name, profile->description);
+    SAFE_ASPRINTF(&swindow_info[line_cnt++], " ");
+    for (i = 0; i < result_cnt && line_cnt < MAX_TUNE_INFO_LINES - 2; i++) {
+        switch (results[i].status) {
+            case TUNING_SET:
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-18s<!B> %s -> %s",
+                        tuningAttrName(results[i].attr), results[i].old_value,
+                        profile->values[results[i].attr]);
+                break;
+            case TUNING_SAME:
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-18s<!B> %s (no change)",
+                        tuningAttrName(results[i].attr), results[i].old_value);
+                break;
+            case TUNING_CREATE_ONLY:
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-18s<!B> %s (wants %s; re-create device)",
+                        tuningAttrName(results[i].attr), results[i].old_value,
+                        profile->values[results[i].attr]);
+                break;
+            default:
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-18s<!B> failed: %s",
+                        tuningAttrName(results[i].attr),
+                        strerror(results[i].error));
+                break;
+        }
+    }
+    if (result_cnt == 0)
+        SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                "The profile has nothing for %s devices.", scst_hndlr);
+    SAFE_ASPRINTF(&swindow_info[line_cnt++], " ");
+    SAFE_ASPRINTF(&swindow_info[line_cnt++], CONTINUE_MSG);
+    setCDKSwindowContents(tune_info, swindow_info, line_cnt);
+    activateCDKSwindow(tune_info, 0);
+
+    /* Done */
+    destroyCDKSwindow(tune_info);
+    refreshCDKScreen(main_cdk_screen);
+    for (i = 0; i < MAX_TUNE_INFO_LINES; i++)
+        FREE_NULL(swindow_info[i]);
+    return;
+}
+
+
+/*
+ * Offer threads_num/threads_pool_type sized from the back-end's request
+ * queue for a device that was just added.
+ */
+void autoTuneDevice(CDKSCREEN *main_cdk_screen, char dev_name[],
+        char handler[], char backing[]) {
+    TUNINGQUEUE queue;
+    TUNINGPROFILE recommended;
+    TUNINGRESULT results[TUNING_ATTRS];
+    char *question_1 = NULL, *question_2 = NULL, *error_msg = NULL;
+    int result_cnt = 0, temp_int = 0;
+
+    /* Nothing to go on without a block device behind it */
+    if ((temp_int = inspectBackingQueue(backing, &queue)) != 0) {
+        DEBUG_LOG("Couldn't inspect the queue for '%s': %s", backing,
+                strerror(temp_int));
+        return;
+    }
+    recommendTuning(&queue, &recommended);
+
+    SAFE_ASPRINTF(&question_1, "%s: %s, %d requests, %d queue(s), node %d",
+            queue.disk, (queue.rotational ? "rotational" : "flash"),
+            queue.nr_requests, queue.hw_queues, queue.numa_node);
+    SAFE_ASPRINTF(&question_2, "Use %s thread(s) (%s) for device '%s'?",
+            recommended.values[TUNING_THREADS_NUM],
+            recommended.values[TUNING_THREADS_POOL], dev_name);
+    if (questionDialog(main_cdk_screen, question_1, question_2) &&
+            (temp_int = applyTuningProfile(&recommended, dev_name, handler,
+            results, &result_cnt)) != 0) {
+        SAFE_ASPRINTF(&error_msg, "Couldn't set the device threads: %s",
+                strerror(temp_int));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+    }
+    FREE_NULL(question_1);
+    FREE_NULL(question_2);
+    return;
+}
+
+
+/*
+ * Run the Rebalance Threads dialog; threads_num/threads_pool_type are
+ * recomputed for every vdisk_blockio/vdisk_fileio device, with the
+ * devices on a NUMA node sharing its CPUs
+ */
+void rebalanceDevicesDialog(CDKSCREEN *main_cdk_screen) {
+    CDKSWINDOW *rebal_info = 0;
+    TUNINGPLAN *plans = NULL, *plan = NULL;
+    TUNINGRESULT results[TUNING_ATTRS];
+    char *swindow_info[MAX_REBAL_INFO_LINES] = {NULL};
+    char *error_msg = NULL, *confirm_msg = NULL;
+    char old_threads[TUNING_VALUE_LEN] = {0};
+    int plan_cnt = 0, result_cnt = 0, line_cnt = 0, changed_cnt = 0,
+            temp_int = 0, i = 0, j = 0;
+    boolean confirm = FALSE;
+
+    while (1) {
+        /* Work out the new threads for every device */
+        if ((temp_int = planRebalance(&plans, &plan_cnt)) != 0) {
+            SAFE_ASPRINTF(&error_msg, "Couldn't read the SCST devices: %s",
+                    strerror(temp_int));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        if (plan_cnt == 0) {
+            errorDialog(main_cdk_screen,
+                    "There are no vdisk_blockio or vdisk_fileio devices.",
+                    NULL);
+            break;
+        }
+        SAFE_ASPRINTF(&confirm_msg, "Recompute the threads of %d device(s)?",
+                plan_cnt);
+        confirm = confirmDialog(main_cdk_screen, confirm_msg,
+                "Devices on a NUMA node will share its CPUs.");
+        FREE_NULL(confirm_msg);
+        if (!confirm)
+            break;
+
+        /* Setup scrolling window widget */
+        rebal_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
+                (REBAL_INFO_ROWS + 2), (REBAL_INFO_COLS + 2),
+                "<C></31/B>Rebalanced SCST Device Threads\n",
+                MAX_REBAL_INFO_LINES, TRUE, FALSE);
+        if (!rebal_info) {
+            errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+            break;
+        }
+        setCDKSwindowBackgroundAttrib(rebal_info, COLOR_DIALOG_TEXT);
+        setCDKSwindowBoxAttribute(rebal_info, COLOR_DIALOG_BOX);
+
+        /* Apply each one, and show what it got */
+        for (i = 0; i < plan_cnt && line_cnt < MAX_REBAL_INFO_LINES - 3;
+                i++) {
+            plan = &plans[i];
+            if (plan->error != 0) {
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-16s<!B> skipped: %s", plan->dev_name,
+                        strerror(plan->error));
+                continue;
+            }
+            temp_int = applyTuningProfile(&plan->profile, plan->dev_name,
+                    plan->handler, results, &result_cnt);
+            snprintf(old_threads, TUNING_VALUE_LEN, "?");
+            for (j = 0; j < result_cnt; j++) {
+                if (results[j].attr == TUNING_THREADS_NUM)
+                    snprintf(old_threads, TUNING_VALUE_LEN, "%s",
+                            results[j].old_value);
+                if (results[j].status == TUNING_SET)
+                    changed_cnt++;
+            }
+            if (temp_int != 0)
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-16s<!B> failed: %s", plan->dev_name,
+                        strerror(temp_int));
+            else
+                SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                        "</B>%-16s<!B> %-8s node %2d  %s -> %s (%s)",
+                        plan->dev_name, plan->queue.disk,
+                        plan->queue.numa_node, old_threads,
+                        plan->profile.values[TUNING_THREADS_NUM],
+                        plan->profile.values[TUNING_THREADS_POOL]);
+        }
+        SAFE_ASPRINTF(&swindow_info[line_cnt++], " ");
+        SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                "%d attribute(s) changed on %d device(s).", changed_cnt,
+                plan_cnt);
+        SAFE_ASPRINTF(&swindow_info[line_cnt++], CONTINUE_MSG);
+        setCDKSwindowContents(rebal_info, swindow_info, line_cnt);
+        activateCDKSwindow(rebal_info, 0);
+        break;
+    }
+
+    /* Done */
+    if (rebal_info)
+        destroyCDKSwindow(rebal_info);
+    refreshCDKScreen(main_cdk_screen);
+    for (i = 0; i < MAX_REBAL_INFO_LINES; i++)
+        FREE_NULL(swindow_info[i]);
+    FREE_NULL(plans);
+    return;
+}
+
+
 /*
  * Run the Delete Device dialog
  */
 void remDeviceDialog(CDKSCREEN *main_cdk_screen) {
+    SCSTSNAPSHOT *snapshot = NULL;
+    TOPODEVICE *device = NULL;
+    TOPOLUN *lun = NULL;
     char scst_dev[MAX_SYSFS_ATTR_SIZE] = {0},
             scst_hndlr[MAX_SYSFS_ATTR_SIZE] = {0},
             attr_path[MAX_SYSFS_PATH_SIZE] = {0},
             attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
-    char *error_msg = NULL, *confirm_msg = NULL;
+    char *error_msg = NULL, *confirm_msg = NULL, *export_msg = NULL;
     boolean confirm = FALSE;
-    int temp_int = 0;
+    int temp_int = 0, lun_cnt = 0, sess_cnt = 0;
 
     /* Have the user choose a SCST device to delete */
     getSCSTDevChoice(main_cdk_screen, scst_dev, scst_hndlr);
     if (scst_dev[0] == '\0' || scst_hndlr[0] == '\0')
         return;
 
+    /* SCST drops the device's LUNs with it; see if it is still exported */
+    if (refreshTopoDevice(scst_dev, &device) == 0 && device != NULL) {
+        snapshot = acquireSCSTSnapshot();
+        for (lun = device->luns; lun != NULL; lun = lun->dev_next) {
+            lun_cnt++;
+            sess_cnt += findTopoSessions(snapshot, lun->group, NULL, 0);
+        }
+        releaseSCSTSnapshot();
+        SAFE_ASPRINTF(&export_msg, "It is on %d LUN(s), used by %d "
+                "session(s).", lun_cnt, sess_cnt);
+    }
+
     /* Get a final confirmation from user before we delete */
-    SAFE_ASPRINTF(&confirm_msg, "SCST device '%s' (%s)?", scst_dev, scst_hndlr);
-    confirm = confirmDialog(main_cdk_screen, "Are you sure you want to delete",
-            confirm_msg);
+    if (export_msg == NULL) {
+        SAFE_ASPRINTF(&confirm_msg, "SCST device '%s' (%s)?", scst_dev,
+                scst_hndlr);
+        confirm = confirmDialog(main_cdk_screen,
+                "Are you sure you want to delete", confirm_msg);
+    } else {
+        SAFE_ASPRINTF(&confirm_msg, "Delete SCST device '%s' (%s)?",
+                scst_dev, scst_hndlr);
+        confirm = confirmDialog(main_cdk_screen, confirm_msg, export_msg);
+    }
     FREE_NULL(confirm_msg);
+    FREE_NULL(export_msg);
     if (confirm) {
         /* Delete the specified SCST device */
         snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/mgmt",
@@ -1004,6 +1452,8 @@ void remDeviceDialog(CDKSCREEN *main_cdk_screen) {
                     strerror(temp_int));
             errorDialog(main_cdk_screen, error_msg, NULL);
             FREE_NULL(error_msg);
+        } else {
+            topoRemoveDevice(scst_dev);
         }
     }
 
@@ -1146,6 +1596,9 @@ void mapDeviceDialog(CDKSCREEN *main_cdk_screen) {
                         strerror(temp_int));
                 errorDialog(main_cdk_screen, error_msg, NULL);
                 FREE_NULL(error_msg);
+            } else {
+                topoAddLUN(tgt_driver, scst_tgt, group_name,
+                        getCDKScaleValue(lun), scst_dev);
             }
         }
         break;
@@ -1167,13 +1620,16 @@ void mapDeviceDialog(CDKSCREEN *main_cdk_screen) {
  * Run the Unmap from Group dialog
  */
 void unmapDeviceDialog(CDKSCREEN *main_cdk_screen) {
+    SCSTSNAPSHOT *snapshot = NULL;
+    TOPOLOGY *topology = NULL;
+    TOPOGROUP *group = NULL;
     char scst_tgt[MAX_SYSFS_ATTR_SIZE] = {0},
             tgt_driver[MAX_SYSFS_ATTR_SIZE] = {0},
             group_name[MAX_SYSFS_ATTR_SIZE] = {0},
             attr_path[MAX_SYSFS_PATH_SIZE] = {0},
             attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
-    char *error_msg = NULL, *confirm_msg = NULL;
-    int temp_int = 0, lun = 0;
+    char *error_msg = NULL, *confirm_msg = NULL, *sess_msg = NULL;
+    int temp_int = 0, lun = 0, sess_cnt = 0;
     boolean confirm = FALSE;
 
     /* Have the user choose a SCST target */
@@ -1191,11 +1647,31 @@ void unmapDeviceDialog(CDKSCREEN *main_cdk_screen) {
     if (lun == -1)
         return;
 
+    /* Sessions using the group lose the LUN */
+    if ((topology = getTopology(FALSE)) != NULL &&
+            (group = findTopoGroup(topology, tgt_driver, scst_tgt,
+            group_name)) != NULL) {
+        snapshot = acquireSCSTSnapshot();
+        sess_cnt = findTopoSessions(snapshot, group, NULL, 0);
+        releaseSCSTSnapshot();
+    }
+
     /* Get a final confirmation from user before removing the LUN mapping */
-    SAFE_ASPRINTF(&confirm_msg, "SCST LUN %d from group '%s'?", lun, group_name);
-    confirm = confirmDialog(main_cdk_screen, "Are you sure you want to unmap",
-            confirm_msg);
-    FREE_NULL(confirm_msg);
+    if (sess_cnt == 0) {
+        SAFE_ASPRINTF(&confirm_msg, "SCST LUN %d from group '%s'?", lun,
+                group_name);
+        confirm = confirmDialog(main_cdk_screen,
+                "Are you sure you want to unmap", confirm_msg);
+        FREE_NULL(confirm_msg);
+    } else {
+        SAFE_ASPRINTF(&confirm_msg, "Unmap SCST LUN %d from group '%s'?",
+                lun, group_name);
+        SAFE_ASPRINTF(&sess_msg, "%d session(s) are using this group.",
+                sess_cnt);
+        confirm = confirmDialog(main_cdk_screen, confirm_msg, sess_msg);
+        FREE_NULL(confirm_msg);
+        FREE_NULL(sess_msg);
+    }
     if (confirm) {
         /* Remove the specified SCST LUN */
         snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
@@ -1207,6 +1683,8 @@ void unmapDeviceDialog(CDKSCREEN *main_cdk_screen) {
                     strerror(temp_int));
             errorDialog(main_cdk_screen, error_msg, NULL);
             FREE_NULL(error_msg);
+        } else {
+            topoRemoveLUN(tgt_driver, scst_tgt, group_name, lun);
         }
     }
 
@@ -1220,181 +1698,73 @@ void unmapDeviceDialog(CDKSCREEN *main_cdk_screen) {
  */
 void lunLayoutDialog(CDKSCREEN *main_cdk_screen) {
     CDKSWINDOW *lun_info = 0;
-    char *swindow_info[MAX_LUN_LAYOUT_LINES] = {NULL};
-    int i = 0, line_pos = 0, dev_path_size = 0, driver_cnt = 0;
-    char dir_name[MAX_SYSFS_PATH_SIZE] = {0},
-            link_path[MAX_SYSFS_PATH_SIZE] = {0},
-            dev_path[MAX_SYSFS_PATH_SIZE] = {0};
-    char tgt_drivers[MAX_SCST_DRIVERS][MISC_STRING_LEN] = {{0}, {0}};
-    DIR *tgt_dir_stream = NULL, *group_dir_stream = NULL,
-            *init_dir_stream = NULL, *lun_dir_stream = NULL;
-    struct dirent *tgt_dir_entry = NULL, *group_dir_entry = NULL,
-            *init_dir_entry = NULL, *lun_dir_entry = NULL;
-
-    /* Fill the array with current SCST target drivers */
-    if (!listSCSTTgtDrivers(tgt_drivers, &driver_cnt)) {
-        errorDialog(main_cdk_screen, TGT_DRIVERS_ERR, NULL);
+    TOPOLOGY *topology = NULL;
+    TOPOTARGET *target = NULL;
+    TOPOGROUP *group = NULL;
+    TOPOINIT *init = NULL;
+    TOPOLUN *lun = NULL;
+    char **swindow_info = NULL;
+    char *error_msg = NULL;
+    int i = 0, line_pos = 0, line_cnt = 0;
+
+    /* Get the layout from the topology index */
+    if ((topology = getTopology(FALSE)) == NULL) {
+        SAFE_ASPRINTF(&error_msg, "Couldn't read the SCST layout: %s",
+                strerror(errno));
+        errorDialog(main_cdk_screen, error_msg, NULL);
+        FREE_NULL(error_msg);
+        return;
+    }
+
+    /* A line for each record, and the blank/error lines */
+    line_cnt = (topology->tgt_cnt * 3) + (topology->group_cnt * 2) +
+            topology->init_cnt + topology->lun_cnt + 2;
+    if ((swindow_info = calloc(line_cnt, sizeof (char *))) == NULL) {
+        errorDialog(main_cdk_screen, strerror(ENOMEM), NULL);
         return;
     }
 
     /* Setup scrolling window widget */
     lun_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
             (LUN_LAYOUT_ROWS + 2), (LUN_LAYOUT_COLS + 2),
-            "<C></31/B>SCST LUN/Group Layout\n",
-            MAX_LUN_LAYOUT_LINES, TRUE, FALSE);
+            "<C></31/B>SCST LUN/Group Layout\n", line_cnt, TRUE, FALSE);
     if (!lun_info) {
         errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+        FREE_NULL(swindow_info);
         return;
     }
     setCDKSwindowBackgroundAttrib(lun_info, COLOR_DIALOG_TEXT);
     setCDKSwindowBoxAttribute(lun_info, COLOR_DIALOG_BOX);
 
-    /* Loop over each target driver type */
-    line_pos = 0;
-    for (i = 0; i < driver_cnt; i++) {
-        /* Loop over each target for current driver type */
-        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/targets/%s",
-                SYSFS_SCST_TGT, tgt_drivers[i]);
-        if ((tgt_dir_stream = opendir(dir_name)) == NULL) {
-            if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                SAFE_ASPRINTF(&swindow_info[line_pos], "opendir(): %s",
-                        strerror(errno));
-                line_pos++;
-            }
-            break;
+    /* Each target, its groups, and their initiators and LUNs */
+    for (target = topology->targets; target != NULL; target = target->next) {
+        SAFE_ASPRINTF(&swindow_info[line_pos++], "</B>Target:<!B> %s (%s)",
+                target->name, target->driver);
+        if (target->error != 0)
+            SAFE_ASPRINTF(&swindow_info[line_pos++],
+                    "\t(Couldn't read groups: %s)", strerror(target->error));
+        for (group = target->groups; group != NULL; group = group->next) {
+            SAFE_ASPRINTF(&swindow_info[line_pos++], "\t</B>Group:<!B> %s",
+                    (group->name ? group->name : "(Default)"));
+            if (group->error != 0)
+                SAFE_ASPRINTF(&swindow_info[line_pos++],
+                        "\t\t(Couldn't read all of it: %s)",
+                        strerror(group->error));
+            for (init = group->inits; init != NULL; init = init->next)
+                SAFE_ASPRINTF(&swindow_info[line_pos++],
+                        "\t\t</B>Initiator:<!B> %s", init->name);
+            for (lun = group->luns; lun != NULL; lun = lun->next)
+                SAFE_ASPRINTF(&swindow_info[line_pos++],
+                        "\t\t</B>LUN:<!B> %d (%s)", lun->lun,
+                        lun->device->name);
         }
-        while ((tgt_dir_entry = readdir(tgt_dir_stream)) != NULL) {
-            /* The target names are directories; skip '.' and '..' */
-            if ((tgt_dir_entry->d_type == DT_DIR) &&
-                    (strcmp(tgt_dir_entry->d_name, ".") != 0) &&
-                    (strcmp(tgt_dir_entry->d_name, "..") != 0)) {
-                if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                    SAFE_ASPRINTF(&swindow_info[line_pos], "</B>Target:<!B> %s (%s)",
-                            tgt_dir_entry->d_name, tgt_drivers[i]);
-                    line_pos++;
-                }
-                /* Loop over each security group for the current target */
-                snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-                        "%s/targets/%s/%s/ini_groups", SYSFS_SCST_TGT,
-                        tgt_drivers[i], tgt_dir_entry->d_name);
-                if ((group_dir_stream = opendir(dir_name)) == NULL) {
-                    if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                        SAFE_ASPRINTF(&swindow_info[line_pos], "opendir(): %s",
-                                strerror(errno));
-                        line_pos++;
-                    }
-                    break;
-                }
-                while ((group_dir_entry = readdir(group_dir_stream)) != NULL) {
-                    /* The group names are directories; skip '.' and '..' */
-                    if ((group_dir_entry->d_type == DT_DIR) &&
-                            (strcmp(group_dir_entry->d_name, ".") != 0) &&
-                            (strcmp(group_dir_entry->d_name, "..") != 0)) {
-                        if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                            SAFE_ASPRINTF(&swindow_info[line_pos],
-                                    "\t</B>Group:<!B> %s",
-                                    group_dir_entry->d_name);
-                            line_pos++;
-                        }
-
-                        /* Loop over each initiator for the current group */
-                        snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-                                "%s/targets/%s/%s/ini_groups/%s/initiators",
-                                SYSFS_SCST_TGT, tgt_drivers[i],
-                                tgt_dir_entry->d_name, group_dir_entry->d_name);
-                        if ((init_dir_stream = opendir(
-                                dir_name)) == NULL) {
-                            if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                                SAFE_ASPRINTF(&swindow_info[line_pos],
-                                        "opendir(): %s", strerror(errno));
-                                line_pos++;
-                            }
-                            break;
-                        }
-                        while ((init_dir_entry = readdir(init_dir_stream)) !=
-                                NULL) {
-                            /* The initiators are files; skip 'mgmt' */
-                            if ((init_dir_entry->d_type == DT_REG) &&
-                                    (strcmp(init_dir_entry->d_name,
-                                    "mgmt") != 0)) {
-                                if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                                    SAFE_ASPRINTF(&swindow_info[line_pos],
-                                            "\t\t</B>Initiator:<!B> %s",
-                                            init_dir_entry->d_name);
-                                    line_pos++;
-                                }
-                            }
-                        }
-                        closedir(init_dir_stream);
-
-                        /* Loop over each LUN for the current group */
-                        snprintf(dir_name, MAX_SYSFS_PATH_SIZE,
-                                "%s/targets/%s/%s/ini_groups/%s/luns",
-                                SYSFS_SCST_TGT, tgt_drivers[i],
-                                tgt_dir_entry->d_name, group_dir_entry->d_name);
-                        if ((lun_dir_stream = opendir(
-                                dir_name)) == NULL) {
-                            if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                                SAFE_ASPRINTF(&swindow_info[line_pos],
-                                        "opendir(): %s", strerror(errno));
-                                line_pos++;
-                            }
-                            break;
-                        }
-                        while ((lun_dir_entry = readdir(lun_dir_stream)) !=
-                                NULL) {
-                            /* The LUNs are directories; skip '.' and '..' */
-                            if ((lun_dir_entry->d_type == DT_DIR) &&
-                                    (strcmp(lun_dir_entry->d_name,
-                                    ".") != 0) &&
-                                    (strcmp(lun_dir_entry->d_name,
-                                    "..") != 0)) {
-                                /* We need to get the device name (link) */
-                                snprintf(link_path, MAX_SYSFS_PATH_SIZE,
-                                        "%s/targets/%s/%s/ini_groups"
-                                        "/%s/luns/%s/device", SYSFS_SCST_TGT,
-                                        tgt_drivers[i], tgt_dir_entry->d_name,
-                                        group_dir_entry->d_name,
-                                        lun_dir_entry->d_name);
-                                /* Read the link to get device name
-                                 * (doesn't append null byte) */
-                                dev_path_size = readlink(link_path, dev_path,
-                                        MAX_SYSFS_PATH_SIZE);
-                                if (dev_path_size < MAX_SYSFS_PATH_SIZE)
-                                    *(dev_path + dev_path_size) = '\0';
-                                if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                                    SAFE_ASPRINTF(&swindow_info[line_pos],
-                                            "\t\t</B>LUN:<!B> %s (%s)",
-                                            lun_dir_entry->d_name,
-                                            (strrchr(dev_path, '/') + 1));
-                                    line_pos++;
-                                }
-                            }
-                        }
-                        closedir(lun_dir_stream);
-                    }
-                }
-                closedir(group_dir_stream);
-                /* Print a blank line to separate targets */
-                if (line_pos < MAX_LUN_LAYOUT_LINES) {
-                    SAFE_ASPRINTF(&swindow_info[line_pos], " ");
-                    line_pos++;
-                }
-            }
-        }
-        closedir(tgt_dir_stream);
+        /* Print a blank line to separate targets */
+        SAFE_ASPRINTF(&swindow_info[line_pos++], " ");
     }
 
-
     /* Add a message to the bottom explaining how to close the dialog */
-    if (line_pos < MAX_LUN_LAYOUT_LINES) {
-        SAFE_ASPRINTF(&swindow_info[line_pos], " ");
-        line_pos++;
-    }
-    if (line_pos < MAX_LUN_LAYOUT_LINES) {
-        SAFE_ASPRINTF(&swindow_info[line_pos], CONTINUE_MSG);
-        line_pos++;
-    }
+    SAFE_ASPRINTF(&swindow_info[line_pos++], " ");
+    SAFE_ASPRINTF(&swindow_info[line_pos++], CONTINUE_MSG);
 
     /* Set the scrolling window content */
     setCDKSwindowContents(lun_info, swindow_info, line_pos);
@@ -1407,7 +1777,168 @@ void lunLayoutDialog(CDKSCREEN *main_cdk_screen) {
     destroyCDKSwindow(lun_info);
 
     /* Done */
-    for (i = 0; i < MAX_LUN_LAYOUT_LINES; i++ )
+    for (i = 0; i < line_cnt; i++)
         FREE_NULL(swindow_info[i]);
+    FREE_NULL(swindow_info);
+    return;
+}
+
+
+/*
+ * Run the Device Paths dialog; shows everywhere a SCST device is exported
+ * (target, group, and LUN) with the sessions using each path and their
+ * current I/O, and lets the user unmap it from all of them in one go.
+ */
+void devPathsDialog(CDKSCREEN *main_cdk_screen) {
+    CDKSWINDOW *paths_info = 0;
+    SCSTSNAPSHOT *snapshot = NULL;
+    SNAPSESSION *sessions[MAX_DEV_PATH_SESSIONS] = {NULL};
+    TOPODEVICE *device = NULL;
+    TOPOLUN *lun = NULL;
+    char scst_dev[MAX_SYSFS_ATTR_SIZE] = {0},
+            scst_hndlr[MAX_SYSFS_ATTR_SIZE] = {0};
+    char **swindow_info = NULL;
+    char *error_msg = NULL, *confirm_msg = NULL, *sess_msg = NULL;
+    int line_cnt = 0, line_pos = 0, lun_cnt = 0, sess_cnt = 0,
+            path_sess_cnt = 0, unmapped = 0, temp_int = 0, key = 0, i = 0;
+    boolean function_key = FALSE, confirm = FALSE;
+
+    /* Have the user choose a SCST device */
+    getSCSTDevChoice(main_cdk_screen, scst_dev, scst_hndlr);
+    if (scst_dev[0] == '\0' || scst_hndlr[0] == '\0')
+        return;
+
+    while (1) {
+        /* Where is it exported (from the device's own export links)? */
+        if ((temp_int = refreshTopoDevice(scst_dev, &device)) != 0) {
+            SAFE_ASPRINTF(&error_msg, "Couldn't read the SCST device "
+                    "exports: %s", strerror(temp_int));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        lun_cnt = 0;
+        for (lun = (device ? device->luns : NULL); lun != NULL;
+                lun = lun->dev_next)
+            lun_cnt++;
+
+        /* A few lines for each path and its sessions, and the summary */
+        line_cnt = (lun_cnt * (MAX_DEV_PATH_SESSIONS + 4)) + 7;
+        if ((swindow_info = calloc(line_cnt, sizeof (char *))) == NULL) {
+            errorDialog(main_cdk_screen, strerror(ENOMEM), NULL);
+            break;
+        }
+
+        /* Setup scrolling window widget */
+        paths_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
+                (DEV_PATHS_ROWS + 2), (DEV_PATHS_COLS + 2),
+                "<C></31/B>SCST Device Paths\n", line_cnt, TRUE, FALSE);
+        if (!paths_info) {
+            errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+            break;
+        }
+        setCDKSwindowBackgroundAttrib(paths_info, COLOR_DIALOG_TEXT);
+        setCDKSwindowBoxAttribute(paths_info, COLOR_DIALOG_BOX);
+
+        /* Each path (the summary line is filled in after) */
+        line_pos = 0;
+        sess_cnt = 0;
+        SAFE_ASPRINTF(&swindow_info[line_pos++], "</B>Device:<!B> %s (%s)",
+                scst_dev, scst_hndlr);
+        line_pos++;
+        SAFE_ASPRINTF(&swindow_info[line_pos++], " ");
+        snapshot = acquireSCSTSnapshot();
+        for (lun = (device ? device->luns : NULL); lun != NULL;
+                lun = lun->dev_next) {
+            SAFE_ASPRINTF(&swindow_info[line_pos++],
+                    "</B>Target:<!B> %s (%s)", lun->group->target->name,
+                    lun->group->target->driver);
+            SAFE_ASPRINTF(&swindow_info[line_pos++],
+                    "\t</B>Group:<!B> %s\t</B>LUN:<!B> %d",
+                    (lun->group->name ? lun->group->name : "(Default)"),
+                    lun->lun);
+            path_sess_cnt = findTopoSessions(snapshot, lun->group, sessions,
+                    MAX_DEV_PATH_SESSIONS);
+            sess_cnt += path_sess_cnt;
+            if (path_sess_cnt == 0)
+                SAFE_ASPRINTF(&swindow_info[line_pos++],
+                        "\t\t(No sessions)");
+            for (i = 0; i < path_sess_cnt && i < MAX_DEV_PATH_SESSIONS; i++)
+                SAFE_ASPRINTF(&swindow_info[line_pos++],
+                        "\t\t%-20.20s R/W %lu/%lu KB/s, %d active",
+                        sessions[i]->init_name, sessions[i]->read_kbps,
+                        sessions[i]->write_kbps, sessions[i]->active_cmds);
+            if (path_sess_cnt > MAX_DEV_PATH_SESSIONS)
+                SAFE_ASPRINTF(&swindow_info[line_pos++],
+                        "\t\t(%d more sessions)",
+                        (path_sess_cnt - MAX_DEV_PATH_SESSIONS));
+            SAFE_ASPRINTF(&swindow_info[line_pos++], " ");
+        }
+        releaseSCSTSnapshot();
+        if (lun_cnt == 0)
+            SAFE_ASPRINTF(&swindow_info[1], "It isn't mapped to any LUNs.");
+        else
+            SAFE_ASPRINTF(&swindow_info[1], "Exported on %d LUN(s), used "
+                    "by %d session(s).", lun_cnt, sess_cnt);
+
+        /* Add a message to the bottom explaining how to use the dialog */
+        if (lun_cnt > 0)
+            SAFE_ASPRINTF(&swindow_info[line_pos++],
+                    "<C>(Press '%c' to unmap it from all of them.)",
+                    DEV_PATHS_UNMAP_KEY);
+        SAFE_ASPRINTF(&swindow_info[line_pos++], CONTINUE_MSG);
+
+        /* Set the scrolling window content */
+        setCDKSwindowContents(paths_info, swindow_info, line_pos);
+        for (i = 0; i < line_cnt; i++)
+            FREE_NULL(swindow_info[i]);
+        FREE_NULL(swindow_info);
+
+        /* Drive the widget ourselves so the unmap key can be caught; the
+         * 'g' makes the swindow widget scroll to the top */
+        drawCDKSwindow(paths_info, TRUE);
+        injectCDKSwindow(paths_info, 'g');
+        while (1) {
+            key = getchCDKObject(ObjOf(paths_info), &function_key);
+            if (key == DEV_PATHS_UNMAP_KEY && lun_cnt > 0)
+                break;
+            injectCDKSwindow(paths_info, key);
+            if (paths_info->exitType != vEARLY_EXIT)
+                break;
+        }
+        destroyCDKSwindow(paths_info);
+        paths_info = NULL;
+        refreshCDKScreen(main_cdk_screen);
+        if (key != DEV_PATHS_UNMAP_KEY || lun_cnt == 0)
+            break;
+
+        /* Get a final confirmation from user before unmapping */
+        SAFE_ASPRINTF(&confirm_msg, "Unmap SCST device '%s' from all %d "
+                "LUN(s)?", scst_dev, lun_cnt);
+        if (sess_cnt > 0)
+            SAFE_ASPRINTF(&sess_msg, "%d session(s) will lose access to it.",
+                    sess_cnt);
+        confirm = confirmDialog(main_cdk_screen, confirm_msg, sess_msg);
+        FREE_NULL(confirm_msg);
+        FREE_NULL(sess_msg);
+        if (!confirm)
+            break;
+
+        /* Remove the LUNs (batched by group); then show what is left */
+        if ((temp_int = unmapTopoDevice(scst_dev, &unmapped)) != 0) {
+            SAFE_ASPRINTF(&error_msg, "Couldn't remove all SCST LUNs (%d "
+                    "of %d removed): %s", unmapped, lun_cnt,
+                    strerror(temp_int));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+        }
+    }
+
+    /* Done */
+    if (swindow_info != NULL) {
+        for (i = 0; i < line_cnt; i++)
+            FREE_NULL(swindow_info[i]);
+        FREE_NULL(swindow_info);
+    }
     return;
 }
@@ -71,6 +71,8 @@ void addGroupDialog(CDKSCREEN *main_cdk_screen) {
                         strerror(temp_int));
                 errorDialog(main_cdk_screen, error_msg, NULL);
                 FREE_NULL(error_msg);
+            } else {
+                topoAddGroup(tgt_driver, scst_tgt, group_name);
             }
         }
         break;
@@ -124,6 +126,8 @@ void remGroupDialog(CDKSCREEN *main_cdk_screen) {
                     strerror(temp_int));
             errorDialog(main_cdk_screen, error_msg, NULL);
             FREE_NULL(error_msg);
+        } else {
+            topoRemoveGroup(tgt_driver, scst_tgt, group_name);
         }
     }
 
@@ -277,6 +281,10 @@ void addInitDialog(CDKSCREEN *main_cdk_screen) {
                     strerror(temp_int));
             errorDialog(main_cdk_screen, error_msg, NULL);
             FREE_NULL(error_msg);
+        } else {
+            topoAddInit(tgt_driver, scst_tgt, group_name,
+                    ((entry_init_name == NULL) ?
+                    scst_sess_inits[init_choice] : entry_init_name));
         }
         break;
     }
@@ -340,6 +348,8 @@ void remInitDialog(CDKSCREEN *main_cdk_screen) {
                     strerror(temp_int));
             errorDialog(main_cdk_screen, error_msg, NULL);
             FREE_NULL(error_msg);
+        } else {
+            topoRemoveInit(tgt_driver, scst_tgt, group_name, init_name);
         }
     }
 
@@ -36,23 +36,25 @@ void helpDialog(CDKSCREEN *main_cdk_screen) {
             "and use ENTER to make");
     SAFE_ASPRINTF(&message[5], "a selection. Use ESCAPE to exit the menu without "
             "making a selection.");
-    SAFE_ASPRINTF(&message[6], " ");
-    SAFE_ASPRINTF(&message[7], "</B>Navigating Dialogs");
-    SAFE_ASPRINTF(&message[8], "On dialogs (screens) that contain more than "
+    SAFE_ASPRINTF(&message[6], "Hit 'o' to change the sort order of the "
+            "active sessions list.");
+    SAFE_ASPRINTF(&message[7], " ");
+    SAFE_ASPRINTF(&message[8], "</B>Navigating Dialogs");
+    SAFE_ASPRINTF(&message[9], "On dialogs (screens) that contain more than "
             "one widget, you can use");
-    SAFE_ASPRINTF(&message[9], "TAB and SHIFT+TAB to traverse through the "
+    SAFE_ASPRINTF(&message[10], "TAB and SHIFT+TAB to traverse through the "
             "widgets (field entry, radio");
-    SAFE_ASPRINTF(&message[10], "lists, buttons, etc.) and use ENTER to execute "
+    SAFE_ASPRINTF(&message[11], "lists, buttons, etc.) and use ENTER to execute "
             "button functions.");
-    SAFE_ASPRINTF(&message[11], "On selection dialogs, single field entry "
+    SAFE_ASPRINTF(&message[12], "On selection dialogs, single field entry "
             "widgets, etc. you can use");
-    SAFE_ASPRINTF(&message[12], "ENTER or TAB to make a choice, or use ESCAPE "
+    SAFE_ASPRINTF(&message[13], "ENTER or TAB to make a choice, or use ESCAPE "
             "to cancel.");
-    SAFE_ASPRINTF(&message[13], " ");
-    SAFE_ASPRINTF(&message[14], "</B>Scrolling Windows");
-    SAFE_ASPRINTF(&message[15], "When a scrolling window widget is active, you "
+    SAFE_ASPRINTF(&message[14], " ");
+    SAFE_ASPRINTF(&message[15], "</B>Scrolling Windows");
+    SAFE_ASPRINTF(&message[16], "When a scrolling window widget is active, you "
             "can use the arrow keys");
-    SAFE_ASPRINTF(&message[16], "to scroll through the text and use ENTER or "
+    SAFE_ASPRINTF(&message[17], "to scroll through the text and use ENTER or "
             "ESCAPE to exit.");
 
     while (1) {
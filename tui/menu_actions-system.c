@@ -16,6 +16,7 @@
 #include <string.h>
 #include <cdk/swindow.h>
 #include <sys/time.h>
+#include <fcntl.h>
 #include <assert.h>
 
 #include "prototypes.h"
@@ -1796,12 +1797,17 @@ void scstInfoDialog(CDKSCREEN *main_cdk_screen) {
             scst_setup_id[MAX_SYSFS_ATTR_SIZE] = {0},
             scst_threads[MAX_SYSFS_ATTR_SIZE] = {0},
             scst_sysfs_res[MAX_SYSFS_ATTR_SIZE] = {0},
-            tmp_sysfs_path[MAX_SYSFS_PATH_SIZE] = {0},
             tmp_attr_line[SCST_INFO_COLS] = {0};
+    ATTRREAD attrs[] = {
+        {-1, "version", scst_ver, 0},
+        {-1, "setup_id", scst_setup_id, 0},
+        {-1, "threads", scst_threads, 0},
+        {-1, "last_sysfs_mgmt_res", scst_sysfs_res, 0}
+    };
     char *swindow_info[MAX_SCST_INFO_LINES] = {NULL};
     char *temp_pstr = NULL;
     FILE *sysfs_file = NULL;
-    int i = 0;
+    int i = 0, scst_dir_fd = -1, stats_fd = -1, temp_int = 0;
 
     /* Setup scrolling window widget */
     scst_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
@@ -1815,19 +1821,21 @@ void scstInfoDialog(CDKSCREEN *main_cdk_screen) {
     setCDKSwindowBackgroundAttrib(scst_info, COLOR_DIALOG_TEXT);
     setCDKSwindowBoxAttribute(scst_info, COLOR_DIALOG_BOX);
 
-    /* Grab some semi-useful information for our scrolling window widget */
-    snprintf(tmp_sysfs_path, MAX_SYSFS_PATH_SIZE,
-            "%s/version",SYSFS_SCST_TGT);
-    readAttribute(tmp_sysfs_path, scst_ver);
-    snprintf(tmp_sysfs_path, MAX_SYSFS_PATH_SIZE,
-            "%s/setup_id", SYSFS_SCST_TGT);
-    readAttribute(tmp_sysfs_path, scst_setup_id);
-    snprintf(tmp_sysfs_path, MAX_SYSFS_PATH_SIZE,
-            "%s/threads", SYSFS_SCST_TGT);
-    readAttribute(tmp_sysfs_path, scst_threads);
-    snprintf(tmp_sysfs_path, MAX_SYSFS_PATH_SIZE,
-            "%s/last_sysfs_mgmt_res", SYSFS_SCST_TGT);
-    readAttribute(tmp_sysfs_path, scst_sysfs_res);
+    /* Grab some semi-useful information for our scrolling window widget
+     * (in one batch, relative to the SCST directory) */
+    if ((temp_int = openAttrDir(SYSFS_SCST_TGT, &scst_dir_fd)) != 0) {
+        for (i = 0; i < (int) (sizeof (attrs) / sizeof (*attrs)); i++)
+            attrs[i].error = temp_int;
+    } else {
+        for (i = 0; i < (int) (sizeof (attrs) / sizeof (*attrs)); i++)
+            attrs[i].dir_fd = scst_dir_fd;
+        readAttributes(attrs, sizeof (attrs) / sizeof (*attrs));
+    }
+    for (i = 0; i < (int) (sizeof (attrs) / sizeof (*attrs)); i++) {
+        if (attrs[i].error != 0)
+            snprintf(attrs[i].value, MAX_SYSFS_ATTR_SIZE, "(%s)",
+                    strerror(attrs[i].error));
+    }
 
     /* Add the attribute values collected above to our
      * scrolling window widget */
@@ -1846,11 +1854,18 @@ void scstInfoDialog(CDKSCREEN *main_cdk_screen) {
     SAFE_ASPRINTF(&swindow_info[3], "</B>Global SGV cache statistics:<!B>");
     addCDKSwindow(scst_info, swindow_info[3], BOTTOM);
     i = 4;
-    snprintf(tmp_sysfs_path, MAX_SYSFS_PATH_SIZE,
-            "%s/sgv/global_stats", SYSFS_SCST_TGT);
-    if ((sysfs_file = fopen(tmp_sysfs_path, "r")) == NULL) {
+    if (temp_int == 0 && (temp_int = openAttribute(scst_dir_fd,
+            "sgv/global_stats", O_RDONLY, &stats_fd)) == 0 &&
+            (sysfs_file = fdopen(stats_fd, "r")) == NULL) {
+        temp_int = errno;
+        close(stats_fd);
+    }
+    if (scst_dir_fd != -1)
+        close(scst_dir_fd);
+    if (sysfs_file == NULL) {
         if (i < MAX_SCST_INFO_LINES) {
-            SAFE_ASPRINTF(&swindow_info[i], "fopen(): %s", strerror(errno));
+            SAFE_ASPRINTF(&swindow_info[i], "Couldn't read statistics: %s",
+                    strerror(temp_int));
             addCDKSwindow(scst_info, swindow_info[i], BOTTOM);
         }
     } else {
@@ -2348,3 +2363,96 @@ void dateTimeDialog(CDKSCREEN *main_cdk_screen) {
         FREE_NULL(tz_files[i]);
     return;
 }
+
+
+/*
+ * Run the CPU Affinity dialog; FC/IB adapter IRQs and targets, SCST device
+ * threads, and iSCSI are pinned to their local NUMA node, and the
+ * placement is shown before and after
+ */
+void affinityDialog(CDKSCREEN *main_cdk_screen) {
+    CDKSWINDOW *affinity_info = 0;
+    AFFINITYITEM *items = NULL, *item = NULL;
+    char *swindow_info[MAX_AFFINITY_INFO_LINES] = {NULL};
+    char *error_msg = NULL, *confirm_msg = NULL;
+    char after[AFFINITY_LIST_LEN] = {0};
+    int item_cnt = 0, line_cnt = 0, kind_cnts[3] = {0}, failed_cnt = 0,
+            temp_int = 0, i = 0;
+    boolean confirm = FALSE;
+
+    while (1) {
+        /* Find what goes where */
+        if ((temp_int = planAffinity(&items, &item_cnt)) != 0) {
+            SAFE_ASPRINTF(&error_msg, "Couldn't read the CPU placement: %s",
+                    strerror(temp_int));
+            errorDialog(main_cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        if (item_cnt == 0) {
+            errorDialog(main_cdk_screen,
+                    "Nothing was found with a local NUMA node.",
+                    "(Is this a single node system?)");
+            break;
+        }
+        for (i = 0; i < item_cnt; i++)
+            kind_cnts[items[i].kind]++;
+        SAFE_ASPRINTF(&confirm_msg, "Pin %d IRQ(s), %d target(s), and %d "
+                "thread(s)", kind_cnts[AFFINITY_IRQ],
+                kind_cnts[AFFINITY_TARGET], kind_cnts[AFFINITY_THREAD]);
+        confirm = confirmDialog(main_cdk_screen, confirm_msg,
+                "to the CPUs of their local NUMA node?");
+        FREE_NULL(confirm_msg);
+        if (!confirm)
+            break;
+
+        /* Setup scrolling window widget */
+        affinity_info = newCDKSwindow(main_cdk_screen, CENTER, CENTER,
+                (AFFINITY_INFO_ROWS + 2), (AFFINITY_INFO_COLS + 2),
+                "<C></31/B>CPU Affinity (Before / After)\n",
+                MAX_AFFINITY_INFO_LINES, TRUE, FALSE);
+        if (!affinity_info) {
+            errorDialog(main_cdk_screen, SWINDOW_ERR_MSG, NULL);
+            break;
+        }
+        setCDKSwindowBackgroundAttrib(affinity_info, COLOR_DIALOG_TEXT);
+        setCDKSwindowBoxAttribute(affinity_info, COLOR_DIALOG_BOX);
+
+        /* Pin everything, then show the placement table */
+        applyAffinity(items, item_cnt);
+        SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                "</B>%-18s %-12s %4s  %-14s %-14s<!B>", "Item", "Local To",
+                "Node", "Before", "After");
+        for (i = 0; i < item_cnt && line_cnt < MAX_AFFINITY_INFO_LINES - 3;
+                i++) {
+            item = &items[i];
+            if (item->error != 0) {
+                snprintf(after, AFFINITY_LIST_LEN, "(%s)",
+                        strerror(item->error));
+                failed_cnt++;
+            } else {
+                snprintf(after, AFFINITY_LIST_LEN, "%s", item->after);
+            }
+            SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                    "%-18.18s %-12.12s %4d  %-14.14s %s", item->name,
+                    item->owner, item->numa_node, item->before, after);
+        }
+        SAFE_ASPRINTF(&swindow_info[line_cnt++], " ");
+        SAFE_ASPRINTF(&swindow_info[line_cnt++],
+                "%d of %d item(s) couldn't be pinned.", failed_cnt,
+                item_cnt);
+        SAFE_ASPRINTF(&swindow_info[line_cnt++], CONTINUE_MSG);
+        setCDKSwindowContents(affinity_info, swindow_info, line_cnt);
+        activateCDKSwindow(affinity_info, 0);
+        break;
+    }
+
+    /* Done */
+    if (affinity_info)
+        destroyCDKSwindow(affinity_info);
+    refreshCDKScreen(main_cdk_screen);
+    for (i = 0; i < MAX_AFFINITY_INFO_LINES; i++)
+        FREE_NULL(swindow_info[i]);
+    FREE_NULL(items);
+    return;
+}
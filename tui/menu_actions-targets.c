@@ -184,6 +184,8 @@ void addiSCSITgtDialog(CDKSCREEN *main_cdk_screen) {
                         strerror(temp_int));
                 errorDialog(main_cdk_screen, error_msg, NULL);
                 FREE_NULL(error_msg);
+            } else {
+                topoAddTarget("iscsi", target_name);
             }
         }
         break;
@@ -229,6 +231,8 @@ void remiSCSITgtDialog(CDKSCREEN *main_cdk_screen) {
                     strerror(temp_int));
             errorDialog(main_cdk_screen, error_msg, NULL);
             FREE_NULL(error_msg);
+        } else {
+            topoRemoveTarget("iscsi", scst_tgt);
         }
     }
 
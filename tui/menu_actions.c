@@ -668,6 +668,65 @@ void getSCSTDevChoice(CDKSCREEN *cdk_screen, char dev_name[],
 }
 
 
+/*
+ * Present the tuning profiles (read in to 'profiles', TUNING_MAX_PROFILES
+ * long) to the user, with a "no profile" choice first if 'allow_none' is
+ * set. Returns the index of the profile chosen, -1 for no profile, or -2
+ * if the user escaped (or the profiles couldn't be read).
+ */
+int getTuningProfileChoice(CDKSCREEN *cdk_screen, TUNINGPROFILE profiles[],
+        boolean allow_none) {
+    CDKSCROLL *profile_list = 0;
+    char *profile_info[TUNING_MAX_PROFILES + 1] = {NULL};
+    char *error_msg = NULL;
+    int profile_cnt = 0, item_cnt = 0, choice = -2, ret_val = 0, i = 0;
+
+    while (1) {
+        if ((ret_val = loadTuningProfiles(profiles, &profile_cnt)) != 0) {
+            SAFE_ASPRINTF(&error_msg, "Couldn't read %s: %s",
+                    SCST_TUNING_CONF, strerror(ret_val));
+            errorDialog(cdk_screen, error_msg, NULL);
+            FREE_NULL(error_msg);
+            break;
+        }
+        if (allow_none)
+            SAFE_ASPRINTF(&profile_info[item_cnt++], "<C>%-18s %-40s",
+                    "(None)", "No tuning profile");
+        for (i = 0; i < profile_cnt; i++)
+            SAFE_ASPRINTF(&profile_info[item_cnt++], "<C>%-18.18s %-40.40s",
+                    profiles[i].name, profiles[i].description);
+        if (item_cnt == 0) {
+            errorDialog(cdk_screen, "No tuning profiles found!", NULL);
+            break;
+        }
+
+        /* Get the profile choice from user */
+        profile_list = newCDKScroll(cdk_screen, CENTER, CENTER, NONE, 12, 66,
+                "<C></31/B>Choose a Tuning Profile\n", profile_info, item_cnt,
+                FALSE, COLOR_DIALOG_SELECT, TRUE, FALSE);
+        if (!profile_list) {
+            errorDialog(cdk_screen, SCROLL_ERR_MSG, NULL);
+            break;
+        }
+        setCDKScrollBoxAttribute(profile_list, COLOR_DIALOG_BOX);
+        setCDKScrollBackgroundAttrib(profile_list, COLOR_DIALOG_TEXT);
+        i = activateCDKScroll(profile_list, 0);
+
+        /* Check exit from widget */
+        if (profile_list->exitType == vNORMAL)
+            choice = allow_none ? (i - 1) : i;
+        break;
+    }
+
+    /* Done */
+    destroyCDKScroll(profile_list);
+    refreshCDKScreen(cdk_screen);
+    for (i = 0; i < TUNING_MAX_PROFILES + 1; i++)
+        FREE_NULL(profile_info[i]);
+    return choice;
+}
+
+
 /*
  * Present a list of adapters to the user and return the adapter
  * number (ID) selected. Currently only MegaRAID adapters.
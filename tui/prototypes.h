@@ -16,6 +16,10 @@ extern "C" {
 #include "system.h"
 #include "megaraid.h"
 #include "dialogs.h"
+#include "snapshot.h"
+#include "tuning.h"
+#include "affinity.h"
+#include "topology.h"
 
 /* main.c */
 void termSize(WINDOW *screen);
@@ -30,8 +34,15 @@ boolean updateInfoLabels(CDKSCREEN *cdk_screen,
         char *tgt_info_msg[], char *sess_info_msg[],
         int *last_scr_y, int *last_scr_x,
         int *last_tgt_rows, int *last_sess_rows);
-int readTargetData(char *label_msg[]);
-int readSessionData(char *label_msg[]);
+int readTargetData(SCSTSNAPSHOT *snapshot, char *label_msg[],
+        boolean *changed);
+int readSessionData(SCSTSNAPSHOT *snapshot, char *label_msg[], int max_rows,
+        boolean *changed);
+void nextSessionSortKey();
+
+/* events.c */
+int waitMainEvent(WINDOW *window);
+void closeMainEvents();
 
 /* menu_actions.c */
 void errorDialog(CDKSCREEN *screen, char *msg_line_1, char *msg_line_2);
@@ -48,6 +59,8 @@ char *getSCSIDiskChoice(CDKSCREEN *cdk_screen);
 void getSCSTDevChoice(CDKSCREEN *cdk_screen, char dev_name[],
         char dev_handler[]);
 int getAdpChoice(CDKSCREEN *cdk_screen, MRADAPTER *mr_adapters[]);
+int getTuningProfileChoice(CDKSCREEN *cdk_screen, TUNINGPROFILE profiles[],
+        boolean allow_none);
 void getSCSTInitChoice(CDKSCREEN *cdk_screen, char tgt_name[],
         char tgt_driver[], char tgt_group[], char initiator[]);
 void syncConfig(CDKSCREEN *main_cdk_screen);
@@ -82,6 +95,7 @@ void chgPasswdDialog(CDKSCREEN *main_cdk_screen);
 void scstInfoDialog(CDKSCREEN *main_cdk_screen);
 void crmStatusDialog(CDKSCREEN *main_cdk_screen);
 void dateTimeDialog(CDKSCREEN *main_cdk_screen);
+void affinityDialog(CDKSCREEN *main_cdk_screen);
 
 /* menu_actions-back_storage.c */
 void adpPropsDialog(CDKSCREEN *main_cdk_screen);
@@ -96,7 +110,11 @@ void createFSDialog(CDKSCREEN *main_cdk_screen);
 void removeFSDialog(CDKSCREEN *main_cdk_screen);
 void addVDiskFileDialog(CDKSCREEN *main_cdk_screen);
 void delVDiskFileDialog(CDKSCREEN *main_cdk_screen);
+void cloneVDiskFileDialog(CDKSCREEN *main_cdk_screen);
+void defragVDiskFileDialog(CDKSCREEN *main_cdk_screen);
+void reclaimVDiskFileDialog(CDKSCREEN *main_cdk_screen);
 void vdiskFileListDialog(CDKSCREEN *main_cdk_screen);
+void vdiskJobsDialog(CDKSCREEN *main_cdk_screen);
 
 /* menu_actions-alua.c */
 void devTgtGrpLayoutDialog(CDKSCREEN *main_cdk_screen);
@@ -117,11 +135,17 @@ void remInitDialog(CDKSCREEN *main_cdk_screen);
 
 /* menu_actions-devices.c */
 void addDeviceDialog(CDKSCREEN *main_cdk_screen);
+void bulkAddDeviceDialog(CDKSCREEN *main_cdk_screen);
+void tuneDeviceDialog(CDKSCREEN *main_cdk_screen);
+void autoTuneDevice(CDKSCREEN *main_cdk_screen, char dev_name[],
+        char handler[], char backing[]);
+void rebalanceDevicesDialog(CDKSCREEN *main_cdk_screen);
 void remDeviceDialog(CDKSCREEN *main_cdk_screen);
 void devInfoDialog(CDKSCREEN *main_cdk_screen);
 void mapDeviceDialog(CDKSCREEN *main_cdk_screen);
 void unmapDeviceDialog(CDKSCREEN *main_cdk_screen);
 void lunLayoutDialog(CDKSCREEN *main_cdk_screen);
+void devPathsDialog(CDKSCREEN *main_cdk_screen);
 
 /* menu_actions-targets.c */
 void tgtInfoDialog(CDKSCREEN *main_cdk_screen);
@@ -138,6 +162,12 @@ void aboutDialog(CDKSCREEN *main_cdk_screen);
 
 /* utility.c */
 char *strStrip(char *string);
+int openAttrDir(const char dir_path[], int *dir_fd);
+int openAttribute(int dir_fd, const char name[], int flags, int *attr_fd);
+int preadAttribute(int attr_fd, char attr_value[]);
+int pwriteAttribute(int attr_fd, const char attr_value[]);
+int readAttributeAt(int dir_fd, const char name[], char attr_value[]);
+int readAttributes(ATTRREAD attrs[], int attr_cnt);
 void readAttribute(char sysfs_attr[], char attr_value[]);
 int writeAttribute(char sysfs_attr[], char attr_value[]);
 int isSCSTLoaded();
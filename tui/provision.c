@@ -0,0 +1,341 @@
+/**
+ * @file provision.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <assert.h>
+#include <syslog.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "dialogs.h"
+#include "strings.h"
+#include "provision.h"
+
+/* A bulk provisioning run, shared by the worker threads */
+typedef struct prov_run PROVRUN;
+struct prov_run {
+    PROVDEV *devs;
+    int dev_cnt;
+    /* Next device to be claimed by a worker */
+    int next_dev;
+    /* The first device that failed (index + 1), or 0; everyone stops */
+    int failed;
+};
+
+
+/*
+ * Microseconds on the monotonic clock.
+ */
+static long long provNow() {
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000LL) + (now.tv_nsec / 1000);
+}
+
+
+/*
+ * Write a mgmt command for the given handler. Returns 0 (zero) or the
+ * errno value.
+ */
+static int provMgmt(const char handler[], const char command[]) {
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0};
+
+    snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/handlers/%s/mgmt",
+            SYSFS_SCST_TGT, handler);
+    return writeAttribute(attr_path, (char *) command);
+}
+
+
+/*
+ * Check one manifest entry (already split in to fields) and fill in the
+ * device; 'devs' holds the 'dev_cnt' good entries before it, which names
+ * and files can't be reused from. Returns NULL if it's good, or why not.
+ */
+static const char *checkProvEntry(char *fields[], int field_cnt,
+        PROVDEV devs[], int dev_cnt, PROVDEV *dev) {
+    char dev_path[MAX_SYSFS_PATH_SIZE] = {0};
+    char *filename = "", *block_size = "512";
+    int flags[5] = {0, 0, 0, 0, 1}, i = 0;
+    struct stat file_stat = {0};
+    boolean good_bs = FALSE;
+
+    if (field_cnt < 2 || field_cnt > PROVISION_FIELDS)
+        return "wrong number of fields";
+
+    /* Device name */
+    if (fields[0][0] == '\0' || strlen(fields[0]) > SCST_DEV_NAME_LEN)
+        return "bad device name length";
+    for (i = 0; fields[0][i] != '\0'; i++)
+        if (!VALID_NAME_CHAR(fields[0][i]))
+            return "invalid character in device name";
+    snprintf(dev->name, sizeof (dev->name), "%s", fields[0]);
+    snprintf(dev_path, MAX_SYSFS_PATH_SIZE, "%s/devices/%s",
+            SYSFS_SCST_TGT, dev->name);
+    if (stat(dev_path, &file_stat) == 0)
+        return "SCST device already exists";
+    for (i = 0; i < dev_cnt; i++)
+        if (strcmp(devs[i].name, dev->name) == 0)
+            return "device name used twice";
+
+    /* Handler and its back-end */
+    snprintf(dev->handler, sizeof (dev->handler), "%s", fields[1]);
+    if (field_cnt > 2)
+        filename = fields[2];
+    if (strcmp(dev->handler, "vdisk_nullio") == 0) {
+        if (filename[0] != '\0')
+            return "vdisk_nullio takes no file name";
+    } else if (strcmp(dev->handler, "vdisk_fileio") == 0 ||
+            strcmp(dev->handler, "vdisk_blockio") == 0) {
+        if (filename[0] != '/' || strpbrk(filename, "; \t") != NULL)
+            return "file name must be an absolute path (no ';' or spaces)";
+        if (stat(filename, &file_stat) == -1)
+            return "file/device doesn't exist";
+        if (!S_ISBLK(file_stat.st_mode) &&
+                (!S_ISREG(file_stat.st_mode) ||
+                strcmp(dev->handler, "vdisk_blockio") == 0))
+            return "wrong type of file for the handler";
+        dev->file_dev = file_stat.st_dev;
+        dev->file_ino = file_stat.st_ino;
+        for (i = 0; i < dev_cnt; i++)
+            if (devs[i].file_ino != 0 && devs[i].file_dev == dev->file_dev &&
+                    devs[i].file_ino == dev->file_ino)
+                return "file/device used twice";
+    } else {
+        return "unsupported handler";
+    }
+
+    /* Block size and flags */
+    if (field_cnt > 3 && fields[3][0] != '\0')
+        block_size = fields[3];
+    for (i = 0; i < 5; i++)
+        if (strcmp(block_size, g_scst_bs_list[i]) == 0)
+            good_bs = TRUE;
+    if (!good_bs)
+        return "invalid block size";
+    for (i = 4; i < field_cnt; i++) {
+        if (strcmp(fields[i], "0") == 0)
+            flags[i - 4] = 0;
+        else if (strcmp(fields[i], "1") == 0)
+            flags[i - 4] = 1;
+        else if (fields[i][0] != '\0')
+            return "flags must be 0 or 1";
+    }
+
+    /* The command, just as the Add Device dialog does it */
+    if (filename[0] == '\0')
+        SAFE_ASPRINTF(&dev->command, "add_device %s blocksize=%s; "
+                "read_only=%d; removable=%d; rotational=%d", dev->name,
+                block_size, flags[2], flags[3], flags[4]);
+    else
+        SAFE_ASPRINTF(&dev->command, "add_device %s filename=%s; "
+                "blocksize=%s; write_through=%d; nv_cache=%d; "
+                "read_only=%d; removable=%d; rotational=%d", dev->name,
+                filename, block_size, flags[0], flags[1], flags[2],
+                flags[3], flags[4]);
+    return NULL;
+}
+
+
+/*
+ * Read and check every entry in a device manifest before anything is
+ * done. On success, '*devs' (free it with freeProvisionManifest()) holds
+ * '*dev_cnt' devices. If any entry is bad, EINVAL is returned with the
+ * number of bad entries in '*bad_cnt' and the first problem described in
+ * 'error_msg' (PROVISION_ERR_LEN bytes). Returns 0 (zero) or the errno
+ * value.
+ */
+int loadProvisionManifest(const char path[], PROVDEV **devs, int *dev_cnt,
+        int *bad_cnt, char error_msg[]) {
+    FILE *manifest = NULL;
+    char line[PROVISION_LINE_LEN] = {0};
+    char *fields[PROVISION_FIELDS + 1] = {NULL};
+    char *position = NULL;
+    const char *problem = NULL;
+    int line_num = 0, field_cnt = 0, ret_val = 0;
+
+    *devs = NULL;
+    *dev_cnt = 0;
+    *bad_cnt = 0;
+    error_msg[0] = '\0';
+    if ((manifest = fopen(path, "r")) == NULL)
+        return errno;
+    if ((*devs = calloc(PROVISION_MAX_DEVS, sizeof (PROVDEV))) == NULL) {
+        fclose(manifest);
+        return ENOMEM;
+    }
+
+    while (fgets(line, sizeof (line), manifest) != NULL) {
+        line_num++;
+        if ((position = strchr(line, '#')) != NULL)
+            *position = '\0';
+        position = strStrip(line);
+        if (*position == '\0')
+            continue;
+        if (*dev_cnt == PROVISION_MAX_DEVS) {
+            snprintf(error_msg, PROVISION_ERR_LEN,
+                    "Line %d: more than %d devices", line_num,
+                    PROVISION_MAX_DEVS);
+            ret_val = E2BIG;
+            break;
+        }
+
+        /* Split it up (one more field than allowed catches extras) */
+        for (field_cnt = 0; position != NULL &&
+                field_cnt <= PROVISION_FIELDS; field_cnt++)
+            fields[field_cnt] = strStrip(strsep(&position, ","));
+
+        (*devs)[*dev_cnt].line = line_num;
+        if ((problem = checkProvEntry(fields, field_cnt, *devs, *dev_cnt,
+                &(*devs)[*dev_cnt])) != NULL) {
+            if (*bad_cnt == 0)
+                snprintf(error_msg, PROVISION_ERR_LEN, "Line %d: %s",
+                        line_num, problem);
+            (*bad_cnt)++;
+            FREE_NULL((*devs)[*dev_cnt].command);
+            memset(&(*devs)[*dev_cnt], 0, sizeof (PROVDEV));
+            continue;
+        }
+        (*dev_cnt)++;
+    }
+    fclose(manifest);
+
+    if (ret_val == 0 && *bad_cnt > 0)
+        ret_val = EINVAL;
+    else if (ret_val == 0 && *dev_cnt == 0)
+        ret_val = ENODATA;
+    if (ret_val != 0) {
+        freeProvisionManifest(*devs, *dev_cnt);
+        *devs = NULL;
+        *dev_cnt = 0;
+    }
+    return ret_val;
+}
+
+
+/*
+ * A provisioning worker; claims the next device, adds it, and repeats
+ * until they're all done or one fails.
+ */
+static void *provWorker(void *arg) {
+    PROVRUN *run = arg;
+    PROVDEV *dev = NULL;
+    long long start = 0;
+    int i = 0, no_failure = 0;
+
+    while (__atomic_load_n(&run->failed, __ATOMIC_SEQ_CST) == 0) {
+        i = __atomic_fetch_add(&run->next_dev, 1, __ATOMIC_SEQ_CST);
+        if (i >= run->dev_cnt)
+            break;
+        dev = &run->devs[i];
+        start = provNow();
+        dev->error = provMgmt(dev->handler, dev->command);
+        dev->usecs = provNow() - start;
+        if (dev->error == 0) {
+            dev->added = TRUE;
+        } else {
+            /* Keep the first failure; everyone else stops */
+            no_failure = 0;
+            __atomic_compare_exchange_n(&run->failed, &no_failure, i + 1,
+                    FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Add the devices (checked by loadProvisionManifest()) with a pool of
+ * PROVISION_THREADS workers. If any device can't be added, the rest are
+ * skipped and the ones that were added are deleted again, so it's all or
+ * nothing. The timing (and what failed) is left in the summary. Returns 0
+ * (zero) or the errno value of the first failure.
+ */
+int runProvision(PROVDEV devs[], int dev_cnt, PROVSUMMARY *summary) {
+    PROVRUN run = {0};
+    pthread_t threads[PROVISION_THREADS];
+    char command[MAX_SYSFS_ATTR_SIZE] = {0};
+    long long start = provNow(), usecs_sum = 0;
+    int thread_cnt = 0, ret_val = 0, i = 0;
+
+    memset(summary, 0, sizeof (PROVSUMMARY));
+    summary->failed = -1;
+    run.devs = devs;
+    run.dev_cnt = dev_cnt;
+    for (i = 0; i < PROVISION_THREADS && i < dev_cnt; i++) {
+        if ((ret_val = pthread_create(&threads[i], NULL, provWorker,
+                &run)) != 0) {
+            DEBUG_LOG("pthread_create(): %s", strerror(ret_val));
+            break;
+        }
+        thread_cnt++;
+    }
+    /* No threads, no problem; just do it here */
+    if (thread_cnt == 0)
+        provWorker(&run);
+    for (i = 0; i < thread_cnt; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; i < dev_cnt; i++) {
+        if (!devs[i].added)
+            continue;
+        summary->added++;
+        usecs_sum += devs[i].usecs;
+        summary->max_usecs = MAX(summary->max_usecs, devs[i].usecs);
+    }
+    if (summary->added > 0)
+        summary->avg_usecs = usecs_sum / summary->added;
+
+    /* Back out what we did if anything failed */
+    ret_val = 0;
+    if (run.failed != 0) {
+        summary->failed = run.failed - 1;
+        ret_val = devs[summary->failed].error;
+        for (i = 0; i < dev_cnt; i++) {
+            if (!devs[i].added)
+                continue;
+            snprintf(command, MAX_SYSFS_ATTR_SIZE, "del_device %s",
+                    devs[i].name);
+            if (provMgmt(devs[i].handler, command) == 0) {
+                devs[i].added = FALSE;
+                summary->rolled_back++;
+            } else {
+                DEBUG_LOG("Couldn't roll back SCST device '%s'",
+                        devs[i].name);
+            }
+        }
+    }
+    summary->total_usecs = provNow() - start;
+    return ret_val;
+}
+
+
+/*
+ * Done with a manifest.
+ */
+void freeProvisionManifest(PROVDEV *devs, int dev_cnt) {
+    int i = 0;
+
+    if (devs == NULL)
+        return;
+    for (i = 0; i < dev_cnt; i++)
+        FREE_NULL(devs[i].command);
+    free(devs);
+    return;
+}
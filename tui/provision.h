@@ -0,0 +1,76 @@
+/**
+ * @file provision.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _PROVISION_H
+#define	_PROVISION_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <limits.h>
+#include <cdk.h>
+
+/* Bulk provisioning settings; a manifest is a CSV file with one device per
+ * line ('#' starts a comment):
+ *   name,handler,filename,blocksize,write_through,nv_cache,read_only,
+ *   removable,rotational
+ * Everything after the handler is optional (the Add Device defaults) */
+#define PROVISION_MAX_DEVS      1024
+#define PROVISION_FIELDS        9
+#define PROVISION_LINE_LEN      (PATH_MAX + 128)
+#define PROVISION_ERR_LEN       128
+/* How many SCST mgmt writes are kept in flight */
+#define PROVISION_THREADS       4
+
+/* One device from a manifest */
+typedef struct prov_dev PROVDEV;
+struct prov_dev {
+    /* Manifest line the device came from */
+    int line;
+    char name[NAME_MAX + 1];
+    /* SCST handler (vdisk_fileio, vdisk_blockio, or vdisk_nullio) */
+    char handler[NAME_MAX + 1];
+    /* Back-end file/device (st_ino is 0 for vdisk_nullio) */
+    dev_t file_dev;
+    ino_t file_ino;
+    /* The 'add_device' mgmt command */
+    char *command;
+    /* Was it added (and not rolled back), and the errno value if adding
+     * it failed */
+    boolean added;
+    int error;
+    /* How long the mgmt write took */
+    long long usecs;
+};
+
+/* Timing for a bulk provisioning run */
+typedef struct prov_summary PROVSUMMARY;
+struct prov_summary {
+    int added;
+    /* The device that failed (its index), or -1, and how many of the ones
+     * already added were removed again */
+    int failed;
+    int rolled_back;
+    /* Wall time for the whole run (rollback included), and the slowest
+     * and average mgmt write */
+    long long total_usecs;
+    long long max_usecs;
+    long long avg_usecs;
+};
+
+/* Function prototypes */
+int loadProvisionManifest(const char path[], PROVDEV **devs, int *dev_cnt,
+        int *bad_cnt, char error_msg[]);
+int runProvision(PROVDEV devs[], int dev_cnt, PROVSUMMARY *summary);
+void freeProvisionManifest(PROVDEV *devs, int dev_cnt);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _PROVISION_H */
@@ -0,0 +1,178 @@
+/**
+ * @file reclaim.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "vdisk.h"
+#include "zeroscan.h"
+#include "reclaim.h"
+
+/*
+ * Read part of the file into the buffer; the offset is aligned, and the
+ * length is rounded up (the read stops short at the end of the file). If
+ * the file system won't do O_DIRECT, we carry on without it. Returns the
+ * bytes read, or -1 with errno set.
+ */
+static ssize_t reclaimRead(FILERECLAIM *reclaim, off_t offset,
+        size_t length) {
+    ssize_t bytes_read = 0, done = 0;
+    int fd_flags = 0;
+
+    length = ((length + RECLAIM_ALIGN - 1) / RECLAIM_ALIGN) * RECLAIM_ALIGN;
+    while ((size_t) done < length) {
+        bytes_read = pread(reclaim->fd, (char *) reclaim->buffer + done,
+                length - done, offset + done);
+        if (bytes_read == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL && reclaim->direct &&
+                    (fd_flags = fcntl(reclaim->fd, F_GETFL)) != -1 &&
+                    fcntl(reclaim->fd, F_SETFL, fd_flags & ~O_DIRECT) != -1) {
+                reclaim->direct = FALSE;
+                continue;
+            }
+            return -1;
+        } else if (bytes_read == 0) {
+            break;
+        }
+        done += bytes_read;
+    }
+    return done;
+}
+
+
+/*
+ * Get ready to reclaim the zeroed space in the given file. The file can't
+ * be the backing file of an SCST device (EBUSY); to reclaim a file that's
+ * in use, take it out of SCST (or reclaim a copy/snapshot). Always call
+ * closeFileReclaim() afterwards. Returns 0 (zero) or the errno value.
+ */
+int openFileReclaim(FILERECLAIM *reclaim, const char path[]) {
+    char dev_name[MAX_SYSFS_ATTR_SIZE] = {0};
+    struct stat file_stat = {0};
+    struct statfs fs_stat = {0};
+    int ret_val = 0;
+
+    memset(reclaim, 0, sizeof (FILERECLAIM));
+    reclaim->fd = -1;
+    if ((ret_val = findVDiskSCSTDev(path, dev_name)) == 0)
+        return EBUSY;
+    else if (ret_val != ENOENT)
+        return ret_val;
+
+    if ((reclaim->fd = open(path, O_RDWR | O_DIRECT | O_CLOEXEC)) != -1) {
+        reclaim->direct = TRUE;
+    } else if (errno != EINVAL ||
+            (reclaim->fd = open(path, O_RDWR | O_CLOEXEC)) == -1) {
+        return errno;
+    }
+    if (fstat(reclaim->fd, &file_stat) == -1 ||
+            fstatfs(reclaim->fd, &fs_stat) == -1)
+        return errno;
+    if (!S_ISREG(file_stat.st_mode))
+        return EINVAL;
+    reclaim->size = file_stat.st_size;
+    /* Reads start on a block, so blocks have to suit O_DIRECT too */
+    reclaim->block_size = fs_stat.f_bsize;
+    if (reclaim->block_size == 0 ||
+            reclaim->block_size % RECLAIM_ALIGN != 0 ||
+            RECLAIM_BUFF_SIZE % reclaim->block_size != 0)
+        reclaim->block_size = RECLAIM_ALIGN;
+    if ((ret_val = posix_memalign(&reclaim->buffer, RECLAIM_ALIGN,
+            RECLAIM_BUFF_SIZE)) != 0) {
+        reclaim->buffer = NULL;
+        return ret_val;
+    }
+    return 0;
+}
+
+
+/*
+ * Reclaim the zeroed space in the part of the file at 'start' (up to
+ * RECLAIM_BUFF_SIZE bytes); only the data is read (holes are skipped), and
+ * zeroed runs are punched out. '*read_bytes' is set to what was read (for
+ * the caller to pace) and '*punched' to the bytes punched out. Returns 0
+ * (zero) or the errno value.
+ */
+int reclaimRange(FILERECLAIM *reclaim, off_t start, off_t *read_bytes,
+        off_t *punched) {
+    off_t end = MIN(start + RECLAIM_BUFF_SIZE, reclaim->size);
+    off_t position = start, data = 0, hole = 0, block = 0;
+    ssize_t bytes_read = 0;
+    size_t run = 0;
+
+    *read_bytes = 0;
+    *punched = 0;
+    while (position < end) {
+        /* Find the next data (if the file system can't tell us, it's all
+         * data) */
+        if ((data = lseek(reclaim->fd, position, SEEK_DATA)) == -1) {
+            if (errno == ENXIO)
+                break;
+            if (errno != EINVAL && errno != EOPNOTSUPP)
+                return errno;
+            data = position;
+            hole = end;
+        } else if ((hole = lseek(reclaim->fd, data, SEEK_HOLE)) == -1) {
+            hole = end;
+        }
+        if (data >= end)
+            break;
+        data = (data / reclaim->block_size) * reclaim->block_size;
+        hole = MIN(hole, end);
+
+        if ((bytes_read = reclaimRead(reclaim, data, hole - data)) == -1)
+            return errno;
+        *read_bytes += bytes_read;
+        bytes_read = MIN(bytes_read, hole - data);
+
+        /* Punch out the zeroed runs of whole blocks */
+        for (block = 0; block < bytes_read; block += run) {
+            run = zeroRunLength((char *) reclaim->buffer + block,
+                    bytes_read - block, reclaim->block_size);
+            if (run >= RECLAIM_MIN_RUN) {
+                if (fallocate(reclaim->fd, FALLOC_FL_PUNCH_HOLE |
+                        FALLOC_FL_KEEP_SIZE, data + block, run) == -1)
+                    return errno;
+                *punched += run;
+            }
+            if (run == 0)
+                run = dataRunLength((char *) reclaim->buffer + block,
+                        bytes_read - block, reclaim->block_size);
+        }
+        if (bytes_read == 0)
+            break;
+        position = data + bytes_read;
+    }
+    return 0;
+}
+
+
+/*
+ * Done with a reclaim.
+ */
+void closeFileReclaim(FILERECLAIM *reclaim) {
+    if (reclaim->fd != -1) {
+        close(reclaim->fd);
+        reclaim->fd = -1;
+    }
+    FREE_NULL(reclaim->buffer);
+    return;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file reclaim.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _RECLAIM_H
+#define	_RECLAIM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <cdk.h>
+
+/* Reclaim settings; the file is read (O_DIRECT, skipping holes) a buffer
+ * at a time, and zeroed runs of whole file system blocks at least
+ * RECLAIM_MIN_RUN long are punched out (shorter ones aren't worth the
+ * fragmentation) */
+#define RECLAIM_ALIGN           4096
+#define RECLAIM_BUFF_SIZE       8388608
+#define RECLAIM_MIN_RUN         65536
+/* Ceiling for the rate (bytes per second) the file is read at; the job
+ * backs off from it with the fill governor's latency threshold */
+#define RECLAIM_MAX_BPS         268435456LL
+
+/* A reclaim of the zeroed space in one file; the file must not be in use
+ * (a zeroed block could be written between our read and the punch) */
+typedef struct file_reclaim FILERECLAIM;
+struct file_reclaim {
+    /* File being reclaimed */
+    int fd;
+    /* Reading with O_DIRECT (dropped if the file system won't have it) */
+    boolean direct;
+    off_t size;
+    /* File system block size (or RECLAIM_ALIGN); holes are punched in
+     * whole blocks */
+    unsigned long block_size;
+    /* Aligned read buffer (RECLAIM_BUFF_SIZE) */
+    void *buffer;
+};
+
+/* Function prototypes */
+int openFileReclaim(FILERECLAIM *reclaim, const char path[]);
+int reclaimRange(FILERECLAIM *reclaim, off_t start, off_t *read_bytes,
+        off_t *punched);
+void closeFileReclaim(FILERECLAIM *reclaim);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _RECLAIM_H */
@@ -0,0 +1,1139 @@
+/**
+ * @file snapshot.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <syslog.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <cdk.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "snapshot.h"
+
+/* A cached sysfs directory (driver, target, session, or adapter) */
+typedef struct snap_node SNAPNODE;
+struct snap_node {
+    boolean in_use;
+    /* Slot number of this node in its cache */
+    int slot;
+    /* Found during the current walk (nodes not seen are closed) */
+    boolean seen;
+    /* Slot number of the parent node (-1 if none) */
+    int parent;
+    char name[MAX_SYSFS_ATTR_SIZE];
+    /* Unique (for the life of the TUI) node ID */
+    unsigned long id;
+    /* Inode number from readdir(); a mismatch means it was re-created */
+    ino_t ino;
+    int dir_fd;
+    /* Sub-directory stream that we enumerate on each pass (may be NULL) */
+    DIR *children;
+    /* Open attribute files, re-read with pread() at offset 0 */
+    int attr_fds[MAX_SNAP_NODE_ATTRS];
+    /* We ran out of descriptors; attributes are opened on each read */
+    boolean uncached;
+    /* Static value, read only once when the node is opened */
+    char value[MAX_SYSFS_ATTR_SIZE];
+    /* Counter values and time of the last rate sample (zero if none) */
+    unsigned long long counters[MAX_SNAP_NODE_ATTRS];
+    struct timespec sampled;
+    /* Per-second rates computed at the last sample */
+    unsigned long rates[MAX_SNAP_NODE_ATTRS];
+    /* Hash chain (slot number + 1, zero terminates) */
+    int next;
+};
+
+/* A set of node slots with a (parent, name) hash index; the slot table
+ * grows as needed and the nodes themselves never move */
+typedef struct snap_cache SNAPCACHE;
+struct snap_cache {
+    /* Number of slots (a slot is NULL until first used) */
+    int size;
+    SNAPNODE **nodes;
+    /* Bucket heads (slot number + 1, zero is empty) */
+    int buckets[SNAP_HASH_SIZE];
+};
+
+/* Session attribute file descriptor slots */
+#define SESS_ACT_CMDS_FD    0
+#define SESS_READ_KB_FD     1
+#define SESS_WRITE_KB_FD    2
+#define SESS_READ_CMDS_FD   3
+#define SESS_WRITE_CMDS_FD  4
+
+/* Session attribute file names (by descriptor slot); the command counters
+ * may not exist with older SCST */
+static const char *sess_attr_names[MAX_SNAP_NODE_ATTRS] = {
+    "active_commands", "read_io_count_kb", "write_io_count_kb",
+    "read_cmd_count", "write_cmd_count"
+};
+#define SESS_OPTIONAL_FD(slot) ((slot) >= SESS_READ_CMDS_FD)
+
+static SNAPCACHE drivers_cache, targets_cache, sessions_cache, fc_cache,
+        ib_cache;
+static DIR *tgt_root = NULL, *fc_root = NULL, *ib_root = NULL;
+static ino_t tgt_root_ino = 0;
+static unsigned long last_node_id = 0;
+/* Descriptors held by the nodes, and how many we allow before new session
+ * nodes are left uncached (set from the open file limit) */
+static int node_fd_cnt = 0, node_fd_budget = SNAP_MIN_FD_BUDGET;
+
+/* The two snapshot buffers; one is published (read by the UI thread) and
+ * the other is filled by the collector. The UI thread sets 'reading' to
+ * the snapshot it holds, and the collector won't re-fill that one. */
+static SCSTSNAPSHOT snapshots[2];
+static SCSTSNAPSHOT *published = NULL, *reading = NULL;
+/* Generation of the last snapshot the UI thread picked up */
+static unsigned long consumed_gen = 0;
+static pthread_t collector_thread;
+static boolean collector_running = FALSE, collector_stop = FALSE;
+/* Collector wake-up (UI to collector) and new snapshot (collector to UI)
+ * event descriptors */
+static int wake_fd = -1, ready_fd = -1;
+
+
+/*
+ * FNV-1a hash of the parent slot number and node name.
+ */
+static unsigned int snapHash(int parent, const char *name) {
+    unsigned int hash = 2166136261U;
+    hash = (hash ^ (unsigned int) (parent + 1)) * 16777619U;
+    while (*name != '\0') {
+        hash = (hash ^ (unsigned char) *name) * 16777619U;
+        name++;
+    }
+    return hash & (SNAP_HASH_SIZE - 1);
+}
+
+
+/*
+ * Close everything a node holds and remove it from the hash index; the
+ * slot is free for re-use afterwards.
+ */
+static void snapCloseNode(SNAPCACHE *cache, int slot) {
+    SNAPNODE *node = cache->nodes[slot];
+    int *link = NULL, i = 0;
+
+    if (node == NULL || !node->in_use)
+        return;
+
+    /* Unlink it from the hash chain */
+    link = &cache->buckets[snapHash(node->parent, node->name)];
+    while (*link != 0) {
+        if (*link == slot + 1) {
+            *link = node->next;
+            break;
+        }
+        link = &cache->nodes[*link - 1]->next;
+    }
+
+    /* Release the descriptors */
+    for (i = 0; i < MAX_SNAP_NODE_ATTRS; i++) {
+        if (node->attr_fds[i] != -1) {
+            close(node->attr_fds[i]);
+            node_fd_cnt--;
+        }
+    }
+    if (node->children != NULL) {
+        closedir(node->children);
+        node_fd_cnt--;
+    }
+    if (node->dir_fd != -1) {
+        close(node->dir_fd);
+        node_fd_cnt--;
+    }
+    node->in_use = FALSE;
+    return;
+}
+
+
+/*
+ * Return the cached node for the given directory entry, opening a new one
+ * if we don't have it yet (or the directory was re-created). The 'is_new'
+ * flag is set so the caller can open the attribute files. The slot table
+ * is grown when all slots are in use. On error, NULL is returned and errno
+ * is set.
+ */
+static SNAPNODE *snapGetNode(SNAPCACHE *cache, int parent, int parent_fd,
+        struct dirent *dir_entry, boolean *is_new) {
+    SNAPNODE *node = NULL, **new_nodes = NULL;
+    unsigned int bucket = 0;
+    int slot = 0, i = 0, new_size = 0;
+
+    /* Look for it in the index first */
+    *is_new = FALSE;
+    bucket = snapHash(parent, dir_entry->d_name);
+    slot = cache->buckets[bucket];
+    while (slot != 0) {
+        node = cache->nodes[slot - 1];
+        if (node->parent == parent &&
+                strcmp(node->name, dir_entry->d_name) == 0) {
+            if (node->ino == dir_entry->d_ino) {
+                node->seen = TRUE;
+                return node;
+            }
+            /* Same name, different inode; its stale */
+            snapCloseNode(cache, slot - 1);
+            break;
+        }
+        slot = node->next;
+    }
+
+    /* Find a free slot */
+    for (slot = 0; slot < cache->size; slot++) {
+        if (cache->nodes[slot] == NULL || !cache->nodes[slot]->in_use)
+            break;
+    }
+    if (slot == cache->size) {
+        new_size = (cache->size == 0) ? SNAP_CACHE_GROW : (cache->size * 2);
+        if ((new_nodes = realloc(cache->nodes,
+                new_size * sizeof (SNAPNODE *))) == NULL)
+            return NULL;
+        memset(&new_nodes[cache->size], 0,
+                (new_size - cache->size) * sizeof (SNAPNODE *));
+        cache->nodes = new_nodes;
+        cache->size = new_size;
+    }
+    if (cache->nodes[slot] == NULL &&
+            (cache->nodes[slot] = malloc(sizeof (SNAPNODE))) == NULL)
+        return NULL;
+    node = cache->nodes[slot];
+    memset(node, 0, sizeof (SNAPNODE));
+    node->slot = slot;
+    node->dir_fd = -1;
+    for (i = 0; i < MAX_SNAP_NODE_ATTRS; i++)
+        node->attr_fds[i] = -1;
+
+    /* Open the directory (this follows the class links) */
+    if ((node->dir_fd = openat(parent_fd, dir_entry->d_name,
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return NULL;
+    node_fd_cnt++;
+    snprintf(node->name, MAX_SYSFS_ATTR_SIZE, "%s", dir_entry->d_name);
+    node->parent = parent;
+    node->id = ++last_node_id;
+    node->ino = dir_entry->d_ino;
+    node->seen = TRUE;
+    node->in_use = TRUE;
+    node->next = cache->buckets[bucket];
+    cache->buckets[bucket] = slot + 1;
+    *is_new = TRUE;
+    return node;
+}
+
+
+/*
+ * Open a sub-directory (relative to an open directory) as a stream; this
+ * is for node children, so it counts against the descriptor budget.
+ */
+static DIR *snapOpenDir(int dir_fd, const char *name) {
+    DIR *dir_stream = NULL;
+    int fd = 0;
+
+    if ((fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return NULL;
+    if ((dir_stream = fdopendir(fd)) == NULL)
+        close(fd);
+    else
+        node_fd_cnt++;
+    return dir_stream;
+}
+
+
+/*
+ * Open an attribute file (relative to the node directory) that is kept
+ * open for the life of the node. Returns FALSE (errno set) on failure.
+ */
+static boolean snapOpenAttr(SNAPNODE *node, int slot, const char *name) {
+    if (openAttribute(node->dir_fd, name, O_RDONLY,
+            &node->attr_fds[slot]) != 0)
+        return FALSE;
+    node_fd_cnt++;
+    return TRUE;
+}
+
+
+/*
+ * Open the attribute files for a new session node. With lots of sessions
+ * (past our descriptor budget, or if we run out) the node is marked
+ * uncached instead; it then holds no descriptors and its attributes are
+ * opened (relative to the target sessions directory) on each read. Returns
+ * FALSE (errno set) if a required attribute couldn't be opened.
+ */
+static boolean snapOpenSessAttrs(SNAPNODE *session) {
+    int i = 0;
+
+    for (i = 0; i < MAX_SNAP_NODE_ATTRS; i++) {
+        if (node_fd_cnt >= node_fd_budget)
+            errno = EMFILE;
+        else if (snapOpenAttr(session, i, sess_attr_names[i]))
+            continue;
+        if (errno == EMFILE || errno == ENFILE) {
+            for (i = 0; i < MAX_SNAP_NODE_ATTRS; i++) {
+                if (session->attr_fds[i] != -1) {
+                    close(session->attr_fds[i]);
+                    session->attr_fds[i] = -1;
+                    node_fd_cnt--;
+                }
+            }
+            close(session->dir_fd);
+            session->dir_fd = -1;
+            node_fd_cnt--;
+            session->uncached = TRUE;
+            return TRUE;
+        }
+        if (errno != ENOENT || !SESS_OPTIONAL_FD(i))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*
+ * Read a session attribute; from the open descriptor if we have one,
+ * otherwise (uncached node) open/read/close it. An optional attribute
+ * that doesn't exist reads as an empty string. Returns FALSE (errno set)
+ * on failure.
+ */
+static boolean snapReadSessAttr(SNAPNODE *target, SNAPNODE *session,
+        int slot, char attr_value[]) {
+    int ret_val = 0;
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0};
+
+    attr_value[0] = '\0';
+    if (session->attr_fds[slot] != -1)
+        return (preadAttribute(session->attr_fds[slot],
+                attr_value) == 0) ? TRUE : FALSE;
+    if (!session->uncached)
+        return TRUE;
+    snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s", session->name,
+            sess_attr_names[slot]);
+    if ((ret_val = readAttributeAt(dirfd(target->children), attr_path,
+            attr_value)) != 0) {
+        errno = ret_val;
+        return (ret_val == ENOENT && SESS_OPTIONAL_FD(slot)) ? TRUE : FALSE;
+    }
+    return TRUE;
+}
+
+
+/*
+ * Read a session counter attribute (unsigned decimal); an optional
+ * attribute that isn't there reads as zero. Returns FALSE (errno set) on
+ * failure.
+ */
+static boolean snapReadCounter(SNAPNODE *target, SNAPNODE *session,
+        int slot, unsigned long long *counter) {
+    char attr_val[MAX_SYSFS_ATTR_SIZE] = {0};
+
+    *counter = 0;
+    if (!snapReadSessAttr(target, session, slot, attr_val))
+        return FALSE;
+    if (attr_val[0] == '\0')
+        return TRUE;
+    errno = 0;
+    *counter = strtoull(attr_val, NULL, 10);
+    return (errno == 0) ? TRUE : FALSE;
+}
+
+
+/*
+ * Raise our open file limit (soft) to the hard limit, since every cached
+ * sysfs node holds a few descriptors, and set the attribute descriptor
+ * budget to half of it (the rest is left for directories and the TUI).
+ */
+static void snapSetFileLimit() {
+    struct rlimit file_limit = {0};
+
+    if (getrlimit(RLIMIT_NOFILE, &file_limit) == -1) {
+        DEBUG_LOG("getrlimit(): %s", strerror(errno));
+        return;
+    }
+    if (file_limit.rlim_cur != file_limit.rlim_max) {
+        file_limit.rlim_cur = file_limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &file_limit) == -1) {
+            DEBUG_LOG("setrlimit(): %s", strerror(errno));
+            getrlimit(RLIMIT_NOFILE, &file_limit);
+        }
+    }
+    if (file_limit.rlim_cur != RLIM_INFINITY &&
+            (file_limit.rlim_cur / 2) > SNAP_MIN_FD_BUDGET)
+        node_fd_budget = file_limit.rlim_cur / 2;
+    return;
+}
+
+
+/*
+ * Update the per-second rates for a node from the current counter values.
+ * A new sample is only taken if at least SNAP_MIN_RATE_MSECS has passed
+ * (refreshes triggered by key presses come quicker than the normal tick),
+ * otherwise the rates from the last sample are kept. A counter that went
+ * backwards (reset) gives a zero rate for that interval.
+ */
+static void snapUpdateRates(SNAPNODE *node, const struct timespec *now,
+        const unsigned long long values[]) {
+    long long elapsed_ms = 0;
+    int i = 0;
+
+    if (node->sampled.tv_sec != 0 || node->sampled.tv_nsec != 0) {
+        elapsed_ms = (now->tv_sec - node->sampled.tv_sec) * 1000LL +
+                (now->tv_nsec - node->sampled.tv_nsec) / 1000000LL;
+        if (elapsed_ms < SNAP_MIN_RATE_MSECS)
+            return;
+        for (i = 0; i < MAX_SNAP_NODE_ATTRS; i++) {
+            if (values[i] >= node->counters[i])
+                node->rates[i] = ((values[i] - node->counters[i]) *
+                        1000ULL) / elapsed_ms;
+            else
+                node->rates[i] = 0;
+        }
+    }
+    memcpy(node->counters, values,
+            MAX_SNAP_NODE_ATTRS * sizeof (unsigned long long));
+    node->sampled = *now;
+    return;
+}
+
+
+/*
+ * Mark every node in the cache as not seen (start of a pass).
+ */
+static void snapMarkUnseen(SNAPCACHE *cache) {
+    int i = 0;
+    for (i = 0; i < cache->size; i++) {
+        if (cache->nodes[i] != NULL)
+            cache->nodes[i]->seen = FALSE;
+    }
+    return;
+}
+
+
+/*
+ * Close all of the nodes that were not found during the last pass; the
+ * number of nodes closed is returned.
+ */
+static int snapSweep(SNAPCACHE *cache) {
+    int i = 0, closed = 0;
+    for (i = 0; i < cache->size; i++) {
+        if (cache->nodes[i] != NULL && cache->nodes[i]->in_use &&
+                !cache->nodes[i]->seen) {
+            snapCloseNode(cache, i);
+            closed++;
+        }
+    }
+    return closed;
+}
+
+
+/*
+ * Close and free every node in the cache.
+ */
+static void snapCloseAll(SNAPCACHE *cache) {
+    int i = 0;
+    for (i = 0; i < cache->size; i++) {
+        snapCloseNode(cache, i);
+        FREE_NULL(cache->nodes[i]);
+    }
+    FREE_NULL(cache->nodes);
+    cache->size = 0;
+    memset(cache->buckets, 0, sizeof (cache->buckets));
+    return;
+}
+
+
+/*
+ * Convert a FC port name (eg, 0x21000024ff3dd8ea) to the format SCST uses
+ * for target names (eg, 21:00:00:24:ff:3d:d8:ea).
+ */
+static void snapFormatWWN(const char port_name[], char wwn[]) {
+    const char *hex = NULL;
+    size_t pos = 0;
+
+    wwn[0] = '\0';
+    if ((hex = strchr(port_name, 'x')) == NULL)
+        return;
+    hex++;
+    while (hex[0] != '\0' && hex[1] != '\0' &&
+            (pos + 3) < MAX_SYSFS_ATTR_SIZE) {
+        if (pos != 0)
+            wwn[pos++] = ':';
+        wwn[pos++] = hex[0];
+        wwn[pos++] = hex[1];
+        hex += 2;
+    }
+    wwn[pos] = '\0';
+    return;
+}
+
+
+/*
+ * Refresh a single session (cached attribute files) and add a record for
+ * it to the end of the snapshot session list. Returns FALSE if the session
+ * node should be dropped.
+ */
+static boolean snapReadSession(SCSTSNAPSHOT *snapshot, SNAPTARGET *tgt_data,
+        SNAPNODE *target, SNAPNODE *session, SNAPSESSION ***sess_link) {
+    SNAPSESSION new_sess, *sess_data = &new_sess;
+    struct stat luns_stat = {0};
+    char attr_val[MAX_SYSFS_ATTR_SIZE] = {0};
+    char luns_path[MAX_SYSFS_PATH_SIZE] = {0};
+    unsigned long long counters[MAX_SNAP_NODE_ATTRS] = {0};
+    int i = 0;
+
+    /* Zeroed so the padding compares equal too */
+    memset(&new_sess, 0, sizeof (SNAPSESSION));
+
+    /* Active commands */
+    if (!snapReadSessAttr(target, session, SESS_ACT_CMDS_FD, attr_val))
+        return FALSE;
+    sess_data->active_cmds = atoi(attr_val);
+
+    /* Read/write IO (in KB) and command counters */
+    for (i = SESS_READ_KB_FD; i < MAX_SNAP_NODE_ATTRS; i++) {
+        if (!snapReadCounter(target, session, i, &counters[i])) {
+            if (errno != ERANGE && errno != EINVAL)
+                return FALSE;
+            snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                    "strtoull(): %s", strerror(errno));
+            return TRUE;
+        }
+    }
+    sess_data->read_io_kb = counters[SESS_READ_KB_FD];
+    sess_data->write_io_kb = counters[SESS_WRITE_KB_FD];
+
+    /* Throughput from the counter deltas */
+    snapUpdateRates(session, &snapshot->taken, counters);
+    sess_data->read_kbps = session->rates[SESS_READ_KB_FD];
+    sess_data->write_kbps = session->rates[SESS_WRITE_KB_FD];
+    sess_data->read_iops = session->rates[SESS_READ_CMDS_FD];
+    sess_data->write_iops = session->rates[SESS_WRITE_CMDS_FD];
+
+    /* The LUN count comes from the link count of the 'luns' directory
+     * (sysfs sets it to the number of sub-directories plus two) */
+    snprintf(luns_path, MAX_SYSFS_PATH_SIZE, "%s/luns", session->name);
+    if (fstatat(dirfd(target->children), luns_path, &luns_stat, 0) == -1)
+        sess_data->lun_count = -1;
+    else if (luns_stat.st_nlink >= 2)
+        sess_data->lun_count = luns_stat.st_nlink - 2;
+    else
+        sess_data->lun_count = 0;
+
+    sess_data->sess_id = session->id;
+
+    /* Add it to the list; the names are copied (the node cache belongs to
+     * the collector, the snapshot to whoever reads it) */
+    if ((sess_data = arenaAlloc(&snapshot->arena,
+            sizeof (SNAPSESSION))) == NULL ||
+            (new_sess.sess_name = arenaStrDup(&snapshot->arena,
+            session->name)) == NULL ||
+            (new_sess.init_name = arenaStrDup(&snapshot->arena,
+            session->value)) == NULL) {
+        snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                "arenaAlloc(): %s", strerror(errno));
+        return TRUE;
+    }
+    new_sess.tgt_driver = tgt_data->driver;
+    new_sess.tgt_name = tgt_data->name;
+    memcpy(sess_data, &new_sess, sizeof (SNAPSESSION));
+    **sess_link = sess_data;
+    *sess_link = &sess_data->next;
+    snapshot->sess_cnt++;
+    return TRUE;
+}
+
+
+/*
+ * Walk the sessions directory of a target.
+ */
+static void snapWalkSessions(SCSTSNAPSHOT *snapshot, SNAPTARGET *tgt_data,
+        SNAPNODE *target, SNAPSESSION ***sess_link) {
+    struct dirent *dir_entry = NULL;
+    SNAPNODE *session = NULL;
+    boolean is_new = FALSE;
+
+    rewinddir(target->children);
+    while ((dir_entry = readdir(target->children)) != NULL) {
+        /* The session names are directories */
+        if ((dir_entry->d_type != DT_DIR) ||
+                (strcmp(dir_entry->d_name, ".") == 0) ||
+                (strcmp(dir_entry->d_name, "..") == 0))
+            continue;
+        session = snapGetNode(&sessions_cache, target->slot,
+                dirfd(target->children), dir_entry, &is_new);
+        if (session == NULL) {
+            /* The session may have just gone away */
+            if (errno != ENOENT)
+                snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                        "openat(): %s", strerror(errno));
+            continue;
+        }
+        if (is_new && (readAttributeAt(session->dir_fd, "initiator_name",
+                session->value) != 0 || !snapOpenSessAttrs(session))) {
+            snapCloseNode(&sessions_cache, session->slot);
+            continue;
+        }
+        if (!snapReadSession(snapshot, tgt_data, target, session,
+                sess_link))
+            snapCloseNode(&sessions_cache, session->slot);
+    }
+    return;
+}
+
+
+/*
+ * Walk the SCST target drivers, targets, and sessions; the records are
+ * linked together (in walk order) starting at 'first_tgt' and 'first_sess'.
+ * Returns FALSE if the top-level targets directory couldn't be read.
+ */
+static boolean snapWalkTargets(SCSTSNAPSHOT *snapshot,
+        SNAPTARGET **first_tgt, SNAPSESSION **first_sess) {
+    struct dirent *drv_entry = NULL, *tgt_entry = NULL;
+    struct stat root_stat = {0};
+    SNAPNODE *driver = NULL, *target = NULL;
+    SNAPTARGET *tgt_data = NULL, **tgt_link = first_tgt;
+    SNAPSESSION **sess_link = first_sess;
+    char attr_val[MAX_SYSFS_ATTR_SIZE] = {0};
+    boolean is_new = FALSE;
+
+    /* Check the top-level directory; if SCST was re-loaded we start over */
+    if (stat(SYSFS_SCST_TGT "/targets", &root_stat) == -1) {
+        if (errno == ENOENT)
+            snapshot->scst_loaded = FALSE;
+        else
+            snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                    "stat(): %s", strerror(errno));
+        return FALSE;
+    }
+    if (tgt_root != NULL && root_stat.st_ino != tgt_root_ino) {
+        closedir(tgt_root);
+        tgt_root = NULL;
+    }
+    if (tgt_root == NULL) {
+        if ((tgt_root = opendir(SYSFS_SCST_TGT "/targets")) == NULL) {
+            snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                    "opendir(): %s", strerror(errno));
+            return FALSE;
+        }
+        tgt_root_ino = root_stat.st_ino;
+    }
+
+    rewinddir(tgt_root);
+    while ((drv_entry = readdir(tgt_root)) != NULL) {
+        /* The driver names are directories */
+        if ((drv_entry->d_type != DT_DIR) ||
+                (strcmp(drv_entry->d_name, ".") == 0) ||
+                (strcmp(drv_entry->d_name, "..") == 0))
+            continue;
+        driver = snapGetNode(&drivers_cache, -1, dirfd(tgt_root),
+                drv_entry, &is_new);
+        if (driver == NULL) {
+            snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                    "openat(): %s", strerror(errno));
+            continue;
+        }
+        if (is_new && (driver->children = snapOpenDir(driver->dir_fd,
+                ".")) == NULL) {
+            snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                    "opendir(): %s", strerror(errno));
+            snapCloseNode(&drivers_cache, driver->slot);
+            continue;
+        }
+
+        rewinddir(driver->children);
+        while ((tgt_entry = readdir(driver->children)) != NULL) {
+            /* The target names are directories */
+            if ((tgt_entry->d_type != DT_DIR) ||
+                    (strcmp(tgt_entry->d_name, ".") == 0) ||
+                    (strcmp(tgt_entry->d_name, "..") == 0))
+                continue;
+            target = snapGetNode(&targets_cache, driver->slot,
+                    dirfd(driver->children), tgt_entry, &is_new);
+            if (target == NULL) {
+                if (errno != ENOENT)
+                    snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                            "openat(): %s", strerror(errno));
+                continue;
+            }
+            if (is_new) {
+                if (!snapOpenAttr(target, 0, "enabled") ||
+                        (target->children = snapOpenDir(target->dir_fd,
+                        "sessions")) == NULL) {
+                    snapCloseNode(&targets_cache, target->slot);
+                    continue;
+                }
+            }
+            /* Get the target enabled/disabled attribute */
+            if (preadAttribute(target->attr_fds[0], attr_val) != 0) {
+                snapCloseNode(&targets_cache, target->slot);
+                continue;
+            }
+            if ((tgt_data = arenaAlloc(&snapshot->arena,
+                    sizeof (SNAPTARGET))) == NULL) {
+                snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                        "arenaAlloc(): %s", strerror(errno));
+                return TRUE;
+            }
+            memset(tgt_data, 0, sizeof (SNAPTARGET));
+            if ((tgt_data->driver = arenaStrDup(&snapshot->arena,
+                    driver->name)) == NULL ||
+                    (tgt_data->name = arenaStrDup(&snapshot->arena,
+                    target->name)) == NULL) {
+                snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                        "arenaAlloc(): %s", strerror(errno));
+                return TRUE;
+            }
+            tgt_data->tgt_id = target->id;
+            tgt_data->enabled = (atoi(attr_val) == 1) ? TRUE : FALSE;
+            tgt_data->speed = "N/A";
+            *tgt_link = tgt_data;
+            tgt_link = &tgt_data->next;
+            snapshot->tgt_cnt++;
+            snapWalkSessions(snapshot, tgt_data, target, &sess_link);
+        }
+    }
+    return TRUE;
+}
+
+
+/*
+ * Walk the FC host or IB HCA class directory; the static name attribute
+ * (matches the SCST target name) is read once per adapter. The rate/speed
+ * is only read for adapters that are SCST targets.
+ */
+static void snapWalkAdapters(SCSTSNAPSHOT *snapshot, SNAPCACHE *cache,
+        DIR **root, const char class_dir[], const char name_attr[],
+        const char speed_attr[]) {
+    struct dirent *dir_entry = NULL;
+    SNAPNODE *adapter = NULL;
+    char attr_val[MAX_SYSFS_ATTR_SIZE] = {0}, *speed = NULL;
+    boolean is_new = FALSE;
+    int i = 0;
+
+    /* No class directory simply means no adapters of this type */
+    if (*root == NULL && (*root = opendir(class_dir)) == NULL) {
+        if (errno != ENOENT)
+            snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                    "opendir(): %s", strerror(errno));
+        return;
+    }
+
+    rewinddir(*root);
+    while ((dir_entry = readdir(*root)) != NULL) {
+        /* The adapter directory names are links */
+        if (dir_entry->d_type != DT_LNK)
+            continue;
+        adapter = snapGetNode(cache, -1, dirfd(*root), dir_entry, &is_new);
+        if (adapter == NULL)
+            continue;
+        if (is_new) {
+            if (readAttributeAt(adapter->dir_fd, name_attr, attr_val) != 0 ||
+                    !snapOpenAttr(adapter, 0, speed_attr)) {
+                snapCloseNode(cache, adapter->slot);
+                continue;
+            }
+            if (cache == &fc_cache)
+                snapFormatWWN(attr_val, adapter->value);
+            else
+                snprintf(adapter->value, MAX_SYSFS_ATTR_SIZE, "%s",
+                        attr_val);
+        }
+        speed = NULL;
+        for (i = 0; i < snapshot->tgt_cnt; i++) {
+            if (strcmp(snapshot->targets[i]->name, adapter->value) != 0)
+                continue;
+            if (speed == NULL) {
+                if (preadAttribute(adapter->attr_fds[0], attr_val) != 0 ||
+                        (speed = arenaStrDup(&snapshot->arena,
+                        attr_val)) == NULL)
+                    break;
+            }
+            snapshot->targets[i]->speed = speed;
+        }
+    }
+    return;
+}
+
+
+/*
+ * Build the target and session index (pointer) arrays for the snapshot
+ * from the record lists; the arrays are sized for this pass and allocated
+ * from the snapshot arena. Returns FALSE (errno set) on failure.
+ */
+static boolean snapIndexRecords(SCSTSNAPSHOT *snapshot,
+        SNAPTARGET *first_tgt, SNAPSESSION *first_sess) {
+    SNAPTARGET *tgt_data = NULL;
+    SNAPSESSION *sess_data = NULL;
+    int i = 0;
+
+    if ((snapshot->targets = arenaAlloc(&snapshot->arena,
+            snapshot->tgt_cnt * sizeof (SNAPTARGET *))) == NULL ||
+            (snapshot->sessions = arenaAlloc(&snapshot->arena,
+            snapshot->sess_cnt * sizeof (SNAPSESSION *))) == NULL) {
+        snapshot->tgt_cnt = 0;
+        snapshot->sess_cnt = 0;
+        return FALSE;
+    }
+    for (i = 0, tgt_data = first_tgt; tgt_data != NULL;
+            i++, tgt_data = tgt_data->next)
+        snapshot->targets[i] = tgt_data;
+    for (i = 0, sess_data = first_sess; sess_data != NULL;
+            i++, sess_data = sess_data->next)
+        snapshot->sessions[i] = sess_data;
+    return TRUE;
+}
+
+
+/*
+ * Take a new snapshot of the SCST targets and sessions (and the FC/IB
+ * adapters backing them). This is a single pass over sysfs; the directory
+ * and attribute descriptors from the previous pass are re-used, so in the
+ * steady state this is one readdir() per directory and one pread() per
+ * attribute. The records are allocated from the snapshot arena, which is
+ * reset (not freed) for each pass, so there is no fixed limit on how many
+ * targets or sessions are kept. The 'changed' flags are set against the
+ * last snapshot (NULL if none), which must not be the same one. Returns
+ * FALSE if SCST isn't loaded or the walk failed.
+ */
+static boolean snapUpdate(SCSTSNAPSHOT *snapshot, const SCSTSNAPSHOT *last) {
+    boolean success = FALSE;
+    SNAPTARGET *first_tgt = NULL, *tgt_data = NULL, *last_tgt = NULL;
+    SNAPSESSION *first_sess = NULL, *sess_data = NULL;
+    int last_tgt_cnt = 0, last_sess_cnt = 0, i = 0;
+    static boolean first_pass = TRUE;
+
+    if (first_pass) {
+        snapSetFileLimit();
+        first_pass = FALSE;
+    }
+    if (last != NULL) {
+        last_tgt_cnt = last->tgt_cnt;
+        last_sess_cnt = last->sess_cnt;
+    }
+    arenaReset(&snapshot->arena);
+
+    /* Start fresh */
+    clock_gettime(CLOCK_MONOTONIC, &snapshot->taken);
+    snapshot->scst_loaded = TRUE;
+    snapshot->error[0] = '\0';
+    snapshot->tgt_changed = FALSE;
+    snapshot->sess_changed = FALSE;
+    snapshot->tgt_cnt = 0;
+    snapshot->sess_cnt = 0;
+    snapMarkUnseen(&drivers_cache);
+    snapMarkUnseen(&targets_cache);
+    snapMarkUnseen(&sessions_cache);
+    snapMarkUnseen(&fc_cache);
+    snapMarkUnseen(&ib_cache);
+
+    /* Targets and sessions, then the adapters */
+    success = snapWalkTargets(snapshot, &first_tgt, &first_sess);
+    if (!snapIndexRecords(snapshot, first_tgt, first_sess)) {
+        snprintf(snapshot->error, MAX_SYSFS_ATTR_SIZE,
+                "arenaAlloc(): %s", strerror(errno));
+        success = FALSE;
+    }
+    if (success) {
+        snapWalkAdapters(snapshot, &fc_cache, &fc_root, SYSFS_FC_HOST,
+                "port_name", "speed");
+        // TODO: It may be incorrect to assume there is only 1 port!
+        snapWalkAdapters(snapshot, &ib_cache, &ib_root, SYSFS_INFINIBAND,
+                "node_guid", "ports/1/rate");
+    }
+
+    /* Anything we didn't see has gone away */
+    if (snapSweep(&sessions_cache) != 0)
+        snapshot->sess_changed = TRUE;
+    snapSweep(&targets_cache);
+    snapSweep(&drivers_cache);
+    snapSweep(&fc_cache);
+    snapSweep(&ib_cache);
+    if (!success && tgt_root != NULL) {
+        closedir(tgt_root);
+        tgt_root = NULL;
+    }
+
+    /* Compare the records with the previous pass at the same position */
+    if (snapshot->tgt_cnt != last_tgt_cnt)
+        snapshot->tgt_changed = TRUE;
+    for (i = 0; i < snapshot->tgt_cnt && !snapshot->tgt_changed; i++) {
+        tgt_data = snapshot->targets[i];
+        last_tgt = last->targets[i];
+        if (tgt_data->tgt_id != last_tgt->tgt_id ||
+                tgt_data->enabled != last_tgt->enabled ||
+                strcmp(tgt_data->speed, last_tgt->speed) != 0)
+            snapshot->tgt_changed = TRUE;
+    }
+    for (i = 0; i < snapshot->sess_cnt; i++) {
+        /* Only the fields before 'changed' are compared */
+        sess_data = snapshot->sessions[i];
+        sess_data->changed = (i >= last_sess_cnt ||
+                memcmp(sess_data, last->sessions[i],
+                offsetof(SNAPSESSION, changed)) != 0) ? TRUE : FALSE;
+        if (sess_data->changed)
+            snapshot->sess_changed = TRUE;
+    }
+
+    /* Count, SCST state, or error message changes affect both labels */
+    if (snapshot->sess_cnt != last_sess_cnt)
+        snapshot->sess_changed = TRUE;
+    if (last == NULL || snapshot->scst_loaded != last->scst_loaded ||
+            strcmp(snapshot->error, last->error) != 0) {
+        snapshot->tgt_changed = TRUE;
+        snapshot->sess_changed = TRUE;
+    }
+
+    /* Done */
+    return success;
+}
+
+
+/*
+ * Carry the changes from a snapshot the UI thread never picked up forward
+ * into the next one, so the labels see everything that changed since the
+ * last snapshot they rendered.
+ */
+static void snapMergeChanges(SCSTSNAPSHOT *snapshot,
+        const SCSTSNAPSHOT *last) {
+    int i = 0;
+
+    snapshot->tgt_changed |= last->tgt_changed;
+    snapshot->sess_changed |= last->sess_changed;
+    for (i = 0; i < snapshot->sess_cnt && i < last->sess_cnt; i++) {
+        if (last->sessions[i]->changed)
+            snapshot->sessions[i]->changed = TRUE;
+    }
+    return;
+}
+
+
+/*
+ * Take the next snapshot into the buffer that isn't published, then
+ * publish it (a single pointer store) and signal the UI thread. Only the
+ * collector thread calls this, or the UI thread if there's no collector.
+ */
+static void snapCollect() {
+    SCSTSNAPSHOT *last = NULL, *next = NULL;
+
+    last = __atomic_load_n(&published, __ATOMIC_SEQ_CST);
+    next = (last == &snapshots[0]) ? &snapshots[1] : &snapshots[0];
+
+    /* Wait for the UI thread to let go of the buffer we're about to use
+     * (it only holds it while rendering the labels) */
+    while (__atomic_load_n(&reading, __ATOMIC_SEQ_CST) == next)
+        usleep(SNAP_GRACE_USECS);
+
+    snapUpdate(next, last);
+    next->generation = (last == NULL) ? 1 : (last->generation + 1);
+    if (last != NULL && __atomic_load_n(&consumed_gen,
+            __ATOMIC_SEQ_CST) != last->generation)
+        snapMergeChanges(next, last);
+
+    __atomic_store_n(&published, next, __ATOMIC_SEQ_CST);
+    if (ready_fd != -1 && eventfd_write(ready_fd, 1) == -1)
+        DEBUG_LOG("eventfd_write(): %s", strerror(errno));
+    return;
+}
+
+
+/*
+ * The collector thread; takes a snapshot every REFRESH_DELAY (tenths of a
+ * second), or right away when woken up, until told to stop.
+ */
+static void *snapCollector(void *arg) {
+    struct itimerspec interval = {{0}, {0}};
+    struct pollfd poll_fds[2];
+    eventfd_t count = 0;
+    uint64_t expirations = 0;
+    int timer_fd = -1, timeout = -1;
+
+    (void) arg;
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC,
+            TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        DEBUG_LOG("timerfd_create(): %s", strerror(errno));
+        timeout = REFRESH_DELAY * 100;
+    } else {
+        interval.it_interval.tv_sec = REFRESH_DELAY / 10;
+        interval.it_interval.tv_nsec = (REFRESH_DELAY % 10) * 100000000L;
+        interval.it_value = interval.it_interval;
+        if (timerfd_settime(timer_fd, 0, &interval, NULL) == -1) {
+            DEBUG_LOG("timerfd_settime(): %s", strerror(errno));
+            close(timer_fd);
+            timer_fd = -1;
+            timeout = REFRESH_DELAY * 100;
+        }
+    }
+
+    for (;;) {
+        poll_fds[0].fd = wake_fd;
+        poll_fds[0].events = POLLIN;
+        poll_fds[0].revents = 0;
+        poll_fds[1].fd = timer_fd;
+        poll_fds[1].events = POLLIN;
+        poll_fds[1].revents = 0;
+        if (poll(poll_fds, 2, timeout) == -1 && errno != EINTR) {
+            DEBUG_LOG("poll(): %s", strerror(errno));
+            break;
+        }
+        if (poll_fds[0].revents & POLLIN)
+            eventfd_read(wake_fd, &count);
+        if ((poll_fds[1].revents & POLLIN) && read(timer_fd, &expirations,
+                sizeof (expirations)) == -1 && errno != EAGAIN)
+            DEBUG_LOG("read(): %s", strerror(errno));
+        if (__atomic_load_n(&collector_stop, __ATOMIC_SEQ_CST))
+            break;
+        snapCollect();
+    }
+
+    if (timer_fd != -1)
+        close(timer_fd);
+    return NULL;
+}
+
+
+/*
+ * Take the first snapshot and start the collector thread, which keeps
+ * taking them in the background so the UI thread never blocks on sysfs.
+ * If the thread can't be started, we return FALSE and the snapshots are
+ * taken by the UI thread (in acquireSCSTSnapshot()) instead.
+ */
+boolean startSCSTCollector() {
+    int ret_val = 0;
+
+    /* There is always a published snapshot after this */
+    if (published == NULL)
+        snapCollect();
+    if (collector_running)
+        return TRUE;
+
+    if ((wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ||
+            (ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        DEBUG_LOG("eventfd(): %s", strerror(errno));
+    } else {
+        __atomic_store_n(&collector_stop, FALSE, __ATOMIC_SEQ_CST);
+        if ((ret_val = pthread_create(&collector_thread, NULL,
+                snapCollector, NULL)) == 0) {
+            collector_running = TRUE;
+            return TRUE;
+        }
+        DEBUG_LOG("pthread_create(): %s", strerror(ret_val));
+    }
+
+    /* No collector; clean up */
+    if (wake_fd != -1) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    if (ready_fd != -1) {
+        close(ready_fd);
+        ready_fd = -1;
+    }
+    return FALSE;
+}
+
+
+/*
+ * Get the latest published snapshot for rendering; it won't change (or be
+ * re-used by the collector) until releaseSCSTSnapshot() is called. Without
+ * a collector thread, a new snapshot is taken here.
+ */
+SCSTSNAPSHOT *acquireSCSTSnapshot() {
+    SCSTSNAPSHOT *snapshot = NULL;
+
+    if (!collector_running)
+        snapCollect();
+
+    /* Announce the snapshot we're using, then make sure it's still the
+     * published one (otherwise the collector may not have seen us) */
+    do {
+        snapshot = __atomic_load_n(&published, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&reading, snapshot, __ATOMIC_SEQ_CST);
+    } while (snapshot != __atomic_load_n(&published, __ATOMIC_SEQ_CST));
+    __atomic_store_n(&consumed_gen, snapshot->generation, __ATOMIC_SEQ_CST);
+    return snapshot;
+}
+
+
+/*
+ * Done with the snapshot from acquireSCSTSnapshot().
+ */
+void releaseSCSTSnapshot() {
+    __atomic_store_n(&reading, NULL, __ATOMIC_SEQ_CST);
+    return;
+}
+
+
+/*
+ * Return a descriptor that becomes readable (eventfd) when a new snapshot
+ * is published, or -1 if there is no collector thread.
+ */
+int scstSnapshotEventFd() {
+    return ready_fd;
+}
+
+
+/*
+ * Ask the collector thread for a new snapshot now (eg, after a hot-plug
+ * event) instead of waiting for the next tick.
+ */
+void kickSCSTCollector() {
+    if (wake_fd != -1 && eventfd_write(wake_fd, 1) == -1)
+        DEBUG_LOG("eventfd_write(): %s", strerror(errno));
+    return;
+}
+
+
+/*
+ * Stop the collector thread and release all of the cached sysfs
+ * descriptors and snapshot memory.
+ */
+void closeSCSTSnapshot() {
+    if (collector_running) {
+        __atomic_store_n(&collector_stop, TRUE, __ATOMIC_SEQ_CST);
+        kickSCSTCollector();
+        pthread_join(collector_thread, NULL);
+        collector_running = FALSE;
+        close(wake_fd);
+        wake_fd = -1;
+        close(ready_fd);
+        ready_fd = -1;
+    }
+    published = NULL;
+    arenaFree(&snapshots[0].arena);
+    arenaFree(&snapshots[1].arena);
+    memset(snapshots, 0, sizeof (snapshots));
+    snapCloseAll(&sessions_cache);
+    snapCloseAll(&targets_cache);
+    snapCloseAll(&drivers_cache);
+    snapCloseAll(&fc_cache);
+    snapCloseAll(&ib_cache);
+    if (tgt_root != NULL) {
+        closedir(tgt_root);
+        tgt_root = NULL;
+    }
+    if (fc_root != NULL) {
+        closedir(fc_root);
+        fc_root = NULL;
+    }
+    if (ib_root != NULL) {
+        closedir(ib_root);
+        ib_root = NULL;
+    }
+    return;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file snapshot.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _SNAPSHOT_H
+#define	_SNAPSHOT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+#include <cdk.h>
+
+#include "system.h"
+#include "arena.h"
+
+/* Snapshot engine limits */
+#define MAX_SNAP_NODE_ATTRS     5
+#define SNAP_HASH_SIZE          4096
+#define SNAP_CACHE_GROW         16
+#define SNAP_MIN_FD_BUDGET      256
+#define SNAP_GRACE_USECS        1000
+#define SNAP_MIN_RATE_MSECS     500
+
+/* Structure to hold a SCST target (main screen targets label); everything
+ * is allocated from the snapshot arena */
+typedef struct scst_snap_target SNAPTARGET;
+struct scst_snap_target {
+    /* Target driver name */
+    const char *driver;
+    /* Target name */
+    const char *name;
+    /* Unique ID for this target (a re-created target gets a new one) */
+    unsigned long tgt_id;
+    /* The 'enabled' attribute */
+    boolean enabled;
+    /* Link speed/rate of a matching FC or IB adapter ("N/A" if none) */
+    const char *speed;
+    /* Next target found during the walk */
+    SNAPTARGET *next;
+};
+
+/* Structure to hold a SCST session (main screen sessions label); this is
+ * kept compact, the target name strings are shared with the target record
+ * and everything is allocated from the snapshot arena */
+typedef struct scst_snap_session SNAPSESSION;
+struct scst_snap_session {
+    /* The 'read_io_count_kb' attribute */
+    unsigned long long read_io_kb;
+    /* The 'write_io_count_kb' attribute */
+    unsigned long long write_io_kb;
+    /* Per-second rates over the last sample interval (KB and commands) */
+    unsigned long read_kbps;
+    unsigned long write_kbps;
+    unsigned long read_iops;
+    unsigned long write_iops;
+    /* Unique ID for this session (a re-created session gets a new one) */
+    unsigned long sess_id;
+    /* Number of LUNs visible to this session */
+    int lun_count;
+    /* The 'active_commands' attribute */
+    int active_cmds;
+    /* Differs from the previous snapshot at this position; the fields from
+     * here on aren't compared (the names go with the session ID) */
+    boolean changed;
+    /* Target driver name */
+    const char *tgt_driver;
+    /* Target name */
+    const char *tgt_name;
+    /* Session (directory) name */
+    const char *sess_name;
+    /* The 'initiator_name' attribute */
+    const char *init_name;
+    /* Next session found during the walk */
+    SNAPSESSION *next;
+};
+
+/* One pass over the SCST sysfs tree (targets, sessions, and adapters); the
+ * records are indexed by pointer arrays sized for each pass, there is no
+ * fixed limit on the number of targets or sessions. Snapshots are taken by
+ * a collector thread and are read-only once published. */
+typedef struct scst_snapshot SCSTSNAPSHOT;
+struct scst_snapshot {
+    /* Increases by one for each snapshot published */
+    unsigned long generation;
+    /* When the snapshot was taken (CLOCK_MONOTONIC) */
+    struct timespec taken;
+    boolean scst_loaded;
+    /* Non-empty if something failed while walking the tree */
+    char error[MAX_SYSFS_ATTR_SIZE];
+    /* Set if anything differs from the previous snapshot (or any snapshot
+     * since the one last picked up by the UI thread) */
+    boolean tgt_changed;
+    boolean sess_changed;
+    int tgt_cnt;
+    SNAPTARGET **targets;
+    int sess_cnt;
+    SNAPSESSION **sessions;
+    /* Records for this snapshot; reset when the buffer is re-used */
+    ARENA arena;
+};
+
+/* Function prototypes */
+boolean startSCSTCollector();
+SCSTSNAPSHOT *acquireSCSTSnapshot();
+void releaseSCSTSnapshot();
+int scstSnapshotEventFd();
+void kickSCSTCollector();
+void closeSCSTSnapshot();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SNAPSHOT_H */
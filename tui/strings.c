@@ -19,7 +19,9 @@ char *g_no_yes_opts[] = {"No", "Yes"},
         *g_raid_opts[] = {"0", "1", "5", "6"},
         *g_strip_opts[] = {"8", "16", "32", "64", "128", "256", "512", "1024"},
         *g_dsbl_enbl_opts[] = {"Disabled (0)", "Enabled (1)"},
-        *g_fs_type_opts[] = {"xfs", "btrfs", "ext3", "ext4"};
+        *g_fs_type_opts[] = {"xfs", "btrfs", "ext3", "ext4"},
+        *g_vdisk_prov_opts[] = {"Thick", "Thick (Zero Range)",
+        "Thin (Sparse)", "Eager Zero"};
 
 /* Label title strings */
 char *g_mail_title_msg[] = {"</31/B>System mail (SMTP) settings..."},
@@ -49,7 +51,11 @@ char *g_transports[] = {"unknown", "scsi", "ide", "dac960", "cpqarray",
         "file", "ataraid", "i2o", "ubd", "dasd", "viodasd", "sx8", "dm"},
         *g_scst_handlers[] = {"dev_disk", "dev_disk_perf", "vcdrom",
         "vdisk_blockio", "vdisk_fileio", "vdisk_nullio", "dev_changer",
-        "dev_tape", "dev_tape_perf"};
+        "dev_tape", "dev_tape_perf"},
+        *g_vdisk_prov_names[] = {"thick", "zero-range", "thin", "eager-zero"},
+        *g_vdisk_job_states[] = {"Free", "Running", "Done", "Failed",
+        "Cancelled", "Interrupted"},
+        *g_vdisk_job_types[] = {"Zero Fill", "Defrag", "Reclaim"};
 
 /* Functions to return the sizes */
 size_t g_scst_dev_types_size() {
@@ -62,6 +62,11 @@ extern "C" {
 #define NOT_MOUNTED_2       "(The file system must be mounted before " \
         "proceeding.)"
 
+/* Virtual disk job messages */
+#define XFS_FSR_MODIFIED_1  "xfs_fsr gave up: the file was modified " \
+        "while it was being copied."
+#define XFS_FSR_MODIFIED_2  "(Resume the job when the file is idle.)"
+
 /* INI parser messages */
 #define SET_FILE_VAL_ERR        "Couldn't set configuration file value!"
 #define NET_CONF_WRITE_ERR      "Couldn't open network config. file " \
@@ -86,7 +91,8 @@ extern "C" {
 /* Dialog radio widget options */
 extern char *g_no_yes_opts[], *g_auth_meth_opts[], *g_ip_opts[],
         *g_cache_opts[], *g_write_opts[], *g_read_opts[], *g_bbu_opts[],
-        *g_raid_opts[], *g_strip_opts[], *g_dsbl_enbl_opts[], *g_fs_type_opts[];
+        *g_raid_opts[], *g_strip_opts[], *g_dsbl_enbl_opts[], *g_fs_type_opts[],
+        *g_vdisk_prov_opts[];
 
 /* Label title strings */
 extern char *g_mail_title_msg[], *g_add_user_title_msg[], *g_date_title_msg[];
@@ -100,7 +106,8 @@ extern char *g_choice_char[], *g_bonding_map[], *g_scst_dev_types[],
 extern char *g_ok_msg[], *g_ok_cancel_msg[], *g_yes_no_msg[];
 
 /* Other string stuff */
-extern char *g_transports[], *g_scst_handlers[];
+extern char *g_transports[], *g_scst_handlers[], *g_vdisk_prov_names[],
+        *g_vdisk_job_states[], *g_vdisk_job_types[];
 
 #ifdef	__cplusplus
 }
@@ -48,6 +48,7 @@ extern "C" {
 #define SYSTEM_SCST_INFO        9
 #define SYSTEM_CRM_STATUS       10
 #define SYSTEM_DATE_TIME        11
+#define SYSTEM_CPU_AFFINITY     12
 
 /* Back-End Storage menu layout */
 #define BACK_STORAGE_MENU               1
@@ -63,7 +64,11 @@ extern "C" {
 #define BACK_STORAGE_REMOVE_FS          10
 #define BACK_STORAGE_ADD_VDISK_FILE     11
 #define BACK_STORAGE_DEL_VDISK_FILE     12
-#define BACK_STORAGE_VDISK_FILE_LIST    13
+#define BACK_STORAGE_CLONE_VDISK_FILE   13
+#define BACK_STORAGE_DEFRAG_VDISK_FILE  14
+#define BACK_STORAGE_RECLAIM_VDISK_FILE 15
+#define BACK_STORAGE_VDISK_FILE_LIST    16
+#define BACK_STORAGE_VDISK_JOBS         17
 
 /* Hosts menu layout */
 #define HOSTS_MENU      2
@@ -76,10 +81,14 @@ extern "C" {
 #define DEVICES_MENU            3
 #define DEVICES_LUN_LAYOUT      1
 #define DEVICES_DEV_INFO        2
-#define DEVICES_ADD_DEV         3
-#define DEVICES_REM_DEV         4
-#define DEVICES_MAP_TO          5
-#define DEVICES_UNMAP_FROM      6
+#define DEVICES_DEV_PATHS       3
+#define DEVICES_ADD_DEV         4
+#define DEVICES_BULK_ADD_DEV    5
+#define DEVICES_TUNE_DEV        6
+#define DEVICES_REBALANCE_DEVS  7
+#define DEVICES_REM_DEV         8
+#define DEVICES_MAP_TO          9
+#define DEVICES_UNMAP_FROM      10
 
 /* Targets menu layout */
 #define TARGETS_MENU            4
@@ -113,12 +122,20 @@ extern "C" {
 /* Misc. limits */
 #define GIBIBYTE_SIZE           1073741824LL
 #define MEBIBYTE_SIZE           1048576LL
-#define VDISK_WRITE_SIZE        262144
 #define MAX_SHELL_CMD_LEN       256
 #define MISC_STRING_LEN         128
 #define UUID_STR_SIZE           64
 #define MAX_TUI_STR_LEN         256
 
+/* Virtual disk file provisioning modes (g_vdisk_prov_opts and
+ * g_vdisk_prov_names order); the mode is kept in an extended attribute */
+#define VDISK_PROV_THICK        0
+#define VDISK_PROV_ZERO_RANGE   1
+#define VDISK_PROV_THIN         2
+#define VDISK_PROV_EAGER_ZERO   3
+#define VDISK_PROV_MODES        4
+#define VDISK_PROV_XATTR        "user.esos.provisioning"
+
 /* Main screen information labels */
 #define MAX_INFO_LABEL_ROWS     512
 #define TARGETS_LABEL_COLS      76
@@ -144,6 +161,7 @@ extern "C" {
 #define SSMTP_BIN       "/usr/sbin/ssmtp"
 #define TAR_BIN         "/usr/bin/tar"
 #define CRM_TOOL        "/usr/sbin/crm"
+#define XFS_FSR_BIN     "/usr/sbin/xfs_fsr"
 
 /* A few sysfs settings */
 #define SYSFS_FC_HOST           "/sys/class/fc_host"
@@ -152,19 +170,38 @@ extern "C" {
 #define SYSFS_SCSI_DISK         "/sys/class/scsi_disk"
 #define SYSFS_SCSI_DEVICE       "/sys/class/scsi_device"
 #define SYSFS_BLOCK             "/sys/block"
+#define SYSFS_DEV_BLOCK         "/sys/dev/block"
+#define SYSFS_DEVICES           "/sys/devices"
+#define SYSFS_NODE              "/sys/devices/system/node"
 #define SYSFS_NET               "/sys/class/net"
 #define MAX_SYSFS_ATTR_SIZE     256
 #define MAX_SYSFS_PATH_SIZE     256
 #define SCSI_CHANGER_TYPE       8
 #define SCSI_TAPE_TYPE          1
 
+/* One sysfs attribute in a batch read (readAttributes()) */
+typedef struct attr_read ATTRREAD;
+struct attr_read {
+    /* Directory handle the name is relative to (or AT_FDCWD) */
+    int dir_fd;
+    /* Attribute file name */
+    const char *name;
+    /* Receives the value (MAX_SYSFS_ATTR_SIZE bytes) */
+    char *value;
+    /* 0 (zero) or the errno value if it couldn't be read */
+    int error;
+};
+
 /* System files (configuration, etc.) */
 #define PROC_DRBD       "/proc/drbd"
 #define PROC_MDSTAT     "/proc/mdstat"
+#define PROC_DIR        "/proc"
+#define PROC_IRQ        "/proc/irq"
 #define SSMTP_CONF      "/etc/ssmtp/ssmtp.conf"
 #define NETWORK_CONF    "/etc/network.conf"
 #define NTP_SERVER      "/etc/ntp_server"
 #define SCST_CONF       "/etc/scst.conf"
+#define SCST_TUNING_CONF "/etc/scst_tuning.conf"
 #define FSTAB           "/etc/fstab"
 #define FSTAB_TMP       "/etc/fstab.new"
 #define MTAB            "/proc/mounts"
@@ -177,6 +214,10 @@ extern "C" {
 #define LOCALTIME       "/etc/localtime"
 #define ZONEINFO        "/usr/share/zoneinfo/posix"
 
+/* Main screen event settings */
+#define EVENT_CONF_DIR          "/etc"
+#define MAX_UEVENT_SIZE         8192
+
 /* Size/limits settings */
 #define MAX_SCST_TGTS               256
 #define MAX_SCST_GROUPS             128
@@ -185,7 +226,6 @@ extern "C" {
 #define MAX_SCST_DEVS               128
 #define MAX_SCST_INITS              128
 #define MAX_SCST_DRIVERS            16
-#define MAX_SCST_SESSNS             512
 #define MAX_SCST_SESS_INITS         128
 #define MAX_SCST_DEV_GRPS           64
 #define MAX_SCST_TGT_GRPS           64
@@ -0,0 +1,1012 @@
+/**
+ * @file topology.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <cdk.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "topology.h"
+
+static TOPOLOGY topology;
+
+
+/*
+ * FNV-1a hash of up to three names (NULL ones are skipped, but still
+ * separate the others).
+ */
+static unsigned int topoHash(const char *first, const char *second,
+        const char *third) {
+    const char *names[] = {first, second, third};
+    const char *name = NULL;
+    unsigned int hash = 2166136261U;
+    int i = 0;
+
+    for (i = 0; i < 3; i++) {
+        for (name = names[i]; name != NULL && *name != '\0'; name++)
+            hash = (hash ^ (unsigned char) *name) * 16777619U;
+        hash = (hash ^ 0xffU) * 16777619U;
+    }
+    return hash & (TOPO_HASH_SIZE - 1);
+}
+
+
+/*
+ * Do two group names match (NULL is the target's default LUNs)?
+ */
+static boolean sameGroupName(const char *name_1, const char *name_2) {
+    if (name_1 == NULL || name_2 == NULL)
+        return (name_1 == name_2) ? TRUE : FALSE;
+    return (strcmp(name_1, name_2) == 0) ? TRUE : FALSE;
+}
+
+
+/*
+ * Add a target to the index (at the end of the list). On error, NULL is
+ * returned.
+ */
+static TOPOTARGET *indexTarget(TOPOLOGY *topo, const char driver[],
+        const char tgt_name[]) {
+    TOPOTARGET *target = NULL, **link = NULL;
+    unsigned int bucket = topoHash(driver, tgt_name, NULL);
+
+    if ((target = arenaAlloc(&topo->arena, sizeof (TOPOTARGET))) == NULL)
+        return NULL;
+    memset(target, 0, sizeof (TOPOTARGET));
+    if ((target->driver = arenaStrDup(&topo->arena, driver)) == NULL ||
+            (target->name = arenaStrDup(&topo->arena, tgt_name)) == NULL)
+        return NULL;
+    for (link = &topo->targets; *link != NULL; link = &(*link)->next)
+        ;
+    *link = target;
+    target->hash_next = topo->tgt_hash[bucket];
+    topo->tgt_hash[bucket] = target;
+    topo->tgt_cnt++;
+    return target;
+}
+
+
+/*
+ * Add a group to a target (the default group goes first). On error, NULL
+ * is returned.
+ */
+static TOPOGROUP *indexGroup(TOPOLOGY *topo, TOPOTARGET *target,
+        const char *group_name) {
+    TOPOGROUP *group = NULL, **link = NULL;
+    unsigned int bucket = topoHash(target->driver, target->name,
+            group_name);
+
+    if ((group = arenaAlloc(&topo->arena, sizeof (TOPOGROUP))) == NULL)
+        return NULL;
+    memset(group, 0, sizeof (TOPOGROUP));
+    if (group_name != NULL &&
+            (group->name = arenaStrDup(&topo->arena, group_name)) == NULL)
+        return NULL;
+    group->target = target;
+    if (group_name == NULL) {
+        group->next = target->groups;
+        target->groups = group;
+    } else {
+        for (link = &target->groups; *link != NULL; link = &(*link)->next)
+            ;
+        *link = group;
+    }
+    group->hash_next = topo->group_hash[bucket];
+    topo->group_hash[bucket] = group;
+    topo->group_cnt++;
+    return group;
+}
+
+
+/*
+ * Add an initiator to a group. On error, NULL is returned.
+ */
+static TOPOINIT *indexInit(TOPOLOGY *topo, TOPOGROUP *group,
+        const char init_name[]) {
+    TOPOINIT *init = NULL, **link = NULL;
+    unsigned int bucket = topoHash(init_name, NULL, NULL);
+
+    if ((init = arenaAlloc(&topo->arena, sizeof (TOPOINIT))) == NULL)
+        return NULL;
+    memset(init, 0, sizeof (TOPOINIT));
+    if ((init->name = arenaStrDup(&topo->arena, init_name)) == NULL)
+        return NULL;
+    init->group = group;
+    for (link = &group->inits; *link != NULL; link = &(*link)->next)
+        ;
+    *link = init;
+    init->hash_next = topo->init_hash[bucket];
+    topo->init_hash[bucket] = init;
+    topo->init_cnt++;
+    return init;
+}
+
+
+/*
+ * Add a LUN to a group; with 'sorted' it goes in LUN order, otherwise it
+ * is put first (a walk sorts each group once at the end). The device is
+ * added to the index if it isn't there yet. On error, NULL is returned.
+ */
+static TOPOLUN *indexLUN(TOPOLOGY *topo, TOPOGROUP *group, int lun,
+        const char dev_name[], boolean sorted) {
+    TOPOLUN *new_lun = NULL, **link = NULL;
+    TOPODEVICE *device = NULL;
+    unsigned int bucket = topoHash(dev_name, NULL, NULL);
+
+    if ((device = findTopoDevice(topo, dev_name)) == NULL) {
+        if ((device = arenaAlloc(&topo->arena,
+                sizeof (TOPODEVICE))) == NULL)
+            return NULL;
+        memset(device, 0, sizeof (TOPODEVICE));
+        if ((device->name = arenaStrDup(&topo->arena, dev_name)) == NULL)
+            return NULL;
+        device->hash_next = topo->dev_hash[bucket];
+        topo->dev_hash[bucket] = device;
+    }
+    if ((new_lun = arenaAlloc(&topo->arena, sizeof (TOPOLUN))) == NULL)
+        return NULL;
+    memset(new_lun, 0, sizeof (TOPOLUN));
+    new_lun->lun = lun;
+    new_lun->group = group;
+    new_lun->device = device;
+    link = &group->luns;
+    if (sorted) {
+        while (*link != NULL && (*link)->lun < lun)
+            link = &(*link)->next;
+    }
+    new_lun->next = *link;
+    *link = new_lun;
+    new_lun->dev_next = device->luns;
+    device->luns = new_lun;
+    topo->lun_cnt++;
+    return new_lun;
+}
+
+
+/*
+ * Compare two LUN records by LUN number (for qsort()).
+ */
+static int compareLUNs(const void *lun_1, const void *lun_2) {
+    return (*(TOPOLUN * const *) lun_1)->lun -
+            (*(TOPOLUN * const *) lun_2)->lun;
+}
+
+
+/*
+ * Put a group's LUNs in LUN order. Returns 0 (zero) or ENOMEM.
+ */
+static int sortGroupLUNs(TOPOGROUP *group) {
+    TOPOLUN **luns = NULL, *lun = NULL;
+    int lun_cnt = 0, i = 0;
+
+    for (lun = group->luns; lun != NULL; lun = lun->next)
+        lun_cnt++;
+    if (lun_cnt < 2)
+        return 0;
+    if ((luns = malloc(lun_cnt * sizeof (TOPOLUN *))) == NULL)
+        return ENOMEM;
+    for (lun = group->luns, i = 0; lun != NULL; lun = lun->next, i++)
+        luns[i] = lun;
+    qsort(luns, lun_cnt, sizeof (TOPOLUN *), compareLUNs);
+    for (i = 0; i < lun_cnt - 1; i++)
+        luns[i]->next = luns[i + 1];
+    luns[lun_cnt - 1]->next = NULL;
+    group->luns = luns[0];
+    FREE_NULL(luns);
+    return 0;
+}
+
+
+/*
+ * Read the LUNs in a 'luns' directory into a group. Returns 0 (zero) or
+ * the errno value (ENOMEM stops the walk, anything else is noted on the
+ * group).
+ */
+static int walkLUNs(TOPOLOGY *topo, TOPOGROUP *group, const char dir_name[]) {
+    char link_path[MAX_SYSFS_PATH_SIZE] = {0},
+            dev_path[MAX_SYSFS_PATH_SIZE] = {0};
+    char *dev_name = NULL, *end = NULL;
+    DIR *lun_dir = NULL;
+    struct dirent *lun_entry = NULL;
+    ssize_t dev_path_size = 0;
+    long lun = 0;
+
+    if ((lun_dir = opendir(dir_name)) == NULL) {
+        group->error = errno;
+        return 0;
+    }
+    while ((lun_entry = readdir(lun_dir)) != NULL) {
+        /* The LUNs are numbered directories */
+        if (lun_entry->d_type != DT_DIR)
+            continue;
+        lun = strtol(lun_entry->d_name, &end, 10);
+        if (end == lun_entry->d_name || *end != '\0')
+            continue;
+        snprintf(link_path, MAX_SYSFS_PATH_SIZE, "%s/%s/device", dir_name,
+                lun_entry->d_name);
+        if ((dev_path_size = readlink(link_path, dev_path,
+                MAX_SYSFS_PATH_SIZE - 1)) == -1) {
+            group->error = errno;
+            continue;
+        }
+        dev_path[dev_path_size] = '\0';
+        dev_name = strrchr(dev_path, '/');
+        dev_name = (dev_name != NULL) ? (dev_name + 1) : dev_path;
+        if (indexLUN(topo, group, (int) lun, dev_name, FALSE) == NULL) {
+            closedir(lun_dir);
+            return ENOMEM;
+        }
+    }
+    closedir(lun_dir);
+    return sortGroupLUNs(group);
+}
+
+
+/*
+ * Read a target's default LUNs and security groups (with their initiators
+ * and LUNs). Returns 0 (zero) or ENOMEM; other errors are noted on the
+ * target/group and the walk goes on.
+ */
+static int walkTarget(TOPOLOGY *topo, TOPOTARGET *target) {
+    char dir_name[MAX_SYSFS_PATH_SIZE] = {0},
+            sub_dir_name[MAX_SYSFS_PATH_SIZE] = {0};
+    DIR *group_dir = NULL, *init_dir = NULL;
+    struct dirent *group_entry = NULL, *init_entry = NULL;
+    TOPOGROUP *group = NULL;
+    int ret_val = 0;
+
+    /* The target's own LUNs (only kept if there are any) */
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/targets/%s/%s/luns",
+            SYSFS_SCST_TGT, target->driver, target->name);
+    if ((group = indexGroup(topo, target, NULL)) == NULL)
+        return ENOMEM;
+    if ((ret_val = walkLUNs(topo, group, dir_name)) != 0)
+        return ret_val;
+    if (group->luns == NULL) {
+        target->groups = group->next;
+        topo->group_hash[topoHash(target->driver, target->name, NULL)] =
+                group->hash_next;
+        topo->group_cnt--;
+    }
+
+    /* Each security group */
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/targets/%s/%s/ini_groups",
+            SYSFS_SCST_TGT, target->driver, target->name);
+    if ((group_dir = opendir(dir_name)) == NULL) {
+        target->error = errno;
+        return 0;
+    }
+    while ((group_entry = readdir(group_dir)) != NULL && ret_val == 0) {
+        /* The group names are directories; skip '.' and '..' */
+        if (group_entry->d_type != DT_DIR || group_entry->d_name[0] == '.')
+            continue;
+        if ((group = indexGroup(topo, target, group_entry->d_name)) == NULL) {
+            ret_val = ENOMEM;
+            break;
+        }
+
+        /* The initiators are files; skip 'mgmt' */
+        snprintf(sub_dir_name, MAX_SYSFS_PATH_SIZE, "%s/%s/initiators",
+                dir_name, group_entry->d_name);
+        if ((init_dir = opendir(sub_dir_name)) == NULL) {
+            group->error = errno;
+        } else {
+            while ((init_entry = readdir(init_dir)) != NULL) {
+                if (init_entry->d_type != DT_REG ||
+                        strcmp(init_entry->d_name, "mgmt") == 0)
+                    continue;
+                if (indexInit(topo, group, init_entry->d_name) == NULL) {
+                    ret_val = ENOMEM;
+                    break;
+                }
+            }
+            closedir(init_dir);
+        }
+
+        snprintf(sub_dir_name, MAX_SYSFS_PATH_SIZE, "%s/%s/luns", dir_name,
+                group_entry->d_name);
+        if (ret_val == 0)
+            ret_val = walkLUNs(topo, group, sub_dir_name);
+    }
+    closedir(group_dir);
+    return ret_val;
+}
+
+
+/*
+ * Build the index with one walk of the SCST sysfs tree. Returns 0 (zero)
+ * or the errno value.
+ */
+static int buildTopology(TOPOLOGY *topo) {
+    char dir_name[MAX_SYSFS_PATH_SIZE] = {0};
+    char tgt_drivers[MAX_SCST_DRIVERS][MISC_STRING_LEN] = {{0}, {0}};
+    DIR *tgt_dir = NULL;
+    struct dirent *tgt_entry = NULL;
+    TOPOTARGET *target = NULL;
+    int driver_cnt = 0, ret_val = 0, i = 0;
+
+    /* Start over (keeping the arena blocks) */
+    invalidateTopology();
+    arenaReset(&topo->arena);
+    if (!listSCSTTgtDrivers(tgt_drivers, &driver_cnt))
+        return ENOENT;
+
+    for (i = 0; i < driver_cnt && ret_val == 0; i++) {
+        snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/targets/%s",
+                SYSFS_SCST_TGT, tgt_drivers[i]);
+        if ((tgt_dir = opendir(dir_name)) == NULL) {
+            DEBUG_LOG("Couldn't open '%s': %s", dir_name, strerror(errno));
+            continue;
+        }
+        while ((tgt_entry = readdir(tgt_dir)) != NULL && ret_val == 0) {
+            /* The target names are directories; skip '.' and '..' */
+            if (tgt_entry->d_type != DT_DIR || tgt_entry->d_name[0] == '.')
+                continue;
+            if ((target = indexTarget(topo, tgt_drivers[i],
+                    tgt_entry->d_name)) == NULL)
+                ret_val = ENOMEM;
+            else
+                ret_val = walkTarget(topo, target);
+        }
+        closedir(tgt_dir);
+    }
+    if (ret_val != 0) {
+        invalidateTopology();
+        return ret_val;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &topo->built_at);
+    topo->built = TRUE;
+    return 0;
+}
+
+
+/*
+ * The topology index, built (or re-built) if it isn't there yet, is older
+ * than TOPO_MAX_AGE_SECS, or 'rebuild' is set. On error, NULL is returned
+ * and errno is set.
+ */
+TOPOLOGY *getTopology(boolean rebuild) {
+    struct timespec now = {0};
+    int ret_val = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (rebuild || !topology.built ||
+            (now.tv_sec - topology.built_at.tv_sec) > TOPO_MAX_AGE_SECS) {
+        if ((ret_val = buildTopology(&topology)) != 0) {
+            errno = ret_val;
+            return NULL;
+        }
+    }
+    return &topology;
+}
+
+
+/*
+ * Throw the index away; it is re-built on the next getTopology().
+ */
+void invalidateTopology() {
+    ARENA arena = topology.arena;
+
+    memset(&topology, 0, sizeof (TOPOLOGY));
+    topology.arena = arena;
+    return;
+}
+
+
+/*
+ * Release the index memory (at exit).
+ */
+void closeTopology() {
+    arenaFree(&topology.arena);
+    memset(&topology, 0, sizeof (TOPOLOGY));
+    return;
+}
+
+
+/*
+ * Look up a target. Returns NULL if it isn't there.
+ */
+TOPOTARGET *findTopoTarget(TOPOLOGY *topo, const char driver[],
+        const char tgt_name[]) {
+    TOPOTARGET *target = topo->tgt_hash[topoHash(driver, tgt_name, NULL)];
+
+    for (; target != NULL; target = target->hash_next)
+        if (strcmp(target->name, tgt_name) == 0 &&
+                strcmp(target->driver, driver) == 0)
+            return target;
+    return NULL;
+}
+
+
+/*
+ * Look up a group of a target (a NULL name is the target's default LUNs).
+ * Returns NULL if it isn't there.
+ */
+TOPOGROUP *findTopoGroup(TOPOLOGY *topo, const char driver[],
+        const char tgt_name[], const char group_name[]) {
+    TOPOGROUP *group =
+            topo->group_hash[topoHash(driver, tgt_name, group_name)];
+
+    for (; group != NULL; group = group->hash_next)
+        if (sameGroupName(group->name, group_name) &&
+                strcmp(group->target->name, tgt_name) == 0 &&
+                strcmp(group->target->driver, driver) == 0)
+            return group;
+    return NULL;
+}
+
+
+/*
+ * Look up a device (its LUNs, across all targets). Returns NULL if it has
+ * none.
+ */
+TOPODEVICE *findTopoDevice(TOPOLOGY *topo, const char dev_name[]) {
+    TOPODEVICE *device = topo->dev_hash[topoHash(dev_name, NULL, NULL)];
+
+    for (; device != NULL; device = device->hash_next)
+        if (strcmp(device->name, dev_name) == 0)
+            return device;
+    return NULL;
+}
+
+
+/*
+ * Step through the groups an initiator is in; pass NULL for the first one
+ * and the previous record after that. Returns NULL when there are no more.
+ */
+TOPOINIT *nextTopoInit(TOPOLOGY *topo, const char init_name[],
+        TOPOINIT *prev) {
+    TOPOINIT *init = (prev == NULL) ?
+            topo->init_hash[topoHash(init_name, NULL, NULL)] :
+            prev->hash_next;
+
+    for (; init != NULL; init = init->hash_next)
+        if (strcmp(init->name, init_name) == 0)
+            return init;
+    return NULL;
+}
+
+
+/*
+ * Take a LUN out of its device's list (and the device out of the index
+ * once it has no LUNs left).
+ */
+static void unlinkLUN(TOPOLOGY *topo, TOPOLUN *lun) {
+    TOPOLUN **link = &lun->device->luns;
+    TOPODEVICE **dev_link = NULL;
+
+    for (; *link != NULL; link = &(*link)->dev_next) {
+        if (*link == lun) {
+            *link = lun->dev_next;
+            break;
+        }
+    }
+    if (lun->device->luns == NULL) {
+        dev_link = &topo->dev_hash[topoHash(lun->device->name, NULL, NULL)];
+        for (; *dev_link != NULL; dev_link = &(*dev_link)->hash_next) {
+            if (*dev_link == lun->device) {
+                *dev_link = lun->device->hash_next;
+                break;
+            }
+        }
+    }
+    topo->lun_cnt--;
+    return;
+}
+
+
+/*
+ * Take an initiator out of the name index.
+ */
+static void unlinkInit(TOPOLOGY *topo, TOPOINIT *init) {
+    TOPOINIT **link = &topo->init_hash[topoHash(init->name, NULL, NULL)];
+
+    for (; *link != NULL; link = &(*link)->hash_next) {
+        if (*link == init) {
+            *link = init->hash_next;
+            break;
+        }
+    }
+    topo->init_cnt--;
+    return;
+}
+
+
+/*
+ * Take a group (and its initiators and LUNs) out of the index; it is
+ * unlinked from its target too.
+ */
+static void unlinkGroup(TOPOLOGY *topo, TOPOGROUP *group) {
+    TOPOGROUP **link = NULL;
+    TOPOINIT *init = NULL;
+    TOPOLUN *lun = NULL;
+
+    for (init = group->inits; init != NULL; init = init->next)
+        unlinkInit(topo, init);
+    for (lun = group->luns; lun != NULL; lun = lun->next)
+        unlinkLUN(topo, lun);
+    for (link = &group->target->groups; *link != NULL;
+            link = &(*link)->next) {
+        if (*link == group) {
+            *link = group->next;
+            break;
+        }
+    }
+    link = &topo->group_hash[topoHash(group->target->driver,
+            group->target->name, group->name)];
+    for (; *link != NULL; link = &(*link)->hash_next) {
+        if (*link == group) {
+            *link = group->hash_next;
+            break;
+        }
+    }
+    topo->group_cnt--;
+    return;
+}
+
+
+/*
+ * The group an update is for; if the index doesn't have it, the index is
+ * out of date and gets re-built next time. Returns NULL if there is
+ * nothing to update.
+ */
+static TOPOGROUP *updateGroup(const char driver[], const char tgt_name[],
+        const char group_name[]) {
+    TOPOGROUP *group = NULL;
+
+    if (!topology.built)
+        return NULL;
+    if ((group = findTopoGroup(&topology, driver, tgt_name,
+            group_name)) == NULL)
+        invalidateTopology();
+    return group;
+}
+
+
+/*
+ * A target was added.
+ */
+void topoAddTarget(const char driver[], const char tgt_name[]) {
+    if (topology.built && indexTarget(&topology, driver, tgt_name) == NULL)
+        invalidateTopology();
+    return;
+}
+
+
+/*
+ * A target was removed (along with its groups and LUNs).
+ */
+void topoRemoveTarget(const char driver[], const char tgt_name[]) {
+    TOPOTARGET *target = NULL, **link = NULL;
+
+    if (!topology.built)
+        return;
+    if ((target = findTopoTarget(&topology, driver, tgt_name)) == NULL) {
+        invalidateTopology();
+        return;
+    }
+    while (target->groups != NULL)
+        unlinkGroup(&topology, target->groups);
+    for (link = &topology.targets; *link != NULL; link = &(*link)->next) {
+        if (*link == target) {
+            *link = target->next;
+            break;
+        }
+    }
+    link = &topology.tgt_hash[topoHash(driver, tgt_name, NULL)];
+    for (; *link != NULL; link = &(*link)->hash_next) {
+        if (*link == target) {
+            *link = target->hash_next;
+            break;
+        }
+    }
+    topology.tgt_cnt--;
+    return;
+}
+
+
+/*
+ * A security group was created.
+ */
+void topoAddGroup(const char driver[], const char tgt_name[],
+        const char group_name[]) {
+    TOPOTARGET *target = NULL;
+
+    if (!topology.built)
+        return;
+    if ((target = findTopoTarget(&topology, driver, tgt_name)) == NULL ||
+            indexGroup(&topology, target, group_name) == NULL)
+        invalidateTopology();
+    return;
+}
+
+
+/*
+ * A security group was deleted.
+ */
+void topoRemoveGroup(const char driver[], const char tgt_name[],
+        const char group_name[]) {
+    TOPOGROUP *group = NULL;
+
+    if ((group = updateGroup(driver, tgt_name, group_name)) != NULL)
+        unlinkGroup(&topology, group);
+    return;
+}
+
+
+/*
+ * An initiator was added to a group.
+ */
+void topoAddInit(const char driver[], const char tgt_name[],
+        const char group_name[], const char init_name[]) {
+    TOPOGROUP *group = NULL;
+
+    if ((group = updateGroup(driver, tgt_name, group_name)) != NULL &&
+            indexInit(&topology, group, init_name) == NULL)
+        invalidateTopology();
+    return;
+}
+
+
+/*
+ * An initiator was removed from a group.
+ */
+void topoRemoveInit(const char driver[], const char tgt_name[],
+        const char group_name[], const char init_name[]) {
+    TOPOGROUP *group = NULL;
+    TOPOINIT **link = NULL, *init = NULL;
+
+    if ((group = updateGroup(driver, tgt_name, group_name)) == NULL)
+        return;
+    for (link = &group->inits; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, init_name) == 0) {
+            init = *link;
+            *link = init->next;
+            unlinkInit(&topology, init);
+            return;
+        }
+    }
+    invalidateTopology();
+    return;
+}
+
+
+/*
+ * A device was mapped to a group as a LUN (a NULL group is the target's
+ * default LUNs).
+ */
+void topoAddLUN(const char driver[], const char tgt_name[],
+        const char group_name[], int lun, const char dev_name[]) {
+    TOPOTARGET *target = NULL;
+    TOPOGROUP *group = NULL;
+
+    if (!topology.built)
+        return;
+    if (group_name == NULL && (group = findTopoGroup(&topology, driver,
+            tgt_name, NULL)) == NULL) {
+        /* The first default LUN */
+        if ((target = findTopoTarget(&topology, driver, tgt_name)) == NULL ||
+                (group = indexGroup(&topology, target, NULL)) == NULL) {
+            invalidateTopology();
+            return;
+        }
+    } else if ((group = updateGroup(driver, tgt_name, group_name)) == NULL) {
+        return;
+    }
+    if (indexLUN(&topology, group, lun, dev_name, TRUE) == NULL)
+        invalidateTopology();
+    return;
+}
+
+
+/*
+ * A LUN was removed from a group.
+ */
+void topoRemoveLUN(const char driver[], const char tgt_name[],
+        const char group_name[], int lun) {
+    TOPOGROUP *group = NULL;
+    TOPOLUN **link = NULL, *old_lun = NULL;
+
+    if ((group = updateGroup(driver, tgt_name, group_name)) == NULL)
+        return;
+    for (link = &group->luns; *link != NULL; link = &(*link)->next) {
+        if ((*link)->lun == lun) {
+            old_lun = *link;
+            *link = old_lun->next;
+            unlinkLUN(&topology, old_lun);
+            if (group->name == NULL && group->luns == NULL)
+                unlinkGroup(&topology, group);
+            return;
+        }
+    }
+    invalidateTopology();
+    return;
+}
+
+
+/*
+ * A device was deleted; SCST drops its LUNs everywhere.
+ */
+void topoRemoveDevice(const char dev_name[]) {
+    TOPODEVICE *device = NULL;
+    TOPOGROUP *group = NULL;
+    TOPOLUN **link = NULL, *lun = NULL;
+
+    if (!topology.built ||
+            (device = findTopoDevice(&topology, dev_name)) == NULL)
+        return;
+    while ((lun = device->luns) != NULL) {
+        group = lun->group;
+        for (link = &group->luns; *link != NULL; link = &(*link)->next) {
+            if (*link == lun) {
+                *link = lun->next;
+                break;
+            }
+        }
+        unlinkLUN(&topology, lun);
+        /* A target's default LUNs are only listed while it has some */
+        if (group->name == NULL && group->luns == NULL)
+            unlinkGroup(&topology, group);
+    }
+    return;
+}
+
+
+/*
+ * Split a LUN directory path (as an 'exported' link gives it) into the
+ * target driver, target, group (NULL for the target's default LUNs), and
+ * LUN number; the path is cut up in place. Returns FALSE if it isn't a
+ * LUN directory.
+ */
+static boolean splitLUNPath(char lun_path[], char **driver,
+        char **tgt_name, char **group_name, int *lun) {
+    char *parts[6] = {NULL}, *start = NULL, *save = NULL, *end = NULL;
+    int part_cnt = 0;
+    long lun_num = 0;
+
+    /* The link is relative; everything before 'targets/' is '..' */
+    if ((start = strstr(lun_path, "targets/")) == NULL)
+        return FALSE;
+    start += strlen("targets/");
+    for (start = strtok_r(start, "/", &save); start != NULL;
+            start = strtok_r(NULL, "/", &save)) {
+        if (part_cnt == 6)
+            return FALSE;
+        parts[part_cnt++] = start;
+    }
+
+    /* driver/target/luns/N or driver/target/ini_groups/group/luns/N */
+    if (part_cnt == 4 && strcmp(parts[2], "luns") == 0) {
+        *group_name = NULL;
+    } else if (part_cnt == 6 && strcmp(parts[2], "ini_groups") == 0 &&
+            strcmp(parts[4], "luns") == 0) {
+        *group_name = parts[3];
+    } else {
+        return FALSE;
+    }
+    lun_num = strtol(parts[part_cnt - 1], &end, 10);
+    if (end == parts[part_cnt - 1] || *end != '\0')
+        return FALSE;
+    *driver = parts[0];
+    *tgt_name = parts[1];
+    *lun = (int) lun_num;
+    return TRUE;
+}
+
+
+/*
+ * Re-read where a device is exported from the links in its 'exported'
+ * directory (the reverse of the LUN 'device' links) and bring its part of
+ * the index up to date; this is cheaper than a full walk. If a link points
+ * at a target or group the index doesn't have, the index is re-built. The
+ * device record is set (NULL if it has no LUNs). Returns 0 (zero) or the
+ * errno value.
+ */
+int refreshTopoDevice(const char dev_name[], TOPODEVICE **device) {
+    char dir_name[MAX_SYSFS_PATH_SIZE] = {0},
+            link_path[MAX_SYSFS_PATH_SIZE] = {0},
+            lun_path[MAX_SYSFS_PATH_SIZE] = {0};
+    char *driver = NULL, *tgt_name = NULL, *group_name = NULL;
+    DIR *exp_dir = NULL;
+    struct dirent *exp_entry = NULL;
+    ssize_t lun_path_size = 0;
+    int lun = 0;
+
+    *device = NULL;
+    if (getTopology(FALSE) == NULL)
+        return errno;
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/devices/%s/exported",
+            SYSFS_SCST_TGT, dev_name);
+    if ((exp_dir = opendir(dir_name)) == NULL)
+        return errno;
+
+    /* Drop what we had for the device, then add each export back */
+    topoRemoveDevice(dev_name);
+    while ((exp_entry = readdir(exp_dir)) != NULL) {
+        if (exp_entry->d_type != DT_LNK)
+            continue;
+        snprintf(link_path, MAX_SYSFS_PATH_SIZE, "%s/%s", dir_name,
+                exp_entry->d_name);
+        if ((lun_path_size = readlink(link_path, lun_path,
+                MAX_SYSFS_PATH_SIZE - 1)) == -1) {
+            /* It may have just gone away; a full walk sorts it out */
+            invalidateTopology();
+            break;
+        }
+        lun_path[lun_path_size] = '\0';
+        if (!splitLUNPath(lun_path, &driver, &tgt_name, &group_name,
+                &lun)) {
+            DEBUG_LOG("Unexpected export link '%s'", lun_path);
+            invalidateTopology();
+            break;
+        }
+        topoAddLUN(driver, tgt_name, group_name, lun, dev_name);
+    }
+    closedir(exp_dir);
+
+    if (getTopology(FALSE) == NULL)
+        return errno;
+    *device = findTopoDevice(&topology, dev_name);
+    return 0;
+}
+
+
+/*
+ * Find the group a session gets its LUNs from; its 'luns' link points at
+ * the group's (or the target's own) LUN directory. The group name is set
+ * to an empty string for the target's default LUNs. Returns 0 (zero) or
+ * the errno value.
+ */
+int readSessionGroup(const char driver[], const char tgt_name[],
+        const char sess_name[], char group_name[]) {
+    char link_path[MAX_SYSFS_PATH_SIZE] = {0},
+            luns_path[MAX_SYSFS_PATH_SIZE] = {0};
+    char *start = NULL, *end = NULL;
+    ssize_t luns_path_size = 0;
+
+    group_name[0] = '\0';
+    snprintf(link_path, MAX_SYSFS_PATH_SIZE,
+            "%s/targets/%s/%s/sessions/%s/luns", SYSFS_SCST_TGT, driver,
+            tgt_name, sess_name);
+    if ((luns_path_size = readlink(link_path, luns_path,
+            MAX_SYSFS_PATH_SIZE - 1)) == -1)
+        return errno;
+    luns_path[luns_path_size] = '\0';
+    if ((start = strstr(luns_path, "ini_groups/")) == NULL)
+        return 0;
+    start += strlen("ini_groups/");
+    if ((end = strchr(start, '/')) != NULL)
+        *end = '\0';
+    snprintf(group_name, MAX_SYSFS_ATTR_SIZE, "%s", start);
+    return 0;
+}
+
+
+/*
+ * Find the sessions (in a SCST snapshot) that get their LUNs from a group.
+ * Up to 'max_sessions' records are set; they are only good until the
+ * snapshot is released. Sessions that go away while we look are skipped.
+ * Returns how many sessions use the group.
+ */
+int findTopoSessions(SCSTSNAPSHOT *snapshot, TOPOGROUP *group,
+        SNAPSESSION *sessions[], int max_sessions) {
+    char group_name[MAX_SYSFS_ATTR_SIZE] = {0};
+    SNAPSESSION *session = NULL;
+    int sess_cnt = 0, i = 0;
+
+    for (i = 0; i < snapshot->sess_cnt; i++) {
+        session = snapshot->sessions[i];
+        if (strcmp(session->tgt_name, group->target->name) != 0 ||
+                strcmp(session->tgt_driver, group->target->driver) != 0)
+            continue;
+        if (readSessionGroup(session->tgt_driver, session->tgt_name,
+                session->sess_name, group_name) != 0)
+            continue;
+        if (!sameGroupName(group->name,
+                (group_name[0] != '\0') ? group_name : NULL))
+            continue;
+        if (sess_cnt < max_sessions)
+            sessions[sess_cnt] = session;
+        sess_cnt++;
+    }
+    return sess_cnt;
+}
+
+
+/*
+ * Order LUN records by group, then LUN number (for qsort()).
+ */
+static int compareGroupLUNs(const void *lun_1, const void *lun_2) {
+    const TOPOLUN *first = *(TOPOLUN * const *) lun_1,
+            *second = *(TOPOLUN * const *) lun_2;
+
+    if (first->group != second->group)
+        return (first->group < second->group) ? -1 : 1;
+    return first->lun - second->lun;
+}
+
+
+/*
+ * Unmap a device from every group it is exported in (see
+ * refreshTopoDevice()). The 'del' commands are batched by group; each
+ * group's 'luns/mgmt' attribute is opened once for all of its LUNs. The
+ * index is updated as they go, and the number of LUNs removed is set.
+ * Returns 0 (zero) or the first errno value (the LUNs that failed are left
+ * mapped).
+ */
+int unmapTopoDevice(const char dev_name[], int *unmapped) {
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
+    TOPODEVICE *device = NULL;
+    TOPOLUN **luns = NULL, *lun = NULL;
+    TOPOGROUP *group = NULL;
+    int lun_cnt = 0, mgmt_fd = -1, temp_int = 0, ret_val = 0, i = 0;
+
+    *unmapped = 0;
+    if ((ret_val = refreshTopoDevice(dev_name, &device)) != 0 ||
+            device == NULL)
+        return ret_val;
+    for (lun = device->luns; lun != NULL; lun = lun->dev_next)
+        lun_cnt++;
+    if ((luns = malloc(lun_cnt * sizeof (TOPOLUN *))) == NULL)
+        return ENOMEM;
+    for (lun = device->luns, i = 0; lun != NULL; lun = lun->dev_next, i++)
+        luns[i] = lun;
+    qsort(luns, lun_cnt, sizeof (TOPOLUN *), compareGroupLUNs);
+
+    for (i = 0; i < lun_cnt; i++) {
+        lun = luns[i];
+        group = lun->group;
+        if (i == 0 || group != luns[i - 1]->group) {
+            /* The next group; open its LUN mgmt attribute */
+            if (mgmt_fd != -1)
+                close(mgmt_fd);
+            mgmt_fd = -1;
+            if (group->name == NULL)
+                snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
+                        "%s/targets/%s/%s/luns/mgmt", SYSFS_SCST_TGT,
+                        group->target->driver, group->target->name);
+            else
+                snprintf(attr_path, MAX_SYSFS_PATH_SIZE,
+                        "%s/targets/%s/%s/ini_groups/%s/luns/mgmt",
+                        SYSFS_SCST_TGT, group->target->driver,
+                        group->target->name, group->name);
+            if ((temp_int = openAttribute(AT_FDCWD, attr_path,
+                    O_WRONLY | O_TRUNC, &mgmt_fd)) != 0) {
+                if (ret_val == 0)
+                    ret_val = temp_int;
+                continue;
+            }
+        }
+        if (mgmt_fd == -1)
+            continue;
+        snprintf(attr_value, MAX_SYSFS_ATTR_SIZE, "del %d", lun->lun);
+        if ((temp_int = pwriteAttribute(mgmt_fd, attr_value)) != 0) {
+            if (ret_val == 0)
+                ret_val = temp_int;
+            continue;
+        }
+        /* The records stay in the arena until the next re-build */
+        topoRemoveLUN(group->target->driver, group->target->name,
+                group->name, lun->lun);
+        (*unmapped)++;
+    }
+    if (mgmt_fd != -1)
+        close(mgmt_fd);
+    FREE_NULL(luns);
+    return ret_val;
+}
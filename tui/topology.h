@@ -0,0 +1,148 @@
+/**
+ * @file topology.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _TOPOLOGY_H
+#define	_TOPOLOGY_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+#include <cdk.h>
+
+#include "arena.h"
+#include "snapshot.h"
+
+/* Topology index settings; the index is re-built from sysfs once it is
+ * this old, so changes made outside the TUI show up */
+#define TOPO_HASH_SIZE          1024
+#define TOPO_MAX_AGE_SECS       30
+
+typedef struct topo_target TOPOTARGET;
+typedef struct topo_group TOPOGROUP;
+typedef struct topo_init TOPOINIT;
+typedef struct topo_lun TOPOLUN;
+typedef struct topo_device TOPODEVICE;
+
+/* A SCST target */
+struct topo_target {
+    const char *driver;
+    const char *name;
+    /* The errno value if its groups couldn't be read, or 0 */
+    int error;
+    /* Its security groups (in sysfs order); the target's own LUNs are in
+     * a group with a NULL name, listed first (if it has any) */
+    TOPOGROUP *groups;
+    /* Next target (all of them, in sysfs order) and hash chain */
+    TOPOTARGET *next;
+    TOPOTARGET *hash_next;
+};
+
+/* A security group (ini_group) of a target */
+struct topo_group {
+    /* NULL for the target's default LUNs */
+    const char *name;
+    TOPOTARGET *target;
+    /* The errno value if its initiators or LUNs couldn't be read, or 0 */
+    int error;
+    TOPOINIT *inits;
+    /* Its LUNs (by LUN number) */
+    TOPOLUN *luns;
+    /* Next group of the target, and hash chain */
+    TOPOGROUP *next;
+    TOPOGROUP *hash_next;
+};
+
+/* An initiator in a group; the same name may be in several groups */
+struct topo_init {
+    const char *name;
+    TOPOGROUP *group;
+    /* Next initiator of the group, and hash chain (by name) */
+    TOPOINIT *next;
+    TOPOINIT *hash_next;
+};
+
+/* A LUN; a device exported in a group */
+struct topo_lun {
+    int lun;
+    TOPOGROUP *group;
+    TOPODEVICE *device;
+    /* Next LUN of the group, and of the device */
+    TOPOLUN *next;
+    TOPOLUN *dev_next;
+};
+
+/* A SCST device with at least one LUN */
+struct topo_device {
+    const char *name;
+    TOPOLUN *luns;
+    /* Hash chain */
+    TOPODEVICE *hash_next;
+};
+
+/* The target/group/initiator/LUN/device relationships, indexed by name;
+ * built from sysfs in one walk and then kept up to date by the dialogs
+ * that change it (see the topo*() update functions). Records are
+ * allocated from the arena, so removed ones are only freed on a re-build.
+ * Only used from the UI thread. */
+typedef struct topology TOPOLOGY;
+struct topology {
+    boolean built;
+    /* When it was built (CLOCK_MONOTONIC) */
+    struct timespec built_at;
+    TOPOTARGET *targets;
+    int tgt_cnt;
+    int group_cnt;
+    int init_cnt;
+    int lun_cnt;
+    /* Hash indexes: targets (driver, name), groups (driver, target, name),
+     * initiators (name), and devices (name) */
+    TOPOTARGET *tgt_hash[TOPO_HASH_SIZE];
+    TOPOGROUP *group_hash[TOPO_HASH_SIZE];
+    TOPOINIT *init_hash[TOPO_HASH_SIZE];
+    TOPODEVICE *dev_hash[TOPO_HASH_SIZE];
+    ARENA arena;
+};
+
+/* Function prototypes */
+TOPOLOGY *getTopology(boolean rebuild);
+void invalidateTopology();
+void closeTopology();
+TOPOTARGET *findTopoTarget(TOPOLOGY *topology, const char driver[],
+        const char tgt_name[]);
+TOPOGROUP *findTopoGroup(TOPOLOGY *topology, const char driver[],
+        const char tgt_name[], const char group_name[]);
+TOPODEVICE *findTopoDevice(TOPOLOGY *topology, const char dev_name[]);
+TOPOINIT *nextTopoInit(TOPOLOGY *topology, const char init_name[],
+        TOPOINIT *prev);
+void topoAddTarget(const char driver[], const char tgt_name[]);
+void topoRemoveTarget(const char driver[], const char tgt_name[]);
+void topoAddGroup(const char driver[], const char tgt_name[],
+        const char group_name[]);
+void topoRemoveGroup(const char driver[], const char tgt_name[],
+        const char group_name[]);
+void topoAddInit(const char driver[], const char tgt_name[],
+        const char group_name[], const char init_name[]);
+void topoRemoveInit(const char driver[], const char tgt_name[],
+        const char group_name[], const char init_name[]);
+void topoAddLUN(const char driver[], const char tgt_name[],
+        const char group_name[], int lun, const char dev_name[]);
+void topoRemoveLUN(const char driver[], const char tgt_name[],
+        const char group_name[], int lun);
+void topoRemoveDevice(const char dev_name[]);
+int refreshTopoDevice(const char dev_name[], TOPODEVICE **device);
+int readSessionGroup(const char driver[], const char tgt_name[],
+        const char sess_name[], char group_name[]);
+int findTopoSessions(SCSTSNAPSHOT *snapshot, TOPOGROUP *group,
+        SNAPSESSION *sessions[], int max_sessions);
+int unmapTopoDevice(const char dev_name[], int *unmapped);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _TOPOLOGY_H */
@@ -0,0 +1,539 @@
+/**
+ * @file tuning.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/param.h>
+#include <iniparser.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "strings.h"
+#include "tuning.h"
+
+/* Handlers an attribute applies to */
+#define TUNING_FILEIO           0x1
+#define TUNING_BLOCKIO          0x2
+#define TUNING_NULLIO           0x4
+#define TUNING_VDISK            (TUNING_FILEIO | TUNING_BLOCKIO | TUNING_NULLIO)
+#define TUNING_ANY              0x8
+
+/* The attributes (in TUNING_* order); 'create' ones are add_device
+ * parameters that SCST won't change afterwards, and 'dialog' ones have a
+ * widget in the Add Device dialog (the rest go in tuningCreateParams()) */
+static const struct {
+    const char *name;
+    int handlers;
+    boolean create;
+    boolean dialog;
+} tuning_attrs[TUNING_ATTRS] = {
+    {"threads_num", TUNING_ANY, FALSE, FALSE},
+    {"threads_pool_type", TUNING_ANY, FALSE, FALSE},
+    {"blocksize", TUNING_VDISK, TRUE, TRUE},
+    {"write_through", TUNING_FILEIO | TUNING_BLOCKIO, TRUE, TRUE},
+    {"nv_cache", TUNING_FILEIO | TUNING_BLOCKIO, TRUE, TRUE},
+    {"rotational", TUNING_VDISK, TRUE, TRUE},
+    {"thin_provisioned", TUNING_FILEIO | TUNING_BLOCKIO, TRUE, FALSE}
+};
+
+/* Written out when there is no profiles file yet */
+static const char *default_profiles =
+        "# SCST device tuning profiles; one section per profile, and any\n"
+        "# attribute left out is left alone. Keep this with scst.conf.\n"
+        "#   threads_num: 0 - 128 (0 means no dedicated threads)\n"
+        "#   threads_pool_type: per_initiator or shared\n"
+        "#   blocksize: 512, 1024, 2048, 4096, or 8192\n"
+        "#   write_through, nv_cache, rotational, thin_provisioned: 0 or 1\n"
+        "# blocksize and the flags can only be set when a device is created.\n"
+        "# Only set nv_cache = 1 if the back-end cache survives power loss.\n"
+        "\n"
+        "[ssd_random]\n"
+        "description = SSD random\n"
+        "threads_num = 8\n"
+        "threads_pool_type = per_initiator\n"
+        "blocksize = 4096\n"
+        "rotational = 0\n"
+        "thin_provisioned = 1\n"
+        "\n"
+        "[hdd_sequential]\n"
+        "description = HDD sequential\n"
+        "threads_num = 2\n"
+        "threads_pool_type = shared\n"
+        "blocksize = 512\n"
+        "rotational = 1\n"
+        "\n"
+        "[nvme_low_latency]\n"
+        "description = NVMe low-latency\n"
+        "threads_num = 16\n"
+        "threads_pool_type = per_initiator\n"
+        "blocksize = 4096\n"
+        "write_through = 0\n"
+        "rotational = 0\n"
+        "thin_provisioned = 1\n";
+
+
+/*
+ * Is the value good for the attribute?
+ */
+static boolean tuningValueOK(int attr, const char value[]) {
+    char *end = NULL;
+    long number = 0;
+    int i = 0;
+
+    switch (attr) {
+        case TUNING_THREADS_NUM:
+            number = strtol(value, &end, 10);
+            return (*value != '\0' && *end == '\0' && number >= 0 &&
+                    number <= TUNING_MAX_THREADS) ? TRUE : FALSE;
+        case TUNING_THREADS_POOL:
+            return (strcmp(value, "per_initiator") == 0 ||
+                    strcmp(value, "shared") == 0) ? TRUE : FALSE;
+        case TUNING_BLOCKSIZE:
+            for (i = 0; i < 5; i++)
+                if (strcmp(value, g_scst_bs_list[i]) == 0)
+                    return TRUE;
+            return FALSE;
+        default:
+            return (strcmp(value, "0") == 0 ||
+                    strcmp(value, "1") == 0) ? TRUE : FALSE;
+    }
+}
+
+
+/*
+ * Read the tuning profiles (up to TUNING_MAX_PROFILES), writing out the
+ * defaults first if there is no profiles file. Bad values are logged and
+ * left out. Returns 0 (zero) or the errno value.
+ */
+int loadTuningProfiles(TUNINGPROFILE profiles[], int *profile_cnt) {
+    dictionary *ini_dict = NULL;
+    FILE *ini_file = NULL;
+    char key[MISC_STRING_LEN] = {0};
+    char *section = NULL, *value = NULL;
+    int section_cnt = 0, i = 0, j = 0;
+
+    *profile_cnt = 0;
+    if (access(SCST_TUNING_CONF, F_OK) != 0) {
+        if (errno != ENOENT)
+            return errno;
+        if ((ini_file = fopen(SCST_TUNING_CONF, "w")) == NULL)
+            return errno;
+        fputs(default_profiles, ini_file);
+        if (fclose(ini_file) != 0)
+            return errno;
+    }
+    if ((ini_dict = iniparser_load(SCST_TUNING_CONF)) == NULL)
+        return EINVAL;
+
+    section_cnt = iniparser_getnsec(ini_dict);
+    for (i = 0; i < section_cnt && *profile_cnt < TUNING_MAX_PROFILES; i++) {
+        if ((section = iniparser_getsecname(ini_dict, i)) == NULL)
+            continue;
+        memset(&profiles[*profile_cnt], 0, sizeof (TUNINGPROFILE));
+        snprintf(profiles[*profile_cnt].name, TUNING_NAME_LEN, "%s",
+                section);
+        snprintf(key, MISC_STRING_LEN, "%s:description", section);
+        snprintf(profiles[*profile_cnt].description, TUNING_DESC_LEN, "%s",
+                iniparser_getstring(ini_dict, key, section));
+        for (j = 0; j < TUNING_ATTRS; j++) {
+            snprintf(key, MISC_STRING_LEN, "%s:%s", section,
+                    tuning_attrs[j].name);
+            if ((value = iniparser_getstring(ini_dict, key, NULL)) == NULL)
+                continue;
+            if (!tuningValueOK(j, value)) {
+                DEBUG_LOG("Ignoring bad %s value '%s' in tuning profile "
+                        "'%s'", tuning_attrs[j].name, value, section);
+                continue;
+            }
+            snprintf(profiles[*profile_cnt].values[j], TUNING_VALUE_LEN,
+                    "%s", value);
+        }
+        (*profile_cnt)++;
+    }
+    iniparser_freedict(ini_dict);
+    return 0;
+}
+
+
+/*
+ * The SCST attribute name.
+ */
+const char *tuningAttrName(int attr) {
+    return (attr >= 0 && attr < TUNING_ATTRS) ? tuning_attrs[attr].name : "";
+}
+
+
+/*
+ * Does the attribute apply to devices of the given handler?
+ */
+boolean tuningAttrApplies(int attr, const char handler[]) {
+    int handler_bit = 0;
+
+    if (attr < 0 || attr >= TUNING_ATTRS)
+        return FALSE;
+    if (tuning_attrs[attr].handlers & TUNING_ANY)
+        return TRUE;
+    if (strcmp(handler, "vdisk_fileio") == 0)
+        handler_bit = TUNING_FILEIO;
+    else if (strcmp(handler, "vdisk_blockio") == 0)
+        handler_bit = TUNING_BLOCKIO;
+    else if (strcmp(handler, "vdisk_nullio") == 0)
+        handler_bit = TUNING_NULLIO;
+    return (tuning_attrs[attr].handlers & handler_bit) ? TRUE : FALSE;
+}
+
+
+/*
+ * Where the profile's value for the attribute is in the given choices (eg,
+ * for an item list widget); with no choices, the value itself is the
+ * index (0/1 flags). Returns 'default_index' if the profile doesn't set it.
+ */
+int tuningValueIndex(const TUNINGPROFILE *profile, int attr,
+        char *choices[], int choice_cnt, int default_index) {
+    int i = 0;
+
+    if (profile == NULL || profile->values[attr][0] == '\0')
+        return default_index;
+    if (choices == NULL) {
+        i = atoi(profile->values[attr]);
+        return (i >= 0 && i < choice_cnt) ? i : default_index;
+    }
+    for (i = 0; i < choice_cnt; i++)
+        if (strcmp(profile->values[attr], choices[i]) == 0)
+            return i;
+    return default_index;
+}
+
+
+/*
+ * The add_device parameters (each starting with "; ") for the profile's
+ * creation-time attributes that the Add Device dialog doesn't have a
+ * widget for; appended to 'params' ('size' bytes in all).
+ */
+void tuningCreateParams(const TUNINGPROFILE *profile, const char handler[],
+        char params[], size_t size) {
+    size_t length = strlen(params);
+    int i = 0;
+
+    if (profile == NULL)
+        return;
+    for (i = 0; i < TUNING_ATTRS && length < size; i++) {
+        if (!tuning_attrs[i].create || tuning_attrs[i].dialog ||
+                profile->values[i][0] == '\0' ||
+                !tuningAttrApplies(i, handler))
+            continue;
+        snprintf(params + length, size - length, "; %s=%s",
+                tuning_attrs[i].name, profile->values[i]);
+        length += strlen(params + length);
+    }
+    return;
+}
+
+
+/*
+ * Apply a profile to an existing SCST device; the run-time attributes are
+ * written, and the creation-time ones are compared (see TUNINGRESULT).
+ * 'results' (TUNING_ATTRS long) gets '*result_cnt' entries. Returns 0
+ * (zero) or the errno value of the first failure.
+ */
+int applyTuningProfile(const TUNINGPROFILE *profile, const char dev_name[],
+        const char handler[], TUNINGRESULT results[], int *result_cnt) {
+    char attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
+    TUNINGRESULT *result = NULL;
+    int ret_val = 0, i = 0;
+
+    *result_cnt = 0;
+    for (i = 0; i < TUNING_ATTRS; i++) {
+        if (profile->values[i][0] == '\0' || !tuningAttrApplies(i, handler))
+            continue;
+        result = &results[(*result_cnt)++];
+        memset(result, 0, sizeof (TUNINGRESULT));
+        result->attr = i;
+
+        /* Current value */
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/devices/%s/%s",
+                SYSFS_SCST_TGT, dev_name, tuning_attrs[i].name);
+        if ((result->error = readAttributeAt(AT_FDCWD, attr_path,
+                attr_value)) != 0) {
+            result->status = TUNING_FAILED;
+            if (ret_val == 0)
+                ret_val = result->error;
+            continue;
+        }
+        snprintf(result->old_value, TUNING_VALUE_LEN, "%s", attr_value);
+
+        if (strcmp(result->old_value, profile->values[i]) == 0) {
+            result->status = TUNING_SAME;
+        } else if (tuning_attrs[i].create) {
+            result->status = TUNING_CREATE_ONLY;
+        } else if ((result->error = writeAttribute(attr_path,
+                (char *) profile->values[i])) != 0) {
+            result->status = TUNING_FAILED;
+            if (ret_val == 0)
+                ret_val = result->error;
+        } else {
+            result->status = TUNING_SET;
+        }
+    }
+    return ret_val;
+}
+
+
+/*
+ * Read a sysfs attribute holding a number; returns 0 (zero) or the errno
+ * value.
+ */
+static int readIntAttr(const char path[], int *number) {
+    char value[MAX_SYSFS_ATTR_SIZE] = {0};
+    char *end = NULL;
+    int ret_val = 0;
+
+    if ((ret_val = readAttributeAt(AT_FDCWD, path, value)) != 0)
+        return ret_val;
+    *number = (int) strtol(value, &end, 10);
+    return (end == value) ? EINVAL : 0;
+}
+
+
+/*
+ * The NUMA node of a disk ('sys_path' is its real /sys/devices path); we
+ * walk up to the bus device it hangs off, and stacked devices (dm, md)
+ * take the node of their first member. Returns -1 if there is none.
+ */
+static int findNUMANode(const char sys_path[], int depth) {
+    char path[PATH_MAX] = {0}, attr_path[PATH_MAX] = {0},
+            slave_path[PATH_MAX] = {0};
+    DIR *slaves_dir = NULL;
+    struct dirent *slave = NULL;
+    int numa_node = -1;
+
+    if ((numa_node = findBusNUMANode(sys_path, NULL)) >= 0)
+        return numa_node;
+    if (depth >= TUNING_MAX_SLAVE_DEPTH)
+        return -1;
+    snprintf(attr_path, PATH_MAX, "%s/slaves", sys_path);
+    if ((slaves_dir = opendir(attr_path)) == NULL)
+        return -1;
+    while ((slave = readdir(slaves_dir)) != NULL) {
+        if (slave->d_name[0] == '.')
+            continue;
+        snprintf(path, PATH_MAX, "%s/%s", attr_path, slave->d_name);
+        if (realpath(path, slave_path) != NULL)
+            numa_node = findNUMANode(slave_path, depth + 1);
+        break;
+    }
+    closedir(slaves_dir);
+    return numa_node;
+}
+
+
+/*
+ * Inspect the request queue behind a back-end (a block device, or a file
+ * on one) for automatic sizing. Returns 0 (zero) or the errno value;
+ * ENODEV if there is no block device behind it (eg, tmpfs).
+ */
+int inspectBackingQueue(const char backing[], TUNINGQUEUE *queue) {
+    char dev_path[PATH_MAX] = {0}, sys_path[PATH_MAX] = {0},
+            attr_path[PATH_MAX] = {0}, cpu_list[MAX_SYSFS_ATTR_SIZE] = {0};
+    char *slash = NULL;
+    struct stat backing_stat = {0};
+    dev_t dev_num = 0;
+    DIR *mq_dir = NULL;
+    struct dirent *hw_queue = NULL;
+    int rotational = 0;
+
+    memset(queue, 0, sizeof (TUNINGQUEUE));
+    queue->numa_node = -1;
+    if (stat(backing, &backing_stat) == -1)
+        return errno;
+    dev_num = S_ISBLK(backing_stat.st_mode) ? backing_stat.st_rdev :
+            backing_stat.st_dev;
+    snprintf(dev_path, PATH_MAX, "%s/%u:%u", SYSFS_DEV_BLOCK,
+            major(dev_num), minor(dev_num));
+    if (realpath(dev_path, sys_path) == NULL)
+        return (errno == ENOENT) ? ENODEV : errno;
+
+    /* A partition shares the whole disk's queue */
+    snprintf(attr_path, PATH_MAX, "%s/partition", sys_path);
+    if (access(attr_path, F_OK) == 0 &&
+            (slash = strrchr(sys_path, '/')) != NULL)
+        *slash = '\0';
+    if ((slash = strrchr(sys_path, '/')) == NULL)
+        return ENODEV;
+    snprintf(queue->disk, NAME_MAX + 1, "%s", slash + 1);
+
+    /* The queue; bio-based devices may not have nr_requests */
+    snprintf(attr_path, PATH_MAX, "%s/queue/nr_requests", sys_path);
+    readIntAttr(attr_path, &queue->nr_requests);
+    snprintf(attr_path, PATH_MAX, "%s/queue/rotational", sys_path);
+    if (readIntAttr(attr_path, &rotational) == 0 && rotational)
+        queue->rotational = TRUE;
+    snprintf(attr_path, PATH_MAX, "%s/mq", sys_path);
+    if ((mq_dir = opendir(attr_path)) != NULL) {
+        while ((hw_queue = readdir(mq_dir)) != NULL)
+            if (hw_queue->d_name[0] != '.')
+                queue->hw_queues++;
+        closedir(mq_dir);
+    }
+
+    /* Where it sits, and what CPUs are there */
+    queue->numa_node = findNUMANode(sys_path, 0);
+    if (queue->numa_node >= 0) {
+        snprintf(attr_path, PATH_MAX, "%s/node%d/cpulist", SYSFS_NODE,
+                queue->numa_node);
+        if (readAttributeAt(AT_FDCWD, attr_path, cpu_list) == 0)
+            queue->node_cpus = cpuListCount(cpu_list);
+    }
+    if (queue->node_cpus <= 0)
+        queue->node_cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (queue->node_cpus <= 0)
+        queue->node_cpus = 1;
+    return 0;
+}
+
+
+/*
+ * Recommend a threads_num and threads_pool_type for an inspected queue;
+ * 'profile' gets just those two (see TUNING_SSD_REQS). Rotational disks
+ * share one pool so the initiators' requests stay sorted together, and
+ * flash gets a pool per initiator.
+ */
+void recommendTuning(const TUNINGQUEUE *queue, TUNINGPROFILE *profile) {
+    int threads = 0;
+
+    memset(profile, 0, sizeof (TUNINGPROFILE));
+    snprintf(profile->name, TUNING_NAME_LEN, "auto");
+    snprintf(profile->description, TUNING_DESC_LEN, "%s, node %d",
+            queue->disk, queue->numa_node);
+    if (queue->rotational) {
+        threads = queue->nr_requests / TUNING_HDD_REQS;
+        threads = MAX(1, MIN(threads, TUNING_HDD_MAX_THREADS));
+        snprintf(profile->values[TUNING_THREADS_POOL], TUNING_VALUE_LEN,
+                "shared");
+    } else {
+        threads = MAX(queue->hw_queues, queue->nr_requests / TUNING_SSD_REQS);
+        threads = MAX(2, MIN(threads, queue->node_cpus));
+        snprintf(profile->values[TUNING_THREADS_POOL], TUNING_VALUE_LEN,
+                "per_initiator");
+    }
+    threads = MIN(threads, TUNING_MAX_THREADS);
+    snprintf(profile->values[TUNING_THREADS_NUM], TUNING_VALUE_LEN, "%d",
+            threads);
+    return;
+}
+
+
+/*
+ * Recommend threads for every vdisk_blockio/vdisk_fileio device, then
+ * scale them back on any NUMA node that would have more than
+ * TUNING_NODE_OVERCOMMIT threads per CPU. '*plans' is allocated (the
+ * caller frees it). Returns 0 (zero) or the errno value.
+ */
+int planRebalance(TUNINGPLAN **plans, int *plan_cnt) {
+    char dir_name[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_path[MAX_SYSFS_PATH_SIZE] = {0},
+            link_path[MAX_SYSFS_PATH_SIZE] = {0},
+            filename[MAX_SYSFS_ATTR_SIZE] = {0};
+    char *slash = NULL;
+    DIR *dev_dir = NULL;
+    struct dirent *dev_entry = NULL;
+    TUNINGPLAN *plan = NULL, *new_plans = NULL;
+    ssize_t link_len = 0;
+    int *wanted = NULL;
+    int plan_max = 0, node_threads = 0, node_limit = 0, threads = 0,
+            i = 0, j = 0;
+
+    *plans = NULL;
+    *plan_cnt = 0;
+    snprintf(dir_name, MAX_SYSFS_PATH_SIZE, "%s/devices", SYSFS_SCST_TGT);
+    if ((dev_dir = opendir(dir_name)) == NULL)
+        return errno;
+    while ((dev_entry = readdir(dev_dir)) != NULL) {
+        if (dev_entry->d_name[0] == '.')
+            continue;
+
+        /* Only the vdisk handlers with a back-end */
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/handler", dir_name,
+                dev_entry->d_name);
+        if ((link_len = readlink(attr_path, link_path,
+                MAX_SYSFS_PATH_SIZE - 1)) == -1)
+            continue;
+        link_path[link_len] = '\0';
+        slash = strrchr(link_path, '/');
+        slash = (slash != NULL) ? (slash + 1) : link_path;
+        if (strcmp(slash, "vdisk_blockio") != 0 &&
+                strcmp(slash, "vdisk_fileio") != 0)
+            continue;
+
+        if (*plan_cnt == plan_max) {
+            plan_max = (plan_max == 0) ? 16 : (plan_max * 2);
+            if ((new_plans = realloc(*plans,
+                    plan_max * sizeof (TUNINGPLAN))) == NULL) {
+                closedir(dev_dir);
+                FREE_NULL(*plans);
+                *plan_cnt = 0;
+                return ENOMEM;
+            }
+            *plans = new_plans;
+        }
+        plan = &(*plans)[(*plan_cnt)++];
+        memset(plan, 0, sizeof (TUNINGPLAN));
+        snprintf(plan->dev_name, NAME_MAX + 1, "%s", dev_entry->d_name);
+        snprintf(plan->handler, NAME_MAX + 1, "%s", slash);
+        snprintf(attr_path, MAX_SYSFS_PATH_SIZE, "%s/%s/filename", dir_name,
+                dev_entry->d_name);
+        if ((plan->error = readAttributeAt(AT_FDCWD, attr_path,
+                filename)) != 0)
+            continue;
+        if ((plan->error = inspectBackingQueue(filename, &plan->queue)) != 0)
+            continue;
+        recommendTuning(&plan->queue, &plan->profile);
+    }
+    closedir(dev_dir);
+
+    /* Keep each node within its share of threads; everything on a node
+     * is scaled back by the same factor (a thread at least) */
+    if (*plan_cnt > 0 && (wanted = calloc(*plan_cnt, sizeof (int))) == NULL) {
+        FREE_NULL(*plans);
+        *plan_cnt = 0;
+        return ENOMEM;
+    }
+    for (i = 0; i < *plan_cnt; i++)
+        if ((*plans)[i].error == 0)
+            wanted[i] = atoi((*plans)[i].profile.values[TUNING_THREADS_NUM]);
+    for (i = 0; i < *plan_cnt; i++) {
+        plan = &(*plans)[i];
+        if (plan->error != 0)
+            continue;
+        node_threads = 0;
+        for (j = 0; j < *plan_cnt; j++)
+            if ((*plans)[j].error == 0 && (*plans)[j].queue.numa_node ==
+                    plan->queue.numa_node)
+                node_threads += wanted[j];
+        node_limit = plan->queue.node_cpus * TUNING_NODE_OVERCOMMIT;
+        if (node_threads <= node_limit)
+            continue;
+        threads = MAX(1, (wanted[i] * node_limit) / node_threads);
+        snprintf(plan->profile.values[TUNING_THREADS_NUM], TUNING_VALUE_LEN,
+                "%d", threads);
+    }
+    FREE_NULL(wanted);
+    return 0;
+}
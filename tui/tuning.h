@@ -0,0 +1,124 @@
+/**
+ * @file tuning.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _TUNING_H
+#define	_TUNING_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <limits.h>
+#include <cdk.h>
+
+/* Tuning profile settings; profiles are kept in SCST_TUNING_CONF (an INI
+ * file, one section per profile) */
+#define TUNING_MAX_PROFILES     16
+#define TUNING_NAME_LEN         32
+#define TUNING_DESC_LEN         40
+#define TUNING_VALUE_LEN        32
+#define TUNING_MAX_THREADS      128
+
+/* Automatic threads_num sizing; a non-rotational device gets a thread per
+ * hardware queue or per TUNING_SSD_REQS requests (at most a thread per CPU
+ * on its NUMA node), a rotational one a thread per TUNING_HDD_REQS requests
+ * (at most TUNING_HDD_MAX_THREADS). A rebalance keeps the threads on each
+ * node to TUNING_NODE_OVERCOMMIT per CPU. */
+#define TUNING_SSD_REQS         32
+#define TUNING_HDD_REQS         64
+#define TUNING_HDD_MAX_THREADS  8
+#define TUNING_NODE_OVERCOMMIT  2
+#define TUNING_MAX_SLAVE_DEPTH  4
+
+/* The SCST device attributes a profile can set */
+#define TUNING_THREADS_NUM      0
+#define TUNING_THREADS_POOL     1
+#define TUNING_BLOCKSIZE        2
+#define TUNING_WRITE_THROUGH    3
+#define TUNING_NV_CACHE         4
+#define TUNING_ROTATIONAL       5
+#define TUNING_THIN_PROV        6
+#define TUNING_ATTRS            7
+
+/* What happened to an attribute when a profile was applied */
+#define TUNING_SET              0
+#define TUNING_SAME             1
+#define TUNING_CREATE_ONLY      2
+#define TUNING_FAILED           3
+
+/* A named set of SCST device attributes */
+typedef struct tuning_profile TUNINGPROFILE;
+struct tuning_profile {
+    /* Section name in the profiles file */
+    char name[TUNING_NAME_LEN];
+    char description[TUNING_DESC_LEN];
+    /* A value for each TUNING_* attribute; empty if the profile leaves it
+     * alone */
+    char values[TUNING_ATTRS][TUNING_VALUE_LEN];
+};
+
+/* One attribute of an applied profile */
+typedef struct tuning_result TUNINGRESULT;
+struct tuning_result {
+    /* One of the TUNING_* attributes */
+    int attr;
+    /* One of TUNING_SET, TUNING_SAME, TUNING_CREATE_ONLY (can only be set
+     * when the device is created, and differs), or TUNING_FAILED */
+    int status;
+    /* The errno value if it failed, or 0 */
+    int error;
+    /* What the device had before */
+    char old_value[TUNING_VALUE_LEN];
+};
+
+/* The request queue of a device's back-end, as found in sysfs */
+typedef struct tuning_queue TUNINGQUEUE;
+struct tuning_queue {
+    /* The whole disk (not a partition) under /sys/block */
+    char disk[NAME_MAX + 1];
+    /* queue/nr_requests, and how many blk-mq hardware queues (0 if not
+     * blk-mq) */
+    int nr_requests;
+    int hw_queues;
+    boolean rotational;
+    /* NUMA node it hangs off (-1 if none), and the online CPUs there (all
+     * of them with no node) */
+    int numa_node;
+    int node_cpus;
+};
+
+/* One SCST device in a rebalance */
+typedef struct tuning_plan TUNINGPLAN;
+struct tuning_plan {
+    char dev_name[NAME_MAX + 1];
+    char handler[NAME_MAX + 1];
+    TUNINGQUEUE queue;
+    /* The recommended threads_num and threads_pool_type */
+    TUNINGPROFILE profile;
+    /* The errno value if the back-end couldn't be inspected, or 0 */
+    int error;
+};
+
+/* Function prototypes */
+int loadTuningProfiles(TUNINGPROFILE profiles[], int *profile_cnt);
+const char *tuningAttrName(int attr);
+boolean tuningAttrApplies(int attr, const char handler[]);
+int tuningValueIndex(const TUNINGPROFILE *profile, int attr,
+        char *choices[], int choice_cnt, int default_index);
+void tuningCreateParams(const TUNINGPROFILE *profile, const char handler[],
+        char params[], size_t size);
+int applyTuningProfile(const TUNINGPROFILE *profile, const char dev_name[],
+        const char handler[], TUNINGRESULT results[], int *result_cnt);
+int inspectBackingQueue(const char backing[], TUNINGQUEUE *queue);
+void recommendTuning(const TUNINGQUEUE *queue, TUNINGPROFILE *profile);
+int planRebalance(TUNINGPLAN **plans, int *plan_cnt);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _TUNING_H */
@@ -12,6 +12,7 @@
 #include <syslog.h>
 #include <inttypes.h>
 #include <netdb.h>
+#include <fcntl.h>
 
 #include "prototypes.h"
 #include "system.h"
@@ -36,32 +37,117 @@ char *strStrip(char *string) {
 }
 
 
+/*
+ * Open a sysfs directory (for use with the *At() attribute functions and
+ * readAttributes()). Returns 0 (zero) or the errno value.
+ */
+int openAttrDir(const char dir_path[], int *dir_fd) {
+    if ((*dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return errno;
+    return 0;
+}
+
+
+/*
+ * Open a sysfs attribute (relative to 'dir_fd', or AT_FDCWD) and keep it
+ * open; the handle can then be read over and over with preadAttribute().
+ * The flags are O_RDONLY or O_WRONLY (plus O_TRUNC). Returns 0 (zero) or
+ * the errno value.
+ */
+int openAttribute(int dir_fd, const char name[], int flags, int *attr_fd) {
+    if ((*attr_fd = openat(dir_fd, name, flags | O_CLOEXEC)) == -1)
+        return errno;
+    return 0;
+}
+
+
+/*
+ * Read a sysfs attribute from an open handle. We use pread() at offset
+ * zero which makes sysfs regenerate the value, so there is no need to
+ * re-open the file (or seek) between reads. Only the first line is kept
+ * (without its newline); SCST adds a "[key]" line to attributes that
+ * aren't set to the default. Returns 0 (zero) or the errno value (errno
+ * is left set); on error the value is an empty string.
+ */
+int preadAttribute(int attr_fd, char attr_value[]) {
+    ssize_t length = 0;
+    char *new_line = NULL;
+
+    if ((length = pread(attr_fd, attr_value, MAX_SYSFS_ATTR_SIZE - 1,
+            0)) == -1) {
+        attr_value[0] = '\0';
+        return errno;
+    }
+    attr_value[length] = '\0';
+    if ((new_line = memchr(attr_value, '\n', length)) != NULL)
+        *new_line = '\0';
+    return 0;
+}
+
+
+/*
+ * Write a value to an open sysfs attribute handle; sysfs takes the whole
+ * value in one write() at offset zero. Returns 0 (zero) or the errno value.
+ */
+int pwriteAttribute(int attr_fd, const char attr_value[]) {
+    size_t length = strlen(attr_value);
+    ssize_t written = 0;
+
+    if ((written = pwrite(attr_fd, attr_value, length, 0)) == -1)
+        return errno;
+    if ((size_t) written != length)
+        return EIO;
+    return 0;
+}
+
+
+/*
+ * Read a sysfs attribute once (open, read, close) relative to 'dir_fd'
+ * (or AT_FDCWD). Returns 0 (zero) or the errno value.
+ */
+int readAttributeAt(int dir_fd, const char name[], char attr_value[]) {
+    int attr_fd = -1, ret_val = 0;
+
+    if ((ret_val = openAttribute(dir_fd, name, O_RDONLY, &attr_fd)) != 0) {
+        attr_value[0] = '\0';
+        return ret_val;
+    }
+    ret_val = preadAttribute(attr_fd, attr_value);
+    close(attr_fd);
+    return ret_val;
+}
+
+
+/*
+ * Read a batch of sysfs attributes; each entry names a directory handle
+ * and an attribute, and gets the value (or an empty string) and an error
+ * code (0 or the errno value). Returns the number of attributes that
+ * couldn't be read.
+ */
+int readAttributes(ATTRREAD attrs[], int attr_cnt) {
+    int i = 0, failed = 0;
+
+    for (i = 0; i < attr_cnt; i++) {
+        attrs[i].error = readAttributeAt(attrs[i].dir_fd, attrs[i].name,
+                attrs[i].value);
+        if (attrs[i].error != 0)
+            failed++;
+    }
+    return failed;
+}
+
+
 /*
  * Reads a sysfs attribute value. Open the specified file and read its
  * contents. If an error occurs, fill the character array with the error.
  */
 void readAttribute(char sysfs_attr[], char attr_value[]) {
-     FILE *sysfs_file = NULL;
-     char *remove_me = NULL;
-
-     /* Open the file and retrieve the value */
-     if ((sysfs_file = fopen(sysfs_attr, "r")) == NULL) {
-         snprintf(attr_value, MAX_SYSFS_ATTR_SIZE,
-                 "fopen(): %s", strerror(errno));
-         return;
-     } else {
-         fgets(attr_value, MAX_SYSFS_ATTR_SIZE, sysfs_file);
-         fclose(sysfs_file);
-     }
-
-     /* Get rid of the newline character */
-     remove_me = strrchr(attr_value, '\n');
-     if (remove_me) {
-         *remove_me = '\0';
-     }
-
-     /* Done */
-     return;
+    int ret_val = 0;
+
+    if ((ret_val = readAttributeAt(AT_FDCWD, sysfs_attr, attr_value)) != 0)
+        snprintf(attr_value, MAX_SYSFS_ATTR_SIZE, "open(): %s",
+                strerror(ret_val));
+    return;
 }
 
 
@@ -70,20 +156,15 @@ void readAttribute(char sysfs_attr[], char attr_value[]) {
  * the errno value, otherwise we return 0 (zero).
  */
 int writeAttribute(char sysfs_attr[], char attr_value[]) {
-     FILE *sysfs_file = NULL;
-     int ret_val = 0;
-
-     /* Open the file and write the value */
-     if ((sysfs_file = fopen(sysfs_attr, "w")) == NULL) {
-         return errno;
-     } else {
-         fprintf(sysfs_file, "%s", attr_value);
-         if ((ret_val = fclose(sysfs_file)) == 0) {
-             return ret_val;
-         } else {
-             return errno;
-         }
-     }
+    int attr_fd = -1, ret_val = 0;
+
+    if ((ret_val = openAttribute(AT_FDCWD, sysfs_attr, O_WRONLY | O_TRUNC,
+            &attr_fd)) != 0)
+        return ret_val;
+    ret_val = pwriteAttribute(attr_fd, attr_value);
+    if (close(attr_fd) == -1 && ret_val == 0)
+        ret_val = errno;
+    return ret_val;
 }
 
 
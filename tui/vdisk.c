@@ -0,0 +1,247 @@
+/**
+ * @file vdisk.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "vdisk.h"
+
+/* Current sort order for sortVDiskInfo() (qsort() has no context) */
+static vdisk_sort_t vdisk_sort_key = VDISK_SORT_NAME;
+
+
+/*
+ * Count the extents in part of a file (to the end if 'length' is 0) with
+ * FIEMAP; with no room for any extent records the kernel just tells us how
+ * many there are. We don't ask it to sync the file first, so dirty data
+ * (eg, a fill in progress) may not be counted yet. Returns -1 if the file
+ * system doesn't support FIEMAP.
+ */
+long countVDiskExtents(int fd, off_t start, off_t length) {
+    struct fiemap fiemap = {0};
+
+    fiemap.fm_start = start;
+    fiemap.fm_length = (length > 0) ? (__u64) length : FIEMAP_MAX_OFFSET;
+    fiemap.fm_extent_count = 0;
+    if (ioctl(fd, FS_IOC_FIEMAP, &fiemap) == -1)
+        return -1;
+    return fiemap.fm_mapped_extents;
+}
+
+
+/*
+ * Add up the holes in a file by walking the data extents with SEEK_DATA
+ * and SEEK_HOLE. If the file system can't tell us, or the file has more
+ * than VDISK_MAX_HOLE_SEEKS data extents, we use the unallocated part of
+ * the file instead (close, but it counts preallocated space as data).
+ */
+off_t scanVDiskHoles(int fd, off_t size, off_t allocated) {
+    off_t data = 0, hole = 0, position = 0, data_bytes = 0;
+    int seeks = 0;
+
+    while (position < size) {
+        if (seeks++ == VDISK_MAX_HOLE_SEEKS)
+            return MAX(size - allocated, 0);
+        if ((data = lseek(fd, position, SEEK_DATA)) == -1) {
+            /* Nothing but a hole from here to the end */
+            if (errno == ENXIO)
+                break;
+            return MAX(size - allocated, 0);
+        }
+        if ((hole = lseek(fd, data, SEEK_HOLE)) == -1)
+            hole = size;
+        data_bytes += MIN(hole, size) - data;
+        position = hole;
+    }
+    return size - data_bytes;
+}
+
+
+/*
+ * Look at every file (anything but a directory) in the given directory;
+ * each entry is stat'd relative to the directory descriptor and opened
+ * once for the extent count, hole scan and provisioning mode. On success
+ * the caller owns (and must free) the '*files' array. Returns 0 (zero) or
+ * the errno value.
+ */
+int scanVDiskDir(const char dir_path[], VDISKINFO **files, int *file_cnt) {
+    DIR *dir_stream = NULL;
+    struct dirent *dir_entry = NULL;
+    struct stat file_stat = {0};
+    VDISKINFO *list = NULL, *new_list = NULL, *info = NULL;
+    int dir_fd = 0, file_fd = 0, count = 0, list_size = 0;
+    ssize_t prov_len = 0;
+
+    *files = NULL;
+    *file_cnt = 0;
+    if ((dir_stream = opendir(dir_path)) == NULL)
+        return errno;
+    dir_fd = dirfd(dir_stream);
+
+    while ((dir_entry = readdir(dir_stream)) != NULL) {
+        /* We only want the files (d_type may not be filled in) */
+        if (dir_entry->d_type == DT_DIR)
+            continue;
+        if (count == list_size) {
+            if ((new_list = realloc(list, (list_size + VDISK_SCAN_CHUNK) *
+                    sizeof (VDISKINFO))) == NULL) {
+                FREE_NULL(list);
+                closedir(dir_stream);
+                return ENOMEM;
+            }
+            list = new_list;
+            list_size += VDISK_SCAN_CHUNK;
+        }
+        info = &list[count];
+        memset(info, 0, sizeof (VDISKINFO));
+        snprintf(info->name, sizeof (info->name), "%s", dir_entry->d_name);
+        info->hole_bytes = -1;
+        info->extents = -1;
+
+        if (fstatat(dir_fd, dir_entry->d_name, &file_stat,
+                AT_SYMLINK_NOFOLLOW) == -1) {
+            info->error = errno;
+            count++;
+            continue;
+        }
+        if (S_ISDIR(file_stat.st_mode))
+            continue;
+        count++;
+        info->size = file_stat.st_size;
+        info->allocated = (off_t) file_stat.st_blocks * 512;
+        if (!S_ISREG(file_stat.st_mode))
+            continue;
+
+        if ((file_fd = openat(dir_fd, dir_entry->d_name,
+                O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1) {
+            info->error = errno;
+            continue;
+        }
+        info->extents = countVDiskExtents(file_fd, 0, 0);
+        info->hole_bytes = scanVDiskHoles(file_fd, info->size,
+                info->allocated);
+        /* Files created before we recorded the mode (or on file systems
+         * without xattrs) don't have one */
+        if ((prov_len = fgetxattr(file_fd, VDISK_PROV_XATTR,
+                info->prov_mode, VDISK_PROV_LEN - 1)) == -1)
+            prov_len = 0;
+        info->prov_mode[prov_len] = '\0';
+        close(file_fd);
+    }
+
+    closedir(dir_stream);
+    *files = list;
+    *file_cnt = count;
+    return 0;
+}
+
+
+/*
+ * See if the file is the backing file of an SCST vdisk_fileio device; the
+ * files are compared by device and inode, so any path to it counts. The
+ * device name is copied to 'dev_name' (MAX_SYSFS_ATTR_SIZE). Returns 0
+ * (zero) if it is, ENOENT if it isn't, or the errno value.
+ */
+int findVDiskSCSTDev(const char path[], char dev_name[]) {
+    DIR *dir_stream = NULL;
+    struct dirent *dir_entry = NULL;
+    struct stat file_stat = {0}, dev_stat = {0};
+    char handler_path[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_name[MAX_SYSFS_PATH_SIZE] = {0},
+            attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
+    int ret_val = ENOENT;
+
+    if (stat(path, &file_stat) == -1)
+        return errno;
+    snprintf(handler_path, MAX_SYSFS_PATH_SIZE, "%s/handlers/vdisk_fileio",
+            SYSFS_SCST_TGT);
+    if ((dir_stream = opendir(handler_path)) == NULL)
+        return (errno == ENOENT) ? ENOENT : errno;
+    while ((dir_entry = readdir(dir_stream)) != NULL) {
+        /* Anything else (mgmt, etc.) has no 'filename' attribute */
+        if (dir_entry->d_name[0] == '.')
+            continue;
+        snprintf(attr_name, MAX_SYSFS_PATH_SIZE, "%s/filename",
+                dir_entry->d_name);
+        if (readAttributeAt(dirfd(dir_stream), attr_name, attr_value) != 0)
+            continue;
+        if (stat(attr_value, &dev_stat) == 0 &&
+                dev_stat.st_dev == file_stat.st_dev &&
+                dev_stat.st_ino == file_stat.st_ino) {
+            snprintf(dev_name, MAX_SYSFS_ATTR_SIZE, "%s", dir_entry->d_name);
+            ret_val = 0;
+            break;
+        }
+    }
+    closedir(dir_stream);
+    return ret_val;
+}
+
+
+/*
+ * Return the value of a file for the current (numeric) sort order; holes
+ * are compared as parts per million of the file size.
+ */
+static long long vdiskSortValue(const VDISKINFO *info) {
+    switch (vdisk_sort_key) {
+        case VDISK_SORT_ALLOCATED:
+            return info->allocated;
+        case VDISK_SORT_HOLES:
+            if (info->hole_bytes < 0 || info->size == 0)
+                return -1;
+            return (long long) ((double) info->hole_bytes / info->size *
+                    1000000.0);
+        case VDISK_SORT_EXTENTS:
+            return info->extents;
+        default:
+            return info->size;
+    }
+}
+
+
+/*
+ * Sort comparator for the inventory; largest (by the current sort order)
+ * first, with ties (or the name sort order) going by file name.
+ */
+static int compareVDisks(const void *a, const void *b) {
+    const VDISKINFO *info_a = a, *info_b = b;
+    long long value_a = 0, value_b = 0;
+
+    if (vdisk_sort_key != VDISK_SORT_NAME) {
+        value_a = vdiskSortValue(info_a);
+        value_b = vdiskSortValue(info_b);
+        if (value_a != value_b)
+            return (value_a < value_b) ? 1 : -1;
+    }
+    return strcmp(info_a->name, info_b->name);
+}
+
+
+/*
+ * Sort the files from scanVDiskDir() by the given key.
+ */
+void sortVDiskInfo(VDISKINFO files[], int file_cnt, vdisk_sort_t sort_key) {
+    vdisk_sort_key = sort_key;
+    qsort(files, file_cnt, sizeof (VDISKINFO), compareVDisks);
+    return;
+}
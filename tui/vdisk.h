@@ -0,0 +1,82 @@
+/**
+ * @file vdisk.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _VDISK_H
+#define	_VDISK_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <cdk.h>
+
+/* Virtual disk file inventory settings; the hole scan gives up (and falls
+ * back to an estimate from the allocated size) after this many data
+ * extents, so a badly fragmented file can't stall the scan */
+#define VDISK_SCAN_CHUNK        256
+#define VDISK_MAX_HOLE_SEEKS    4096
+#define VDISK_PROV_LEN          32
+
+/* Hole/data seeks on the virtual disk files (clone, inventory, reclaim);
+ * from linux 3.1, but glibc only defines them from 2.15 (ESOS has 2.12) */
+#ifndef SEEK_DATA
+#define SEEK_DATA               3
+#endif
+#ifndef SEEK_HOLE
+#define SEEK_HOLE               4
+#endif
+/* Same for the fallocate() modes (provisioning and reclaim); glibc has
+ * them from 2.18, and zero range is from linux 3.15 */
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE     0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE    0x02
+#endif
+#ifndef FALLOC_FL_ZERO_RANGE
+#define FALLOC_FL_ZERO_RANGE    0x10
+#endif
+
+/* Virtual disk file inventory sort order */
+typedef enum {
+    VDISK_SORT_NAME, VDISK_SORT_SIZE, VDISK_SORT_ALLOCATED, VDISK_SORT_HOLES,
+    VDISK_SORT_EXTENTS, VDISK_SORT_KEYS
+} vdisk_sort_t;
+
+/* What we know about one virtual disk file */
+typedef struct vdisk_info VDISKINFO;
+struct vdisk_info {
+    /* File name (relative to the directory scanned) */
+    char name[NAME_MAX + 1];
+    /* Apparent size and bytes actually allocated (st_blocks) */
+    off_t size;
+    off_t allocated;
+    /* Bytes in holes (SEEK_HOLE), or -1 if unknown */
+    off_t hole_bytes;
+    /* Extent count (FIEMAP), or -1 if the file system can't tell us */
+    long extents;
+    /* Provisioning mode we recorded at creation (VDISK_PROV_XATTR) */
+    char prov_mode[VDISK_PROV_LEN];
+    /* The errno value if we couldn't look at the file, or 0 */
+    int error;
+};
+
+/* Function prototypes */
+int scanVDiskDir(const char dir_path[], VDISKINFO **files, int *file_cnt);
+long countVDiskExtents(int fd, off_t start, off_t length);
+off_t scanVDiskHoles(int fd, off_t size, off_t allocated);
+int findVDiskSCSTDev(const char path[], char dev_name[]);
+void sortVDiskInfo(VDISKINFO files[], int file_cnt, vdisk_sort_t sort_key);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _VDISK_H */
@@ -0,0 +1,498 @@
+/**
+ * @file zerofill.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "prototypes.h"
+#include "system.h"
+#include "zerofill.h"
+
+/*
+ * Write zeros over part of the file (the whole length, unless there is an
+ * error). Returns 0 (zero) or the errno value.
+ */
+static int zeroFillWrite(ZEROFILL *fill, off_t offset, size_t length) {
+    ssize_t bytes_written = 0;
+    size_t done = 0;
+
+    while (done < length) {
+        bytes_written = pwrite(fill->fd, (char *) fill->buffer + done,
+                length - done, offset + done);
+        if (bytes_written == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        } else if (bytes_written == 0) {
+            return EIO;
+        }
+        done += bytes_written;
+    }
+
+    /* Without O_DIRECT, write the pages out now and drop them so we don't
+     * push everything else out of the page cache */
+    if (!fill->direct) {
+        sync_file_range(fill->fd, offset, length,
+                SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fill->fd, offset, length, POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+
+/*
+ * Wait for our turn to write 'length' bytes under the byte rate limit (if
+ * any); the writes are spaced out, there is no saved up burst.
+ */
+static void zeroFillPace(ZEROFILL *fill, size_t length) {
+    struct timespec now = {0}, when = {0};
+    long long max_bps = 0, now_ns = 0, when_ns = 0;
+
+    if ((max_bps = __atomic_load_n(&fill->max_bps, __ATOMIC_SEQ_CST)) <= 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ns = (now.tv_sec * 1000000000LL) + now.tv_nsec;
+    pthread_mutex_lock(&fill->pace_lock);
+    if (fill->pace_next < now_ns)
+        fill->pace_next = now_ns;
+    when_ns = fill->pace_next;
+    fill->pace_next += (length * 1000000000LL) / max_bps;
+    pthread_mutex_unlock(&fill->pace_lock);
+    if (when_ns > now_ns) {
+        when.tv_sec = when_ns / 1000000000LL;
+        when.tv_nsec = when_ns % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when,
+                NULL) == EINTR)
+            ;
+    }
+    return;
+}
+
+
+/*
+ * A fill worker; claims the next chunk of the file, writes it, and repeats
+ * until the range is done, an error occurs, or we're cancelled. Workers
+ * past the governor's depth limit sit out.
+ */
+static void *zeroFillWorker(void *arg) {
+    ZEROFILL *fill = arg;
+    off_t offset = 0, *in_flight = NULL;
+    size_t length = 0;
+    int ret_val = 0, no_error = 0, slot = 0;
+
+    /* Claim our in-flight slot */
+    slot = __atomic_fetch_add(&fill->next_slot, 1, __ATOMIC_SEQ_CST);
+    in_flight = &fill->in_flight[slot];
+
+    while (!__atomic_load_n(&fill->cancel, __ATOMIC_SEQ_CST)) {
+        if (slot >= __atomic_load_n(&fill->max_depth, __ATOMIC_SEQ_CST)) {
+            /* If the others have claimed everything, we're done (the
+             * governor may keep the limit down to the end) */
+            if (__atomic_load_n(&fill->next_offset, __ATOMIC_SEQ_CST) >=
+                    fill->direct_end)
+                break;
+            /* Nothing in flight, so don't hold back the checkpoint */
+            __atomic_store_n(in_flight, __atomic_load_n(&fill->next_offset,
+                    __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+            usleep(FILL_GOV_IDLE_USECS);
+            continue;
+        }
+        /* Publish a lower bound before claiming, so a checkpoint taken
+         * in between can't skip over our chunk */
+        __atomic_store_n(in_flight, __atomic_load_n(&fill->next_offset,
+                __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+        offset = __atomic_fetch_add(&fill->next_offset,
+                (off_t) fill->buffer_size, __ATOMIC_SEQ_CST);
+        if (offset >= fill->direct_end)
+            break;
+        __atomic_store_n(in_flight, offset, __ATOMIC_SEQ_CST);
+        length = MIN((off_t) fill->buffer_size, fill->direct_end - offset);
+        zeroFillPace(fill, length);
+        if ((ret_val = zeroFillWrite(fill, offset, length)) != 0) {
+            /* Keep the first error; everyone else stops */
+            no_error = 0;
+            __atomic_compare_exchange_n(&fill->error, &no_error, ret_val,
+                    FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&fill->cancel, TRUE, __ATOMIC_SEQ_CST);
+            break;
+        }
+        __atomic_add_fetch(&fill->done_bytes, (off_t) length,
+                __ATOMIC_SEQ_CST);
+    }
+
+    /* Leave the slot at our failed chunk (if any) */
+    if (ret_val == 0)
+        __atomic_store_n(in_flight, fill->direct_end, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&fill->active, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+
+/*
+ * Start zero-filling a file (an open, writable descriptor) from 'start'
+ * up to 'end' with 'queue_depth' worker threads, each writing
+ * 'buffer_size' bytes at a time (the values are clamped to our limits).
+ * The file is switched to O_DIRECT so the fill doesn't go through (and
+ * evict) the page cache; if the file system can't do that, we fall back
+ * to regular writes. The start offset is rounded down to FILL_ALIGN. The
+ * fill runs in the background; watch it with zeroFillProgress() and
+ * zeroFillDone(), and always call finishZeroFill() afterwards. Returns 0
+ * (zero) or the errno value (nothing is running then).
+ */
+int startZeroFill(ZEROFILL *fill, int fd, off_t start, off_t end,
+        size_t buffer_size, int queue_depth) {
+    int fd_flags = 0, ret_val = 0, i = 0;
+    size_t length = 0;
+
+    memset(fill, 0, sizeof (ZEROFILL));
+    fill->fd = fd;
+    fill->start = start - (start % FILL_ALIGN);
+    fill->end = end;
+    if (fill->end < fill->start)
+        fill->end = fill->start;
+    buffer_size = buffer_size - (buffer_size % FILL_ALIGN);
+    fill->buffer_size = MAX(MIN(buffer_size, FILL_MAX_BUFF_SIZE),
+            FILL_MIN_BUFF_SIZE);
+    fill->queue_depth = MAX(MIN(queue_depth, FILL_MAX_QUEUE_DEPTH), 1);
+    fill->max_depth = fill->queue_depth;
+
+    /* A single zeroed buffer, aligned for O_DIRECT */
+    if ((ret_val = posix_memalign(&fill->buffer, FILL_ALIGN,
+            fill->buffer_size)) != 0) {
+        fill->buffer = NULL;
+        return ret_val;
+    }
+    memset(fill->buffer, 0, fill->buffer_size);
+
+    /* Try O_DIRECT for the aligned part of the range */
+    if ((fd_flags = fcntl(fd, F_GETFL)) != -1 &&
+            fcntl(fd, F_SETFL, fd_flags | O_DIRECT) != -1) {
+        fill->direct = TRUE;
+        fill->direct_end = fill->start + ((fill->end - fill->start) -
+                ((fill->end - fill->start) % FILL_ALIGN));
+        /* Some file systems take the flag but not the writes; the first
+         * chunk tells us */
+        length = MIN((off_t) fill->buffer_size,
+                fill->direct_end - fill->start);
+        if (length > 0) {
+            if ((ret_val = zeroFillWrite(fill, fill->start, length)) == 0) {
+                fill->done_bytes = length;
+            } else if (ret_val == EINVAL) {
+                fill->direct = FALSE;
+                fcntl(fd, F_SETFL, fd_flags);
+            } else {
+                fcntl(fd, F_SETFL, fd_flags);
+                FREE_NULL(fill->buffer);
+                return ret_val;
+            }
+        }
+    }
+    if (!fill->direct)
+        fill->direct_end = fill->end;
+    fill->next_offset = fill->start + fill->done_bytes;
+    for (i = 0; i < FILL_MAX_QUEUE_DEPTH; i++)
+        fill->in_flight[i] = fill->next_offset;
+    if ((ret_val = pthread_mutex_init(&fill->pace_lock, NULL)) != 0) {
+        if (fill->direct)
+            fcntl(fd, F_SETFL, fd_flags);
+        FREE_NULL(fill->buffer);
+        return ret_val;
+    }
+
+    /* Start the workers */
+    fill->active = fill->queue_depth;
+    for (i = 0; i < fill->queue_depth; i++) {
+        if ((ret_val = pthread_create(&fill->threads[i], NULL,
+                zeroFillWorker, fill)) != 0) {
+            DEBUG_LOG("pthread_create(): %s", strerror(ret_val));
+            __atomic_sub_fetch(&fill->active, fill->queue_depth - i,
+                    __ATOMIC_SEQ_CST);
+            break;
+        }
+        fill->thread_cnt++;
+    }
+    if (fill->thread_cnt == 0) {
+        if (fill->direct)
+            fcntl(fd, F_SETFL, fd_flags);
+        pthread_mutex_destroy(&fill->pace_lock);
+        FREE_NULL(fill->buffer);
+        return ret_val;
+    }
+    return 0;
+}
+
+
+/*
+ * Bytes written so far (from the start offset).
+ */
+off_t zeroFillProgress(ZEROFILL *fill) {
+    return __atomic_load_n(&fill->done_bytes, __ATOMIC_SEQ_CST);
+}
+
+
+/*
+ * An offset everything before which has been written (for resuming an
+ * interrupted fill); chunks finish out of order, so this lags behind the
+ * progress a bit.
+ */
+off_t zeroFillCheckpoint(ZEROFILL *fill) {
+    off_t checkpoint = 0, in_flight = 0;
+    int i = 0;
+
+    checkpoint = MIN(__atomic_load_n(&fill->next_offset, __ATOMIC_SEQ_CST),
+            fill->direct_end);
+    for (i = 0; i < fill->thread_cnt; i++) {
+        in_flight = __atomic_load_n(&fill->in_flight[i], __ATOMIC_SEQ_CST);
+        checkpoint = MIN(checkpoint, in_flight);
+    }
+    return checkpoint;
+}
+
+
+/*
+ * Have all of the workers finished (done, failed, or cancelled)?
+ */
+boolean zeroFillDone(ZEROFILL *fill) {
+    return (__atomic_load_n(&fill->active, __ATOMIC_SEQ_CST) == 0) ?
+            TRUE : FALSE;
+}
+
+
+/*
+ * Ask the workers to stop; finishZeroFill() waits for them.
+ */
+void cancelZeroFill(ZEROFILL *fill) {
+    __atomic_store_n(&fill->cancel, TRUE, __ATOMIC_SEQ_CST);
+    return;
+}
+
+
+/*
+ * Wait for the workers, write the unaligned tail of the range (if any)
+ * without O_DIRECT, and put the descriptor back how we found it. The
+ * caller still owns the descriptor (and any fsync()). Returns 0 (zero),
+ * the errno value of the first failed write, or ECANCELED.
+ */
+int finishZeroFill(ZEROFILL *fill) {
+    int fd_flags = 0, ret_val = 0, i = 0;
+
+    for (i = 0; i < fill->thread_cnt; i++)
+        pthread_join(fill->threads[i], NULL);
+    fill->thread_cnt = 0;
+
+    if (fill->direct) {
+        if ((fd_flags = fcntl(fill->fd, F_GETFL)) != -1)
+            fcntl(fill->fd, F_SETFL, fd_flags & ~O_DIRECT);
+        fill->direct = FALSE;
+    }
+
+    if ((ret_val = fill->error) == 0) {
+        if (fill->cancel) {
+            ret_val = ECANCELED;
+        } else if (fill->direct_end < fill->end) {
+            if ((ret_val = zeroFillWrite(fill, fill->direct_end,
+                    fill->end - fill->direct_end)) == 0)
+                fill->done_bytes += fill->end - fill->direct_end;
+        }
+    }
+
+    pthread_mutex_destroy(&fill->pace_lock);
+    FREE_NULL(fill->buffer);
+    return ret_val;
+}
+
+
+/*
+ * Limit a running fill to 'max_bps' bytes per second (0 for no limit) and
+ * 'max_depth' writes in flight (clamped to the queue depth).
+ */
+void setZeroFillLimits(ZEROFILL *fill, long long max_bps, int max_depth) {
+    __atomic_store_n(&fill->max_bps, MAX(max_bps, 0), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&fill->max_depth,
+            MAX(MIN(max_depth, fill->queue_depth), 1), __ATOMIC_SEQ_CST);
+    return;
+}
+
+
+/*
+ * Read the completed I/O and time (milliseconds) counters, for reads and
+ * writes, from a block device 'stat' attribute. Returns 0 (zero) or the
+ * errno value.
+ */
+static int readDeviceStat(int stat_fd, unsigned long long ios[],
+        unsigned long long ticks[]) {
+    char attr_value[MAX_SYSFS_ATTR_SIZE] = {0};
+    int ret_val = 0;
+
+    if ((ret_val = preadAttribute(stat_fd, attr_value)) != 0)
+        return ret_val;
+    /* reads, merges, sectors, ticks, then the same for writes */
+    if (sscanf(attr_value, "%llu %*u %*u %llu %llu %*u %*u %llu",
+            &ios[0], &ticks[0], &ios[1], &ticks[1]) != 4)
+        return EINVAL;
+    return 0;
+}
+
+
+/*
+ * Read the device counters and add what completed since the last read to
+ * the front-end I/O, leaving out our own: with just our own writes, the
+ * reads are counted; otherwise, everything, but only while we're idle.
+ * Returns 0 (zero) or the errno value.
+ */
+static int countFrontEnd(FILLGOVERNOR *governor) {
+    unsigned long long ios[2] = {0}, ticks[2] = {0};
+    int ret_val = 0, i = 0;
+
+    if ((ret_val = readDeviceStat(governor->stat_fd, ios, ticks)) != 0)
+        return ret_val;
+    for (i = 0; i < 2; i++) {
+        if ((governor->own_io == FILL_GOV_OWN_WRITES && i == 0) ||
+                (governor->own_io == FILL_GOV_OWN_ANY && governor->idle)) {
+            governor->front_ios += ios[i] - governor->ios[i];
+            governor->front_ticks += ticks[i] - governor->ticks[i];
+        }
+        governor->ios[i] = ios[i];
+        governor->ticks[i] = ticks[i];
+    }
+    return 0;
+}
+
+
+/*
+ * Set up a governor for a fill (or another job) on the given file; we find
+ * the block device the file lives on (a partition, or a DM/MD device, has
+ * its own counters). The device counters include our own I/O, which would
+ * hold us back for nothing on an idle device, so 'own_io' (FILL_GOV_OWN_*)
+ * says what to leave out. File systems without a device (eg, btrfs) can't
+ * be governed. Returns 0 (zero) or the errno value.
+ */
+int openFillGovernor(FILLGOVERNOR *governor, int fd, int own_io) {
+    char stat_path[MAX_SYSFS_PATH_SIZE] = {0};
+    struct stat file_stat = {0};
+    int ret_val = 0;
+
+    memset(governor, 0, sizeof (FILLGOVERNOR));
+    governor->stat_fd = -1;
+    governor->own_io = own_io;
+    if (fstat(fd, &file_stat) == -1)
+        return errno;
+    snprintf(stat_path, MAX_SYSFS_PATH_SIZE, "/sys/dev/block/%u:%u/stat",
+            major(file_stat.st_dev), minor(file_stat.st_dev));
+    if ((ret_val = openAttribute(AT_FDCWD, stat_path, O_RDONLY,
+            &governor->stat_fd)) != 0)
+        return ret_val;
+    if ((ret_val = readDeviceStat(governor->stat_fd, governor->ios,
+            governor->ticks)) != 0) {
+        closeFillGovernor(governor);
+        return ret_val;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &governor->taken);
+    return 0;
+}
+
+
+/*
+ * For a job that does its I/O one piece at a time (FILL_GOV_OWN_ANY): say
+ * when it's idle (all of its I/O has completed) and when it starts again.
+ */
+void idleFillGovernor(FILLGOVERNOR *governor, boolean idle) {
+    if (governor->stat_fd == -1 || governor->idle == idle)
+        return;
+    /* Count up to here with the old state */
+    if (countFrontEnd(governor) == 0)
+        governor->idle = idle;
+    return;
+}
+
+
+/*
+ * Sample the device; updates the governor's latency (the average for the
+ * front-end I/O, 0 if there wasn't any), and returns our rate (bytes per
+ * second, from 'done_bytes') over the interval since the last sample, or
+ * -1 if there isn't a new sample.
+ */
+long long sampleFillGovernor(FILLGOVERNOR *governor, off_t done_bytes) {
+    struct timespec now = {0};
+    long long msecs = 0, fill_bps = 0;
+
+    if (governor->stat_fd == -1 || countFrontEnd(governor) != 0)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    msecs = ((now.tv_sec - governor->taken.tv_sec) * 1000LL) +
+            ((now.tv_nsec - governor->taken.tv_nsec) / 1000000LL);
+    if (msecs <= 0)
+        return -1;
+
+    /* Average latency and our rate over the interval */
+    governor->latency_ms = (governor->front_ios > 0) ?
+            (governor->front_ticks / governor->front_ios) : 0;
+    governor->front_ios = 0;
+    governor->front_ticks = 0;
+    fill_bps = ((done_bytes - governor->done_bytes) * 1000LL) / msecs;
+    governor->peak_bps = MAX(governor->peak_bps, fill_bps);
+    governor->done_bytes = done_bytes;
+    governor->taken = now;
+    return fill_bps;
+}
+
+
+/*
+ * Sample the device and adjust the fill's limits; call this every second
+ * or so. Past the latency threshold, the byte rate (starting from what
+ * we're getting) and the depth are halved; under it, they're stepped back
+ * up until the limits come off.
+ */
+void runFillGovernor(FILLGOVERNOR *governor, ZEROFILL *fill) {
+    long long fill_bps = 0, max_bps = 0;
+    int max_depth = 0;
+
+    if ((fill_bps = sampleFillGovernor(governor,
+            zeroFillProgress(fill))) == -1)
+        return;
+
+    max_bps = __atomic_load_n(&fill->max_bps, __ATOMIC_SEQ_CST);
+    max_depth = __atomic_load_n(&fill->max_depth, __ATOMIC_SEQ_CST);
+    if (governor->latency_ms > FILL_GOV_LAT_MSECS) {
+        max_bps = MAX(((max_bps > 0) ? max_bps : fill_bps) / 2,
+                FILL_GOV_MIN_BPS);
+        max_depth = max_depth / 2;
+    } else if (max_bps > 0) {
+        max_bps += FILL_GOV_STEP_BPS;
+        max_depth++;
+        if (max_bps >= governor->peak_bps && max_depth >= fill->queue_depth)
+            max_bps = 0;
+    }
+    setZeroFillLimits(fill, max_bps, max_depth);
+    return;
+}
+
+
+/*
+ * Done with a governor.
+ */
+void closeFillGovernor(FILLGOVERNOR *governor) {
+    if (governor->stat_fd != -1) {
+        close(governor->stat_fd);
+        governor->stat_fd = -1;
+    }
+    return;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file zerofill.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _ZEROFILL_H
+#define	_ZEROFILL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <cdk.h>
+
+/* Zero-fill engine settings; the queue depth is the number of worker
+ * threads (each has one write outstanding) */
+#define FILL_ALIGN              4096
+#define FILL_MIN_BUFF_SIZE      1048576
+#define FILL_MAX_BUFF_SIZE      8388608
+#define FILL_DEF_BUFF_SIZE      4194304
+#define FILL_DEF_QUEUE_DEPTH    4
+#define FILL_MAX_QUEUE_DEPTH    32
+#define FILL_POLL_USECS         100000
+
+/* Fill governor settings; the fill backs off when the average latency
+ * (await) of the front-end I/O on the backing device goes past
+ * FILL_GOV_LAT_MSECS */
+#define FILL_GOV_LAT_MSECS      20
+#define FILL_GOV_MIN_BPS        4194304LL
+#define FILL_GOV_STEP_BPS       8388608LL
+#define FILL_GOV_IDLE_USECS     10000
+/* The governed job's own I/O, which mustn't count as front-end latency:
+ * only writes (a fill; the latency is taken from the reads), or anything
+ * (the latency is only taken while the job is idle, see idleFillGovernor) */
+#define FILL_GOV_OWN_WRITES     0
+#define FILL_GOV_OWN_ANY        1
+
+/* A zero-fill of part of a file; the progress/error fields are shared
+ * with the worker threads and must only be read with zeroFillProgress()
+ * and friends */
+typedef struct zero_fill ZEROFILL;
+struct zero_fill {
+    /* File being filled (opened/closed by the caller) */
+    int fd;
+    /* Range being filled; 'direct_end' is where the O_DIRECT part stops
+     * (the tail, if any, is written without it) */
+    off_t start;
+    off_t end;
+    off_t direct_end;
+    /* Write size and number of writes in flight (worker threads) */
+    size_t buffer_size;
+    int queue_depth;
+    /* Using O_DIRECT (not all file systems support it) */
+    boolean direct;
+    /* One aligned, zeroed buffer shared (read-only) by all workers */
+    void *buffer;
+    /* Next offset to be claimed by a worker */
+    off_t next_offset;
+    /* Lowest offset each worker may still be writing (see
+     * zeroFillCheckpoint()) */
+    off_t in_flight[FILL_MAX_QUEUE_DEPTH];
+    int next_slot;
+    /* Bytes written so far (from 'start') */
+    off_t done_bytes;
+    /* First error (errno value) seen by a worker, or 0 */
+    int error;
+    /* Set to make the workers stop after their current write */
+    boolean cancel;
+    /* Workers still running */
+    int active;
+    int thread_cnt;
+    pthread_t threads[FILL_MAX_QUEUE_DEPTH];
+    /* Limits set by the governor: bytes per second (0 for none), and the
+     * number of workers allowed to write (the rest wait) */
+    long long max_bps;
+    int max_depth;
+    /* When the next write may start (CLOCK_MONOTONIC nanoseconds) under
+     * the byte rate limit */
+    pthread_mutex_t pace_lock;
+    long long pace_next;
+};
+
+/* Watches the backing device of a file being filled and sets the fill's
+ * limits; additive increase, multiplicative decrease on latency */
+typedef struct fill_governor FILLGOVERNOR;
+struct fill_governor {
+    /* The device's sysfs 'stat' attribute */
+    int stat_fd;
+    /* What our own I/O is (FILL_GOV_OWN_*), and whether we're idle */
+    int own_io;
+    boolean idle;
+    /* Counters from the last read of 'stat' (completed reads and writes,
+     * and the milliseconds spent on each) */
+    unsigned long long ios[2];
+    unsigned long long ticks[2];
+    /* Front-end I/O (not ours) seen since the last sample */
+    unsigned long long front_ios;
+    unsigned long long front_ticks;
+    off_t done_bytes;
+    struct timespec taken;
+    /* Best fill rate seen (bytes per second) */
+    long long peak_bps;
+    /* Average front-end latency over the last interval (milliseconds) */
+    unsigned long latency_ms;
+};
+
+/* Function prototypes */
+int startZeroFill(ZEROFILL *fill, int fd, off_t start, off_t end,
+        size_t buffer_size, int queue_depth);
+off_t zeroFillProgress(ZEROFILL *fill);
+off_t zeroFillCheckpoint(ZEROFILL *fill);
+boolean zeroFillDone(ZEROFILL *fill);
+void cancelZeroFill(ZEROFILL *fill);
+int finishZeroFill(ZEROFILL *fill);
+void setZeroFillLimits(ZEROFILL *fill, long long max_bps, int max_depth);
+int openFillGovernor(FILLGOVERNOR *governor, int fd, int own_io);
+void idleFillGovernor(FILLGOVERNOR *governor, boolean idle);
+long long sampleFillGovernor(FILLGOVERNOR *governor, off_t done_bytes);
+void runFillGovernor(FILLGOVERNOR *governor, ZEROFILL *fill);
+void closeFillGovernor(FILLGOVERNOR *governor);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _ZEROFILL_H */
@@ -0,0 +1,242 @@
+/**
+ * @file zeroscan.c
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZEROSCAN_X86
+#endif
+
+#include "zeroscan.h"
+
+/* Bytes the scalar kernel ORs together between checks for data */
+#define ZEROSCAN_SCALAR_CHUNK   256
+
+static int zeroScalar(const unsigned char *buffer, size_t length);
+#ifdef ZEROSCAN_X86
+static int zeroSSE2(const unsigned char *buffer, size_t length);
+static int zeroAVX2(const unsigned char *buffer, size_t length);
+#endif
+static int useZeroScanKernel(int kernel);
+
+/* The kernel in use (set once, on first use, by pickZeroScanKernel()) */
+static pthread_once_t zero_kernel_once = PTHREAD_ONCE_INIT;
+static int zero_kernel_id = ZEROSCAN_SCALAR;
+static int (*zero_kernel)(const unsigned char *, size_t) = zeroScalar;
+
+
+/*
+ * The fallback; eight bytes at a time (unaligned loads are fine on the
+ * hardware we run on), stopping at the first chunk with data in it.
+ */
+static int zeroScalar(const unsigned char *buffer, size_t length) {
+    uint64_t acc = 0, word = 0;
+    size_t i = 0, chunk_end = 0;
+
+    while (i + sizeof (word) <= length) {
+        chunk_end = i + ZEROSCAN_SCALAR_CHUNK;
+        if (chunk_end > length)
+            chunk_end = length;
+        for (; i + sizeof (word) <= chunk_end; i += sizeof (word)) {
+            memcpy(&word, buffer + i, sizeof (word));
+            acc |= word;
+        }
+        if (acc != 0)
+            return 0;
+    }
+    for (; i < length; i++)
+        acc |= buffer[i];
+    return acc == 0;
+}
+
+
+#ifdef ZEROSCAN_X86
+/*
+ * 64 bytes per pass with four independent ORs, then whatever is left with
+ * the scalar kernel.
+ */
+static int zeroSSE2(const unsigned char *buffer, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+
+    for (i = 0; i + 64 <= length; i += 64) {
+        acc = _mm_or_si128(
+                _mm_or_si128(
+                _mm_loadu_si128((const __m128i *) (buffer + i)),
+                _mm_loadu_si128((const __m128i *) (buffer + i + 16))),
+                _mm_or_si128(
+                _mm_loadu_si128((const __m128i *) (buffer + i + 32)),
+                _mm_loadu_si128((const __m128i *) (buffer + i + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xFFFF)
+            return 0;
+    }
+    return zeroScalar(buffer + i, length - i);
+}
+
+
+/*
+ * 128 bytes per pass; only ever called if the CPU (and kernel) has AVX2.
+ * The tail is done here too, since calling into SSE code with the upper
+ * halves of the registers dirty costs more than the scan.
+ */
+__attribute__ ((target ("avx2")))
+static int zeroAVX2(const unsigned char *buffer, size_t length) {
+    __m256i acc;
+    unsigned char tail = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 128 <= length; i += 128) {
+        acc = _mm256_or_si256(
+                _mm256_or_si256(
+                _mm256_loadu_si256((const __m256i *) (buffer + i)),
+                _mm256_loadu_si256((const __m256i *) (buffer + i + 32))),
+                _mm256_or_si256(
+                _mm256_loadu_si256((const __m256i *) (buffer + i + 64)),
+                _mm256_loadu_si256((const __m256i *) (buffer + i + 96))));
+        if (!_mm256_testz_si256(acc, acc))
+            return 0;
+    }
+    for (; i + 32 <= length; i += 32) {
+        acc = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        if (!_mm256_testz_si256(acc, acc))
+            return 0;
+    }
+    for (; i < length; i++)
+        tail |= buffer[i];
+    return tail == 0;
+}
+#endif
+
+
+/*
+ * Pick the best kernel this CPU has (cpuid, via the GCC builtins, which
+ * also check the kernel saves the AVX state).
+ */
+static void pickZeroScanKernel(void) {
+#ifdef ZEROSCAN_X86
+    __builtin_cpu_init();
+    if (!useZeroScanKernel(ZEROSCAN_AVX2))
+        useZeroScanKernel(ZEROSCAN_SSE2);
+#endif
+    return;
+}
+
+
+/*
+ * Is the buffer (any length or alignment) all zeros? Stops at the first
+ * data found, so a buffer of data costs next to nothing.
+ */
+int isZeroBuffer(const void *buffer, size_t length) {
+    pthread_once(&zero_kernel_once, pickZeroScanKernel);
+    return zero_kernel(buffer, length);
+}
+
+
+/*
+ * How many bytes of whole 'block_size' blocks at the start of the buffer
+ * are all zeros (a partial block at the end never counts).
+ */
+size_t zeroRunLength(const void *buffer, size_t length, size_t block_size) {
+    const unsigned char *block = buffer;
+    size_t run = 0;
+
+    pthread_once(&zero_kernel_once, pickZeroScanKernel);
+    if (block_size == 0)
+        return 0;
+    while (run + block_size <= length &&
+            zero_kernel(block + run, block_size))
+        run += block_size;
+    return run;
+}
+
+
+/*
+ * How many bytes at the start of the buffer come before the next whole
+ * 'block_size' block of zeros (or the end of the buffer).
+ */
+size_t dataRunLength(const void *buffer, size_t length, size_t block_size) {
+    const unsigned char *block = buffer;
+    size_t run = 0;
+
+    pthread_once(&zero_kernel_once, pickZeroScanKernel);
+    if (block_size == 0)
+        return length;
+    while (run + block_size <= length &&
+            !zero_kernel(block + run, block_size))
+        run += block_size;
+    return (run + block_size > length) ? length : run;
+}
+
+
+/*
+ * The kernel in use (one of ZEROSCAN_*).
+ */
+int getZeroScanKernel(void) {
+    pthread_once(&zero_kernel_once, pickZeroScanKernel);
+    return zero_kernel_id;
+}
+
+
+/*
+ * Switch to the given kernel if this CPU has it.
+ */
+static int useZeroScanKernel(int kernel) {
+    switch (kernel) {
+#ifdef ZEROSCAN_X86
+        case ZEROSCAN_AVX2:
+            if (!__builtin_cpu_supports("avx2"))
+                return 0;
+            zero_kernel = zeroAVX2;
+            break;
+        case ZEROSCAN_SSE2:
+            if (!__builtin_cpu_supports("sse2"))
+                return 0;
+            zero_kernel = zeroSSE2;
+            break;
+#endif
+        case ZEROSCAN_SCALAR:
+            zero_kernel = zeroScalar;
+            break;
+        default:
+            return 0;
+    }
+    zero_kernel_id = kernel;
+    return 1;
+}
+
+
+/*
+ * Use the given kernel (eg, to benchmark them); returns 0, and leaves
+ * things as they were, if this CPU doesn't have it.
+ */
+int setZeroScanKernel(int kernel) {
+    pthread_once(&zero_kernel_once, pickZeroScanKernel);
+    return useZeroScanKernel(kernel);
+}
+
+
+/*
+ * A name for the kernel (for the benchmark and logs).
+ */
+const char *zeroScanKernelName(int kernel) {
+    switch (kernel) {
+        case ZEROSCAN_AVX2:
+            return "AVX2";
+        case ZEROSCAN_SSE2:
+            return "SSE2";
+        case ZEROSCAN_SCALAR:
+            return "scalar";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,36 @@
+/**
+ * @file zeroscan.h
+ * @author Copyright (c) 2012-2015 Astersmith, LLC
+ * @author Marc A. Smith
+ */
+
+#ifndef _ZEROSCAN_H
+#define	_ZEROSCAN_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* Zero scan kernels, best first; the best one the CPU has is picked on
+ * first use */
+#define ZEROSCAN_AVX2           0
+#define ZEROSCAN_SSE2           1
+#define ZEROSCAN_SCALAR         2
+#define ZEROSCAN_KERNELS        3
+
+/* Function prototypes; this stays free of cdk.h (so the benchmark builds
+ * without it), and the yes/no functions return an int (1 for yes) */
+int isZeroBuffer(const void *buffer, size_t length);
+size_t zeroRunLength(const void *buffer, size_t length, size_t block_size);
+size_t dataRunLength(const void *buffer, size_t length, size_t block_size);
+int getZeroScanKernel(void);
+int setZeroScanKernel(int kernel);
+const char *zeroScanKernelName(int kernel);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _ZEROSCAN_H */